@@ -1,43 +1,55 @@
 #include <stdio.h>
 #include <CL/cl.h>
+#include "../common/cl_profile.c"
 
 #define MAX_INFO_SIZE 1024
 
+#define MAX_PLATFORMS 16
+#define MAX_DEVICES 16
+
+// Lists every device of every platform, not only the first one: a node may
+// have several GPUs and CPU runtimes such as PoCL next to them.
 int cuda_info() {
-    cl_platform_id platform;
-    cl_device_id device;
-    cl_uint num_platforms, num_devices;
-
-    // Get the number of OpenCL platforms
-    clGetPlatformIDs(1, &platform, &num_platforms);
-
-    // Get the platform name
-    char platform_name[MAX_INFO_SIZE];
-    clGetPlatformInfo(platform, CL_PLATFORM_NAME, MAX_INFO_SIZE, platform_name, NULL);
-    printf("OpenCL Platform: %s\n", platform_name);
-
-    // Get the platform version
-    char platform_version[MAX_INFO_SIZE];
-    clGetPlatformInfo(platform, CL_PLATFORM_VERSION, MAX_INFO_SIZE, platform_version, NULL);
-    printf("OpenCL Platform Version: %s\n", platform_version);
-
-    // Get the number of OpenCL devices
-    clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 1, &device, &num_devices);
-
-    // Get the device name
-    char device_name[MAX_INFO_SIZE];
-    clGetDeviceInfo(device, CL_DEVICE_NAME, MAX_INFO_SIZE, device_name, NULL);
-    printf("OpenCL Device: %s\n", device_name);
-
-    // Get the device version
-    char device_version[MAX_INFO_SIZE];
-    clGetDeviceInfo(device, CL_DEVICE_VERSION, MAX_INFO_SIZE, device_version, NULL);
-    printf("OpenCL Device Version: %s\n", device_version);
-
-    // Get the number of compute units
-    cl_uint num_compute_units;
-    clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &num_compute_units, NULL);
-    printf("OpenCL Device Compute Units: %u\n", num_compute_units);
+    cl_platform_id platforms[MAX_PLATFORMS];
+    cl_uint num_platforms = 0;
+
+    // Get the OpenCL platforms
+    cl_int err = clGetPlatformIDs(MAX_PLATFORMS, platforms, &num_platforms);
+    if (err != CL_SUCCESS) {
+        printf("No OpenCL platforms found: %d\n", err);
+        return 1;
+    }
+    if (num_platforms > MAX_PLATFORMS) num_platforms = MAX_PLATFORMS;
+    printf("OpenCL Platforms: %u\n", num_platforms);
+
+    int index = 0;
+    for (cl_uint p = 0; p < num_platforms; p++) {
+        // Get the platform name
+        char platform_name[MAX_INFO_SIZE];
+        clGetPlatformInfo(platforms[p], CL_PLATFORM_NAME, MAX_INFO_SIZE, platform_name, NULL);
+        printf("\nOpenCL Platform %u: %s\n", p, platform_name);
+
+        // Get the platform version
+        char platform_version[MAX_INFO_SIZE];
+        clGetPlatformInfo(platforms[p], CL_PLATFORM_VERSION, MAX_INFO_SIZE, platform_version, NULL);
+        printf("OpenCL Platform Version: %s\n", platform_version);
+
+        // Get the OpenCL devices of this platform
+        cl_device_id devices[MAX_DEVICES];
+        cl_uint num_devices = 0;
+        if (clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, MAX_DEVICES, devices, &num_devices) != CL_SUCCESS) {
+            num_devices = 0;
+        }
+        if (num_devices > MAX_DEVICES) num_devices = MAX_DEVICES;
+
+        // Every device as the capability profile its kernels are built for
+        for (cl_uint d = 0; d < num_devices; d++, index++) {
+            cl_profile profile;
+            cl_profile_query(devices[d], &profile);
+            printf("\nDevice index %d (CL_DEVICES)\n", index);
+            cl_profile_print(&profile, stdout);
+        }
+    }
 
     return 0;
 }
@@ -30,6 +30,12 @@ install intel-opencl-icd
 //Depending of your installation more includes should be uses, check your particular SDK installation
 //
 #include <CL/cl.h>
+#include "../common/cl_source.c"
+#include "../common/cl_cache.c"
+#include "../common/cl_profile.c"
+#include "../common/trace.c"
+#include "../common/cl_trace.c"
+#include "../common/cl_runtime.c"
 
 //This is a kernel, a piece of code intended to be executed in a GPU or CPU
 const char *kernel_source =
@@ -49,43 +55,47 @@ const char *kernel_source =
 "output[12]='\\0';"
 "}";
 
-// Get OpenCL CUDA Information 
+// Get OpenCL CUDA Information of every device of every platform, not only
+// the first one
 int opencl_cuda_info() {
     #define MAX_INFO_SIZE 1024 
-    cl_platform_id platform;
-    cl_device_id device;
-    cl_uint num_platforms, num_devices;
-
-    // Get the number of OpenCL platforms
-    clGetPlatformIDs(1, &platform, &num_platforms);
-
-    // Get the platform name
-    char platform_name[MAX_INFO_SIZE];
-    clGetPlatformInfo(platform, CL_PLATFORM_NAME, MAX_INFO_SIZE, platform_name, NULL);
-    printf("OpenCL Platform: %s\n", platform_name);
-
-    // Get the platform version
-    char platform_version[MAX_INFO_SIZE];
-    clGetPlatformInfo(platform, CL_PLATFORM_VERSION, MAX_INFO_SIZE, platform_version, NULL);
-    printf("OpenCL Platform Version: %s\n", platform_version);
-
-    // Get the number of OpenCL devices
-    clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 1, &device, &num_devices);
-
-    // Get the device name
-    char device_name[MAX_INFO_SIZE];
-    clGetDeviceInfo(device, CL_DEVICE_NAME, MAX_INFO_SIZE, device_name, NULL);
-    printf("OpenCL Device: %s\n", device_name);
-
-    // Get the device version
-    char device_version[MAX_INFO_SIZE];
-    clGetDeviceInfo(device, CL_DEVICE_VERSION, MAX_INFO_SIZE, device_version, NULL);
-    printf("OpenCL Device Version: %s\n", device_version);
-
-    // Get the number of compute units
-    cl_uint num_compute_units;
-    clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &num_compute_units, NULL);
-    printf("OpenCL Device Compute Units: %u\n", num_compute_units);
+    #define MAX_PLATFORMS 16
+    #define MAX_DEVICES 16
+    cl_platform_id platforms[MAX_PLATFORMS];
+    cl_uint num_platforms = 0;
+
+    // Get the OpenCL platforms
+    if (clGetPlatformIDs(MAX_PLATFORMS, platforms, &num_platforms) != CL_SUCCESS) {
+        return 1;
+    }
+    if (num_platforms > MAX_PLATFORMS) num_platforms = MAX_PLATFORMS;
+
+    for (cl_uint p = 0; p < num_platforms; p++) {
+        // Get the platform name
+        char platform_name[MAX_INFO_SIZE];
+        clGetPlatformInfo(platforms[p], CL_PLATFORM_NAME, MAX_INFO_SIZE, platform_name, NULL);
+        printf("OpenCL Platform %u: %s\n", p, platform_name);
+
+        // Get the platform version
+        char platform_version[MAX_INFO_SIZE];
+        clGetPlatformInfo(platforms[p], CL_PLATFORM_VERSION, MAX_INFO_SIZE, platform_version, NULL);
+        printf("OpenCL Platform Version: %s\n", platform_version);
+
+        // Get the OpenCL devices of this platform
+        cl_device_id devices[MAX_DEVICES];
+        cl_uint num_devices = 0;
+        if (clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, MAX_DEVICES, devices, &num_devices) != CL_SUCCESS) {
+            num_devices = 0;
+        }
+        if (num_devices > MAX_DEVICES) num_devices = MAX_DEVICES;
+
+        // Name, version, compute units and the rest of the capability profile
+        for (cl_uint d = 0; d < num_devices; d++) {
+            cl_profile profile;
+            cl_profile_query(devices[d], &profile);
+            cl_profile_print(&profile, stdout);
+        }
+    }
 
     return 0;
 }
@@ -96,76 +106,67 @@ int opencl_cuda_info() {
 int main()
 {
     cl_int           err;
-    cl_uint          num_platforms;
-    cl_platform_id  *platforms;
-    cl_device_id     device;
-    cl_context       context;
-    cl_command_queue queue;
-    cl_program       program;
+    cl_uint          num_platforms = 0;
+    cl_runtime      *runtime;
     cl_kernel        kernel;
     cl_mem           output;
 
     char result[13];
 
     // PLATFORM
-    // In this example we will only consider one platform
     //
-    int num_max_platforms = 1;
-    err = clGetPlatformIDs(num_max_platforms, NULL, &num_platforms);
+    err = clGetPlatformIDs(0, NULL, &num_platforms);
     printf("Num platforms detected: %d\n", num_platforms);
-    opencl_cuda_info();
-
-    platforms = (cl_platform_id*) malloc(sizeof(cl_platform_id) * num_platforms);
-    err = clGetPlatformIDs(num_max_platforms, platforms, &num_platforms);
-
-    if(num_platforms < 1)
+    if(err != CL_SUCCESS || num_platforms < 1)
     {
         printf("No platform detected, exit\n");
         exit(1);
     }
+    opencl_cuda_info();
 
-    //DEVICE (could be CL_DEVICE_TYPE_GPU)
-    //
-    err = clGetDeviceIDs(platforms[0], CL_DEVICE_TYPE_ALL, 1, &device, NULL);
-
-    //CONTEXT
-    //
-    context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
-
-    //QUEUE
+    //DEVICE, CONTEXT AND QUEUE
+    //Created once by the shared runtime (GPU if there is one, else any device)
+    //and reused by every later call
     //
-    queue = clCreateCommandQueue(context, device, 0, &err);
+    runtime = cl_runtime_get();
 
-    //READ KERNEL AND COMPILE IT
+    //COMPILE THE KERNEL AND CREATE IT
+    //The source is registered under the name "hello"; asking again returns the
+    //kernel that is already built
     //
-    program = clCreateProgramWithSource(context, 1, &kernel_source, NULL, &err);
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-
+    cl_runtime_program("hello", kernel_source, 0, NULL);
+    kernel = cl_runtime_kernel("hello", NULL, "hello");
+    if(kernel == NULL)
+    {
+        exit(1);
+    }
 
-    //CREATE KERNEL AND KERNEL PARAMETERS
+    //KERNEL PARAMETERS
     //
-    kernel = clCreateKernel(program, "hello", &err);
-    output = clCreateBuffer(context, CL_MEM_WRITE_ONLY, 13 * sizeof(char), NULL, &err);
-    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &output);
+    output = clCreateBuffer(runtime->context, CL_MEM_WRITE_ONLY, 13 * sizeof(char), NULL, &err);
+    cl_runtime_arg args[] = {CL_RUNTIME_ARG(output)};
 
     //EXECUTE KERNEL!
+    //One work-item, the same as clEnqueueTask
     //
-    err = clEnqueueTask(queue, kernel, 0, NULL, NULL);
+    size_t global_size = 1;
+    err = cl_runtime_dispatch(kernel, 1, &global_size, NULL, 1, args, NULL);
 
     //READ KERNEL OUTPUT
     //
-    err = clEnqueueReadBuffer(queue, output, CL_TRUE, 0, 13 * sizeof(char), result, 0, NULL, NULL);
-    printf("***%s***", result);
+    cl_event *event = cl_trace_event(NULL);
+    err = clEnqueueReadBuffer(runtime->queue, output, CL_TRUE, 0, 13 * sizeof(char), result, 0, NULL, event);
+    cl_trace_command("read output", runtime->queue, event, err);
+    printf("***%s***\n", result);
+    printf("Runtime setup: %.3f ms, program build: %.3f ms (%s)\n", runtime->init_ms, runtime->build_ms,
+           runtime->programs_cached ? "cached binary" : "compiled");
 
 
 
     //Free your memory please....
+    //The kernel, program, queue and context belong to the runtime and are
+    //released at exit
     clReleaseMemObject(output);
-    clReleaseKernel(kernel);
-    clReleaseProgram(program);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
-    free(platforms);
 
 
     return 0;
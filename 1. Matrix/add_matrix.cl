@@ -9,3 +9,43 @@ __kernel void add_matrix(__global const float* matrix_1,
 
     result[i * cols + j] = matrix_1[i * cols + j] + matrix_2[i * cols + j];
 }
+
+// 1-D vectorized variant for any element count. Each work-item adds VW floats
+// at a time (VW = 1, 2, 4, 8 or 16, set at build time with -DVW=...; by
+// default the width of the device profile) and walks the array with a
+// grid-stride loop, so the launch size can be chosen for the device instead
+// of the matrix shape.
+#ifndef VW
+#ifdef DEV_VECTOR_WIDTH
+#define VW DEV_VECTOR_WIDTH
+#else
+#define VW 4
+#endif
+#endif
+
+#define CAT_(a, b) a##b
+#define CAT(a, b) CAT_(a, b)
+#if VW == 1
+#define VLOAD(i, p) ((p)[i])
+#define VSTORE(v, i, p) ((p)[i] = (v))
+#else
+#define VLOAD(i, p) CAT(vload, VW)(i, p)
+#define VSTORE(v, i, p) CAT(vstore, VW)(v, i, p)
+#endif
+
+__kernel void add_matrix_vec(__global const float* matrix_1,
+                             __global const float* matrix_2,
+                             __global float* result,
+                             const int num_elements) {
+    const int stride = get_global_size(0);
+    const int num_vectors = num_elements / VW;
+
+    for (int i = get_global_id(0); i < num_vectors; i += stride) {
+        VSTORE(VLOAD(i, matrix_1) + VLOAD(i, matrix_2), i, result);
+    }
+
+    // Fewer than VW elements are left over at the end
+    for (int i = num_vectors * VW + get_global_id(0); i < num_elements; i += stride) {
+        result[i] = matrix_1[i] + matrix_2[i];
+    }
+}
@@ -0,0 +1,497 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "fused_elementwise.h"
+#include "../common/cl_cache.h"
+#include "../common/cl_trace.h"
+
+#define FUSED_SOURCE_SIZE 16384
+#define FUSED_EVAL_BLOCK 256
+
+// ---------------------------------------------------------------- parser
+
+typedef struct {
+    const char *text;
+    const char *pos;
+    fused_expr *expr;
+    int failed;
+} fused_parser;
+
+static const struct {
+    const char *name;
+    fused_op op;
+    int num_args;
+} fused_functions[] = {
+    {"min", FUSED_MIN, 2}, {"max", FUSED_MAX, 2}, {"clamp", FUSED_CLAMP, 3},
+    {"fma", FUSED_FMA, 3}, {"fabs", FUSED_ABS, 1}, {"abs", FUSED_ABS, 1}, {"sqrt", FUSED_SQRT, 1},
+};
+
+static int fused_error(fused_parser *p, const char *message) {
+    if (!p->failed) {
+        fprintf(stderr, "Expression error at column %d: %s\n  %s\n",
+                (int)(p->pos - p->text) + 1, message, p->text);
+        p->failed = 1;
+    }
+    return -1;
+}
+
+static void fused_skip_space(fused_parser *p) {
+    while (isspace((unsigned char)*p->pos)) p->pos++;
+}
+
+static int fused_accept(fused_parser *p, char c) {
+    fused_skip_space(p);
+    if (*p->pos != c) return 0;
+    p->pos++;
+    return 1;
+}
+
+static int fused_add_node(fused_parser *p, fused_op op, int a, int b, int c) {
+    if (p->failed) return -1;
+    if (p->expr->num_nodes == FUSED_MAX_NODES) return fused_error(p, "expression too long");
+    int id = p->expr->num_nodes++;
+    fused_node *node = &p->expr->nodes[id];
+    node->op = op;
+    node->arg[0] = a;
+    node->arg[1] = b;
+    node->arg[2] = c;
+    node->index = 0;
+    node->value = 0.0f;
+    return id;
+}
+
+// Index of a matrix or scalar name, adding it on first use
+static int fused_name_index(fused_parser *p, const char *name, int is_input) {
+    char (*names)[FUSED_NAME_SIZE] = is_input ? p->expr->inputs : p->expr->scalars;
+    int *count = is_input ? &p->expr->num_inputs : &p->expr->num_scalars;
+    for (int i = 0; i < *count; i++) {
+        if (strcmp(names[i], name) == 0) return i;
+    }
+    if (*count == FUSED_MAX_ARGS) return fused_error(p, "too many matrices or scalars");
+    snprintf(names[*count], FUSED_NAME_SIZE, "%s", name);
+    return (*count)++;
+}
+
+static int fused_parse_sum(fused_parser *p);
+
+static int fused_parse_primary(fused_parser *p) {
+    fused_skip_space(p);
+    const char *start = p->pos;
+
+    if (isdigit((unsigned char)*start) || *start == '.') {
+        char *end;
+        float value = strtof(start, &end);
+        if (end == start) return fused_error(p, "bad number");
+        p->pos = end;
+        if (*p->pos == 'f' || *p->pos == 'F') p->pos++;
+        int id = fused_add_node(p, FUSED_CONST, -1, -1, -1);
+        if (id >= 0) p->expr->nodes[id].value = value;
+        return id;
+    }
+
+    if (isalpha((unsigned char)*start) || *start == '_') {
+        while (isalnum((unsigned char)*p->pos) || *p->pos == '_') p->pos++;
+        size_t length = p->pos - start;
+        if (length >= FUSED_NAME_SIZE) return fused_error(p, "name too long");
+        char name[FUSED_NAME_SIZE];
+        memcpy(name, start, length);
+        name[length] = '\0';
+
+        if (!fused_accept(p, '(')) {
+            int is_input = isupper((unsigned char)name[0]);
+            int index = fused_name_index(p, name, is_input);
+            int id = fused_add_node(p, is_input ? FUSED_INPUT : FUSED_SCALAR, -1, -1, -1);
+            if (id >= 0) p->expr->nodes[id].index = index;
+            return index < 0 ? -1 : id;
+        }
+
+        for (size_t f = 0; f < sizeof(fused_functions) / sizeof(fused_functions[0]); f++) {
+            if (strcmp(name, fused_functions[f].name) != 0) continue;
+            int args[3] = {-1, -1, -1};
+            for (int i = 0; i < fused_functions[f].num_args; i++) {
+                if (i > 0 && !fused_accept(p, ',')) return fused_error(p, "expected ','");
+                args[i] = fused_parse_sum(p);
+                if (args[i] < 0) return -1;
+            }
+            if (!fused_accept(p, ')')) return fused_error(p, "expected ')'");
+            return fused_add_node(p, fused_functions[f].op, args[0], args[1], args[2]);
+        }
+        p->pos = start;
+        return fused_error(p, "unknown function");
+    }
+
+    if (fused_accept(p, '(')) {
+        int id = fused_parse_sum(p);
+        if (id >= 0 && !fused_accept(p, ')')) return fused_error(p, "expected ')'");
+        return id;
+    }
+    return fused_error(p, "expected a name, number or '('");
+}
+
+static int fused_parse_unary(fused_parser *p) {
+    if (fused_accept(p, '-')) {
+        return fused_add_node(p, FUSED_NEG, fused_parse_unary(p), -1, -1);
+    }
+    if (fused_accept(p, '+')) {
+        return fused_parse_unary(p);
+    }
+    return fused_parse_primary(p);
+}
+
+static int fused_parse_product(fused_parser *p) {
+    int left = fused_parse_unary(p);
+    for (;;) {
+        if (fused_accept(p, '*')) {
+            left = fused_add_node(p, FUSED_MUL, left, fused_parse_unary(p), -1);
+        } else if (fused_accept(p, '/')) {
+            left = fused_add_node(p, FUSED_DIV, left, fused_parse_unary(p), -1);
+        } else {
+            return left;
+        }
+    }
+}
+
+static int fused_parse_sum(fused_parser *p) {
+    int left = fused_parse_product(p);
+    for (;;) {
+        if (fused_accept(p, '+')) {
+            left = fused_add_node(p, FUSED_ADD, left, fused_parse_product(p), -1);
+        } else if (fused_accept(p, '-')) {
+            left = fused_add_node(p, FUSED_SUB, left, fused_parse_product(p), -1);
+        } else {
+            return left;
+        }
+    }
+}
+
+// Renumber names alphabetically so the argument order does not depend on
+// where a name first appears in the expression
+static void fused_sort_names(char (*names)[FUSED_NAME_SIZE], int count, fused_expr *expr, fused_op op) {
+    int order[FUSED_MAX_ARGS], rank[FUSED_MAX_ARGS];
+    for (int i = 0; i < count; i++) order[i] = i;
+    for (int i = 1; i < count; i++) {
+        for (int j = i; j > 0 && strcmp(names[order[j - 1]], names[order[j]]) > 0; j--) {
+            int t = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = t;
+        }
+    }
+    char sorted[FUSED_MAX_ARGS][FUSED_NAME_SIZE];
+    for (int i = 0; i < count; i++) {
+        rank[order[i]] = i;
+        memcpy(sorted[i], names[order[i]], FUSED_NAME_SIZE);
+    }
+    memcpy(names, sorted, sizeof(sorted[0]) * count);
+    for (int n = 0; n < expr->num_nodes; n++) {
+        if (expr->nodes[n].op == op) expr->nodes[n].index = rank[expr->nodes[n].index];
+    }
+}
+
+int fused_parse(const char *text, fused_expr *expr) {
+    fused_parser p = {text, text, expr, 0};
+    expr->num_nodes = 0;
+    expr->num_inputs = 0;
+    expr->num_scalars = 0;
+
+    int root = fused_parse_sum(&p);
+    fused_skip_space(&p);
+    if (root >= 0 && *p.pos != '\0') {
+        root = fused_error(&p, "unexpected character");
+    }
+    if (root < 0) {
+        return -1;
+    }
+    if (expr->num_inputs == 0) {
+        fprintf(stderr, "Expression error: \"%s\" uses no matrix\n", text);
+        return -1;
+    }
+    fused_sort_names(expr->inputs, expr->num_inputs, expr, FUSED_INPUT);
+    fused_sort_names(expr->scalars, expr->num_scalars, expr, FUSED_SCALAR);
+    return 0;
+}
+
+// ---------------------------------------------------------------- code generation
+
+typedef struct {
+    char *out;
+    size_t size;
+    size_t used;
+} fused_writer;
+
+static void fused_print(fused_writer *w, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    // Keeps counting once the buffer is full, so the caller can detect truncation
+    size_t room = w->used < w->size ? w->size - w->used : 0;
+    int n = vsnprintf(room ? w->out + w->used : NULL, room, format, args);
+    va_end(args);
+    if (n > 0) w->used += n;
+}
+
+// Fully parenthesized expression over in<i>/s<i>. In vector code scalars and
+// constants are broadcast, since fma() and friends want matching types.
+static void fused_print_node(fused_writer *w, const fused_expr *expr, int id, const char *type) {
+    static const char *binary[] = {[FUSED_ADD] = "+", [FUSED_SUB] = "-", [FUSED_MUL] = "*", [FUSED_DIV] = "/"};
+    static const char *calls[] = {[FUSED_MIN] = "fmin", [FUSED_MAX] = "fmax", [FUSED_CLAMP] = "clamp",
+                                  [FUSED_FMA] = "fma", [FUSED_ABS] = "fabs", [FUSED_SQRT] = "sqrt"};
+    const fused_node *node = &expr->nodes[id];
+    switch (node->op) {
+    case FUSED_INPUT:
+        fused_print(w, "in%d", node->index);
+        break;
+    case FUSED_SCALAR:
+        fused_print(w, "((%s)(s%d))", type, node->index);
+        break;
+    case FUSED_CONST: {
+        char number[32];
+        snprintf(number, sizeof(number), "%.9g", node->value);
+        int has_point = strpbrk(number, ".e") != NULL;
+        fused_print(w, "((%s)(%s%sf))", type, number, has_point ? "" : ".0");
+        break;
+    }
+    case FUSED_NEG:
+        fused_print(w, "(-");
+        fused_print_node(w, expr, node->arg[0], type);
+        fused_print(w, ")");
+        break;
+    case FUSED_ADD:
+    case FUSED_SUB:
+    case FUSED_MUL:
+    case FUSED_DIV:
+        fused_print(w, "(");
+        fused_print_node(w, expr, node->arg[0], type);
+        fused_print(w, " %s ", binary[node->op]);
+        fused_print_node(w, expr, node->arg[1], type);
+        fused_print(w, ")");
+        break;
+    default:
+        fused_print(w, "%s(", calls[node->op]);
+        for (int i = 0; i < 3 && node->arg[i] >= 0; i++) {
+            if (i) fused_print(w, ", ");
+            fused_print_node(w, expr, node->arg[i], type);
+        }
+        fused_print(w, ")");
+        break;
+    }
+}
+
+static void fused_print_function(fused_writer *w, const fused_expr *expr, const char *name, const char *type) {
+    fused_print(w, "inline %s %s(", type, name);
+    for (int i = 0; i < expr->num_inputs; i++) {
+        fused_print(w, "%s%s in%d", i ? ", " : "", type, i);
+    }
+    for (int i = 0; i < expr->num_scalars; i++) {
+        fused_print(w, ", float s%d", i);
+    }
+    fused_print(w, ") {\n    return ");
+    fused_print_node(w, expr, expr->num_nodes - 1, type);
+    fused_print(w, ";\n}\n\n");
+}
+
+static void fused_print_call(fused_writer *w, const fused_expr *expr, const char *name, const char *load) {
+    fused_print(w, "%s(", name);
+    for (int i = 0; i < expr->num_inputs; i++) {
+        fused_print(w, load, i ? ", " : "", i);
+    }
+    for (int i = 0; i < expr->num_scalars; i++) {
+        fused_print(w, ", s%d", i);
+    }
+    fused_print(w, ")");
+}
+
+int fused_source(const fused_expr *expr, int vector_width, char *source, size_t size) {
+    fused_writer w = {source, size, 0};
+    char vector_type[16];
+    snprintf(vector_type, sizeof(vector_type), vector_width > 1 ? "float%d" : "float", vector_width);
+
+    fused_print_function(&w, expr, "fused_scalar", "float");
+    if (vector_width > 1) {
+        fused_print_function(&w, expr, "fused_vector", vector_type);
+    }
+
+    fused_print(&w, "__kernel void fused_elementwise(");
+    for (int i = 0; i < expr->num_inputs; i++) {
+        fused_print(&w, "__global const float* in%d,\n                                ", i);
+    }
+    fused_print(&w, "__global float* result,\n                                const int num_elements");
+    for (int i = 0; i < expr->num_scalars; i++) {
+        fused_print(&w, ",\n                                const float s%d", i);
+    }
+    fused_print(&w, ") {\n"
+                    "    const int stride = get_global_size(0);\n"
+                    "    const int num_vectors = num_elements / %d;\n", vector_width);
+
+    // Same grid-stride layout as add_matrix_vec: full vectors, then the tail
+    if (vector_width > 1) {
+        char load[32];
+        snprintf(load, sizeof(load), "%%svload%d(i, in%%d)", vector_width);
+        fused_print(&w, "    for (int i = get_global_id(0); i < num_vectors; i += stride) {\n"
+                        "        vstore%d(", vector_width);
+        fused_print_call(&w, expr, "fused_vector", load);
+        fused_print(&w, ", i, result);\n    }\n");
+    }
+    fused_print(&w, "    for (int i = num_vectors * %d + get_global_id(0); i < num_elements; i += stride) {\n"
+                    "        result[i] = ", vector_width);
+    fused_print_call(&w, expr, "fused_scalar", "%sin%d[i]");
+    fused_print(&w, ";\n    }\n}\n");
+
+    return w.used < size ? (int)w.used : -1;
+}
+
+// ---------------------------------------------------------------- host reference
+
+void fused_eval_host(const fused_expr *expr, const float *const *inputs, const float *scalars,
+                     float *result, size_t count) {
+    // One block of values per node, evaluated children first
+    float *values = (float *)malloc(sizeof(float) * FUSED_EVAL_BLOCK * expr->num_nodes);
+    for (size_t start = 0; start < count; start += FUSED_EVAL_BLOCK) {
+        size_t n = count - start < FUSED_EVAL_BLOCK ? count - start : FUSED_EVAL_BLOCK;
+        for (int id = 0; id < expr->num_nodes; id++) {
+            const fused_node *node = &expr->nodes[id];
+            float *v = values + (size_t)id * FUSED_EVAL_BLOCK;
+            const float *a = node->arg[0] >= 0 ? values + (size_t)node->arg[0] * FUSED_EVAL_BLOCK : NULL;
+            const float *b = node->arg[1] >= 0 ? values + (size_t)node->arg[1] * FUSED_EVAL_BLOCK : NULL;
+            const float *c = node->arg[2] >= 0 ? values + (size_t)node->arg[2] * FUSED_EVAL_BLOCK : NULL;
+            for (size_t i = 0; i < n; i++) {
+                switch (node->op) {
+                case FUSED_INPUT:  v[i] = inputs[node->index][start + i]; break;
+                case FUSED_SCALAR: v[i] = scalars[node->index]; break;
+                case FUSED_CONST:  v[i] = node->value; break;
+                case FUSED_NEG:    v[i] = -a[i]; break;
+                case FUSED_ADD:    v[i] = a[i] + b[i]; break;
+                case FUSED_SUB:    v[i] = a[i] - b[i]; break;
+                case FUSED_MUL:    v[i] = a[i] * b[i]; break;
+                case FUSED_DIV:    v[i] = a[i] / b[i]; break;
+                case FUSED_MIN:    v[i] = fminf(a[i], b[i]); break;
+                case FUSED_MAX:    v[i] = fmaxf(a[i], b[i]); break;
+                case FUSED_CLAMP:  v[i] = fminf(fmaxf(a[i], b[i]), c[i]); break;
+                case FUSED_FMA:    v[i] = fmaf(a[i], b[i], c[i]); break;
+                case FUSED_ABS:    v[i] = fabsf(a[i]); break;
+                case FUSED_SQRT:   v[i] = sqrtf(a[i]); break;
+                }
+            }
+        }
+        memcpy(result + start, values + (size_t)(expr->num_nodes - 1) * FUSED_EVAL_BLOCK, n * sizeof(float));
+    }
+    free(values);
+}
+
+// ---------------------------------------------------------------- program cache
+
+static fused_kernel *fused_cache = NULL;
+
+fused_kernel *fused_get(cl_context context, cl_device_id device_id, const char *expression,
+                        int vector_width) {
+    fused_expr expr;
+    if (fused_parse(expression, &expr) != 0) {
+        return NULL;
+    }
+    if (vector_width != 1 && vector_width != 2 && vector_width != 4 && vector_width != 8 && vector_width != 16) {
+        fprintf(stderr, "Unsupported vector width %d\n", vector_width);
+        return NULL;
+    }
+
+    // Names are positional in the generated code, so the cache key is the
+    // expression shape rather than the text the caller wrote
+    char shape[1024];
+    fused_writer w = {shape, sizeof(shape), 0};
+    fused_print_node(&w, &expr, expr.num_nodes - 1, "float");
+    if (w.used >= sizeof(shape)) {
+        fprintf(stderr, "Expression error: \"%s\" is too long\n", expression);
+        return NULL;
+    }
+
+    for (fused_kernel *k = fused_cache; k; k = k->next) {
+        if (k->context == context && k->device_id == device_id && k->vector_width == vector_width &&
+            strcmp(k->shape, shape) == 0) {
+            k->expr = expr; // keep the caller's names for messages
+            return k;
+        }
+    }
+
+    char *source = (char *)malloc(FUSED_SOURCE_SIZE);
+    if (fused_source(&expr, vector_width, source, FUSED_SOURCE_SIZE) < 0) {
+        fprintf(stderr, "Expression error: \"%s\" is too long\n", expression);
+        free(source);
+        return NULL;
+    }
+
+    // Generated sources go through the binary cache too, hashed here
+    cl_int err;
+    cl_program program = cl_cache_build(context, device_id, source, strlen(source), 0, "-cl-fast-relaxed-math",
+                                        &err, NULL);
+    if (program) {
+        if (err != CL_SUCCESS) {
+            char build_log[4096];
+            clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, sizeof(build_log), build_log, NULL);
+            fprintf(stderr, "Error building fused kernel for \"%s\":\n%s\n%s\n", expression, build_log, source);
+        }
+    }
+    free(source);
+    cl_kernel kernel = NULL;
+    if (err == CL_SUCCESS) {
+        kernel = clCreateKernel(program, "fused_elementwise", &err);
+    }
+    if (err != CL_SUCCESS) {
+        if (program) clReleaseProgram(program);
+        return NULL;
+    }
+
+    fused_kernel *fused = (fused_kernel *)malloc(sizeof(fused_kernel));
+    fused->expr = expr;
+    memcpy(fused->shape, shape, sizeof(shape));
+    fused->vector_width = vector_width;
+    fused->context = context;
+    fused->device_id = device_id;
+    fused->compute_units = 1;
+    clGetDeviceInfo(device_id, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(fused->compute_units), &fused->compute_units, NULL);
+    fused->program = program;
+    fused->kernel = kernel;
+    fused->next = fused_cache;
+    fused_cache = fused;
+    return fused;
+}
+
+cl_int fused_enqueue(cl_command_queue queue, fused_kernel *fused, const cl_mem *inputs,
+                     const float *scalars, cl_mem result, int num_elements, size_t local_size,
+                     cl_event *event) {
+    const fused_expr *expr = &fused->expr;
+    cl_int err = CL_SUCCESS;
+    cl_uint arg = 0;
+    for (int i = 0; i < expr->num_inputs; i++) {
+        err |= clSetKernelArg(fused->kernel, arg++, sizeof(cl_mem), &inputs[i]);
+    }
+    err |= clSetKernelArg(fused->kernel, arg++, sizeof(cl_mem), &result);
+    err |= clSetKernelArg(fused->kernel, arg++, sizeof(int), &num_elements);
+    for (int i = 0; i < expr->num_scalars; i++) {
+        err |= clSetKernelArg(fused->kernel, arg++, sizeof(float), &scalars[i]);
+    }
+    if (err != CL_SUCCESS) {
+        return err;
+    }
+
+    // Enough work-groups to fill the device; the grid-stride loop covers the rest
+    if (local_size == 0) local_size = 256;
+    size_t needed = ((size_t)(num_elements + fused->vector_width - 1) / fused->vector_width + local_size - 1) / local_size;
+    size_t groups = (size_t)fused->compute_units * 8;
+    if (groups > needed) groups = needed;
+    if (groups < 1) groups = 1;
+    size_t global_size = groups * local_size;
+    cl_event *traced = cl_trace_event(event);
+    err = clEnqueueNDRangeKernel(queue, fused->kernel, 1, NULL, &global_size, &local_size, 0, NULL, traced);
+    cl_trace_command("fused_elementwise", queue, traced, err);
+    return err;
+}
+
+void fused_release_all(void) {
+    while (fused_cache) {
+        fused_kernel *next = fused_cache->next;
+        clReleaseKernel(fused_cache->kernel);
+        clReleaseProgram(fused_cache->program);
+        free(fused_cache);
+        fused_cache = next;
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef FUSED_ELEMENTWISE_H
+#define FUSED_ELEMENTWISE_H
+
+#include <stddef.h>
+#include <CL/cl.h>
+
+// Runtime-fused element-wise expressions, e.g. "alpha*A + B*C - D".
+//
+// The expression is parsed once and turned into a single OpenCL kernel, so
+// every element of every input is read once and the result is written once,
+// instead of one kernel launch and one temporary buffer per operation.
+// Compiled programs are cached per context, device, vector width and
+// expression shape; "alpha*A + B" and "beta*X + Y" share one program.
+//
+// Syntax:
+//   names starting with an upper-case letter are matrices (float buffers)
+//   other names are float scalars
+//   numbers, + - * /, unary -, parentheses
+//   min(x, y) max(x, y) clamp(x, lo, hi) fma(a, b, c) fabs(x) sqrt(x)
+//
+// Matrices and scalars are passed in alphabetical order of their names:
+// for "alpha*A + B*C - D" the inputs are A, B, C, D and the scalars alpha.
+
+#define FUSED_MAX_NODES 64
+#define FUSED_MAX_ARGS 8
+#define FUSED_NAME_SIZE 32
+
+typedef enum {
+    FUSED_INPUT, FUSED_SCALAR, FUSED_CONST,
+    FUSED_NEG, FUSED_ADD, FUSED_SUB, FUSED_MUL, FUSED_DIV,
+    FUSED_MIN, FUSED_MAX, FUSED_CLAMP, FUSED_FMA, FUSED_ABS, FUSED_SQRT
+} fused_op;
+
+// Nodes are stored children first, so evaluating them in order is valid
+typedef struct {
+    fused_op op;
+    int arg[3];   // operand nodes
+    int index;    // input or scalar index
+    float value;  // FUSED_CONST
+} fused_node;
+
+typedef struct {
+    int num_nodes;
+    fused_node nodes[FUSED_MAX_NODES];
+    int num_inputs;
+    char inputs[FUSED_MAX_ARGS][FUSED_NAME_SIZE];
+    int num_scalars;
+    char scalars[FUSED_MAX_ARGS][FUSED_NAME_SIZE];
+} fused_expr;
+
+typedef struct fused_kernel {
+    fused_expr expr;
+    char shape[1024];  // expression with positional names, the cache key
+    int vector_width;
+    cl_context context;
+    cl_device_id device_id;
+    cl_uint compute_units;
+    cl_program program;
+    cl_kernel kernel;
+    struct fused_kernel *next;
+} fused_kernel;
+
+// Returns 0, or -1 with a message on stderr
+int fused_parse(const char *text, fused_expr *expr);
+
+// OpenCL source of the fused kernel "fused_elementwise". Arguments: the input
+// buffers, the result buffer, the element count, then the scalars.
+// vector_width is 1, 2, 4, 8 or 16. Returns the length, or -1 if it does not fit.
+int fused_source(const fused_expr *expr, int vector_width, char *source, size_t size);
+
+// Host evaluation, used as the reference for the device result
+void fused_eval_host(const fused_expr *expr, const float *const *inputs, const float *scalars,
+                     float *result, size_t count);
+
+// Parse and build, or return the cached kernel. NULL on a parse or build error.
+// The kernel object is shared, so do not enqueue it from two threads at once.
+fused_kernel *fused_get(cl_context context, cl_device_id device_id, const char *expression,
+                        int vector_width);
+
+// Enqueue over num_elements floats. result may alias one of the inputs.
+// local_size 0 picks 256 work-items per group and enough groups to fill the device.
+cl_int fused_enqueue(cl_command_queue queue, fused_kernel *fused, const cl_mem *inputs,
+                     const float *scalars, cl_mem result, int num_elements, size_t local_size,
+                     cl_event *event);
+
+// Release every cached program and kernel
+void fused_release_all(void);
+
+#endif
@@ -0,0 +1,583 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include "gemm.h"
+#include "simd_kernels.h"
+
+#define GEMM_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+float *gemm_alloc(size_t count) {
+#ifdef _WIN32
+    return (float *)_aligned_malloc(count * sizeof(float), GEMM_ALIGN);
+#else
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, GEMM_ALIGN, count * sizeof(float)) != 0) {
+        return NULL;
+    }
+    return (float *)ptr;
+#endif
+}
+
+void gemm_free(float *ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+int gemm_workspace_init(gemm_workspace *ws) {
+    ws->packed_A = gemm_alloc((size_t)GEMM_MC * GEMM_KC);
+    ws->packed_B = gemm_alloc((size_t)GEMM_KC * GEMM_NC);
+    if (!ws->packed_A || !ws->packed_B) {
+        gemm_workspace_release(ws);
+        return -1;
+    }
+    return 0;
+}
+
+void gemm_workspace_release(gemm_workspace *ws) {
+    gemm_free(ws->packed_A);
+    gemm_free(ws->packed_B);
+    ws->packed_A = NULL;
+    ws->packed_B = NULL;
+}
+
+// Pack an mc x kc block of A into MR-row micro-panels: panel[p][0..MR).
+// Rows past the edge are zero-filled so the micro-kernel never branches.
+// A transposed A is read in place (element (i, p) at A[p * lda + i]), and
+// alpha is folded in here so the micro-kernel does not have to scale.
+static void pack_A(int mc, int kc, const float *A, int lda, gemm_trans trans, float alpha, float *packed) {
+    for (int i = 0; i < mc; i += GEMM_MR) {
+        int rows = GEMM_MIN(GEMM_MR, mc - i);
+        for (int p = 0; p < kc; p++) {
+            int r = 0;
+            if (trans == GEMM_TRANS) {
+                const float *a = A + (size_t)p * lda + i;
+                for (; r < rows; r++) {
+                    packed[r] = alpha * a[r];
+                }
+            } else {
+                const float *a = A + (size_t)i * lda + p;
+                for (; r < rows; r++) {
+                    packed[r] = alpha * a[(size_t)r * lda];
+                }
+            }
+            for (; r < GEMM_MR; r++) {
+                packed[r] = 0.0f;
+            }
+            packed += GEMM_MR;
+        }
+    }
+}
+
+// Pack a kc x nc panel of B into NR-column micro-panels: panel[p][0..NR).
+// A transposed B has element (p, j) at B[j * ldb + p]; it is walked one
+// column of the panel at a time so the reads stay sequential.
+static void pack_B(int kc, int nc, const float *B, int ldb, gemm_trans trans, float *packed) {
+    for (int j = 0; j < nc; j += GEMM_NR) {
+        int cols = GEMM_MIN(GEMM_NR, nc - j);
+        if (trans == GEMM_TRANS) {
+            for (int c = 0; c < GEMM_NR; c++) {
+                const float *column = B + (size_t)(j + c) * ldb;
+                for (int p = 0; p < kc; p++) {
+                    packed[(size_t)p * GEMM_NR + c] = c < cols ? column[p] : 0.0f;
+                }
+            }
+            packed += (size_t)kc * GEMM_NR;
+            continue;
+        }
+        const float *b = B + j;
+        for (int p = 0; p < kc; p++) {
+            const float *row = b + (size_t)p * ldb;
+            int c = 0;
+            for (; c < cols; c++) {
+                packed[c] = row[c];
+            }
+            for (; c < GEMM_NR; c++) {
+                packed[c] = 0.0f;
+            }
+            packed += GEMM_NR;
+        }
+    }
+}
+
+// Multiply a packed mc x kc block of A with a packed kc x nc panel of B.
+// The MR x NR register tile is computed by the SIMD micro-kernel picked at runtime.
+static void gemm_macro_kernel(int mc, int nc, int kc, const float *packed_A, const float *packed_B,
+                              float *C, int ldc, int accumulate) {
+    simd_gemm_kernel_fn micro_kernel = simd_get()->gemm_kernel;
+    for (int j = 0; j < nc; j += GEMM_NR) {
+        int nr = GEMM_MIN(GEMM_NR, nc - j);
+        const float *b = packed_B + (size_t)j * kc;
+        for (int i = 0; i < mc; i += GEMM_MR) {
+            int mr = GEMM_MIN(GEMM_MR, mc - i);
+            const float *a = packed_A + (size_t)i * kc;
+            micro_kernel(kc, a, b, C + (size_t)i * ldc + j, ldc, mr, nr, accumulate);
+        }
+    }
+}
+
+// 16-bit storage: widen to float while packing, so the fp32 micro-kernel
+// runs unchanged and only the reads from memory get narrower
+static float gemm_widen(gemm_dtype type, uint16_t value) {
+    return type == GEMM_F16 ? simd_f16_to_f32(value) : simd_bf16_to_f32(value);
+}
+
+static void pack_A_16(gemm_dtype type, int mc, int kc, const uint16_t *A, int lda, float *packed) {
+    for (int i = 0; i < mc; i += GEMM_MR) {
+        int rows = GEMM_MIN(GEMM_MR, mc - i);
+        const uint16_t *a = A + (size_t)i * lda;
+        for (int p = 0; p < kc; p++) {
+            int r = 0;
+            for (; r < rows; r++) {
+                packed[r] = gemm_widen(type, a[(size_t)r * lda + p]);
+            }
+            for (; r < GEMM_MR; r++) {
+                packed[r] = 0.0f;
+            }
+            packed += GEMM_MR;
+        }
+    }
+}
+
+static void pack_B_16(gemm_dtype type, int kc, int nc, const uint16_t *B, int ldb, float *packed) {
+    simd_f16_fn f16_to_f32 = simd_get()->f16_to_f32;
+    for (int j = 0; j < nc; j += GEMM_NR) {
+        int cols = GEMM_MIN(GEMM_NR, nc - j);
+        const uint16_t *b = B + j;
+        for (int p = 0; p < kc; p++) {
+            const uint16_t *row = b + (size_t)p * ldb;
+            int c = 0;
+            if (type == GEMM_F16) {
+                f16_to_f32(packed, row, cols);
+                c = cols;
+            }
+            for (; c < cols; c++) {
+                packed[c] = gemm_widen(type, row[c]);
+            }
+            for (; c < GEMM_NR; c++) {
+                packed[c] = 0.0f;
+            }
+            packed += GEMM_NR;
+        }
+    }
+}
+
+// int8: pairs of consecutive k, sign-extended to int16, for the madd-style
+// micro-kernels. An odd last k is paired with zero.
+static void pack_A_i8(int mc, int kc, const int8_t *A, int lda, int16_t *packed) {
+    for (int i = 0; i < mc; i += GEMM_MR) {
+        int rows = GEMM_MIN(GEMM_MR, mc - i);
+        const int8_t *a = A + (size_t)i * lda;
+        for (int p = 0; p < kc; p += 2) {
+            int r = 0;
+            for (; r < rows; r++) {
+                const int8_t *x = a + (size_t)r * lda + p;
+                packed[2 * r] = x[0];
+                packed[2 * r + 1] = p + 1 < kc ? x[1] : 0;
+            }
+            for (; r < GEMM_MR; r++) {
+                packed[2 * r] = 0;
+                packed[2 * r + 1] = 0;
+            }
+            packed += 2 * GEMM_MR;
+        }
+    }
+}
+
+static void pack_B_i8(int kc, int nc, const int8_t *B, int ldb, int16_t *packed) {
+    for (int j = 0; j < nc; j += GEMM_NR) {
+        int cols = GEMM_MIN(GEMM_NR, nc - j);
+        const int8_t *b = B + j;
+        for (int p = 0; p < kc; p += 2) {
+            const int8_t *row0 = b + (size_t)p * ldb;
+            const int8_t *row1 = p + 1 < kc ? row0 + ldb : NULL;
+            int c = 0;
+            for (; c < cols; c++) {
+                packed[2 * c] = row0[c];
+                packed[2 * c + 1] = row1 ? row1[c] : 0;
+            }
+            for (; c < GEMM_NR; c++) {
+                packed[2 * c] = 0;
+                packed[2 * c + 1] = 0;
+            }
+            packed += 2 * GEMM_NR;
+        }
+    }
+}
+
+static void gemm_macro_kernel_i8(int mc, int nc, int kc, const int16_t *packed_A, const int16_t *packed_B,
+                                 float *C, int ldc, int accumulate,
+                                 const float *row_scales, const float *col_scales) {
+    simd_gemm_i8_kernel_fn micro_kernel = simd_get()->gemm_i8_kernel;
+    int kp = (kc + 1) / 2;
+    for (int j = 0; j < nc; j += GEMM_NR) {
+        int nr = GEMM_MIN(GEMM_NR, nc - j);
+        const int16_t *b = packed_B + (size_t)j * 2 * kp;
+        for (int i = 0; i < mc; i += GEMM_MR) {
+            int mr = GEMM_MIN(GEMM_MR, mc - i);
+            const int16_t *a = packed_A + (size_t)i * 2 * kp;
+            micro_kernel(kp, a, b, C + (size_t)i * ldc + j, ldc, mr, nr, accumulate,
+                         row_scales ? row_scales + i : NULL, col_scales ? col_scales + j : NULL);
+        }
+    }
+}
+
+static size_t gemm_dtype_size(gemm_dtype type) {
+    return type == GEMM_F32 ? sizeof(float) : type == GEMM_I8 ? sizeof(int8_t) : sizeof(uint16_t);
+}
+
+// How A and B are read and how the product lands in C, see sgemm()
+typedef struct {
+    gemm_trans trans_a, trans_b;
+    float alpha, beta;
+} gemm_op;
+
+static const gemm_op gemm_plain = {GEMM_NO_TRANS, GEMM_NO_TRANS, 1.0f, 0.0f};
+
+// C block = beta * C block, with beta == 0 clearing it without reading C
+static void gemm_scale_block(int m0, int m1, int n0, int n1, float beta, float *C, int ldc) {
+    for (int i = m0; i < m1; i++) {
+        float *c = C + (size_t)i * ldc;
+        if (beta == 0.0f) {
+            memset(c + n0, 0, (size_t)(n1 - n0) * sizeof(float));
+        } else {
+            for (int j = n0; j < n1; j++) {
+                c[j] *= beta;
+            }
+        }
+    }
+}
+
+// gemm_tile for any storage type of A and B. Scales are only used for int8,
+// whose K blocks are accumulated exactly in int32 and then scaled into C.
+// Transposes, alpha and beta (op) are only supported for fp32.
+static void gemm_tile_any(gemm_dtype type, const gemm_op *op, int m0, int m1, int n0, int n1, int K,
+                          const void *A, int lda, const float *row_scales,
+                          const void *B, int ldb, const float *col_scales,
+                          float *C, int ldc, gemm_workspace *ws) {
+    if (K <= 0 || op->alpha == 0.0f) {
+        gemm_scale_block(m0, m1, n0, n1, op->beta, C, ldc);
+        return;
+    }
+    // beta == 0 lets the first K block overwrite C; otherwise scale C once
+    // up front and accumulate every block into it
+    int accumulate_all = op->beta != 0.0f;
+    if (accumulate_all && op->beta != 1.0f) {
+        gemm_scale_block(m0, m1, n0, n1, op->beta, C, ldc);
+    }
+
+    size_t size = gemm_dtype_size(type);
+    for (int jc = n0; jc < n1; jc += GEMM_NC) {
+        int nc = GEMM_MIN(GEMM_NC, n1 - jc);
+        for (int pc = 0; pc < K; pc += GEMM_KC) {
+            int kc = GEMM_MIN(GEMM_KC, K - pc);
+            size_t b_offset = op->trans_b == GEMM_TRANS ? (size_t)jc * ldb + pc : (size_t)pc * ldb + jc;
+            const void *b = (const char *)B + b_offset * size;
+            if (type == GEMM_F32) {
+                pack_B(kc, nc, (const float *)b, ldb, op->trans_b, ws->packed_B);
+            } else if (type == GEMM_I8) {
+                pack_B_i8(kc, nc, (const int8_t *)b, ldb, (int16_t *)ws->packed_B);
+            } else {
+                pack_B_16(type, kc, nc, (const uint16_t *)b, ldb, ws->packed_B);
+            }
+            for (int ic = m0; ic < m1; ic += GEMM_MC) {
+                int mc = GEMM_MIN(GEMM_MC, m1 - ic);
+                size_t a_offset = op->trans_a == GEMM_TRANS ? (size_t)pc * lda + ic : (size_t)ic * lda + pc;
+                const void *a = (const char *)A + a_offset * size;
+                float *c = C + (size_t)ic * ldc + jc;
+                // The first K block overwrites C, later ones accumulate into it
+                if (type == GEMM_I8) {
+                    pack_A_i8(mc, kc, (const int8_t *)a, lda, (int16_t *)ws->packed_A);
+                    gemm_macro_kernel_i8(mc, nc, kc, (const int16_t *)ws->packed_A, (const int16_t *)ws->packed_B,
+                                         c, ldc, pc > 0, row_scales ? row_scales + ic : NULL,
+                                         col_scales ? col_scales + jc : NULL);
+                    continue;
+                }
+                if (type == GEMM_F32) {
+                    pack_A(mc, kc, (const float *)a, lda, op->trans_a, op->alpha, ws->packed_A);
+                } else {
+                    pack_A_16(type, mc, kc, (const uint16_t *)a, lda, ws->packed_A);
+                }
+                gemm_macro_kernel(mc, nc, kc, ws->packed_A, ws->packed_B, c, ldc, accumulate_all || pc > 0);
+            }
+        }
+    }
+}
+
+void gemm_tile(int m0, int m1, int n0, int n1, int K,
+               const float *A, int lda, const float *B, int ldb, float *C, int ldc,
+               gemm_workspace *ws) {
+    gemm_tile_any(GEMM_F32, &gemm_plain, m0, m1, n0, n1, K, A, lda, NULL, B, ldb, NULL, C, ldc, ws);
+}
+
+void gemm_blocked(int M, int N, int K,
+                  const float *A, int lda, const float *B, int ldb, float *C, int ldc) {
+    if (M <= 0 || N <= 0) {
+        return;
+    }
+    gemm_workspace ws;
+    if (gemm_workspace_init(&ws) != 0) {
+        fprintf(stderr, "Failed to allocate GEMM packing buffers\n");
+        exit(EXIT_FAILURE);
+    }
+    gemm_tile(0, M, 0, N, K, A, lda, B, ldb, C, ldc, &ws);
+    gemm_workspace_release(&ws);
+}
+
+// Per-worker packing buffers, grown on demand and kept for later calls
+static gemm_workspace *gemm_worker_ws = NULL;
+static int gemm_worker_ws_count = 0;
+
+static void gemm_release_worker_ws(void) {
+    for (int i = 0; i < gemm_worker_ws_count; i++) {
+        gemm_workspace_release(&gemm_worker_ws[i]);
+    }
+    free(gemm_worker_ws);
+    gemm_worker_ws = NULL;
+    gemm_worker_ws_count = 0;
+}
+
+static void gemm_reserve_worker_ws(int count) {
+    if (count <= gemm_worker_ws_count) {
+        return;
+    }
+    if (gemm_worker_ws_count == 0) {
+        atexit(gemm_release_worker_ws);
+    }
+    gemm_worker_ws = (gemm_workspace *)realloc(gemm_worker_ws, count * sizeof(gemm_workspace));
+    for (int i = gemm_worker_ws_count; i < count; i++) {
+        if (gemm_workspace_init(&gemm_worker_ws[i]) != 0) {
+            fprintf(stderr, "Failed to allocate GEMM packing buffers\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    gemm_worker_ws_count = count;
+}
+
+typedef struct {
+    int M, N, K;
+    gemm_dtype type;
+    const gemm_op *op;
+    const void *A;
+    int lda;
+    const float *row_scales;
+    const void *B;
+    int ldb;
+    const float *col_scales;
+    float *C;
+    int ldc;
+    int tile_m, tile_n, tiles_n;
+} gemm_parallel_job;
+
+static void gemm_parallel_task(void *arg, int task, int worker) {
+    gemm_parallel_job *job = (gemm_parallel_job *)arg;
+    int m0 = (task / job->tiles_n) * job->tile_m;
+    int n0 = (task % job->tiles_n) * job->tile_n;
+    int m1 = GEMM_MIN(m0 + job->tile_m, job->M);
+    int n1 = GEMM_MIN(n0 + job->tile_n, job->N);
+    gemm_tile_any(job->type, job->op, m0, m1, n0, n1, job->K, job->A, job->lda, job->row_scales,
+                  job->B, job->ldb, job->col_scales, job->C, job->ldc, &gemm_worker_ws[worker]);
+}
+
+static void gemm_parallel_any(thread_pool *pool, gemm_dtype type, const gemm_op *op, int M, int N, int K,
+                              const void *A, int lda, const float *row_scales,
+                              const void *B, int ldb, const float *col_scales, float *C, int ldc) {
+    if (M <= 0 || N <= 0) {
+        return;
+    }
+    if (!pool) {
+        pool = thread_pool_default();
+    }
+    int threads = thread_pool_size(pool);
+
+    // Aim for at least four tiles per worker so stealing can balance ragged
+    // edges and non-square shapes; narrow the tiles before making them shorter.
+    gemm_parallel_job job = {M, N, K, type, op, A, lda, row_scales, B, ldb, col_scales, C, ldc,
+                             GEMM_MC, GEMM_TILE_N, 0};
+    int target = 4 * threads;
+    #define GEMM_TILE_COUNT(tm, tn) (((M + (tm) - 1) / (tm)) * ((N + (tn) - 1) / (tn)))
+    while (GEMM_TILE_COUNT(job.tile_m, job.tile_n) < target && job.tile_n > 4 * GEMM_NR) {
+        job.tile_n /= 2;
+    }
+    while (GEMM_TILE_COUNT(job.tile_m, job.tile_n) < target && job.tile_m > 4 * GEMM_MR) {
+        job.tile_m = (job.tile_m / 2 + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+    }
+    #undef GEMM_TILE_COUNT
+    job.tiles_n = (N + job.tile_n - 1) / job.tile_n;
+    int tiles_m = (M + job.tile_m - 1) / job.tile_m;
+
+    gemm_reserve_worker_ws(threads);
+    thread_pool_run(pool, tiles_m * job.tiles_n, gemm_parallel_task, &job);
+}
+
+void gemm_parallel(thread_pool *pool, int M, int N, int K,
+                   const float *A, int lda, const float *B, int ldb, float *C, int ldc) {
+    gemm_parallel_any(pool, GEMM_F32, &gemm_plain, M, N, K, A, lda, NULL, B, ldb, NULL, C, ldc);
+}
+
+void sgemm(gemm_trans transA, gemm_trans transB, int M, int N, int K,
+           float alpha, const float *A, int lda, const float *B, int ldb,
+           float beta, float *C, int ldc) {
+    // Same argument checks as the reference BLAS, adapted to row-major
+    int cols_a = transA == GEMM_TRANS ? M : K;
+    int cols_b = transB == GEMM_TRANS ? K : N;
+    const char *error = NULL;
+    if (M < 0 || N < 0 || K < 0) {
+        error = "negative dimension";
+    } else if (lda < (cols_a > 1 ? cols_a : 1)) {
+        error = "lda smaller than a row of A";
+    } else if (ldb < (cols_b > 1 ? cols_b : 1)) {
+        error = "ldb smaller than a row of B";
+    } else if (ldc < (N > 1 ? N : 1)) {
+        error = "ldc smaller than a row of C";
+    }
+    if (error) {
+        fprintf(stderr, "sgemm: %s (M=%d N=%d K=%d lda=%d ldb=%d ldc=%d)\n", error, M, N, K, lda, ldb, ldc);
+        exit(EXIT_FAILURE);
+    }
+    if (M == 0 || N == 0 || ((K == 0 || alpha == 0.0f) && beta == 1.0f)) {
+        return;
+    }
+
+    gemm_op op = {transA, transB, alpha, beta};
+    gemm_parallel_any(NULL, GEMM_F32, &op, M, N, K, A, lda, NULL, B, ldb, NULL, C, ldc);
+}
+
+void gemm_parallel_f16(thread_pool *pool, int M, int N, int K,
+                       const uint16_t *A, int lda, const uint16_t *B, int ldb, float *C, int ldc) {
+    gemm_parallel_any(pool, GEMM_F16, &gemm_plain, M, N, K, A, lda, NULL, B, ldb, NULL, C, ldc);
+}
+
+void gemm_parallel_bf16(thread_pool *pool, int M, int N, int K,
+                        const uint16_t *A, int lda, const uint16_t *B, int ldb, float *C, int ldc) {
+    gemm_parallel_any(pool, GEMM_BF16, &gemm_plain, M, N, K, A, lda, NULL, B, ldb, NULL, C, ldc);
+}
+
+void gemm_parallel_i8(thread_pool *pool, int M, int N, int K,
+                      const int8_t *A, int lda, const float *row_scales,
+                      const int8_t *B, int ldb, const float *col_scales, float *C, int ldc) {
+    gemm_parallel_any(pool, GEMM_I8, &gemm_plain, M, N, K, A, lda, row_scales, B, ldb, col_scales, C, ldc);
+}
+
+void gemm_convert_f16(uint16_t *dst, const float *src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = simd_f32_to_f16(src[i]);
+    }
+}
+
+void gemm_convert_bf16(uint16_t *dst, const float *src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = simd_f32_to_bf16(src[i]);
+    }
+}
+
+static int8_t gemm_quantize(float value, float inverse_scale) {
+    float q = value * inverse_scale;
+    q = q > 127.0f ? 127.0f : q < -127.0f ? -127.0f : q;
+    return (int8_t)(q < 0.0f ? q - 0.5f : q + 0.5f);
+}
+
+// Symmetric quantization: scale = max |x| / 127 over the row (or column)
+void gemm_quantize_rows(int rows, int cols, const float *X, int ldx, int8_t *Q, int ldq, float *scales) {
+    for (int i = 0; i < rows; i++) {
+        const float *x = X + (size_t)i * ldx;
+        float max_abs = 0.0f;
+        for (int j = 0; j < cols; j++) {
+            float v = x[j] < 0.0f ? -x[j] : x[j];
+            if (v > max_abs) max_abs = v;
+        }
+        scales[i] = max_abs > 0.0f ? max_abs / 127.0f : 1.0f;
+        float inverse = 1.0f / scales[i];
+        for (int j = 0; j < cols; j++) {
+            Q[(size_t)i * ldq + j] = gemm_quantize(x[j], inverse);
+        }
+    }
+}
+
+void gemm_quantize_cols(int rows, int cols, const float *X, int ldx, int8_t *Q, int ldq, float *scales) {
+    for (int j = 0; j < cols; j++) {
+        scales[j] = 0.0f;
+    }
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            float v = X[(size_t)i * ldx + j];
+            v = v < 0.0f ? -v : v;
+            if (v > scales[j]) scales[j] = v;
+        }
+    }
+    for (int j = 0; j < cols; j++) {
+        scales[j] = scales[j] > 0.0f ? scales[j] / 127.0f : 1.0f;
+    }
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            Q[(size_t)i * ldq + j] = gemm_quantize(X[(size_t)i * ldx + j], 1.0f / scales[j]);
+        }
+    }
+}
+
+typedef struct {
+    int M, N, K;
+    const float *A;
+    int lda;
+    size_t stride_a;
+    const float *B;
+    int ldb;
+    size_t stride_b;
+    float *C;
+    int ldc;
+    size_t stride_c;
+    const float *const *A_array; // pointer-array batches, NULL for strided ones
+    const float *const *B_array;
+    float *const *C_array;
+    int batch, tasks;
+} gemm_batched_job;
+
+static void gemm_batched_task(void *arg, int task, int worker) {
+    gemm_batched_job *job = (gemm_batched_job *)arg;
+    int first = (int)((long long)task * job->batch / job->tasks);
+    int last = (int)((long long)(task + 1) * job->batch / job->tasks);
+    for (int b = first; b < last; b++) {
+        const float *A = job->A_array ? job->A_array[b] : job->A + b * job->stride_a;
+        const float *B = job->B_array ? job->B_array[b] : job->B + b * job->stride_b;
+        float *C = job->C_array ? job->C_array[b] : job->C + b * job->stride_c;
+        gemm_tile(0, job->M, 0, job->N, job->K, A, job->lda, B, job->ldb, C, job->ldc,
+                  &gemm_worker_ws[worker]);
+    }
+}
+
+static void gemm_batched_run(thread_pool *pool, gemm_batched_job *job) {
+    if (job->M <= 0 || job->N <= 0 || job->batch <= 0) {
+        return;
+    }
+    if (!pool) {
+        pool = thread_pool_default();
+    }
+    int threads = thread_pool_size(pool);
+
+    // A few contiguous runs of products per worker, so stealing can even out
+    job->tasks = GEMM_MIN(job->batch, 8 * threads);
+    gemm_reserve_worker_ws(threads);
+    thread_pool_run(pool, job->tasks, gemm_batched_task, job);
+}
+
+void gemm_batched_strided(thread_pool *pool, int M, int N, int K,
+                          const float *A, int lda, size_t stride_a,
+                          const float *B, int ldb, size_t stride_b,
+                          float *C, int ldc, size_t stride_c, int batch) {
+    gemm_batched_job job = {M, N, K, A, lda, stride_a, B, ldb, stride_b, C, ldc, stride_c,
+                            NULL, NULL, NULL, batch, 0};
+    gemm_batched_run(pool, &job);
+}
+
+void gemm_batched(thread_pool *pool, int M, int N, int K,
+                  const float *const *A, int lda, const float *const *B, int ldb,
+                  float *const *C, int ldc, int batch) {
+    gemm_batched_job job = {M, N, K, NULL, lda, 0, NULL, ldb, 0, NULL, ldc, 0,
+                            A, B, C, batch, 0};
+    gemm_batched_run(pool, &job);
+}
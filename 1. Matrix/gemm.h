@@ -0,0 +1,113 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "thread_pool.h"
+
+// Host single-precision GEMM: C (M x N) = A (M x K) * B (K x N), row-major.
+// lda, ldb and ldc are the row strides (in elements) of A, B and C.
+//
+// The loops follow the usual Goto/BLIS layout:
+//   NC x KC panel of B is packed once and stays in L3,
+//   MC x KC block of A is packed once and stays in L2,
+//   MR x NR tile of C is accumulated in registers by the micro-kernel,
+//   while a KC x NR sliver of B streams through L1.
+//
+// Build with optimization enabled (e.g. gcc -O3 -march=native), otherwise the
+// micro-kernel is not vectorized and the blocking buys very little.
+#define GEMM_MR 6
+#define GEMM_NR 16
+#define GEMM_MC 144   // multiple of GEMM_MR
+#define GEMM_KC 256
+#define GEMM_NC 3072  // multiple of GEMM_NR
+
+#define GEMM_ALIGN 64 // bytes, one cache line
+
+// Widest C tile handed to one worker by gemm_parallel (multiple of GEMM_NR).
+// Tiles shrink towards 4 x MR by 4 x NR until every worker has several.
+#define GEMM_TILE_N 512
+
+// Packing buffers for one thread. Allocate once and reuse across calls.
+typedef struct {
+    float *packed_A; // GEMM_MC * GEMM_KC floats
+    float *packed_B; // GEMM_KC * GEMM_NC floats
+} gemm_workspace;
+
+float *gemm_alloc(size_t count);
+void gemm_free(float *ptr);
+
+int gemm_workspace_init(gemm_workspace *ws);
+void gemm_workspace_release(gemm_workspace *ws);
+
+// Compute the C block rows [m0, m1) x columns [n0, n1) using the whole K range.
+void gemm_tile(int m0, int m1, int n0, int n1, int K,
+               const float *A, int lda, const float *B, int ldb, float *C, int ldc,
+               gemm_workspace *ws);
+
+// Single-threaded blocked GEMM.
+void gemm_blocked(int M, int N, int K,
+                  const float *A, int lda, const float *B, int ldb, float *C, int ldc);
+
+// Multithreaded blocked GEMM. C is cut into tiles that the pool distributes
+// with work stealing; each worker packs into its own workspace. pool may be
+// NULL to use thread_pool_default().
+void gemm_parallel(thread_pool *pool, int M, int N, int K,
+                   const float *A, int lda, const float *B, int ldb, float *C, int ldc);
+
+// BLAS-style GEMM, row-major: C = alpha * op(A) * op(B) + beta * C with
+// op(A) M x K, op(B) K x N and C M x N, where op(X) is X or its transpose.
+// lda, ldb and ldc are the row strides of the arrays as stored, so a
+// transposed A is a K x M array with lda >= M, and any of the three may be a
+// sub-block of a larger matrix. Transposes are handled by the packing
+// routines and alpha is applied while packing A, so nothing is copied or
+// scaled beforehand. beta == 0 overwrites C without reading it.
+// Runs on thread_pool_default(); invalid arguments are reported and exit.
+typedef enum { GEMM_NO_TRANS, GEMM_TRANS } gemm_trans;
+
+void sgemm(gemm_trans transA, gemm_trans transB, int M, int N, int K,
+           float alpha, const float *A, int lda, const float *B, int ldb,
+           float beta, float *C, int ldc);
+
+// Reduced-precision storage, fp32 result. A and B are stored as IEEE half
+// (f16) or bfloat16 (bf16) and widened to float while they are packed, so
+// the arithmetic and accumulation stay fp32 and only memory traffic and
+// footprint shrink. The int8 variant accumulates exactly in int32 within each
+// K block and scales the result by row_scales[i] * col_scales[j]; either may
+// be NULL for 1. Sizes and strides are in elements, as for gemm_parallel.
+typedef enum { GEMM_F32, GEMM_F16, GEMM_BF16, GEMM_I8 } gemm_dtype;
+
+void gemm_parallel_f16(thread_pool *pool, int M, int N, int K,
+                       const uint16_t *A, int lda, const uint16_t *B, int ldb, float *C, int ldc);
+void gemm_parallel_bf16(thread_pool *pool, int M, int N, int K,
+                        const uint16_t *A, int lda, const uint16_t *B, int ldb, float *C, int ldc);
+void gemm_parallel_i8(thread_pool *pool, int M, int N, int K,
+                      const int8_t *A, int lda, const float *row_scales,
+                      const int8_t *B, int ldb, const float *col_scales, float *C, int ldc);
+
+// float to storage conversions, round to nearest even
+void gemm_convert_f16(uint16_t *dst, const float *src, size_t count);
+void gemm_convert_bf16(uint16_t *dst, const float *src, size_t count);
+
+// Symmetric int8 quantization with one scale (max |x| / 127) per row or per
+// column; X ~ scale * Q. Use rows for A and columns for B.
+void gemm_quantize_rows(int rows, int cols, const float *X, int ldx, int8_t *Q, int ldq, float *scales);
+void gemm_quantize_cols(int rows, int cols, const float *X, int ldx, int8_t *Q, int ldq, float *scales);
+
+// Batched GEMM for many independent products of the same shape, parallel
+// across the batch: each task runs a contiguous range of products through
+// gemm_tile with its worker's packing buffers. Even at 8 x 8 the packed SIMD
+// path beats a direct triple loop, so there is no separate small-matrix path.
+//
+// Strided: product b uses A + b * stride_a, B + b * stride_b, C + b * stride_c.
+// Pointer array: product b uses A[b], B[b], C[b].
+void gemm_batched_strided(thread_pool *pool, int M, int N, int K,
+                          const float *A, int lda, size_t stride_a,
+                          const float *B, int ldb, size_t stride_b,
+                          float *C, int ldc, size_t stride_c, int batch);
+
+void gemm_batched(thread_pool *pool, int M, int N, int K,
+                  const float *const *A, int lda, const float *const *B, int ldb,
+                  float *const *C, int ldc, int batch);
+
+#endif
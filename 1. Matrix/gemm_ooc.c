@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gemm_ooc.h"
+#include "../common/bench.h"
+
+#define GEMM_OOC_MAX_TILE_N 4096
+#define GEMM_OOC_MAX_TILE_K 512
+#define GEMM_OOC_MIN_TILE 32
+#define GEMM_OOC_MIN_PANEL 256 // rows an A panel needs to be worth keeping
+
+static int gemm_ooc_extent(int total, int tile, int index) {
+    int rest = total - index * tile;
+    return rest < tile ? rest : tile;
+}
+
+// Rounds a tile down to a multiple of GEMM_OOC_MIN_TILE unless it covers total
+static int gemm_ooc_round(int tile, int total) {
+    if (tile >= total) return total;
+    return tile > GEMM_OOC_MIN_TILE ? tile / GEMM_OOC_MIN_TILE * GEMM_OOC_MIN_TILE : tile;
+}
+
+int gemm_ooc_plan_tiles(int M, int N, int K, size_t budget, gemm_ooc_plan *plan) {
+    memset(plan, 0, sizeof(*plan));
+    double floats = (double)budget / sizeof(float);
+    int min_panel = M < GEMM_OOC_MIN_PANEL ? M : GEMM_OOC_MIN_PANEL;
+
+    // In floats, for tile_m rows: the mapped A (the panel, or the current and
+    // next tile), the current and next B tile, two C accumulators, and the
+    // two staging copies of A and B tiles the device backend needs
+    for (int tn = N < GEMM_OOC_MAX_TILE_N ? N : GEMM_OOC_MAX_TILE_N;; tn /= 2) {
+        int tk = K < GEMM_OOC_MAX_TILE_K ? K : GEMM_OOC_MAX_TILE_K;
+        if (tk > tn && tn >= GEMM_OOC_MIN_TILE) tk = tn;
+        double available = floats - 4.0 * tk * tn;
+        double panel_rows = available / ((double)K + 2.0 * tn + 2.0 * tk);
+        double stream_rows = available / (4.0 * tk + 2.0 * tn);
+        if (available > 0 && panel_rows >= min_panel) {
+            plan->keep_a = 1;
+            plan->tile_m = gemm_ooc_round(panel_rows > M ? M : (int)panel_rows, M);
+        } else if (available > 0 && stream_rows >= (tn < M ? tn : M)) {
+            plan->tile_m = gemm_ooc_round(tn, M);
+        }
+        if (plan->tile_m > 0) {
+            plan->tile_n = gemm_ooc_round(tn, N);
+            plan->tile_k = tk;
+            break;
+        }
+        if (tn <= GEMM_OOC_MIN_TILE) {
+            return -1;
+        }
+    }
+
+    double tm = plan->tile_m, tn = plan->tile_n, tk = plan->tile_k;
+    double mapped_a = plan->keep_a ? tm * K : 2.0 * tm * tk;
+    plan->working_set = (size_t)((mapped_a + 4.0 * tk * tn + 2.0 * tm * tn + 2.0 * tm * tk) * sizeof(float));
+
+    int num_steps;
+    gemm_ooc_step *steps = gemm_ooc_steps(M, N, K, plan, &num_steps);
+    for (int s = 0; s < num_steps; s++) {
+        gemm_ooc_region region = gemm_ooc_step_region(M, N, K, plan, &steps[s]);
+        if (steps[s].load_a) plan->bytes_read += (double)region.rows * region.depth * sizeof(float);
+        if (steps[s].load_b) plan->bytes_read += (double)region.depth * region.cols * sizeof(float);
+        if (steps[s].last) plan->bytes_written += (double)region.rows * region.cols * sizeof(float);
+    }
+    free(steps);
+    return 0;
+}
+
+gemm_ooc_step *gemm_ooc_steps(int M, int N, int K, const gemm_ooc_plan *plan, int *num_steps) {
+    int block_rows = (M + plan->tile_m - 1) / plan->tile_m;
+    int block_cols = (N + plan->tile_n - 1) / plan->tile_n;
+    int chunks = (K + plan->tile_k - 1) / plan->tile_k;
+    int count = block_rows * block_cols * chunks;
+    gemm_ooc_step *steps = (gemm_ooc_step *)calloc((size_t)count, sizeof(gemm_ooc_step));
+
+    // Serpentine over block columns and over chunks
+    int s = 0, block = 0;
+    for (int bi = 0; bi < block_rows; bi++) {
+        for (int jj = 0; jj < block_cols; jj++, block++) {
+            int bj = bi % 2 ? block_cols - 1 - jj : jj;
+            for (int kk = 0; kk < chunks; kk++, s++) {
+                steps[s].block_row = bi;
+                steps[s].block_col = bj;
+                steps[s].chunk = block % 2 ? chunks - 1 - kk : kk;
+                steps[s].first = kk == 0;
+                steps[s].last = kk == chunks - 1;
+                // With the panel kept, A tiles are read by the first block of a row
+                // and the panel is released after the last
+                steps[s].load_a = plan->keep_a && jj == 0;
+                steps[s].release_a = plan->keep_a && jj == block_cols - 1 && kk == chunks - 1;
+            }
+        }
+    }
+
+    for (s = 0; s < count; s++) {
+        const gemm_ooc_step *prev = s > 0 ? &steps[s - 1] : NULL;
+        const gemm_ooc_step *next = s + 1 < count ? &steps[s + 1] : NULL;
+        gemm_ooc_step *step = &steps[s];
+        int same_b_prev = prev && prev->chunk == step->chunk && prev->block_col == step->block_col;
+        int same_b_next = next && next->chunk == step->chunk && next->block_col == step->block_col;
+        step->load_b = !same_b_prev;
+        step->release_b = !same_b_next;
+        if (!plan->keep_a) {
+            step->load_a = !(prev && prev->chunk == step->chunk && prev->block_row == step->block_row);
+            step->release_a = !(next && next->chunk == step->chunk && next->block_row == step->block_row);
+        }
+    }
+    *num_steps = count;
+    return steps;
+}
+
+int gemm_ooc_check(const matrix_file *A, const matrix_file *B, const matrix_file *C) {
+    const matrix_file *files[3] = {A, B, C};
+    for (int i = 0; i < 3; i++) {
+        const matrix_file_header *h = &files[i]->header;
+        if (h->dtype != MATRIX_F32 || h->layout != MATRIX_ROW_MAJOR || h->rows == 0 || h->cols == 0 ||
+            h->rows > 0x7fffffff || h->cols > 0x7fffffff) {
+            fprintf(stderr, "Out-of-core GEMM needs non-empty row-major f32 matrices\n");
+            return -1;
+        }
+    }
+    if (A->header.cols != B->header.rows || C->header.rows != A->header.rows || C->header.cols != B->header.cols) {
+        fprintf(stderr, "Shapes %llu x %llu, %llu x %llu and %llu x %llu do not multiply\n",
+                (unsigned long long)A->header.rows, (unsigned long long)A->header.cols,
+                (unsigned long long)B->header.rows, (unsigned long long)B->header.cols,
+                (unsigned long long)C->header.rows, (unsigned long long)C->header.cols);
+        return -1;
+    }
+    if (!C->file.writable) {
+        fprintf(stderr, "The C matrix is mapped read-only\n");
+        return -1;
+    }
+    return 0;
+}
+
+void gemm_ooc_advise_tile(const matrix_file *matrix, int row, int col, int rows, int cols,
+                          mapped_file_advice advice) {
+    size_t ld = (size_t)matrix->header.cols;
+    size_t offset = matrix->header.data_offset + ((size_t)row * ld + col) * sizeof(float);
+    if ((size_t)cols == ld) {
+        mapped_file_advise(&matrix->file, offset, (size_t)rows * cols * sizeof(float), advice);
+        return;
+    }
+    for (int i = 0; i < rows; i++, offset += ld * sizeof(float)) {
+        mapped_file_advise(&matrix->file, offset, (size_t)cols * sizeof(float), advice);
+    }
+}
+
+gemm_ooc_region gemm_ooc_step_region(int M, int N, int K, const gemm_ooc_plan *plan, const gemm_ooc_step *step) {
+    gemm_ooc_region region;
+    region.row = step->block_row * plan->tile_m;
+    region.col = step->block_col * plan->tile_n;
+    region.k = step->chunk * plan->tile_k;
+    region.rows = gemm_ooc_extent(M, plan->tile_m, step->block_row);
+    region.cols = gemm_ooc_extent(N, plan->tile_n, step->block_col);
+    region.depth = gemm_ooc_extent(K, plan->tile_k, step->chunk);
+    return region;
+}
+
+// M, N and K of a checked A and B
+#define GEMM_OOC_DIMS(A, B) (int)(A)->header.rows, (int)(B)->header.cols, (int)(A)->header.cols
+
+void gemm_ooc_prefetch(const matrix_file *A, const matrix_file *B, const gemm_ooc_plan *plan,
+                       const gemm_ooc_step *step) {
+    gemm_ooc_region r = gemm_ooc_step_region(GEMM_OOC_DIMS(A, B), plan, step);
+    if (step->load_a) gemm_ooc_advise_tile(A, r.row, r.k, r.rows, r.depth, MAPPED_FILE_WILLNEED);
+    if (step->load_b) gemm_ooc_advise_tile(B, r.k, r.col, r.depth, r.cols, MAPPED_FILE_WILLNEED);
+}
+
+void gemm_ooc_release(const matrix_file *A, const matrix_file *B, const gemm_ooc_plan *plan,
+                      const gemm_ooc_step *step) {
+    gemm_ooc_region r = gemm_ooc_step_region(GEMM_OOC_DIMS(A, B), plan, step);
+    if (step->release_a && plan->keep_a) {
+        gemm_ooc_advise_tile(A, r.row, 0, r.rows, (int)A->header.cols, MAPPED_FILE_DONTNEED);
+    } else if (step->release_a) {
+        gemm_ooc_advise_tile(A, r.row, r.k, r.rows, r.depth, MAPPED_FILE_DONTNEED);
+    }
+    if (step->release_b) {
+        gemm_ooc_advise_tile(B, r.k, r.col, r.depth, r.cols, MAPPED_FILE_DONTNEED);
+    }
+}
+
+void gemm_ooc_store(matrix_file *C, const gemm_ooc_region *region, const float *block, int ld_block) {
+    size_t N = (size_t)C->header.cols;
+    float *c = (float *)C->data;
+    for (int i = 0; i < region->rows; i++) {
+        memcpy(c + (size_t)(region->row + i) * N + region->col, block + (size_t)i * ld_block,
+               (size_t)region->cols * sizeof(float));
+    }
+    // Start the write-back now so dirty pages do not pile up
+    size_t offset = C->header.data_offset + ((size_t)region->row * N + region->col) * sizeof(float);
+    mapped_file_flush(&C->file, offset, ((size_t)(region->rows - 1) * N + region->cols) * sizeof(float), 0);
+    gemm_ooc_advise_tile(C, region->row, region->col, region->rows, region->cols, MAPPED_FILE_DONTNEED);
+}
+
+int gemm_ooc_host(const matrix_file *A, const matrix_file *B, matrix_file *C, const gemm_ooc_plan *plan,
+                  gemm_ooc_stats *stats) {
+    if (gemm_ooc_check(A, B, C) != 0) {
+        return -1;
+    }
+    int M = (int)A->header.rows, N = (int)B->header.cols, K = (int)A->header.cols;
+    float *acc = gemm_alloc((size_t)plan->tile_m * plan->tile_n);
+    if (!acc) {
+        fprintf(stderr, "Failed to allocate the C accumulator\n");
+        return -1;
+    }
+    memset(stats, 0, sizeof(*stats));
+    gemm_ooc_step *steps = gemm_ooc_steps(M, N, K, plan, &stats->steps);
+    const float *a = (const float *)A->data;
+    const float *b = (const float *)B->data;
+
+    // The read-ahead of step s + 1 runs while step s computes
+    double start = bench_now_ms();
+    gemm_ooc_prefetch(A, B, plan, &steps[0]);
+    for (int s = 0; s < stats->steps; s++) {
+        const gemm_ooc_step *step = &steps[s];
+        gemm_ooc_region r = gemm_ooc_step_region(M, N, K, plan, step);
+        if (s + 1 < stats->steps) {
+            gemm_ooc_prefetch(A, B, plan, &steps[s + 1]);
+        }
+
+        double t = bench_now_ms();
+        sgemm(GEMM_NO_TRANS, GEMM_NO_TRANS, r.rows, r.cols, r.depth, 1.0f, a + (size_t)r.row * K + r.k, K,
+              b + (size_t)r.k * N + r.col, N, step->first ? 0.0f : 1.0f, acc, plan->tile_n);
+        stats->compute_ms += bench_now_ms() - t;
+        if (step->load_a) stats->bytes_read += (double)r.rows * r.depth * sizeof(float);
+        if (step->load_b) stats->bytes_read += (double)r.depth * r.cols * sizeof(float);
+
+        gemm_ooc_release(A, B, plan, step);
+        if (step->last) {
+            gemm_ooc_store(C, &r, acc, plan->tile_n);
+            stats->bytes_written += (double)r.rows * r.cols * sizeof(float);
+        }
+    }
+    mapped_file_flush(&C->file, 0, C->file.size, 1);
+    stats->total_ms = bench_now_ms() - start;
+
+    free(steps);
+    gemm_free(acc);
+    return 0;
+}
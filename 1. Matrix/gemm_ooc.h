@@ -0,0 +1,92 @@
+#ifndef GEMM_OOC_H
+#define GEMM_OOC_H
+
+#include <stddef.h>
+#include "gemm.h"
+#include "../common/matrix_file.h"
+
+// Out-of-core GEMM: C (M x N) = A (M x K) * B (K x N) on row-major f32
+// matrices in .mat files (matrix_file.h), used through their mappings, that
+// need not fit in memory.
+//
+// C is computed one tile_m x tile_n block at a time in an accumulator, while
+// tile_m x tile_k tiles of A and tile_k x tile_n tiles of B stream through.
+// The order of the steps is chosen for reuse:
+//   - when the A row panel (tile_m x K) fits in the budget, it stays in
+//     memory for a whole row of C blocks, so A is read from disk once and
+//     B once per block row;
+//   - otherwise blocks are square and all tiles stream;
+//   - the k chunks of consecutive blocks run in opposite directions, and the
+//     blocks of consecutive block rows too, so the tile at each turn is
+//     still in memory.
+// The tiles of the next step are prefetched while the current one computes,
+// and tiles that are not used again are released right away, so the memory
+// in use stays within the planned working set and the disk keeps streaming.
+
+typedef struct {
+    int tile_m, tile_n, tile_k;
+    int keep_a;             // the A row panel stays in memory for a block row
+    size_t working_set;     // bytes of memory tiles, buffers and prefetch may occupy
+    double bytes_read;      // from A and B, at this plan
+    double bytes_written;   // to C
+} gemm_ooc_plan;
+
+// One step multiplies A tile (block_row, chunk) by B tile (chunk, block_col)
+// into the accumulator of C block (block_row, block_col)
+typedef struct {
+    int block_row, block_col, chunk;
+    int first, last;         // first (overwrite) and last (store C) chunk of the block
+    int load_a, load_b;      // the tile is not in memory from an earlier step
+    int release_a, release_b; // no later step before a reload needs the tile;
+                              // with keep_a, release_a means the whole A panel
+} gemm_ooc_step;
+
+typedef struct {
+    double total_ms;
+    double compute_ms;      // host: sgemm calls, device: busy time of the kernels
+    double bytes_read, bytes_written;
+    int steps;
+} gemm_ooc_stats;
+
+// Largest tiles whose working set fits in budget bytes. Returns -1 if even
+// the smallest tiles do not fit.
+int gemm_ooc_plan_tiles(int M, int N, int K, size_t budget, gemm_ooc_plan *plan);
+
+// The steps of plan in execution order; free() the result
+gemm_ooc_step *gemm_ooc_steps(int M, int N, int K, const gemm_ooc_plan *plan, int *num_steps);
+
+// Where the tiles of a step lie: C block rows [row, row + rows) and columns
+// [col, col + cols), A and B tiles along K [k, k + depth)
+typedef struct {
+    int row, col, k;
+    int rows, cols, depth;
+} gemm_ooc_region;
+
+gemm_ooc_region gemm_ooc_step_region(int M, int N, int K, const gemm_ooc_plan *plan, const gemm_ooc_step *step);
+
+// Reports and returns -1 unless A, B and C are row-major f32 matrices of
+// shapes M x K, K x N and M x N, with C writable
+int gemm_ooc_check(const matrix_file *A, const matrix_file *B, const matrix_file *C);
+
+// Prefetch (MAPPED_FILE_WILLNEED) or release (MAPPED_FILE_DONTNEED) a
+// rows x cols tile at (row, col) of a row-major matrix
+void gemm_ooc_advise_tile(const matrix_file *matrix, int row, int col, int rows, int cols,
+                          mapped_file_advice advice);
+
+// Read-ahead for the tiles of step marked load_a and load_b
+void gemm_ooc_prefetch(const matrix_file *A, const matrix_file *B, const gemm_ooc_plan *plan,
+                       const gemm_ooc_step *step);
+
+// Releases the tiles of step marked release_a and release_b, after their last use
+void gemm_ooc_release(const matrix_file *A, const matrix_file *B, const gemm_ooc_plan *plan,
+                      const gemm_ooc_step *step);
+
+// Copies a finished block (row stride ld_block) into C at region, starts
+// writing it back and releases it
+void gemm_ooc_store(matrix_file *C, const gemm_ooc_region *region, const float *block, int ld_block);
+
+// Host backend on the thread pool of sgemm()
+int gemm_ooc_host(const matrix_file *A, const matrix_file *B, matrix_file *C, const gemm_ooc_plan *plan,
+                  gemm_ooc_stats *stats);
+
+#endif
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gemm_ooc_opencl.h"
+#include "../common/bench.h"
+#include "../common/cl_trace.h"
+
+#define GEMM_OOC_SLOTS 2 // tile buffer sets, and C blocks in flight
+
+typedef struct {
+    int M, N, K;
+    const matrix_file *A, *B;
+    matrix_file *C;
+    const gemm_ooc_plan *plan;
+    const gemm_ooc_step *steps;
+    int num_steps, chunks;
+    const sgemm_opencl_kernel *sgemm;
+    float *a_host[GEMM_OOC_SLOTS], *b_host[GEMM_OOC_SLOTS], *c_host[GEMM_OOC_SLOTS]; // pinned
+    cl_mem a_dev[GEMM_OOC_SLOTS], b_dev[GEMM_OOC_SLOTS], c_dev[GEMM_OOC_SLOTS];
+    cl_event c_read[GEMM_OOC_SLOTS]; // download into c_host not stored yet
+    int c_step[GEMM_OOC_SLOTS];      // last step of the block it holds
+    gemm_ooc_stats *stats;
+} gemm_ooc_job;
+
+// C blocks alternate between the two device and host blocks
+static int gemm_ooc_block_slot(const gemm_ooc_job *job, int step) {
+    return step / job->chunks % GEMM_OOC_SLOTS;
+}
+
+// Waits for the download into c_host[slot] and stores the block in C
+static cl_int gemm_ooc_store_pending(gemm_ooc_job *job, int slot) {
+    if (!job->c_read[slot]) {
+        return CL_SUCCESS;
+    }
+    cl_int err = clWaitForEvents(1, &job->c_read[slot]);
+    clReleaseEvent(job->c_read[slot]);
+    job->c_read[slot] = NULL;
+    if (err == CL_SUCCESS) {
+        gemm_ooc_region r = gemm_ooc_step_region(job->M, job->N, job->K, job->plan, &job->steps[job->c_step[slot]]);
+        gemm_ooc_store(job->C, &r, job->c_host[slot], r.cols);
+        job->stats->bytes_written += (double)r.rows * r.cols * sizeof(float);
+    }
+    return err;
+}
+
+static cl_int gemm_ooc_upload(void *user, int slab, int slot, cl_command_queue queue,
+                              cl_uint num_wait, const cl_event *wait, cl_pipeline_events *done) {
+    gemm_ooc_job *job = (gemm_ooc_job *)user;
+    const gemm_ooc_step *step = &job->steps[slab];
+    gemm_ooc_region r = gemm_ooc_step_region(job->M, job->N, job->K, job->plan, step);
+
+    // The compute of step slab - slots is done, so its tiles in this slot are free
+    cl_int err = num_wait > 0 ? clWaitForEvents(num_wait, wait) : CL_SUCCESS;
+    if (err != CL_SUCCESS) {
+        return err;
+    }
+    if (slab + 1 < job->num_steps) {
+        gemm_ooc_prefetch(job->A, job->B, job->plan, &job->steps[slab + 1]);
+    }
+
+    // Packing the tiles is where the pages are read from disk
+    const float *a = (const float *)job->A->data + (size_t)r.row * job->K + r.k;
+    const float *b = (const float *)job->B->data + (size_t)r.k * job->N + r.col;
+    for (int i = 0; i < r.rows; i++) {
+        memcpy(job->a_host[slot] + (size_t)i * r.depth, a + (size_t)i * job->K, (size_t)r.depth * sizeof(float));
+    }
+    for (int p = 0; p < r.depth; p++) {
+        memcpy(job->b_host[slot] + (size_t)p * r.cols, b + (size_t)p * job->N, (size_t)r.cols * sizeof(float));
+    }
+    if (step->load_a) job->stats->bytes_read += (double)r.rows * r.depth * sizeof(float);
+    if (step->load_b) job->stats->bytes_read += (double)r.depth * r.cols * sizeof(float);
+    gemm_ooc_release(job->A, job->B, job->plan, step);
+
+    cl_event *event = cl_trace_event(cl_pipeline_next(done));
+    err = clEnqueueWriteBuffer(queue, job->a_dev[slot], CL_FALSE, 0, (size_t)r.rows * r.depth * sizeof(float),
+                               job->a_host[slot], 0, NULL, event);
+    cl_trace_command("write A tile", queue, event, err);
+    if (err == CL_SUCCESS) {
+        event = cl_trace_event(cl_pipeline_next(done));
+        err = clEnqueueWriteBuffer(queue, job->b_dev[slot], CL_FALSE, 0, (size_t)r.depth * r.cols * sizeof(float),
+                                   job->b_host[slot], 0, NULL, event);
+        cl_trace_command("write B tile", queue, event, err);
+    }
+    return err;
+}
+
+static cl_int gemm_ooc_compute(void *user, int slab, int slot, cl_command_queue queue,
+                               cl_uint num_wait, const cl_event *wait, cl_pipeline_events *done) {
+    gemm_ooc_job *job = (gemm_ooc_job *)user;
+    const gemm_ooc_step *step = &job->steps[slab];
+    gemm_ooc_region r = gemm_ooc_step_region(job->M, job->N, job->K, job->plan, step);
+    int c_slot = gemm_ooc_block_slot(job, slab);
+
+    // A new block overwrites the device C block, whose previous download may still be pending
+    cl_event after[3];
+    cl_uint num_after = 0;
+    for (cl_uint i = 0; i < num_wait; i++) {
+        after[num_after++] = wait[i];
+    }
+    if (step->first && job->c_read[c_slot]) {
+        after[num_after++] = job->c_read[c_slot];
+    }
+    // sgemm_opencl() takes no wait list; the barrier holds it back instead
+    cl_event *barrier = cl_trace_event(NULL);
+    cl_int err = clEnqueueBarrierWithWaitList(queue, num_after, num_after ? after : NULL, barrier);
+    cl_trace_command("wait for tiles", queue, barrier, err);
+    if (err != CL_SUCCESS) {
+        return err;
+    }
+    return sgemm_opencl(job->sgemm, queue, GEMM_NO_TRANS, GEMM_NO_TRANS, r.rows, r.cols, r.depth,
+                        1.0f, job->a_dev[slot], 0, r.depth, job->b_dev[slot], 0, r.cols,
+                        step->first ? 0.0f : 1.0f, job->c_dev[c_slot], 0, r.cols, cl_pipeline_next(done));
+}
+
+static cl_int gemm_ooc_download(void *user, int slab, int slot, cl_command_queue queue,
+                                cl_uint num_wait, const cl_event *wait, cl_pipeline_events *done) {
+    gemm_ooc_job *job = (gemm_ooc_job *)user;
+    const gemm_ooc_step *step = &job->steps[slab];
+    (void)slot;
+    if (!step->last) {
+        return CL_SUCCESS;
+    }
+    gemm_ooc_region r = gemm_ooc_step_region(job->M, job->N, job->K, job->plan, step);
+    int c_slot = gemm_ooc_block_slot(job, slab);
+    cl_int err = gemm_ooc_store_pending(job, c_slot);
+    if (err != CL_SUCCESS) {
+        return err;
+    }
+    cl_event *event = cl_trace_event(cl_pipeline_next(done));
+    err = clEnqueueReadBuffer(queue, job->c_dev[c_slot], CL_FALSE, 0, (size_t)r.rows * r.cols * sizeof(float),
+                              job->c_host[c_slot], num_wait, wait, event);
+    cl_trace_command("read C block", queue, event, err);
+    if (err == CL_SUCCESS) {
+        clRetainEvent(*event);
+        job->c_read[c_slot] = *event;
+        job->c_step[c_slot] = slab;
+    }
+    return err;
+}
+
+cl_int gemm_ooc_opencl(cl_context context, cl_device_id device, const sgemm_opencl_kernel *sgemm, int num_queues,
+                       const matrix_file *A, const matrix_file *B, matrix_file *C,
+                       const gemm_ooc_plan *plan, gemm_ooc_stats *stats) {
+    if (gemm_ooc_check(A, B, C) != 0) {
+        return CL_INVALID_VALUE;
+    }
+    int M = (int)A->header.rows, N = (int)B->header.cols, K = (int)A->header.cols;
+    gemm_ooc_job job;
+    memset(&job, 0, sizeof(job));
+    memset(stats, 0, sizeof(*stats));
+    job.M = M;
+    job.N = N;
+    job.K = K;
+    job.A = A;
+    job.B = B;
+    job.C = C;
+    job.plan = plan;
+    job.sgemm = sgemm;
+    job.stats = stats;
+    job.chunks = (K + plan->tile_k - 1) / plan->tile_k;
+    gemm_ooc_step *steps = gemm_ooc_steps(M, N, K, plan, &job.num_steps);
+    job.steps = steps;
+    stats->steps = job.num_steps;
+
+    cl_pipeline pipeline;
+    cl_int err = cl_pipeline_create(&pipeline, context, device, num_queues);
+    if (err != CL_SUCCESS) {
+        free(steps);
+        return err;
+    }
+    size_t a_size = (size_t)plan->tile_m * plan->tile_k * sizeof(float);
+    size_t b_size = (size_t)plan->tile_k * plan->tile_n * sizeof(float);
+    size_t c_size = (size_t)plan->tile_m * plan->tile_n * sizeof(float);
+    for (int s = 0; s < GEMM_OOC_SLOTS && err == CL_SUCCESS; s++) {
+        job.a_host[s] = (float *)cl_pipeline_pinned(&pipeline, a_size, &err);
+        if (err == CL_SUCCESS) job.b_host[s] = (float *)cl_pipeline_pinned(&pipeline, b_size, &err);
+        if (err == CL_SUCCESS) job.c_host[s] = (float *)cl_pipeline_pinned(&pipeline, c_size, &err);
+        if (err == CL_SUCCESS) job.a_dev[s] = clCreateBuffer(context, CL_MEM_READ_ONLY, a_size, NULL, &err);
+        if (err == CL_SUCCESS) job.b_dev[s] = clCreateBuffer(context, CL_MEM_READ_ONLY, b_size, NULL, &err);
+        if (err == CL_SUCCESS) job.c_dev[s] = clCreateBuffer(context, CL_MEM_READ_WRITE, c_size, NULL, &err);
+    }
+
+    if (err == CL_SUCCESS) {
+        cl_pipeline_stats pipeline_stats;
+        memset(&pipeline_stats, 0, sizeof(pipeline_stats));
+        double start = bench_now_ms();
+        gemm_ooc_prefetch(A, B, plan, &steps[0]);
+        err = cl_pipeline_run(&pipeline, job.num_steps, GEMM_OOC_SLOTS, gemm_ooc_upload, gemm_ooc_compute,
+                              gemm_ooc_download, &job, &pipeline_stats);
+        // The last two blocks are still in the host C blocks, the older one first
+        int older = job.c_step[0] < job.c_step[1] ? 0 : 1;
+        cl_int store_err = gemm_ooc_store_pending(&job, older);
+        if (store_err == CL_SUCCESS) store_err = gemm_ooc_store_pending(&job, 1 - older);
+        if (err == CL_SUCCESS) err = store_err;
+        mapped_file_flush(&C->file, 0, C->file.size, 1);
+        stats->total_ms = bench_now_ms() - start;
+        stats->compute_ms = pipeline_stats.compute_ms;
+    }
+
+    for (int s = 0; s < GEMM_OOC_SLOTS; s++) {
+        if (job.c_read[s]) clReleaseEvent(job.c_read[s]);
+        if (job.a_dev[s]) clReleaseMemObject(job.a_dev[s]);
+        if (job.b_dev[s]) clReleaseMemObject(job.b_dev[s]);
+        if (job.c_dev[s]) clReleaseMemObject(job.c_dev[s]);
+    }
+    cl_pipeline_release(&pipeline);
+    free(steps);
+    return err;
+}
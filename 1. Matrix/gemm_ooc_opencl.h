@@ -0,0 +1,21 @@
+#ifndef GEMM_OOC_OPENCL_H
+#define GEMM_OOC_OPENCL_H
+
+#include <CL/cl.h>
+#include "gemm_ooc.h"
+#include "sgemm_opencl.h"
+#include "../common/cl_pipeline.h"
+
+// Device backend of the out-of-core GEMM in gemm_ooc.h, in the same step
+// order. Every step is one slab of a cl_pipeline: the host packs the A and B
+// tiles from the mappings into pinned memory and uploads them, sgemm_opencl()
+// accumulates into a device C block, and the last chunk of a block downloads
+// it. Two sets of tile buffers and two C blocks alternate, so reading the
+// disk, copying over the bus and computing all overlap.
+//
+// num_queues is 2 or 3, as for cl_pipeline_create().
+cl_int gemm_ooc_opencl(cl_context context, cl_device_id device, const sgemm_opencl_kernel *sgemm, int num_queues,
+                       const matrix_file *A, const matrix_file *B, matrix_file *C,
+                       const gemm_ooc_plan *plan, gemm_ooc_stats *stats);
+
+#endif
@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hetero.h"
+#include "simd_kernels.h"
+#include "../common/bench.h"
+#include "../common/cl_cache.h"
+#include "../common/cl_profile.h"
+#include "../common/cl_source.h"
+#include "../common/cl_trace.h"
+
+#define HETERO_GEMM_GRANULE 16  // rows; whole micro-kernel and work-group tiles
+#define HETERO_ADD_GRANULE 4
+#define HETERO_ADD_ROWS 64      // rows per host task of an add
+#define HETERO_ADD_LOCAL 256
+#define HETERO_ADD_GROUPS_PER_UNIT 8
+
+void hetero_init(hetero *h, thread_pool *pool, int use_host) {
+    memset(h, 0, sizeof(*h));
+    h->pool = pool ? pool : thread_pool_default();
+    h->use_host = use_host;
+}
+
+cl_int hetero_add_device(hetero *h, cl_context context, cl_device_id device) {
+    if (h->num_devices == HETERO_MAX_DEVICES) {
+        return CL_OUT_OF_RESOURCES;
+    }
+    hetero_device *dev = &h->devices[h->num_devices];
+    memset(dev, 0, sizeof(*dev));
+    cl_int err;
+    dev->queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+    if (err != CL_SUCCESS) {
+        return err;
+    }
+    dev->context = context;
+    dev->device = device;
+    cl_profile profile;
+    cl_profile_query(device, &profile);
+    snprintf(dev->name, sizeof(dev->name), "%s", profile.name);
+    dev->compute_units = profile.compute_units;
+    dev->vector_width = cl_profile_vector_width(&profile);
+    h->num_devices++;
+    return CL_SUCCESS;
+}
+
+void hetero_release(hetero *h) {
+    for (int d = 0; d < h->num_devices; d++) {
+        hetero_device *dev = &h->devices[d];
+        clFinish(dev->queue);
+        if (dev->has_sgemm) sgemm_opencl_release(&dev->sgemm);
+        if (dev->add_kernel) clReleaseKernel(dev->add_kernel);
+        if (dev->add_program) clReleaseProgram(dev->add_program);
+        for (int i = 0; i < 3; i++) {
+            if (dev->buffers[i]) clReleaseMemObject(dev->buffers[i]);
+        }
+        clReleaseCommandQueue(dev->queue);
+    }
+    memset(h, 0, sizeof(*h));
+}
+
+void hetero_split(const hetero *h, hetero_op op, int rows, int granule, int *counts) {
+    const hetero_balance *balance = &h->balance[op];
+    int num_backends = 1 + h->num_devices;
+    int active[HETERO_MAX_BACKENDS];
+    double measured = 0.0;
+    int num_measured = 0;
+    for (int i = 0; i < num_backends; i++) {
+        active[i] = i > 0 || h->use_host || h->num_devices == 0;
+        counts[i] = 0;
+        if (active[i] && balance->rate[i] > 0.0) {
+            measured += balance->rate[i];
+            num_measured++;
+        }
+    }
+
+    // Backends without a measurement count as an average one
+    double assumed = num_measured ? measured / num_measured : 1.0;
+    double rate[HETERO_MAX_BACKENDS], total = 0.0;
+    int fastest = -1;
+    for (int i = 0; i < num_backends; i++) {
+        rate[i] = !active[i] ? 0.0 : balance->rate[i] > 0.0 ? balance->rate[i] : assumed;
+        total += rate[i];
+        if (active[i] && (fastest < 0 || rate[i] > rate[fastest])) fastest = i;
+    }
+
+    int probe = rows / HETERO_PROBE / granule * granule;
+    if (probe < granule) probe = granule;
+    int assigned = 0;
+    for (int i = 0; i < num_backends; i++) {
+        if (!active[i] || i == fastest) continue;
+        int share = (int)(rows * (rate[i] / total)) / granule * granule;
+        counts[i] = share < probe ? probe : share;
+        assigned += counts[i];
+    }
+    if (assigned > rows) {
+        // Too few rows to go around
+        for (int i = 0; i < num_backends; i++) counts[i] = 0;
+        assigned = 0;
+    }
+    counts[fastest] = rows - assigned;
+}
+
+// Grows buffer index of dev to at least size bytes
+static cl_int hetero_reserve(hetero_device *dev, int index, size_t size) {
+    if (dev->capacity[index] >= size) {
+        return CL_SUCCESS;
+    }
+    if (dev->buffers[index]) {
+        clReleaseMemObject(dev->buffers[index]);
+        dev->buffers[index] = NULL;
+        dev->capacity[index] = 0;
+    }
+    cl_int err;
+    dev->buffers[index] = clCreateBuffer(dev->context, CL_MEM_READ_WRITE, size, NULL, &err);
+    if (err == CL_SUCCESS) {
+        dev->capacity[index] = size;
+    }
+    return err;
+}
+
+// Copies a rows x cols block with host row stride ld into a dense device buffer
+static cl_int hetero_write(cl_command_queue queue, cl_mem mem, int rows, int cols, const float *src, int ld,
+                           cl_event *event, const char *name) {
+    size_t origin[3] = {0, 0, 0};
+    size_t region[3] = {(size_t)cols * sizeof(float), (size_t)rows, 1};
+    cl_event *traced = cl_trace_event(event);
+    cl_int err = clEnqueueWriteBufferRect(queue, mem, CL_FALSE, origin, origin, region, region[0], 0,
+                                          (size_t)ld * sizeof(float), 0, src, 0, NULL, traced);
+    cl_trace_command(name, queue, traced, err);
+    return err;
+}
+
+static cl_int hetero_read(cl_command_queue queue, cl_mem mem, int rows, int cols, float *dst, int ld,
+                          cl_event *event, const char *name) {
+    size_t origin[3] = {0, 0, 0};
+    size_t region[3] = {(size_t)cols * sizeof(float), (size_t)rows, 1};
+    cl_event *traced = cl_trace_event(event);
+    cl_int err = clEnqueueReadBufferRect(queue, mem, CL_FALSE, origin, origin, region, region[0], 0,
+                                         (size_t)ld * sizeof(float), 0, dst, 0, NULL, traced);
+    cl_trace_command(name, queue, traced, err);
+    return err;
+}
+
+// Device time of one call: start of the first command to end of the last
+static double hetero_span_ms(cl_event first, cl_event last) {
+    cl_ulong start = 0, end = 0;
+    clGetEventProfilingInfo(first, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+    clGetEventProfilingInfo(last, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+    return end > start ? (double)(end - start) * 1e-6 : 0.0;
+}
+
+// Waits for the devices and folds the times of this call into the estimate
+static cl_int hetero_finish(hetero *h, hetero_op op, const int *counts, double host_ms, double work_per_row,
+                            cl_event *first, cl_event *last, double start) {
+    hetero_balance *balance = &h->balance[op];
+    cl_int err = CL_SUCCESS;
+    double ms[HETERO_MAX_BACKENDS];
+    ms[0] = host_ms;
+    for (int d = 0; d < h->num_devices; d++) {
+        ms[1 + d] = 0.0;
+        if (!last[d]) continue;
+        cl_int wait_err = clWaitForEvents(1, &last[d]);
+        if (wait_err == CL_SUCCESS) {
+            ms[1 + d] = hetero_span_ms(first[d], last[d]);
+        } else if (err == CL_SUCCESS) {
+            err = wait_err;
+        }
+        clReleaseEvent(first[d]);
+        clReleaseEvent(last[d]);
+    }
+    balance->total_ms = bench_now_ms() - start;
+    if (err != CL_SUCCESS) {
+        return err;
+    }
+
+    for (int i = 0; i < 1 + h->num_devices; i++) {
+        balance->rows[i] = counts[i];
+        balance->ms[i] = counts[i] > 0 ? ms[i] : 0.0;
+        if (counts[i] > 0 && ms[i] > 0.0) {
+            double rate = counts[i] * work_per_row / ms[i];
+            balance->rate[i] = balance->rate[i] > 0.0
+                                   ? (1.0 - HETERO_SMOOTHING) * balance->rate[i] + HETERO_SMOOTHING * rate
+                                   : rate;
+        }
+    }
+    balance->calls++;
+    return CL_SUCCESS;
+}
+
+static cl_int hetero_gemm_enqueue(hetero_device *dev, int rows, int N, int K, const float *A, int lda,
+                                  const float *B, int ldb, float *C, int ldc, cl_event *first, cl_event *last) {
+    cl_int err = CL_SUCCESS;
+    if (!dev->has_sgemm) {
+        const cl_source *source = cl_source_get("multiply_matrix.cl");
+        err = sgemm_opencl_init(&dev->sgemm, dev->context, dev->device, source->source, source->size, NULL);
+        if (err != CL_SUCCESS) {
+            return err;
+        }
+        dev->has_sgemm = 1;
+    }
+    err = hetero_reserve(dev, 0, (size_t)rows * K * sizeof(float));
+    if (err == CL_SUCCESS) err = hetero_reserve(dev, 1, (size_t)K * N * sizeof(float));
+    if (err == CL_SUCCESS) err = hetero_reserve(dev, 2, (size_t)rows * N * sizeof(float));
+    if (err == CL_SUCCESS) err = hetero_write(dev->queue, dev->buffers[0], rows, K, A, lda, first, "write A");
+    if (err != CL_SUCCESS) {
+        return err;
+    }
+    err = hetero_write(dev->queue, dev->buffers[1], K, N, B, ldb, NULL, "write B");
+    if (err == CL_SUCCESS) {
+        err = sgemm_opencl(&dev->sgemm, dev->queue, GEMM_NO_TRANS, GEMM_NO_TRANS, rows, N, K, 1.0f,
+                           dev->buffers[0], 0, K, dev->buffers[1], 0, N, 0.0f, dev->buffers[2], 0, N, NULL);
+    }
+    if (err == CL_SUCCESS) {
+        err = hetero_read(dev->queue, dev->buffers[2], rows, N, C, ldc, last, "read C");
+    }
+    if (err != CL_SUCCESS) {
+        clFinish(dev->queue);
+        clReleaseEvent(*first);
+        *first = NULL;
+        return err;
+    }
+    clFlush(dev->queue);
+    return CL_SUCCESS;
+}
+
+cl_int hetero_gemm(hetero *h, int M, int N, int K, const float *A, int lda, const float *B, int ldb,
+                   float *C, int ldc) {
+    int counts[HETERO_MAX_BACKENDS];
+    cl_event first[HETERO_MAX_DEVICES] = {NULL}, last[HETERO_MAX_DEVICES] = {NULL};
+    hetero_split(h, HETERO_GEMM, M, HETERO_GEMM_GRANULE, counts);
+
+    double start = bench_now_ms();
+    cl_int err = CL_SUCCESS;
+    int row = counts[0];
+    for (int d = 0; d < h->num_devices && err == CL_SUCCESS; d++) {
+        int rows = counts[1 + d];
+        if (rows > 0) {
+            err = hetero_gemm_enqueue(&h->devices[d], rows, N, K, A + (size_t)row * lda, lda, B, ldb,
+                                      C + (size_t)row * ldc, ldc, &first[d], &last[d]);
+        }
+        row += rows;
+    }
+
+    double host_ms = 0.0;
+    if (err == CL_SUCCESS && counts[0] > 0) {
+        double t = bench_now_ms();
+        trace_begin("hetero host gemm");
+        gemm_parallel(h->pool, counts[0], N, K, A, lda, B, ldb, C, ldc);
+        trace_end();
+        host_ms = bench_now_ms() - t;
+    }
+    cl_int finish_err = hetero_finish(h, HETERO_GEMM, counts, host_ms, 2.0 * N * K, first, last, start);
+    return err != CL_SUCCESS ? err : finish_err;
+}
+
+static cl_int hetero_add_enqueue(hetero_device *dev, int rows, int cols, const float *A, const float *B,
+                                 float *C, cl_event *first, cl_event *last) {
+    cl_int err = CL_SUCCESS;
+    if (!dev->add_kernel) {
+        const cl_source *source = cl_source_get("add_matrix.cl");
+        dev->add_program = cl_cache_build(dev->context, dev->device, source->source, source->size, source->hash,
+                                          NULL, &err, NULL);
+        if (dev->add_program && err == CL_SUCCESS) {
+            dev->add_kernel = clCreateKernel(dev->add_program, "add_matrix_vec", &err);
+        }
+        if (err != CL_SUCCESS) {
+            return err;
+        }
+    }
+
+    int num_elements = rows * cols;
+    size_t bytes = (size_t)num_elements * sizeof(float);
+    for (int i = 0; i < 3 && err == CL_SUCCESS; i++) {
+        err = hetero_reserve(dev, i, bytes);
+    }
+    if (err == CL_SUCCESS) {
+        err = clEnqueueWriteBuffer(dev->queue, dev->buffers[0], CL_FALSE, 0, bytes, A, 0, NULL, first);
+        cl_trace_command("write A", dev->queue, first, err);
+    }
+    if (err != CL_SUCCESS) {
+        return err;
+    }
+    cl_event *traced = cl_trace_event(NULL);
+    err = clEnqueueWriteBuffer(dev->queue, dev->buffers[1], CL_FALSE, 0, bytes, B, 0, NULL, traced);
+    cl_trace_command("write B", dev->queue, traced, err);
+
+    // Grid-stride kernel: a few work-groups per compute unit cover any size
+    size_t local_size = HETERO_ADD_LOCAL;
+    size_t max_work_group = local_size;
+    clGetDeviceInfo(dev->device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_work_group), &max_work_group, NULL);
+    if (local_size > max_work_group) local_size = max_work_group;
+    size_t needed = ((size_t)num_elements / dev->vector_width + local_size - 1) / local_size;
+    size_t groups = (size_t)dev->compute_units * HETERO_ADD_GROUPS_PER_UNIT;
+    if (groups > needed) groups = needed;
+    if (groups < 1) groups = 1;
+    size_t global_size = groups * local_size;
+    if (err == CL_SUCCESS) {
+        err = clSetKernelArg(dev->add_kernel, 0, sizeof(cl_mem), &dev->buffers[0]);
+        err |= clSetKernelArg(dev->add_kernel, 1, sizeof(cl_mem), &dev->buffers[1]);
+        err |= clSetKernelArg(dev->add_kernel, 2, sizeof(cl_mem), &dev->buffers[2]);
+        err |= clSetKernelArg(dev->add_kernel, 3, sizeof(int), &num_elements);
+    }
+    if (err == CL_SUCCESS) {
+        traced = cl_trace_event(NULL);
+        err = clEnqueueNDRangeKernel(dev->queue, dev->add_kernel, 1, NULL, &global_size, &local_size,
+                                     0, NULL, traced);
+        cl_trace_command("add_matrix_vec", dev->queue, traced, err);
+    }
+    if (err == CL_SUCCESS) {
+        err = clEnqueueReadBuffer(dev->queue, dev->buffers[2], CL_FALSE, 0, bytes, C, 0, NULL, last);
+        cl_trace_command("read C", dev->queue, last, err);
+    }
+    if (err != CL_SUCCESS) {
+        clFinish(dev->queue);
+        clReleaseEvent(*first);
+        *first = NULL;
+        return err;
+    }
+    clFlush(dev->queue);
+    return CL_SUCCESS;
+}
+
+typedef struct {
+    const float *A, *B;
+    float *C;
+    int rows, cols;
+} hetero_add_task;
+
+static void hetero_add_rows(void *arg, int task, int worker) {
+    hetero_add_task *t = (hetero_add_task *)arg;
+    (void)worker;
+    int first = task * HETERO_ADD_ROWS;
+    int rows = t->rows - first < HETERO_ADD_ROWS ? t->rows - first : HETERO_ADD_ROWS;
+    size_t offset = (size_t)first * t->cols;
+    simd_get()->add(t->C + offset, t->A + offset, t->B + offset, (size_t)rows * t->cols);
+}
+
+cl_int hetero_add(hetero *h, int rows, int cols, const float *A, const float *B, float *C) {
+    int counts[HETERO_MAX_BACKENDS];
+    cl_event first[HETERO_MAX_DEVICES] = {NULL}, last[HETERO_MAX_DEVICES] = {NULL};
+    hetero_split(h, HETERO_ADD, rows, HETERO_ADD_GRANULE, counts);
+
+    double start = bench_now_ms();
+    cl_int err = CL_SUCCESS;
+    size_t offset = (size_t)counts[0] * cols;
+    for (int d = 0; d < h->num_devices && err == CL_SUCCESS; d++) {
+        int device_rows = counts[1 + d];
+        if (device_rows > 0) {
+            err = hetero_add_enqueue(&h->devices[d], device_rows, cols, A + offset, B + offset, C + offset,
+                                     &first[d], &last[d]);
+        }
+        offset += (size_t)device_rows * cols;
+    }
+
+    double host_ms = 0.0;
+    if (err == CL_SUCCESS && counts[0] > 0) {
+        hetero_add_task task = {A, B, C, counts[0], cols};
+        double t = bench_now_ms();
+        trace_begin("hetero host add");
+        thread_pool_run(h->pool, (counts[0] + HETERO_ADD_ROWS - 1) / HETERO_ADD_ROWS, hetero_add_rows, &task);
+        trace_end();
+        host_ms = bench_now_ms() - t;
+    }
+    cl_int finish_err = hetero_finish(h, HETERO_ADD, counts, host_ms, (double)cols, first, last, start);
+    return err != CL_SUCCESS ? err : finish_err;
+}
+
+void hetero_print(const hetero *h, hetero_op op, FILE *out) {
+    const hetero_balance *balance = &h->balance[op];
+    int total = 0;
+    double slowest = 0.0, fastest = -1.0;
+    for (int i = 0; i < 1 + h->num_devices; i++) {
+        total += balance->rows[i];
+    }
+    for (int i = 0; i < 1 + h->num_devices; i++) {
+        if (i == 0 && !h->use_host && h->num_devices > 0) continue;
+        const char *name = i == 0 ? "host" : h->devices[i - 1].name;
+        fprintf(out, "  %-32.32s %7d rows (%5.1f%%) %9.3f ms, %10.3g %s/ms\n", name, balance->rows[i],
+                total ? 100.0 * balance->rows[i] / total : 0.0, balance->ms[i], balance->rate[i],
+                op == HETERO_GEMM ? "flop" : "elem");
+        if (balance->rows[i] > 0) {
+            if (balance->ms[i] > slowest) slowest = balance->ms[i];
+            if (fastest < 0.0 || balance->ms[i] < fastest) fastest = balance->ms[i];
+        }
+    }
+    fprintf(out, "  wall %.3f ms, imbalance %.1f%% (first to finish waited for the last)\n", balance->total_ms,
+            slowest > 0.0 ? 100.0 * (slowest - fastest) / slowest : 0.0);
+}
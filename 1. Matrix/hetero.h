@@ -0,0 +1,94 @@
+#ifndef HETERO_H
+#define HETERO_H
+
+#include <stdio.h>
+#include <CL/cl.h>
+#include "gemm.h"
+#include "thread_pool.h"
+#include "sgemm_opencl.h"
+
+// Runs one operation on the host thread pool and on OpenCL devices at once,
+// splitting its rows between them.
+//
+// Every backend gets one contiguous range of rows: the host the first range,
+// then the devices in the order they were added. The device ranges are
+// enqueued first (upload, kernel, download, all non-blocking), the host
+// computes its range meanwhile, and the call then waits for the devices.
+//
+// The split follows the throughput of each backend on earlier calls of the
+// same operation. Work is counted in flops for GEMM and elements for add, so
+// calls of different shapes share the estimate. After each call the time
+// every backend took updates its throughput as a moving average:
+//   - the host time is its wall clock;
+//   - a device time runs from the start of its first upload to the end of
+//     its download, taken from the profiling counters.
+// The next split therefore moves rows from the backend that finished last
+// to the ones that waited, until they all finish together. Backends that
+// have not been measured yet get an even share. Each backend keeps at least
+// a small probe share, so a slow one is still measured and can win rows
+// back when conditions change.
+
+#define HETERO_MAX_DEVICES 8
+#define HETERO_MAX_BACKENDS (1 + HETERO_MAX_DEVICES) // backend 0 is the host
+#define HETERO_PROBE 32       // every backend gets at least rows / HETERO_PROBE
+#define HETERO_SMOOTHING 0.5  // weight of the newest measurement
+
+typedef enum { HETERO_GEMM, HETERO_ADD, HETERO_NUM_OPS } hetero_op;
+
+typedef struct {
+    cl_context context;
+    cl_device_id device;
+    cl_command_queue queue;      // profiling enabled, owned by the device
+    char name[128];
+    cl_uint compute_units;
+    int vector_width;            // of add_matrix_vec, from the device profile
+    sgemm_opencl_kernel sgemm;   // built on the first GEMM
+    int has_sgemm;
+    cl_program add_program;      // built on the first add
+    cl_kernel add_kernel;
+    cl_mem buffers[3];           // grown on demand
+    size_t capacity[3];
+} hetero_device;
+
+// Throughput estimate of one operation
+typedef struct {
+    double rate[HETERO_MAX_BACKENDS];  // work per ms, 0 until measured
+    int rows[HETERO_MAX_BACKENDS];     // split of the last call
+    double ms[HETERO_MAX_BACKENDS];    // time each backend took on the last call
+    double total_ms;                   // wall clock of the last call
+    int calls;
+} hetero_balance;
+
+typedef struct {
+    thread_pool *pool;
+    int use_host;
+    int num_devices;
+    hetero_device devices[HETERO_MAX_DEVICES];
+    hetero_balance balance[HETERO_NUM_OPS];
+} hetero;
+
+// pool may be NULL for thread_pool_default(); use_host = 0 leaves the host
+// out of the split (it still drives the devices)
+void hetero_init(hetero *h, thread_pool *pool, int use_host);
+
+// Adds a device with its own profiling queue; kernels are built on first use
+cl_int hetero_add_device(hetero *h, cl_context context, cl_device_id device);
+
+void hetero_release(hetero *h);
+
+// Rows for every backend from the current estimate; counts are multiples of
+// granule except the one that takes the remainder
+void hetero_split(const hetero *h, hetero_op op, int rows, int granule, int *counts);
+
+// C (M x N) = A (M x K) * B (K x N), row-major with row strides lda, ldb, ldc.
+// Rows of A and C are split; every device gets all of B.
+cl_int hetero_gemm(hetero *h, int M, int N, int K, const float *A, int lda, const float *B, int ldb,
+                   float *C, int ldc);
+
+// C = A + B on dense rows x cols matrices
+cl_int hetero_add(hetero *h, int rows, int cols, const float *A, const float *B, float *C);
+
+// The split and timing of the last call of op, one line per backend
+void hetero_print(const hetero *h, hetero_op op, FILE *out);
+
+#endif
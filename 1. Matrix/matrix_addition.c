@@ -1,27 +1,42 @@
+#include "simd_kernels.c"
+#include "../common/mapped_file.c"
+#include "../common/matrix_file.c"
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
 
-// Function to add two matrices
+// Function to add two matrices. The matrices are dense, so this is one flat
+// vectorized pass; MATRIX_SIMD=scalar|sse|avx2|avx512 forces a variant.
 void add_Matrix(float *result, float *matrix_1, float *matrix_2, int rows, int cols) {
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            result[i * cols + j] = matrix_1[i * cols + j] + matrix_2[i * cols + j];
-        }
-    }
+    simd_get()->add(result, matrix_1, matrix_2, (size_t)rows * cols);
 }
 
+// MATRIX_A and MATRIX_B name .mat files (common/matrix_file.h) to add
+// instead of random matrices, and MATRIX_C a file for the result.
 int main() {
     int rows = 100;
     int cols = 100;
 
+    // Input files are used in place through their mappings
+    matrix_file file_1, file_2;
+    float *matrix_1 = matrix_file_from_env("MATRIX_A", &file_1, &rows, &cols);
+    int rows_2 = rows, cols_2 = cols;
+    float *matrix_2 = matrix_file_from_env("MATRIX_B", &file_2, &rows_2, &cols_2);
+    if (!matrix_1 != !matrix_2 || rows_2 != rows || cols_2 != cols) {
+        fprintf(stderr, "MATRIX_A and MATRIX_B must both be set, to matrices of the same shape\n");
+        return 1;
+    }
+    int loaded = matrix_1 != NULL;
+
     // Allocate memory for matrices
-    float *matrix_1 = (float *)malloc(rows * cols * sizeof(float));
-    float *matrix_2 = (float *)malloc(rows * cols * sizeof(float));
+    if (!loaded) {
+        matrix_1 = (float *)malloc(rows * cols * sizeof(float));
+        matrix_2 = (float *)malloc(rows * cols * sizeof(float));
+    }
     float *result = (float *)malloc(rows * cols * sizeof(float));
 
     // Populate matrices with random values (for testing)
-    for (int i = 0; i < rows * cols; i++) {
+    for (int i = 0; !loaded && i < rows * cols; i++) {
         matrix_1[i] = (float)(rand() % 100);
         matrix_2[i] = (float)(rand() % 100);
     }
@@ -36,11 +51,18 @@ int main() {
     double execution_time = (end.tv_sec - start.tv_sec) * 1000.0; // Convert to milliseconds
     execution_time += (end.tv_usec - start.tv_usec) / 1000.0; // Convert to milliseconds
 
+    printf("SIMD: %s\n", simd_get()->name);
     printf("Execution time: %f ms\n", execution_time);
+    matrix_file_save_env("MATRIX_C", rows, cols, result);
 
     // Free allocated memory
-    free(matrix_1);
-    free(matrix_2);
+    if (loaded) {
+        matrix_file_close(&file_1);
+        matrix_file_close(&file_2);
+    } else {
+        free(matrix_1);
+        free(matrix_2);
+    }
     free(result);
 
     return 0;
@@ -1,8 +1,24 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <CL/cl.h>
-
-#define MAX_SOURCE_SIZE (0x100000)
+#include "../common/cl_autotune.c"
+#include "../common/cl_source.c"
+#include "../common/cl_cache.c"
+#include "../common/cl_profile.c"
+#include "../common/trace.c"
+#include "../common/cl_trace.c"
+#include "../common/cl_runtime.c"
+#include "../common/cl_buffer.c"
+#include "../common/mapped_file.c"
+#include "../common/matrix_file.c"
+
+// Candidate launch parameters for add_matrix_vec; the first value of each list
+// is the default when tuning is off, except that the vector width of the
+// device profile goes first
+static const int vector_widths[] = {4, 1, 2, 8, 16};       // VW: floats per load/store
+static const int group_sizes[] = {256, 64, 128, 512, 1024}; // LS: work-group size
+static const int groups_per_unit[] = {8, 2, 4, 16, 32};     // GPU: work-groups per compute unit
 
 void checkError(cl_int error, const char *message) {
     if (error != CL_SUCCESS) {
@@ -11,176 +27,213 @@ void checkError(cl_int error, const char *message) {
     }
 }
 
-// Get OpenCL CUDA Information 
+// Capability profile of the runtime's device (see common/cl_profile.h)
 int opencl_cuda_info() {
-    #define MAX_INFO_SIZE 1024 
-    cl_platform_id platform;
-    cl_device_id device;
-    cl_uint num_platforms, num_devices;
-
-    // Get the number of OpenCL platforms
-    clGetPlatformIDs(1, &platform, &num_platforms);
-
-    // Get the platform name
-    char platform_name[MAX_INFO_SIZE];
-    clGetPlatformInfo(platform, CL_PLATFORM_NAME, MAX_INFO_SIZE, platform_name, NULL);
-    printf("OpenCL Platform: %s\n", platform_name);
-
-    // Get the platform version
-    char platform_version[MAX_INFO_SIZE];
-    clGetPlatformInfo(platform, CL_PLATFORM_VERSION, MAX_INFO_SIZE, platform_version, NULL);
-    printf("OpenCL Platform Version: %s\n", platform_version);
-
-    // Get the number of OpenCL devices
-    clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 1, &device, &num_devices);
-
-    // Get the device name
-    char device_name[MAX_INFO_SIZE];
-    clGetDeviceInfo(device, CL_DEVICE_NAME, MAX_INFO_SIZE, device_name, NULL);
-    printf("OpenCL Device: %s\n", device_name);
-
-    // Get the device version
-    char device_version[MAX_INFO_SIZE];
-    clGetDeviceInfo(device, CL_DEVICE_VERSION, MAX_INFO_SIZE, device_version, NULL);
-    printf("OpenCL Device Version: %s\n", device_version);
-
-    // Get the number of compute units
-    cl_uint num_compute_units;
-    clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &num_compute_units, NULL);
-    printf("OpenCL Device Compute Units: %u\n", num_compute_units);
-
+    cl_profile profile;
+    cl_profile_query(cl_runtime_get()->device, &profile);
+    cl_profile_print(&profile, stdout);
     return 0;
 }
 
-int main() {
-    int rows = 100;
-    int cols = 100;
+double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1.0e3 + now.tv_nsec * 1.0e-6;
+}
 
-    // Allocate memory for matrices
-    float *matrix_1 = (float *)malloc(rows * cols * sizeof(float));
-    float *matrix_2 = (float *)malloc(rows * cols * sizeof(float));
-    float *result = (float *)malloc(rows * cols * sizeof(float));
+// add_matrix_vec with the vector width baked in, built once per width by the runtime
+cl_kernel add_kernel(int vector_width) {
+    char build_options[32];
+    snprintf(build_options, sizeof(build_options), "-DVW=%d", vector_width);
+    return cl_runtime_kernel("add_matrix.cl", build_options, "add_matrix_vec");
+}
 
-    // Populate matrices with random values (for testing)
-    for (int i = 0; i < rows * cols; i++) {
-        matrix_1[i] = (float)(rand() % 100);
-        matrix_2[i] = (float)(rand() % 100);
-    }
+// Enough work-groups to fill the device; the grid-stride loop covers the rest
+void add_launch_size(cl_device_id device_id, const autotune_config *config, int num_elements,
+                     size_t *global_size, size_t *local_size) {
+    cl_uint compute_units;
+    clGetDeviceInfo(device_id, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+
+    size_t vector_width = autotune_value(config, "VW", 4);
+    *local_size = autotune_value(config, "LS", 256);
+    size_t needed = ((num_elements + vector_width - 1) / vector_width + *local_size - 1) / *local_size;
+    size_t groups = (size_t)compute_units * autotune_value(config, "GPU", 8);
+    if (groups > needed) groups = needed;
+    if (groups < 1) groups = 1;
+    *global_size = groups * *local_size;
+}
 
-    // Load kernel source code
-    FILE *kernel_file = fopen("add_matrix.cl", "r");
-    if (!kernel_file) {
-        fprintf(stderr, "Failed to open kernel file.\n");
-        exit(EXIT_FAILURE);
+typedef struct {
+    cl_mem matrix_1, matrix_2, result;
+    int num_elements;
+} add_tuning;
+
+// autotune_measure_fn: time add_matrix_vec for one vector width and launch shape.
+// Each width is built once and stays registered, so the final lookup is free.
+double measure_add(const autotune_config *config, void *user) {
+    add_tuning *t = (add_tuning *)user;
+    cl_runtime *runtime = cl_runtime_get();
+    size_t max_work_group;
+    clGetDeviceInfo(runtime->device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_work_group), &max_work_group, NULL);
+    size_t global_size, local_size;
+    add_launch_size(runtime->device, config, t->num_elements, &global_size, &local_size);
+    if (local_size > max_work_group) {
+        return -1.0;
     }
-    char *kernel_source;
-    kernel_source = (char *)malloc(MAX_SOURCE_SIZE);
-    size_t kernel_size = fread(kernel_source, 1, MAX_SOURCE_SIZE, kernel_file);
-    fclose(kernel_file);
-
-    // Initialize OpenCL
-    cl_platform_id platform_id = NULL;
-    cl_device_id device_id = NULL;
-    cl_uint num_platforms, num_devices;
-    cl_int err;
 
-    // Get platform and device information
-    err = clGetPlatformIDs(1, &platform_id, &num_platforms);
-    checkError(err, "Failed to get platform ID");
-
-    err = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_GPU, 1, &device_id, &num_devices);
-    checkError(err, "Failed to get device ID");
+    cl_kernel kernel = add_kernel(autotune_value(config, "VW", 4));
+    if (!kernel) {
+        return -1.0;
+    }
+    cl_int err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &t->matrix_1);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &t->matrix_2);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &t->result);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &t->num_elements);
+    if (err != CL_SUCCESS) {
+        return -1.0;
+    }
+    return autotune_time_kernel(runtime->queue, kernel, 1, &global_size, &local_size, 2, 5);
+}
 
-    // Create an OpenCL context
-    cl_context context = clCreateContext(NULL, 1, &device_id, NULL, NULL, &err);
-    checkError(err, "Failed to create context");
+// Usage: matrix_addition_opencl [rows cols]
+// MATRIX_A and MATRIX_B name .mat files (common/matrix_file.h) to add instead
+// of random matrices, and set the shape; MATRIX_C saves the result.
+int main(int argc, char **argv) {
+    int rows = 100;
+    int cols = 100;
+    if (argc > 2) {
+        rows = atoi(argv[1]);
+        cols = atoi(argv[2]);
+    }
+    matrix_file file_1, file_2;
+    const float *loaded_1 = matrix_file_from_env("MATRIX_A", &file_1, &rows, &cols);
+    int rows_2 = rows, cols_2 = cols;
+    const float *loaded_2 = matrix_file_from_env("MATRIX_B", &file_2, &rows_2, &cols_2);
+    if (!loaded_1 != !loaded_2 || rows_2 != rows || cols_2 != cols) {
+        fprintf(stderr, "MATRIX_A and MATRIX_B must both be set, to matrices of the same shape\n");
+        exit(EXIT_FAILURE);
+    }
 
-    // Create a command queue
-    cl_command_queue command_queue = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &err);
-    checkError(err, "Failed to create command queue");
+    // Platform, device, context and queue come from the shared runtime
+    cl_int err;
+    cl_runtime *runtime = cl_runtime_get();
+    cl_device_id device_id = runtime->device;
+    cl_context context = runtime->context;
+    cl_command_queue command_queue = runtime->queue;
 
-    // Create memory buffers on the device for each matrix
-    cl_mem matrix_1_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, rows * cols * sizeof(float), NULL, &err);
+    // Buffers the host fills and reads in place: zero-copy on devices that
+    // share memory with the host, pinned staging otherwise
+    int num_elements = rows * cols;
+    size_t bytes = (size_t)num_elements * sizeof(float);
+    cl_buffer matrix_1, matrix_2, result;
+    err = cl_buffer_create(&matrix_1, context, device_id, command_queue, CL_MEM_READ_ONLY, bytes);
     checkError(err, "Failed to create buffer for matrix 1");
 
-    cl_mem matrix_2_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, rows * cols * sizeof(float), NULL, &err);
+    err = cl_buffer_create(&matrix_2, context, device_id, command_queue, CL_MEM_READ_ONLY, bytes);
     checkError(err, "Failed to create buffer for matrix 2");
 
-    cl_mem result_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, rows * cols * sizeof(float), NULL, &err);
+    err = cl_buffer_create(&result, context, device_id, command_queue, CL_MEM_WRITE_ONLY, bytes);
     checkError(err, "Failed to create buffer for result");
-
-    // Write matrices into the device memory
-    err = clEnqueueWriteBuffer(command_queue, matrix_1_buffer, CL_TRUE, 0, rows * cols * sizeof(float), matrix_1, 0, NULL, NULL);
-    checkError(err, "Failed to write matrix 1 to device");
-
-    err = clEnqueueWriteBuffer(command_queue, matrix_2_buffer, CL_TRUE, 0, rows * cols * sizeof(float), matrix_2, 0, NULL, NULL);
-    checkError(err, "Failed to write matrix 2 to device");
-
-    // Create a program from the kernel source
-    cl_program program = clCreateProgramWithSource(context, 1, (const char **)&kernel_source, (const size_t *)&kernel_size, &err);
-    checkError(err, "Failed to create program");
-
-    // Build the program
-    err = clBuildProgram(program, 1, &device_id, NULL, NULL, NULL);
-    if (err != CL_SUCCESS) {
-        size_t len;
-        char buffer[2048];
-        clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, &len);
-        fprintf(stderr, "Build error: %s\n", buffer);
+    cl_mem matrix_1_buffer = matrix_1.mem, matrix_2_buffer = matrix_2.mem, result_buffer = result.mem;
+
+    // Copy the input files, or populate matrices with random values (for
+    // testing), directly in the buffers
+    float *host_1 = (float *)cl_buffer_map(&matrix_1, command_queue, CL_MAP_WRITE_INVALIDATE_REGION, &err);
+    checkError(err, "Failed to map matrix 1");
+    float *host_2 = (float *)cl_buffer_map(&matrix_2, command_queue, CL_MAP_WRITE_INVALIDATE_REGION, &err);
+    checkError(err, "Failed to map matrix 2");
+    if (loaded_1) {
+        memcpy(host_1, loaded_1, bytes);
+        memcpy(host_2, loaded_2, bytes);
+        matrix_file_close(&file_1);
+        matrix_file_close(&file_2);
+    }
+    for (int i = 0; !loaded_1 && i < num_elements; i++) {
+        host_1[i] = (float)(rand() % 100);
+        host_2[i] = (float)(rand() % 100);
+    }
+    double upload_start = now_ms();
+    err = cl_buffer_unmap(&matrix_1, command_queue);
+    err |= cl_buffer_unmap(&matrix_2, command_queue);
+    checkError(err, "Failed to write matrices to device");
+    clFinish(command_queue);
+    double upload_time = now_ms() - upload_start;
+
+    // Pick vector width and launch shape: tuned database entry, fresh search, or defaults.
+    // The kernel walks the array with a grid-stride loop, so the best setup only
+    // depends on the size class, not the exact matrix shape.
+    cl_profile profile;
+    cl_profile_query(device_id, &profile);
+    int widths[5] = {cl_profile_vector_width(&profile)};
+    for (int i = 0, n = 1; i < 5 && n < 5; i++) {
+        if (vector_widths[i] != widths[0]) widths[n++] = vector_widths[i];
+    }
+    autotune_param params[] = {{"VW", widths, 5}, {"LS", group_sizes, 5}, {"GPU", groups_per_unit, 5}};
+    add_tuning tuning = {matrix_1_buffer, matrix_2_buffer, result_buffer, num_elements};
+    int size_class = 1;
+    while (size_class < num_elements) size_class *= 2;
+    char tuning_key[64];
+    snprintf(tuning_key, sizeof(tuning_key), "add_matrix_vec/%d", size_class);
+    autotune_config config;
+    autotune_get(device_id, tuning_key, params, 3, measure_add, &tuning, &config);
+
+    // The kernel for the chosen width; already built if the tuner just ran
+    cl_kernel kernel = add_kernel(autotune_value(&config, "VW", 4));
+    if (!kernel) {
         exit(1);
     }
 
-    // Create the OpenCL kernel
-    cl_kernel kernel = clCreateKernel(program, "add_matrix", &err);
-    checkError(err, "Failed to create kernel");
-
-    // Set the arguments of the kernel
-    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *)&matrix_1_buffer);
-    checkError(err, "Failed to set kernel argument 0");
-
-    err = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *)&matrix_2_buffer);
-    checkError(err, "Failed to set kernel argument 1");
-
-    err = clSetKernelArg(kernel, 2, sizeof(cl_mem), (void *)&result_buffer);
-    checkError(err, "Failed to set kernel argument 2");
-
-    int num_elements = rows * cols;
-
     // Execute the OpenCL kernel
-    size_t global_size[2] = {rows, cols};
-    size_t local_size[2] = {10, 10}; // For example, you can adjust this as needed
+    size_t global_size, local_size;
+    add_launch_size(device_id, &config, num_elements, &global_size, &local_size);
+    printf("Vector width: %d, work-group size: %zu, work-groups: %zu\n",
+           autotune_value(&config, "VW", 4), local_size, global_size / local_size);
 
+    cl_runtime_arg args[] = {CL_RUNTIME_ARG(matrix_1_buffer), CL_RUNTIME_ARG(matrix_2_buffer),
+                             CL_RUNTIME_ARG(result_buffer), CL_RUNTIME_ARG(num_elements)};
     cl_event event;
-    err = clEnqueueNDRangeKernel(command_queue, kernel, 2, NULL, global_size, local_size, 0, NULL, &event);
+    err = cl_runtime_dispatch(kernel, 1, &global_size, &local_size, 4, args, &event);
     checkError(err, "Failed to execute kernel");
+    double execution_time = cl_runtime_event_ms(event);
 
-    // Profiling
-    clWaitForEvents(1, &event);
-    cl_ulong start_time, end_time;
-    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_time, NULL);
-    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, NULL);
-    double execution_time = (end_time - start_time) * 1.0e-6; // Convert nanoseconds to milliseconds
+    // A repeated operation only looks the kernel up and enqueues it
+    double dispatch_start = now_ms();
+    kernel = add_kernel(autotune_value(&config, "VW", 4));
+    err = cl_runtime_dispatch(kernel, 1, &global_size, &local_size, 4, args, NULL);
+    double dispatch_time = now_ms() - dispatch_start;
+    checkError(err, "Failed to execute kernel");
+    clFinish(command_queue);
 
     opencl_cuda_info();
-    printf("Execution time on device: %f ms\n", execution_time);
-
-    // Read the result buffer back to the host
-    err = clEnqueueReadBuffer(command_queue, result_buffer, CL_TRUE, 0, num_elements * sizeof(float), result, 0, NULL, NULL);
+    printf("Execution time on device: %f ms (%.2f GB/s)\n", execution_time,
+           3.0 * num_elements * sizeof(float) / (execution_time * 1.0e6));
+    printf("Runtime setup: %.3f ms, %d program builds (%d cached): %.3f ms, repeated lookup + dispatch: %.3f ms\n",
+           runtime->init_ms, runtime->programs_built, runtime->programs_cached, runtime->build_ms, dispatch_time);
+
+    // Map the result back to the host
+    double download_start = now_ms();
+    float *host_result = (float *)cl_buffer_map(&result, command_queue, CL_MAP_READ, &err);
     checkError(err, "Failed to read result buffer");
+    double download_time = now_ms() - download_start;
+    printf("Buffers: %s, upload %.3f ms, result map %.3f ms\n",
+           result.zero_copy ? "zero-copy" : "pinned staging", upload_time, download_time);
+
+    // Check against the host
+    host_1 = (float *)cl_buffer_map(&matrix_1, command_queue, CL_MAP_READ, &err);
+    checkError(err, "Failed to map matrix 1");
+    host_2 = (float *)cl_buffer_map(&matrix_2, command_queue, CL_MAP_READ, &err);
+    checkError(err, "Failed to map matrix 2");
+    int mismatches = 0;
+    for (int i = 0; i < num_elements; i++) {
+        if (host_result[i] != host_1[i] + host_2[i]) mismatches++;
+    }
+    printf("Mismatches: %d\n", mismatches);
+    matrix_file_save_env("MATRIX_C", rows, cols, host_result);
 
-    // Free OpenCL resources
-    clReleaseMemObject(matrix_1_buffer);
-    clReleaseMemObject(matrix_2_buffer);
-    clReleaseMemObject(result_buffer);
-    clReleaseProgram(program);
-    clReleaseKernel(kernel);
-    clReleaseCommandQueue(command_queue);
-    clReleaseContext(context);
-
-    // Free allocated memory
-    free(matrix_1);
-    free(matrix_2);
-    free(result);
+    // Free OpenCL resources (this also unmaps)
+    cl_buffer_release(&matrix_1);
+    cl_buffer_release(&matrix_2);
+    cl_buffer_release(&result);
 
     return 0;
 }
@@ -0,0 +1,248 @@
+#include "thread_pool.c"
+#include "simd_kernels.c"
+#include "gemm.c"
+#include "../common/bench.c"
+#include "../common/cl_source.c"
+#include "../common/cl_cache.c"
+#include "../common/cl_profile.c"
+#include "../common/trace.c"
+#include "../common/cl_trace.c"
+#include "../common/cl_runtime.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <CL/cl.h>
+
+#define BATCH_GROUP_SIZE 256 // work-items per group, shared by the products of the group
+
+// Many small independent products in one launch (device) and one parallel
+// call (host), instead of one call with a fresh buffer set per product.
+//
+// Usage: matrix_batched_opencl [M N K] [batch] [strided|indexed]
+// A is M x N, B is N x K and C is M x K, as in matrix_multiplication_opencl.
+// "indexed" passes every product through an offset table in reverse order,
+// the device counterpart of a pointer-array batch.
+
+void checkError(cl_int error, const char *message) {
+    if (error != CL_SUCCESS) {
+        fprintf(stderr, "%s: %d\n", message, error);
+        exit(EXIT_FAILURE);
+    }
+}
+
+double event_time_ms(cl_event event) {
+    cl_ulong time_start, time_end;
+    clWaitForEvents(1, &event);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+    clReleaseEvent(event);
+    return (double)(time_end - time_start) * 1e-6;
+}
+
+int main(int argc, char **argv) {
+    int M = 16, N = 16, K = 16;
+    int batch = 4096;
+    int indexed = 0;
+    int arg = 1;
+    if (argc > 3) {
+        M = atoi(argv[1]);
+        N = atoi(argv[2]);
+        K = atoi(argv[3]);
+        arg = 4;
+    }
+    if (argc > arg) {
+        batch = atoi(argv[arg++]);
+    }
+    if (argc > arg) {
+        indexed = strcmp(argv[arg], "indexed") == 0;
+    }
+    if (M <= 0 || N <= 0 || K <= 0 || batch <= 0) {
+        fprintf(stderr, "Matrix dimensions and batch size must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // One contiguous allocation per operand, products stored back to back
+    int stride_a = M * N, stride_b = N * K, stride_c = M * K;
+    float *A = gemm_alloc((size_t)stride_a * batch);
+    float *B = gemm_alloc((size_t)stride_b * batch);
+    float *C = gemm_alloc((size_t)stride_c * batch);
+    float *reference = gemm_alloc((size_t)stride_c * batch);
+    for (size_t i = 0; i < (size_t)stride_a * batch; i++) {
+        A[i] = (float)(rand() % 100) / 100.0f;
+    }
+    for (size_t i = 0; i < (size_t)stride_b * batch; i++) {
+        B[i] = (float)(rand() % 100) / 100.0f;
+    }
+
+    // Product b of an indexed batch uses the operands stored at batch - 1 - b
+    int *offsets = (int *)malloc(3 * batch * sizeof(int));
+    const float **A_array = (const float **)malloc(batch * sizeof(float *));
+    const float **B_array = (const float **)malloc(batch * sizeof(float *));
+    float **C_array = (float **)malloc(batch * sizeof(float *));
+    for (int b = 0; b < batch; b++) {
+        int slot = indexed ? batch - 1 - b : b;
+        offsets[3 * b] = slot * stride_a;
+        offsets[3 * b + 1] = slot * stride_b;
+        offsets[3 * b + 2] = slot * stride_c;
+        A_array[b] = A + offsets[3 * b];
+        B_array[b] = B + offsets[3 * b + 1];
+        C_array[b] = reference + offsets[3 * b + 2];
+    }
+
+    // Host: the whole batch in one call, spread over the worker pool.
+    // The host GEMM is C (M x N) = A (M x K) * B (K x N), hence the swapped N and K.
+    thread_pool *pool = thread_pool_default();
+    double start = bench_now_ms();
+    if (indexed) {
+        gemm_batched(pool, M, K, N, A_array, N, B_array, K, C_array, K, batch);
+    } else {
+        gemm_batched_strided(pool, M, K, N, A, N, stride_a, B, K, stride_b, reference, K, stride_c, batch);
+    }
+    double host_time_ms = bench_now_ms() - start;
+    double flops = 2.0 * M * N * K * batch;
+    printf("Batch: %d products of %d x %d x %d, %s\n", batch, M, N, K, indexed ? "indexed" : "strided");
+    printf("Host Execution Time: %.3f ms (%.2f GFLOP/s, %d threads)\n", host_time_ms,
+           flops / (host_time_ms * 1.0e6), thread_pool_size(pool));
+
+    // Kernel source, embedded at build time (see common/cl_source.h)
+    const cl_source *kernel_source = cl_source_get("multiply_matrix.cl");
+    const char *source_str = kernel_source->source;
+    size_t source_size = kernel_source->size;
+
+    // The shared runtime's device: the first GPU, else any device, or the
+    // type in CL_RUNTIME_DEVICE (see common/cl_runtime.h)
+    cl_runtime *runtime = cl_runtime_get();
+    cl_device_id device_id = runtime->device;
+    cl_context context = runtime->context;
+    cl_command_queue command_queue = runtime->queue;
+    cl_int ret;
+
+    // Pack as many products into a work-group as its work-items can cover,
+    // as long as their operands fit in local memory
+    size_t max_work_group;
+    cl_ulong local_mem;
+    clGetDeviceInfo(device_id, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_work_group), &max_work_group, NULL);
+    clGetDeviceInfo(device_id, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem), &local_mem, NULL);
+    size_t local_size = max_work_group < BATCH_GROUP_SIZE ? max_work_group : BATCH_GROUP_SIZE;
+    size_t product_bytes = (size_t)(stride_a + stride_b) * sizeof(float);
+    int per_group = (int)(local_size / stride_c);
+    if (per_group < 1) per_group = 1;
+    if (per_group > batch) per_group = batch;
+    while (per_group > 1 && (cl_ulong)(per_group * product_bytes) > local_mem) per_group--;
+    if ((cl_ulong)product_bytes > local_mem) {
+        fprintf(stderr, "One %d x %d x %d product needs %zu bytes of local memory, the device has %lu\n",
+                M, N, K, product_bytes, (unsigned long)local_mem);
+        exit(EXIT_FAILURE);
+    }
+    size_t num_groups = (batch + per_group - 1) / per_group;
+    size_t global_size = num_groups * local_size;
+
+    // Create memory buffers on the device
+    cl_mem memobjA = clCreateBuffer(context, CL_MEM_READ_ONLY, (size_t)stride_a * batch * sizeof(float), NULL, &ret);
+    cl_mem memobjB = clCreateBuffer(context, CL_MEM_READ_ONLY, (size_t)stride_b * batch * sizeof(float), NULL, &ret);
+    cl_mem memobjC = clCreateBuffer(context, CL_MEM_WRITE_ONLY, (size_t)stride_c * batch * sizeof(float), NULL, &ret);
+    cl_mem memobjOffsets = NULL;
+    if (indexed) {
+        memobjOffsets = clCreateBuffer(context, CL_MEM_READ_ONLY, 3 * batch * sizeof(int), NULL, &ret);
+    }
+    checkError(ret, "Failed to create buffers");
+
+    // Copy the whole batch to the device in one transfer per operand
+    cl_event write_events[3];
+    ret = clEnqueueWriteBuffer(command_queue, memobjA, CL_FALSE, 0, (size_t)stride_a * batch * sizeof(float), A, 0, NULL, &write_events[0]);
+    cl_trace_command("write A", command_queue, &write_events[0], ret);
+    checkError(ret, "Failed to write data to device");
+    ret = clEnqueueWriteBuffer(command_queue, memobjB, CL_FALSE, 0, (size_t)stride_b * batch * sizeof(float), B, 0, NULL, &write_events[1]);
+    cl_trace_command("write B", command_queue, &write_events[1], ret);
+    checkError(ret, "Failed to write data to device");
+    if (indexed) {
+        ret = clEnqueueWriteBuffer(command_queue, memobjOffsets, CL_FALSE, 0, 3 * batch * sizeof(int), offsets, 0, NULL, &write_events[2]);
+        cl_trace_command("write offsets", command_queue, &write_events[2], ret);
+        checkError(ret, "Failed to write data to device");
+    }
+    double transfer_ms = event_time_ms(write_events[0]) + event_time_ms(write_events[1]);
+    if (indexed) {
+        transfer_ms += event_time_ms(write_events[2]);
+    }
+
+    // Build the program, or load it from the binary cache (common/cl_cache.h)
+    cl_program program = cl_cache_build(context, device_id, source_str, source_size, kernel_source->hash, NULL,
+                                        &ret, NULL);
+    if (!program) {
+        checkError(ret, "Failed to create program");
+    }
+    if (ret != CL_SUCCESS) {
+        char build_log[2048];
+        clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, sizeof(build_log), build_log, NULL);
+        fprintf(stderr, "Error in kernel build:\n%s\n", build_log);
+        exit(1);
+    }
+
+    cl_kernel kernel = clCreateKernel(program, "multiply_matrix_batched", &ret);
+    checkError(ret, "Failed to create kernel");
+
+    // Set the arguments of the kernel; a NULL offset table selects the strided layout
+    ret = clSetKernelArg(kernel, 0, sizeof(int), &M);
+    ret |= clSetKernelArg(kernel, 1, sizeof(int), &N);
+    ret |= clSetKernelArg(kernel, 2, sizeof(int), &K);
+    ret |= clSetKernelArg(kernel, 3, sizeof(int), &batch);
+    ret |= clSetKernelArg(kernel, 4, sizeof(int), &per_group);
+    ret |= clSetKernelArg(kernel, 5, sizeof(cl_mem), &memobjA);
+    ret |= clSetKernelArg(kernel, 6, sizeof(int), &stride_a);
+    ret |= clSetKernelArg(kernel, 7, sizeof(cl_mem), &memobjB);
+    ret |= clSetKernelArg(kernel, 8, sizeof(int), &stride_b);
+    ret |= clSetKernelArg(kernel, 9, sizeof(cl_mem), &memobjC);
+    ret |= clSetKernelArg(kernel, 10, sizeof(int), &stride_c);
+    ret |= clSetKernelArg(kernel, 11, sizeof(cl_mem), indexed ? &memobjOffsets : NULL);
+    ret |= clSetKernelArg(kernel, 12, per_group * product_bytes, NULL);
+    checkError(ret, "Failed to set kernel arguments");
+
+    // One launch for the whole batch
+    cl_event event;
+    ret = clEnqueueNDRangeKernel(command_queue, kernel, 1, NULL, &global_size, &local_size, 0, NULL, &event);
+    cl_trace_command("multiply_matrix_batched", command_queue, &event, ret);
+    checkError(ret, "Failed to enqueue NDRange kernel");
+    double kernel_ms = event_time_ms(event);
+
+    cl_event read_event;
+    ret = clEnqueueReadBuffer(command_queue, memobjC, CL_TRUE, 0, (size_t)stride_c * batch * sizeof(float), C, 0, NULL, &read_event);
+    cl_trace_command("read C", command_queue, &read_event, ret);
+    checkError(ret, "Failed to read output array C");
+    transfer_ms += event_time_ms(read_event);
+
+    printf("Products per work-group: %d, work-groups: %zu, work-group size: %zu\n", per_group, num_groups, local_size);
+    printf("Kernel Execution Time: %0.3f ms (%.2f GFLOP/s, %.3f us per product)\n", kernel_ms,
+           flops / (kernel_ms * 1.0e6), kernel_ms * 1.0e3 / batch);
+    printf("Transfer Time: %0.3f ms\n", transfer_ms);
+
+    // Compare every product with the host batch
+    double max_error = 0.0;
+    for (size_t i = 0; i < (size_t)stride_c * batch; i++) {
+        double error = fabs((double)C[i] - reference[i]) / (fabs(reference[i]) + 1.0);
+        if (error > max_error) max_error = error;
+    }
+    printf("Max relative error vs host: %g\n", max_error);
+
+    // Cleanup
+    ret = clReleaseKernel(kernel);
+    ret |= clReleaseProgram(program);
+    ret |= clReleaseMemObject(memobjA);
+    ret |= clReleaseMemObject(memobjB);
+    ret |= clReleaseMemObject(memobjC);
+    if (memobjOffsets) {
+        ret |= clReleaseMemObject(memobjOffsets);
+    }
+    checkError(ret, "Failed during cleanup");
+
+    gemm_free(A);
+    gemm_free(B);
+    gemm_free(C);
+    gemm_free(reference);
+    free(offsets);
+    free(A_array);
+    free(B_array);
+    free(C_array);
+
+    return 0;
+}
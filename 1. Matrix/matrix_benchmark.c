@@ -0,0 +1,460 @@
+#include "thread_pool.c"
+#include "simd_kernels.c"
+#include "gemm.c"
+#include "strassen.c"
+#include "../common/bench.c"
+#include "../common/cl_autotune.c"
+#include "../common/cl_source.c"
+#include "../common/cl_cache.c"
+#include "../common/cl_profile.c"
+#include "../common/trace.c"
+#include "../common/cl_trace.c"
+#include "../common/cl_runtime.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <CL/cl.h>
+
+// Benchmark driver for the matrix programs. Every configuration runs a few
+// warm-up calls and then a number of timed repetitions; results go to stdout
+// (or --output) as CSV or JSON, one record per op/backend/size.
+//
+// Usage: matrix_benchmark [--op add|gemm|strassen|all] [--backend host|opencl|all]
+//                         [--sizes 64,128,...] [--warmup W] [--reps N]
+//                         [--format csv|json] [--output file]
+// OpenCL runs need add_matrix.cl and multiply_matrix.cl in the working directory.
+
+#define MAX_SIZES 32
+
+typedef struct {
+    int warmup;
+    int reps;
+    bench_writer writer;
+} bench_options;
+
+float *random_matrix(size_t count) {
+    float *matrix = gemm_alloc(count);
+    for (size_t i = 0; i < count; i++) {
+        matrix[i] = (float)rand() / RAND_MAX;
+    }
+    return matrix;
+}
+
+// ---------------------------------------------------------------- host
+
+void bench_host_add(int n, bench_options *opts) {
+    size_t count = (size_t)n * n;
+    float *x = random_matrix(count), *y = random_matrix(count), *result = gemm_alloc(count);
+    double *samples = (double *)malloc(opts->reps * sizeof(double));
+    const simd_kernels *kernels = simd_get();
+
+    for (int r = 0; r < opts->warmup + opts->reps; r++) {
+        double start = bench_now_ms();
+        kernels->add(result, x, y, count);
+        double elapsed = bench_now_ms() - start;
+        if (r >= opts->warmup) samples[r - opts->warmup] = elapsed;
+    }
+
+    bench_record record = {.op = "add", .backend = "host", .variant = kernels->name,
+                           .M = n, .N = n, .K = 0, .reps = opts->reps,
+                           .flops = (double)count, .bytes = 3.0 * count * sizeof(float)};
+    record.kernel = bench_summarize(samples, opts->reps);
+    record.total = record.kernel;
+    bench_write(&opts->writer, &record);
+
+    free(samples);
+    gemm_free(x);
+    gemm_free(y);
+    gemm_free(result);
+}
+
+void bench_host_gemm(int n, bench_options *opts) {
+    size_t count = (size_t)n * n;
+    float *A = random_matrix(count), *B = random_matrix(count), *C = gemm_alloc(count);
+    double *samples = (double *)malloc(opts->reps * sizeof(double));
+
+    for (int r = 0; r < opts->warmup + opts->reps; r++) {
+        double start = bench_now_ms();
+        gemm_parallel(NULL, n, n, n, A, n, B, n, C, n);
+        double elapsed = bench_now_ms() - start;
+        if (r >= opts->warmup) samples[r - opts->warmup] = elapsed;
+    }
+
+    bench_record record = {.op = "gemm", .backend = "host", .variant = simd_get()->name,
+                           .M = n, .N = n, .K = n, .reps = opts->reps,
+                           .flops = 2.0 * n * n * n, .bytes = 3.0 * count * sizeof(float)};
+    record.kernel = bench_summarize(samples, opts->reps);
+    record.total = record.kernel;
+    bench_write(&opts->writer, &record);
+
+    free(samples);
+    gemm_free(A);
+    gemm_free(B);
+    gemm_free(C);
+}
+
+// Normwise error of a result against a reference
+double relative_error(const float *result, const float *reference, size_t count) {
+    double max_diff = 0.0, max_ref = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        double diff = fabs((double)result[i] - reference[i]);
+        if (diff > max_diff) max_diff = diff;
+        if (fabs(reference[i]) > max_ref) max_ref = fabs(reference[i]);
+    }
+    return max_ref > 0.0 ? max_diff / max_ref : max_diff;
+}
+
+// Strassen-Winograd against the blocked GEMM, which also serves as the
+// accuracy reference. Sizes at or below STRASSEN_CUTOFF run the blocked kernel.
+void bench_host_strassen(int n, bench_options *opts) {
+    size_t count = (size_t)n * n;
+    float *A = random_matrix(count), *B = random_matrix(count), *C = gemm_alloc(count);
+    float *reference = gemm_alloc(count);
+    double *samples = (double *)malloc(opts->reps * sizeof(double));
+    strassen_arena arena;
+    if (strassen_arena_init(&arena, strassen_workspace_size(n, n, n, STRASSEN_CUTOFF)) != 0) {
+        fprintf(stderr, "Failed to allocate Strassen workspace\n");
+        exit(EXIT_FAILURE);
+    }
+
+    gemm_parallel(NULL, n, n, n, A, n, B, n, reference, n);
+    for (int r = 0; r < opts->warmup + opts->reps; r++) {
+        double start = bench_now_ms();
+        gemm_strassen(NULL, n, n, n, A, n, B, n, C, n, STRASSEN_CUTOFF, &arena);
+        double elapsed = bench_now_ms() - start;
+        if (r >= opts->warmup) samples[r - opts->warmup] = elapsed;
+    }
+
+    // Rates count the classical 2n^3 flops so they compare directly with "gemm"
+    bench_record record = {.op = "gemm", .backend = "host", .variant = "strassen",
+                           .M = n, .N = n, .K = n, .reps = opts->reps,
+                           .flops = 2.0 * n * n * n, .bytes = 3.0 * count * sizeof(float)};
+    record.kernel = bench_summarize(samples, opts->reps);
+    record.total = record.kernel;
+    record.has_error = 1;
+    record.max_error = relative_error(C, reference, count);
+    bench_write(&opts->writer, &record);
+
+    strassen_arena_release(&arena);
+    free(samples);
+    gemm_free(A);
+    gemm_free(B);
+    gemm_free(C);
+    gemm_free(reference);
+}
+
+// ---------------------------------------------------------------- OpenCL
+
+typedef struct {
+    cl_device_id device_id;
+    cl_context context;
+    cl_command_queue queue;
+    const cl_source *add_source;
+    const cl_source *gemm_source;
+} opencl_state;
+
+// Returns -1 (and the benchmark skips OpenCL) if there is no platform. The
+// device is the shared runtime's: the first GPU, else any device, or the type
+// in CL_RUNTIME_DEVICE (see common/cl_runtime.h).
+int opencl_setup(opencl_state *cl) {
+    cl_uint num_platforms = 0;
+    if (clGetPlatformIDs(0, NULL, &num_platforms) != CL_SUCCESS || num_platforms == 0) {
+        return -1;
+    }
+    cl_runtime *runtime = cl_runtime_get();
+    cl->device_id = runtime->device;
+    cl->context = runtime->context;
+    cl->queue = runtime->queue;
+    cl->add_source = cl_source_get("add_matrix.cl");
+    cl->gemm_source = cl_source_get("multiply_matrix.cl");
+    return 0;
+}
+
+// Built through the binary cache (common/cl_cache.h), with the device profile defines
+cl_kernel build_kernel(opencl_state *cl, const cl_source *source, const char *options, const char *name,
+                       cl_program *program) {
+    cl_int err;
+    *program = cl_cache_build(cl->context, cl->device_id, source->source, source->size, source->hash, options,
+                              &err, NULL);
+    if (!*program) {
+        fprintf(stderr, "Failed to create program: %d\n", err);
+        exit(EXIT_FAILURE);
+    }
+    if (err != CL_SUCCESS) {
+        char build_log[2048];
+        clGetProgramBuildInfo(*program, cl->device_id, CL_PROGRAM_BUILD_LOG, sizeof(build_log), build_log, NULL);
+        fprintf(stderr, "Error in kernel build:\n%s\n", build_log);
+        exit(EXIT_FAILURE);
+    }
+    cl_kernel kernel = clCreateKernel(*program, name, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create kernel %s: %d\n", name, err);
+        exit(EXIT_FAILURE);
+    }
+    return kernel;
+}
+
+double event_ms(cl_event event) {
+    cl_ulong start = 0, end = 0;
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+    clReleaseEvent(event);
+    return (end - start) * 1.0e-6;
+}
+
+// Upload inputs, run the kernel, read the result back; fills one sample of each phase
+void opencl_round_trip(opencl_state *cl, cl_kernel kernel, cl_uint dims, const size_t *global_size,
+                       const size_t *local_size, cl_mem in_1, const float *host_1, size_t bytes_1,
+                       cl_mem in_2, const float *host_2, size_t bytes_2, cl_mem out, float *host_out,
+                       size_t bytes_out, double *transfer, double *kernel_time, double *total) {
+    cl_event write_1, write_2, run, read;
+    double start = bench_now_ms();
+    cl_int err = clEnqueueWriteBuffer(cl->queue, in_1, CL_FALSE, 0, bytes_1, host_1, 0, NULL, &write_1);
+    cl_trace_command("write A", cl->queue, &write_1, err);
+    if (err == CL_SUCCESS) {
+        err = clEnqueueWriteBuffer(cl->queue, in_2, CL_FALSE, 0, bytes_2, host_2, 0, NULL, &write_2);
+        cl_trace_command("write B", cl->queue, &write_2, err);
+    }
+    if (err == CL_SUCCESS) {
+        err = clEnqueueNDRangeKernel(cl->queue, kernel, dims, NULL, global_size, local_size, 0, NULL, &run);
+        if (trace_enabled()) {
+            char name[64] = "";
+            clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, sizeof(name) - 1, name, NULL);
+            cl_trace_command(name, cl->queue, &run, err);
+        }
+    }
+    if (err == CL_SUCCESS) {
+        err = clEnqueueReadBuffer(cl->queue, out, CL_TRUE, 0, bytes_out, host_out, 0, NULL, &read);
+        cl_trace_command("read C", cl->queue, &read, err);
+    }
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "OpenCL benchmark run failed: %d\n", err);
+        exit(EXIT_FAILURE);
+    }
+    *total = bench_now_ms() - start;
+    *transfer = event_ms(write_1) + event_ms(write_2) + event_ms(read);
+    *kernel_time = event_ms(run);
+}
+
+void bench_opencl_run(opencl_state *cl, bench_options *opts, bench_record *record, cl_kernel kernel,
+                      cl_uint dims, const size_t *global_size, const size_t *local_size,
+                      size_t count_1, size_t count_2, size_t count_out) {
+    cl_int err;
+    float *host_1 = random_matrix(count_1), *host_2 = random_matrix(count_2), *host_out = gemm_alloc(count_out);
+    cl_mem in_1 = clCreateBuffer(cl->context, CL_MEM_READ_ONLY, count_1 * sizeof(float), NULL, &err);
+    cl_mem in_2 = clCreateBuffer(cl->context, CL_MEM_READ_ONLY, count_2 * sizeof(float), NULL, &err);
+    cl_mem out = clCreateBuffer(cl->context, CL_MEM_WRITE_ONLY, count_out * sizeof(float), NULL, &err);
+
+    // add_matrix takes (x, y, result); the GEMM kernels take (M, N, K, A, B, C)
+    cl_uint first = strcmp(record->op, "gemm") == 0 ? 3 : 0;
+    err = clSetKernelArg(kernel, first, sizeof(cl_mem), &in_1);
+    err |= clSetKernelArg(kernel, first + 1, sizeof(cl_mem), &in_2);
+    err |= clSetKernelArg(kernel, first + 2, sizeof(cl_mem), &out);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Failed to set benchmark kernel arguments: %d\n", err);
+        exit(EXIT_FAILURE);
+    }
+
+    double *transfer = (double *)malloc(opts->reps * sizeof(double));
+    double *kernel_time = (double *)malloc(opts->reps * sizeof(double));
+    double *total = (double *)malloc(opts->reps * sizeof(double));
+    for (int r = 0; r < opts->warmup + opts->reps; r++) {
+        int i = r < opts->warmup ? 0 : r - opts->warmup;
+        opencl_round_trip(cl, kernel, dims, global_size, local_size,
+                          in_1, host_1, count_1 * sizeof(float), in_2, host_2, count_2 * sizeof(float),
+                          out, host_out, count_out * sizeof(float), &transfer[i], &kernel_time[i], &total[i]);
+    }
+    record->transfer = bench_summarize(transfer, opts->reps);
+    record->kernel = bench_summarize(kernel_time, opts->reps);
+    record->total = bench_summarize(total, opts->reps);
+    bench_write(&opts->writer, record);
+
+    free(transfer);
+    free(kernel_time);
+    free(total);
+    clReleaseMemObject(in_1);
+    clReleaseMemObject(in_2);
+    clReleaseMemObject(out);
+    gemm_free(host_1);
+    gemm_free(host_2);
+    gemm_free(host_out);
+}
+
+void bench_opencl_add(opencl_state *cl, int n, bench_options *opts) {
+    // Vector width and launch shape from the auto-tuning database, defaults otherwise
+    int num_elements = n * n;
+    int size_class = 1;
+    while (size_class < num_elements) size_class *= 2;
+    char device_key[AUTOTUNE_KEY_SIZE], tuning_key[64];
+    autotune_device_key(cl->device_id, device_key, sizeof(device_key));
+    snprintf(tuning_key, sizeof(tuning_key), "add_matrix_vec/%d", size_class);
+    autotune_config config;
+    if (autotune_lookup(device_key, tuning_key, &config) != 0) {
+        config.num_params = 0;
+    }
+    int vector_width = autotune_value(&config, "VW", 4);
+    char options[32];
+    snprintf(options, sizeof(options), "-DVW=%d", vector_width);
+
+    cl_program program;
+    cl_kernel kernel = build_kernel(cl, cl->add_source, options, "add_matrix_vec", &program);
+    cl_int err = clSetKernelArg(kernel, 3, sizeof(int), &num_elements);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Failed to set add size argument: %d\n", err);
+        exit(EXIT_FAILURE);
+    }
+
+    // Enough work-groups to fill the device, the grid-stride loop covers the rest
+    cl_uint compute_units;
+    clGetDeviceInfo(cl->device_id, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+    size_t local_size = autotune_value(&config, "LS", 256);
+    size_t needed = ((size_t)(num_elements + vector_width - 1) / vector_width + local_size - 1) / local_size;
+    size_t groups = (size_t)compute_units * autotune_value(&config, "GPU", 8);
+    if (groups > needed) groups = needed;
+    size_t global_size = groups * local_size;
+
+    size_t count = (size_t)num_elements;
+    bench_record record = {.op = "add", .backend = "opencl", .variant = "add_matrix_vec",
+                           .M = n, .N = n, .K = 0, .reps = opts->reps,
+                           .flops = (double)count, .bytes = 3.0 * count * sizeof(float)};
+    bench_opencl_run(cl, opts, &record, kernel, 1, &global_size, &local_size, count, count, count);
+
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+}
+
+void bench_opencl_gemm(opencl_state *cl, int n, bench_options *opts) {
+    // Tile sizes from the auto-tuning database, else the ones that fit this
+    // device (the same defaults multiply_matrix.cl and sgemm_opencl_init use)
+    cl_profile profile;
+    cl_profile_query(cl->device_id, &profile);
+    int ts, tsk, wptm, wptn;
+    cl_profile_gemm_tiles(&profile, &ts, &tsk, &wptm, &wptn);
+    char device_key[AUTOTUNE_KEY_SIZE], tuning_key[128];
+    autotune_device_key(cl->device_id, device_key, sizeof(device_key));
+    int size_class = 1;
+    while (size_class < n) size_class *= 2;
+    snprintf(tuning_key, sizeof(tuning_key), "multiply_matrix_tiled/%dx%dx%d", size_class, size_class, size_class);
+    autotune_config config;
+    if (autotune_lookup(device_key, tuning_key, &config) != 0) {
+        config.num_params = 0;
+    }
+    ts = autotune_value(&config, "TS", ts);
+    tsk = autotune_value(&config, "TSK", tsk);
+    wptm = autotune_value(&config, "WPTM", wptm);
+    wptn = autotune_value(&config, "WPTN", wptn);
+    char options[256];
+    snprintf(options, sizeof(options), "-DTSM=%d -DTSN=%d -DTSK=%d -DWPTM=%d -DWPTN=%d", ts, ts, tsk, wptm, wptn);
+
+    cl_program program;
+    cl_kernel kernel = build_kernel(cl, cl->gemm_source, options, "multiply_matrix_tiled", &program);
+    cl_int err = clSetKernelArg(kernel, 0, sizeof(int), &n);
+    err |= clSetKernelArg(kernel, 1, sizeof(int), &n);
+    err |= clSetKernelArg(kernel, 2, sizeof(int), &n);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Failed to set GEMM size arguments: %d\n", err);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t local_size[2] = {ts / wptn, ts / wptm};
+    size_t global_size[2] = {(size_t)(n + ts - 1) / ts * local_size[0], (size_t)(n + ts - 1) / ts * local_size[1]};
+    size_t count = (size_t)n * n;
+    bench_record record = {.op = "gemm", .backend = "opencl", .variant = "multiply_matrix_tiled",
+                           .M = n, .N = n, .K = n, .reps = opts->reps,
+                           .flops = 2.0 * n * n * n, .bytes = 3.0 * count * sizeof(float)};
+    bench_opencl_run(cl, opts, &record, kernel, 2, global_size, local_size, count, count, count);
+
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+}
+
+// ---------------------------------------------------------------- driver
+
+int parse_sizes(const char *text, int *sizes) {
+    int count = 0;
+    while (*text && count < MAX_SIZES) {
+        sizes[count] = atoi(text);
+        if (sizes[count] <= 0) {
+            return -1;
+        }
+        count++;
+        text = strchr(text, ',');
+        if (!text) break;
+        text++;
+    }
+    return count;
+}
+
+void usage(void) {
+    fprintf(stderr, "Usage: matrix_benchmark [--op add|gemm|strassen|all] [--backend host|opencl|all]\n"
+                    "                        [--sizes 64,128,...] [--warmup W] [--reps N]\n"
+                    "                        [--format csv|json] [--output file]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    const char *op = "all", *backend = "all", *output = NULL;
+    int sizes[MAX_SIZES] = {64, 128, 256, 512, 1024, 2048};
+    int num_sizes = 6;
+    bench_format format = BENCH_CSV;
+    bench_options opts;
+    opts.warmup = 2;
+    opts.reps = 10;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) usage();
+        if (strcmp(argv[i], "--op") == 0) {
+            op = argv[++i];
+        } else if (strcmp(argv[i], "--backend") == 0) {
+            backend = argv[++i];
+        } else if (strcmp(argv[i], "--sizes") == 0) {
+            num_sizes = parse_sizes(argv[++i], sizes);
+            if (num_sizes <= 0) usage();
+        } else if (strcmp(argv[i], "--warmup") == 0) {
+            opts.warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--reps") == 0) {
+            opts.reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--format") == 0) {
+            if (bench_parse_format(argv[++i], &format) != 0) usage();
+        } else if (strcmp(argv[i], "--output") == 0) {
+            output = argv[++i];
+        } else {
+            usage();
+        }
+    }
+    if (opts.reps <= 0 || opts.warmup < 0) usage();
+
+    int run_add = strcmp(op, "all") == 0 || strcmp(op, "add") == 0;
+    int run_gemm = strcmp(op, "all") == 0 || strcmp(op, "gemm") == 0;
+    int run_strassen = strcmp(op, "all") == 0 || strcmp(op, "strassen") == 0;
+    int run_host = strcmp(backend, "all") == 0 || strcmp(backend, "host") == 0;
+    int run_opencl = strcmp(backend, "all") == 0 || strcmp(backend, "opencl") == 0;
+
+    opencl_state cl;
+    if (run_opencl && opencl_setup(&cl) != 0) {
+        fprintf(stderr, "No usable OpenCL device, skipping OpenCL runs\n");
+        run_opencl = 0;
+    }
+
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Failed to open %s\n", output);
+        return 1;
+    }
+    bench_begin(&opts.writer, out, format);
+
+    for (int s = 0; s < num_sizes; s++) {
+        int n = sizes[s];
+        fprintf(stderr, "Size %d...\n", n);
+        if (run_add && run_host) bench_host_add(n, &opts);
+        if (run_add && run_opencl) bench_opencl_add(&cl, n, &opts);
+        if (run_gemm && run_host) bench_host_gemm(n, &opts);
+        if (run_gemm && run_opencl) bench_opencl_gemm(&cl, n, &opts);
+        if (run_strassen && run_host) bench_host_strassen(n, &opts);
+    }
+
+    bench_end(&opts.writer);
+    if (output) fclose(out);
+    return 0;
+}
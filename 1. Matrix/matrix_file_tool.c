@@ -0,0 +1,113 @@
+#include "thread_pool.c"
+#include "simd_kernels.c"
+#include "gemm.c"
+#include "../common/mapped_file.c"
+#include "../common/matrix_file.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Creates and inspects .mat files (common/matrix_file.h) for the matrix
+// programs, which load them through MATRIX_A, MATRIX_B and MATRIX_C.
+//
+// Usage: matrix_file_tool info file.mat
+//        matrix_file_tool random rows cols out.mat [f32|f64|f16|bf16|i8|i32]
+//        matrix_file_tool import raw.bin rows cols out.mat [dtype]
+// random writes values in [0, 1) (integers in [0, 100)) a row at a time,
+// import wraps raw row-major elements of dtype (f32 by default), also
+// streaming, so neither needs memory for the whole matrix.
+
+void usage(void) {
+    fprintf(stderr, "Usage: matrix_file_tool info file.mat\n"
+                    "       matrix_file_tool random rows cols out.mat [f32|f64|f16|bf16|i8|i32]\n"
+                    "       matrix_file_tool import raw.bin rows cols out.mat [dtype]\n");
+    exit(EXIT_FAILURE);
+}
+
+// One row of random values in dtype
+void random_row(void *row, const float *values, int cols, matrix_dtype dtype) {
+    for (int j = 0; j < cols; j++) {
+        switch (dtype) {
+        case MATRIX_F64: ((double *)row)[j] = values[j]; break;
+        case MATRIX_I8: ((int8_t *)row)[j] = (int8_t)(values[j] * 100.0f); break;
+        case MATRIX_I32: ((int32_t *)row)[j] = (int32_t)(values[j] * 100.0f); break;
+        default: break;
+        }
+    }
+    if (dtype == MATRIX_F32) memcpy(row, values, (size_t)cols * sizeof(float));
+    if (dtype == MATRIX_F16) gemm_convert_f16((uint16_t *)row, values, (size_t)cols);
+    if (dtype == MATRIX_BF16) gemm_convert_bf16((uint16_t *)row, values, (size_t)cols);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 2 && strcmp(argv[1], "info") == 0) {
+        matrix_file matrix;
+        if (matrix_file_load(&matrix, argv[2]) != 0) {
+            return 1;
+        }
+        const matrix_file_header *h = &matrix.header;
+        printf("%s: %llu x %llu %s, %s, payload %llu bytes at offset %llu (aligned to %u)\n", argv[2],
+               (unsigned long long)h->rows, (unsigned long long)h->cols, matrix_dtype_name((matrix_dtype)h->dtype),
+               h->layout == MATRIX_ROW_MAJOR ? "row-major" : "column-major", (unsigned long long)h->data_size,
+               (unsigned long long)h->data_offset, h->alignment);
+        matrix_file_close(&matrix);
+        return 0;
+    }
+
+    int import = argc > 5 && strcmp(argv[1], "import") == 0;
+    if (!import && !(argc > 4 && strcmp(argv[1], "random") == 0)) {
+        usage();
+    }
+    int first = import ? 3 : 2; // rows, cols, out, [dtype]
+    int rows = atoi(argv[first]), cols = atoi(argv[first + 1]);
+    const char *path = argv[first + 2];
+    matrix_dtype dtype = MATRIX_F32;
+    if (argc > first + 3 && matrix_dtype_parse(argv[first + 3], &dtype) != 0) {
+        return 1;
+    }
+    if (rows <= 0 || cols <= 0) {
+        fprintf(stderr, "Matrix dimensions must be positive\n");
+        return 1;
+    }
+
+    size_t row_bytes = (size_t)cols * matrix_dtype_size(dtype);
+    void *row = malloc(row_bytes);
+    float *values = (float *)malloc((size_t)cols * sizeof(float));
+    FILE *in = NULL;
+    if (import) {
+        in = fopen(argv[2], "rb");
+        if (!in) {
+            perror(argv[2]);
+            return 1;
+        }
+    }
+    matrix_file_writer writer;
+    if (matrix_file_writer_open(&writer, path, dtype, MATRIX_ROW_MAJOR, (uint64_t)cols) != 0) {
+        return 1;
+    }
+    for (int i = 0; i < rows; i++) {
+        if (import && fread(row, 1, row_bytes, in) != row_bytes) {
+            fprintf(stderr, "%s ends before row %d of %d\n", argv[2], i, rows);
+            return 1;
+        }
+        if (!import) {
+            for (int j = 0; j < cols; j++) {
+                values[j] = (float)(rand() % 100) / 100.0f;
+            }
+            random_row(row, values, cols, dtype);
+        }
+        if (matrix_file_write(&writer, row, 1) != 0) {
+            return 1;
+        }
+    }
+    if (matrix_file_writer_close(&writer) != 0) {
+        return 1;
+    }
+    printf("Wrote %s: %d x %d %s\n", path, rows, cols, matrix_dtype_name(dtype));
+
+    if (in) fclose(in);
+    free(row);
+    free(values);
+    return 0;
+}
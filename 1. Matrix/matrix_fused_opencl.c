@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <CL/cl.h>
+#include "fused_elementwise.c"
+#include "../common/bench.c"
+#include "../common/cl_source.c"
+#include "../common/cl_cache.c"
+#include "../common/cl_profile.c"
+#include "../common/trace.c"
+#include "../common/cl_trace.c"
+#include "../common/cl_runtime.c"
+
+// Evaluates a chain of element-wise operations as one fused OpenCL kernel.
+//
+// Usage: matrix_fused_opencl [rows cols] ["expression"] [name=value ...]
+//   e.g. matrix_fused_opencl 1000 1000 "clamp(alpha*A + B*C - D, lo, hi)" alpha=0.5 lo=0 hi=50
+// Matrices are filled with random values, scalars default to 2.
+
+#define VECTOR_WIDTH 4
+
+void checkError(cl_int error, const char *message) {
+    if (error != CL_SUCCESS) {
+        printf("%s: %d\n", message, error);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Bytes moved when every operation runs as its own kernel with a temporary
+// buffer in between, against one read per input and one write for the fused kernel
+void memory_traffic(const fused_expr *expr, int num_elements, double *unfused, double *fused) {
+    int has_matrix[FUSED_MAX_NODES];
+    int accesses = 0;
+    for (int id = 0; id < expr->num_nodes; id++) {
+        const fused_node *node = &expr->nodes[id];
+        has_matrix[id] = node->op == FUSED_INPUT;
+        int matrix_operands = 0;
+        for (int i = 0; i < 3 && node->op > FUSED_CONST && node->arg[i] >= 0; i++) {
+            if (has_matrix[node->arg[i]]) {
+                has_matrix[id] = 1;
+                matrix_operands++;
+            }
+        }
+        if (matrix_operands > 0) {
+            accesses += matrix_operands + 1;
+        }
+    }
+    *unfused = (double)accesses * num_elements * sizeof(float);
+    *fused = (double)(expr->num_inputs + 1) * num_elements * sizeof(float);
+}
+
+int main(int argc, char **argv) {
+    int rows = 100;
+    int cols = 100;
+    const char *expression = "alpha*A + B*C - D";
+    int arg = 1;
+    if (argc > 2 && strchr(argv[1], '=') == NULL) {
+        rows = atoi(argv[1]);
+        cols = atoi(argv[2]);
+        arg = 3;
+    }
+    if (arg < argc && strchr(argv[arg], '=') == NULL) {
+        expression = argv[arg++];
+    }
+
+    fused_expr expr;
+    if (fused_parse(expression, &expr) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    int num_elements = rows * cols;
+
+    // Scalars from name=value arguments
+    float scalars[FUSED_MAX_ARGS];
+    for (int i = 0; i < expr.num_scalars; i++) {
+        scalars[i] = 2.0f;
+        for (int a = arg; a < argc; a++) {
+            size_t length = strlen(expr.scalars[i]);
+            if (strncmp(argv[a], expr.scalars[i], length) == 0 && argv[a][length] == '=') {
+                scalars[i] = (float)atof(argv[a] + length + 1);
+            }
+        }
+    }
+
+    // Allocate and populate the input matrices
+    float *inputs[FUSED_MAX_ARGS];
+    for (int i = 0; i < expr.num_inputs; i++) {
+        inputs[i] = (float *)malloc(num_elements * sizeof(float));
+        for (int j = 0; j < num_elements; j++) {
+            inputs[i][j] = (float)(rand() % 100);
+        }
+    }
+    float *result = (float *)malloc(num_elements * sizeof(float));
+    float *reference = (float *)malloc(num_elements * sizeof(float));
+
+    // The shared runtime's device: the first GPU, else any device, or the
+    // type in CL_RUNTIME_DEVICE (see common/cl_runtime.h)
+    cl_runtime *runtime = cl_runtime_get();
+    cl_device_id device_id = runtime->device;
+    cl_context context = runtime->context;
+    cl_command_queue command_queue = runtime->queue;
+    cl_int err;
+
+    // Create and fill the device buffers
+    cl_mem input_buffers[FUSED_MAX_ARGS];
+    for (int i = 0; i < expr.num_inputs; i++) {
+        input_buffers[i] = clCreateBuffer(context, CL_MEM_READ_ONLY, num_elements * sizeof(float), NULL, &err);
+        checkError(err, "Failed to create input buffer");
+        cl_event *event = cl_trace_event(NULL);
+        err = clEnqueueWriteBuffer(command_queue, input_buffers[i], CL_TRUE, 0, num_elements * sizeof(float), inputs[i], 0, NULL, event);
+        cl_trace_command("write input", command_queue, event, err);
+        checkError(err, "Failed to write input to device");
+    }
+    cl_mem result_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, num_elements * sizeof(float), NULL, &err);
+    checkError(err, "Failed to create buffer for result");
+
+    // The first lookup generates and builds the kernel, later ones hit the cache
+    double start = bench_now_ms();
+    fused_kernel *fused = fused_get(context, device_id, expression, VECTOR_WIDTH);
+    double build_time = bench_now_ms() - start;
+    if (!fused) {
+        exit(EXIT_FAILURE);
+    }
+    start = bench_now_ms();
+    fused = fused_get(context, device_id, expression, VECTOR_WIDTH);
+    double lookup_time = bench_now_ms() - start;
+    printf("Expression: %s\n", expression);
+    printf("Build: %.3f ms, cached lookup: %.3f ms\n", build_time, lookup_time);
+
+    // Execute the fused kernel
+    cl_event event;
+    err = fused_enqueue(command_queue, fused, input_buffers, scalars, result_buffer, num_elements, 0, &event);
+    checkError(err, "Failed to execute kernel");
+
+    // Profiling
+    clWaitForEvents(1, &event);
+    cl_ulong start_time, end_time;
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_time, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, NULL);
+    clReleaseEvent(event);
+    double execution_time = (end_time - start_time) * 1.0e-6; // Convert nanoseconds to milliseconds
+
+    double unfused_bytes, fused_bytes;
+    memory_traffic(&expr, num_elements, &unfused_bytes, &fused_bytes);
+    printf("Execution time on device: %f ms (%.2f GB/s)\n", execution_time,
+           fused_bytes / (execution_time * 1.0e6));
+    printf("Memory traffic: %.2f MB fused, %.2f MB as separate kernels\n",
+           fused_bytes * 1.0e-6, unfused_bytes * 1.0e-6);
+
+    // Read the result back and check it against the host
+    cl_event *read_event = cl_trace_event(NULL);
+    err = clEnqueueReadBuffer(command_queue, result_buffer, CL_TRUE, 0, num_elements * sizeof(float), result, 0, NULL, read_event);
+    cl_trace_command("read result", command_queue, read_event, err);
+    checkError(err, "Failed to read result buffer");
+
+    fused_eval_host(&expr, (const float *const *)inputs, scalars, reference, num_elements);
+    double max_error = 0.0;
+    for (int i = 0; i < num_elements; i++) {
+        double error = fabs(result[i] - reference[i]) / fmax(1.0, fabs(reference[i]));
+        if (error > max_error) max_error = error;
+    }
+    printf("Max relative error: %g\n", max_error);
+
+    // Free OpenCL resources
+    fused_release_all();
+    for (int i = 0; i < expr.num_inputs; i++) {
+        clReleaseMemObject(input_buffers[i]);
+        free(inputs[i]);
+    }
+    clReleaseMemObject(result_buffer);
+
+    free(result);
+    free(reference);
+
+    return 0;
+}
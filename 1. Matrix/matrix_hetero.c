@@ -0,0 +1,126 @@
+#include "thread_pool.c"
+#include "simd_kernels.c"
+#include "gemm.c"
+#include "sgemm_opencl.c"
+#include "hetero.c"
+#include "../common/cl_autotune.c"
+#include "../common/cl_source.c"
+#include "../common/cl_cache.c"
+#include "../common/cl_profile.c"
+#include "../common/trace.c"
+#include "../common/cl_trace.c"
+#include "../common/cl_devices.c"
+#include "../common/bench.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <CL/cl.h>
+
+// Runs GEMM or add on the host and every OpenCL device at once (see
+// hetero.h) and shows how the split settles over repeated calls.
+//
+// Usage: matrix_hetero gemm [M N K] [calls]
+//        matrix_hetero add [rows cols] [calls]
+// The first call splits evenly; every later one follows the throughput
+// measured so far. CL_DEVICES picks the devices (see common/cl_devices.h),
+// HETERO_HOST=0 leaves the host out, to compare against the devices alone.
+
+void checkError(cl_int error, const char *message) {
+    if (error != CL_SUCCESS) {
+        fprintf(stderr, "%s: %d\n", message, error);
+        exit(EXIT_FAILURE);
+    }
+}
+
+float *random_matrix(size_t count) {
+    float *matrix = gemm_alloc(count);
+    for (size_t i = 0; i < count; i++) {
+        matrix[i] = (float)(rand() % 100) / 100.0f;
+    }
+    return matrix;
+}
+
+int main(int argc, char **argv) {
+    int is_gemm = argc < 2 || strcmp(argv[1], "gemm") == 0;
+    if (argc > 1 && !is_gemm && strcmp(argv[1], "add") != 0) {
+        fprintf(stderr, "Usage: %s gemm [M N K] [calls] | add [rows cols] [calls]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    int num_dims = is_gemm ? 3 : 2;
+    int dims[3] = {1024, 1024, 1024};
+    int calls = 8;
+    if (!is_gemm) {
+        dims[0] = dims[1] = 4096;
+    }
+    int arg = 2;
+    if (argc > 1 + num_dims) {
+        for (int i = 0; i < num_dims; i++) {
+            dims[i] = atoi(argv[arg++]);
+        }
+    }
+    if (argc > arg) {
+        calls = atoi(argv[arg]);
+    }
+    if (dims[0] <= 0 || dims[1] <= 0 || dims[2] <= 0 || calls <= 0) {
+        fprintf(stderr, "Dimensions and calls must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+    int M = dims[0], N = dims[1], K = is_gemm ? dims[2] : dims[1];
+
+    const char *use_host = getenv("HETERO_HOST");
+    hetero h;
+    hetero_init(&h, NULL, !use_host || strcmp(use_host, "0") != 0);
+    cl_devices devices;
+    cl_devices_open(&devices);
+    cl_devices_print(&devices, stdout);
+    for (int d = 0; d < devices.count && d < HETERO_MAX_DEVICES; d++) {
+        checkError(hetero_add_device(&h, devices.devices[d].context, devices.devices[d].device),
+                   "Failed to add device");
+    }
+
+    // GEMM: A is M x K, B is K x N. add: A, B and C are all M x N.
+    float *A = random_matrix(is_gemm ? (size_t)M * K : (size_t)M * N);
+    float *B = random_matrix(is_gemm ? (size_t)K * N : (size_t)M * N);
+    float *C = gemm_alloc((size_t)M * N);
+    double work = is_gemm ? 2.0 * M * N * K : (double)M * N;
+
+    if (is_gemm) {
+        printf("hetero gemm, M=%d N=%d K=%d, %d calls, %d host threads%s\n", M, N, K, calls,
+               thread_pool_size(h.pool), h.use_host ? "" : " (host left out)");
+    } else {
+        printf("hetero add, %d x %d, %d calls, %d host threads%s\n", M, N, calls, thread_pool_size(h.pool),
+               h.use_host ? "" : " (host left out)");
+    }
+    for (int call = 0; call < calls; call++) {
+        cl_int ret = is_gemm ? hetero_gemm(&h, M, N, K, A, K, B, N, C, N) : hetero_add(&h, M, N, A, B, C);
+        checkError(ret, is_gemm ? "Failed to run hetero_gemm" : "Failed to run hetero_add");
+        hetero_op op = is_gemm ? HETERO_GEMM : HETERO_ADD;
+        printf("Call %d: %.3f ms (%.2f %s)\n", call + 1, h.balance[op].total_ms,
+               work / (h.balance[op].total_ms * 1.0e6), is_gemm ? "GFLOP/s" : "Gelem/s");
+        hetero_print(&h, op, stdout);
+    }
+
+    // Every backend wrote its own rows; spot-check rows from all of them
+    double max_error = 0.0;
+    for (int s = 0; s < 256; s++) {
+        int i = rand() % M, j = rand() % N;
+        double expected = 0.0;
+        if (is_gemm) {
+            for (int p = 0; p < K; p++) {
+                expected += (double)A[(size_t)i * K + p] * B[(size_t)p * N + j];
+            }
+        } else {
+            expected = (double)A[(size_t)i * N + j] + B[(size_t)i * N + j];
+        }
+        max_error = fmax(max_error, fabs(C[(size_t)i * N + j] - expected) / (fabs(expected) + 1.0));
+    }
+    printf("Max relative error (256 samples): %g\n", max_error);
+
+    hetero_release(&h);
+    cl_devices_release(&devices);
+    gemm_free(A);
+    gemm_free(B);
+    gemm_free(C);
+    return max_error < 1e-4 ? 0 : 1;
+}
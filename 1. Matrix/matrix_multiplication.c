@@ -1,52 +1,205 @@
+#include "thread_pool.c"
+#include "simd_kernels.c"
+#include "gemm.c"
+#include "strassen.c"
+#include "../common/mapped_file.c"
+#include "../common/matrix_file.c"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <sys/time.h>
 
-#define SIZE 100 // Size of the matrix
+#define SIZE 100 // Default size of the matrix
 
-// Function to multiply matrices
-void multiply_Matrix(float *matrix1, float *matrix2, float *result) {
-    for (int i = 0; i < SIZE; i++) {
-        for (int j = 0; j < SIZE; j++) {
+// Naive reference, only used to validate the blocked version on small sizes
+void multiply_Matrix_naive(const float *matrix1, const float *matrix2, float *result, int M, int N, int K) {
+    for (int i = 0; i < M; i++) {
+        for (int j = 0; j < N; j++) {
             float sum = 0.0f;
-            for (int k = 0; k < SIZE; k++) {
-                sum += matrix1[i * SIZE + k] * matrix2[k * SIZE + j];
+            for (int k = 0; k < K; k++) {
+                sum += matrix1[i * K + k] * matrix2[k * N + j];
             }
-            result[i * SIZE + j] = sum;
+            result[i * N + j] = sum;
         }
     }
 }
 
-int main() {
+// Function to multiply matrices: result (M x N) = matrix1 (M x K) * matrix2 (K x N)
+// Uses every core; set MATRIX_NUM_THREADS=1 for the single-threaded baseline
+// and MATRIX_SIMD=scalar|sse|avx2|avx512 to force a micro-kernel.
+void multiply_Matrix(const float *matrix1, const float *matrix2, float *result, int M, int N, int K) {
+    gemm_parallel(NULL, M, N, K, matrix1, K, matrix2, N, result, N);
+}
+
+// Strassen-Winograd for large products: fewer flops, somewhat larger rounding error
+void multiply_Matrix_strassen(const float *matrix1, const float *matrix2, float *result, int M, int N, int K) {
+    gemm_strassen(NULL, M, N, K, matrix1, K, matrix2, N, result, N, STRASSEN_CUTOFF, NULL);
+}
+
+// Reduced-precision storage: convert the inputs once (not timed), multiply with
+// fp32 or int32 accumulation. Returns the conversion time in ms.
+double multiply_Matrix_lowp(const char *algorithm, const float *matrix1, const float *matrix2,
+                            float *result, int M, int N, int K, double *multiply_ms) {
+    struct timeval start, end;
+    double convert_ms;
+    gettimeofday(&start, NULL);
+    if (strcmp(algorithm, "int8") == 0) {
+        int8_t *q1 = (int8_t *)malloc((size_t)M * K);
+        int8_t *q2 = (int8_t *)malloc((size_t)K * N);
+        float *row_scales = (float *)malloc(M * sizeof(float));
+        float *col_scales = (float *)malloc(N * sizeof(float));
+        gemm_quantize_rows(M, K, matrix1, K, q1, K, row_scales);
+        gemm_quantize_cols(K, N, matrix2, N, q2, N, col_scales);
+        gettimeofday(&end, NULL);
+        convert_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0;
+
+        gettimeofday(&start, NULL);
+        gemm_parallel_i8(NULL, M, N, K, q1, K, row_scales, q2, N, col_scales, result, N);
+        gettimeofday(&end, NULL);
+        free(q1);
+        free(q2);
+        free(row_scales);
+        free(col_scales);
+    } else {
+        int bf16 = strcmp(algorithm, "bf16") == 0;
+        uint16_t *h1 = (uint16_t *)malloc((size_t)M * K * sizeof(uint16_t));
+        uint16_t *h2 = (uint16_t *)malloc((size_t)K * N * sizeof(uint16_t));
+        (bf16 ? gemm_convert_bf16 : gemm_convert_f16)(h1, matrix1, (size_t)M * K);
+        (bf16 ? gemm_convert_bf16 : gemm_convert_f16)(h2, matrix2, (size_t)K * N);
+        gettimeofday(&end, NULL);
+        convert_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0;
+
+        gettimeofday(&start, NULL);
+        if (bf16) {
+            gemm_parallel_bf16(NULL, M, N, K, h1, K, h2, N, result, N);
+        } else {
+            gemm_parallel_f16(NULL, M, N, K, h1, K, h2, N, result, N);
+        }
+        gettimeofday(&end, NULL);
+        free(h1);
+        free(h2);
+    }
+    *multiply_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0;
+    return convert_ms;
+}
+
+// Usage: matrix_multiplication [M [N [K [blocked|strassen|f16|bf16|int8]]]]
+// MATRIX_A and MATRIX_B name .mat files (common/matrix_file.h) to multiply
+// instead of random matrices, and set M, N and K; MATRIX_C saves the result.
+int main(int argc, char **argv) {
     struct timeval start, end;
     float *matrix1, *matrix2, *result;
 
+    int M = argc > 1 ? atoi(argv[1]) : SIZE;
+    int N = argc > 2 ? atoi(argv[2]) : M;
+    int K = argc > 3 ? atoi(argv[3]) : M;
+    const char *algorithm = argc > 4 ? argv[4] : "blocked";
+    int strassen = strcmp(algorithm, "strassen") == 0;
+    int lowp = strcmp(algorithm, "f16") == 0 || strcmp(algorithm, "bf16") == 0 || strcmp(algorithm, "int8") == 0;
+    if (!strassen && !lowp) {
+        algorithm = "blocked";
+    }
+    if (M <= 0 || N <= 0 || K <= 0) {
+        fprintf(stderr, "Matrix dimensions must be positive\n");
+        return 1;
+    }
+
+    // Input files are multiplied in place through their mappings
+    matrix_file file1, file2;
+    matrix1 = matrix_file_from_env("MATRIX_A", &file1, &M, &K);
+    int K2 = K;
+    matrix2 = matrix_file_from_env("MATRIX_B", &file2, &K2, &N);
+    if (!matrix1 != !matrix2 || K2 != K) {
+        fprintf(stderr, "MATRIX_A and MATRIX_B must both be set, with as many columns in A as rows in B\n");
+        return 1;
+    }
+    int loaded = matrix1 != NULL;
+
     // Allocate memory
-    matrix1 = (float *)malloc(SIZE * SIZE * sizeof(float));
-    matrix2 = (float *)malloc(SIZE * SIZE * sizeof(float));
-    result = (float *)malloc(SIZE * SIZE * sizeof(float));
+    if (!loaded) {
+        matrix1 = gemm_alloc((size_t)M * K);
+        matrix2 = gemm_alloc((size_t)K * N);
+    }
+    result = gemm_alloc((size_t)M * N);
 
     // Initialize matrices
-    for (int i = 0; i < SIZE*SIZE; i++) {
-        matrix1[i] = 1.0f; // Example value
-        matrix2[i] = 2.0f; // Example value
+    for (size_t i = 0; !loaded && i < (size_t)M * K; i++) {
+        matrix1[i] = (float)(rand() % 100) / 100.0f;
+    }
+    for (size_t i = 0; !loaded && i < (size_t)K * N; i++) {
+        matrix2[i] = (float)(rand() % 100) / 100.0f;
     }
 
+    // Start the worker pool outside the timed region
+    thread_pool *pool = thread_pool_default();
+
     // Profile the multiplication
-    gettimeofday(&start, NULL);
-    multiply_Matrix(matrix1, matrix2, result);
-    gettimeofday(&end, NULL);
+    float millis;
+    double convert_ms = 0.0;
+    if (lowp) {
+        double multiply_ms;
+        convert_ms = multiply_Matrix_lowp(algorithm, matrix1, matrix2, result, M, N, K, &multiply_ms);
+        millis = multiply_ms;
+    } else {
+        gettimeofday(&start, NULL);
+        if (strassen) {
+            multiply_Matrix_strassen(matrix1, matrix2, result, M, N, K);
+        } else {
+            multiply_Matrix(matrix1, matrix2, result, M, N, K);
+        }
+        gettimeofday(&end, NULL);
 
-    long seconds = (end.tv_sec - start.tv_sec);
-    long micros = ((seconds * 1000000) + end.tv_usec) - (start.tv_usec);
-    float millis = micros / 1000.0; // Convert microseconds to milliseconds
+        long seconds = (end.tv_sec - start.tv_sec);
+        long micros = ((seconds * 1000000) + end.tv_usec) - (start.tv_usec);
+        millis = micros / 1000.0; // Convert microseconds to milliseconds
+    }
+    // Small products can finish inside one timer tick
+    double gflops = millis > 0.0 ? 2.0 * M * N * K / (millis * 1.0e6) : 0.0;
 
-    printf("Host Execution Time: %.2f ms\n", millis); // Print with 2 decimal places
+    printf("Matrix size: %d x %d x %d, threads: %d, SIMD: %s, algorithm: %s\n", M, N, K,
+           thread_pool_size(pool), simd_get()->name, algorithm);
+    printf("Host Execution Time: %.2f ms (%.2f GFLOP/s)\n", millis, gflops); // Print with 2 decimal places
+    if (lowp) {
+        printf("Input conversion: %.2f ms (not included above)\n", convert_ms);
+    }
+
+    // Check against the naive loop when it is cheap enough
+    if (!lowp && (double)M * N * K <= 512.0 * 512.0 * 512.0) {
+        float *reference = gemm_alloc((size_t)M * N);
+        multiply_Matrix_naive(matrix1, matrix2, reference, M, N, K);
+        double max_error = 0.0;
+        for (size_t i = 0; i < (size_t)M * N; i++) {
+            double error = fabs((double)result[i] - reference[i]);
+            if (error > max_error) max_error = error;
+        }
+        printf("Max abs error vs naive: %g\n", max_error);
+        gemm_free(reference);
+    } else if (strassen || lowp) {
+        // Measure the accuracy loss against the fp32 blocked GEMM
+        float *reference = gemm_alloc((size_t)M * N);
+        multiply_Matrix(matrix1, matrix2, reference, M, N, K);
+        double max_error = 0.0, max_value = 0.0;
+        for (size_t i = 0; i < (size_t)M * N; i++) {
+            double error = fabs((double)result[i] - reference[i]);
+            if (error > max_error) max_error = error;
+            if (fabs(reference[i]) > max_value) max_value = fabs(reference[i]);
+        }
+        printf("Max abs error vs blocked: %g (relative %g)\n", max_error, max_error / max_value);
+        gemm_free(reference);
+    }
+
+    matrix_file_save_env("MATRIX_C", M, N, result);
 
     // Cleanup
-    free(matrix1);
-    free(matrix2);
-    free(result);
+    if (loaded) {
+        matrix_file_close(&file1);
+        matrix_file_close(&file2);
+    } else {
+        gemm_free(matrix1);
+        gemm_free(matrix2);
+    }
+    gemm_free(result);
 
     return 0;
 }
@@ -1,8 +1,28 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <CL/cl.h>
+#include "thread_pool.c"
+#include "simd_kernels.c"
+#include "gemm.c"
+#include "../common/cl_autotune.c"
+#include "../common/cl_source.c"
+#include "../common/cl_cache.c"
+#include "../common/cl_profile.c"
+#include "../common/trace.c"
+#include "../common/cl_trace.c"
+#include "../common/cl_runtime.c"
+#include "../common/cl_buffer.c"
+#include "../common/mapped_file.c"
+#include "../common/matrix_file.c"
 
-#define MAX_SOURCE_SIZE (0x100000)
+// Candidate tile sizes for multiply_matrix_tiled, passed to the kernel build as
+// -D defines. The tiles of the device profile are put in front of these and
+// are the default when tuning is off.
+static const int tile_sizes[] = {64, 32, 128};  // TS: rows and cols of C per work-group
+static const int tile_depths[] = {16, 8, 32};   // TSK: depth of the tiles staged in local memory
+static const int work_sizes[] = {4, 2, 8};      // WPTM/WPTN: rows/cols of C per work-item
 
 void checkError(cl_int error, const char *message) {
     if (error != CL_SUCCESS) {
@@ -11,76 +31,242 @@ void checkError(cl_int error, const char *message) {
     }
 }
 
-int main() {
-    // Initialize matrices dimensions
-    const int M = 100, N = 100, K = 100;
+// Storage types of A and B for the tiled kernel, see multiply_matrix.cl
+typedef struct {
+    const char *name;
+    const char *define;  // build option selecting the storage type
+    size_t element_size;
+} storage_type;
 
-    // Allocate memory for matrices A, B, and C
-    float *A = (float *)malloc(M * N * sizeof(float));
-    float *B = (float *)malloc(N * K * sizeof(float));
-    float *C = (float *)malloc(M * K * sizeof(float));
+static const storage_type storage_types[] = {
+    {"tiled", "", sizeof(float)},
+    {"half", "-DSTORAGE_HALF", sizeof(uint16_t)},
+    {"bf16", "-DSTORAGE_BF16", sizeof(uint16_t)},
+    {"int8", "-DSTORAGE_INT8", sizeof(int8_t)},
+};
 
-    // Populate matrices A and B with random values for demonstration
-    for (int i = 0; i < M * N; i++) {
-        A[i] = rand() % 100;
+// Kernel kernel_name built with the tile sizes of config and the storage type baked in.
+// The runtime keeps every build, so asking again for the same options is free.
+cl_kernel tiled_kernel(const autotune_config *config, const storage_type *storage, const char *kernel_name) {
+    char build_options[256];
+    snprintf(build_options, sizeof(build_options), "-DTSM=%d -DTSN=%d -DTSK=%d -DWPTM=%d -DWPTN=%d %s",
+             autotune_value(config, "TS", 64), autotune_value(config, "TS", 64),
+             autotune_value(config, "TSK", 16), autotune_value(config, "WPTM", 4),
+             autotune_value(config, "WPTN", 4), storage->define);
+    return cl_runtime_kernel("multiply_matrix.cl", build_options, kernel_name);
+}
+
+// One work-item per WPTM x WPTN block, grid rounded up to whole tiles
+void tiled_launch_size(const autotune_config *config, int M, int K, size_t global_size[2], size_t local_size[2]) {
+    int ts = autotune_value(config, "TS", 64);
+    local_size[0] = ts / autotune_value(config, "WPTN", 4);
+    local_size[1] = ts / autotune_value(config, "WPTM", 4);
+    global_size[0] = (size_t)(K + ts - 1) / ts * local_size[0];
+    global_size[1] = (size_t)(M + ts - 1) / ts * local_size[1];
+}
+
+// values with first in front and no duplicate; out holds count + 1 entries
+int prefer_value(const int *values, int count, int first, int *out) {
+    int n = 0;
+    out[n++] = first;
+    for (int i = 0; i < count; i++) {
+        if (values[i] != first) out[n++] = values[i];
     }
-    for (int i = 0; i < N * K; i++) {
-        B[i] = rand() % 100;
+    return n;
+}
+
+typedef struct {
+    int M, N, K;
+    cl_mem A, B, C;
+    const storage_type *storage;
+    cl_mem row_scales, col_scales; // int8 storage only
+} tiled_tuning;
+
+// autotune_measure_fn: build one candidate and time it on the real buffers
+double measure_tiled(const autotune_config *config, void *user) {
+    tiled_tuning *t = (tiled_tuning *)user;
+    cl_runtime *runtime = cl_runtime_get();
+    int ts = autotune_value(config, "TS", 64);
+    int tsk = autotune_value(config, "TSK", 16);
+
+    // Reject what the device cannot run before paying for a build
+    cl_profile profile;
+    cl_profile_query(runtime->device, &profile);
+    size_t global_size[2], local_size[2];
+    tiled_launch_size(config, t->M, t->K, global_size, local_size);
+    if (!cl_profile_gemm_fits(&profile, ts, tsk, autotune_value(config, "WPTM", 4),
+                              autotune_value(config, "WPTN", 4))) {
+        return -1.0;
     }
 
-    // Load kernel source code
-    FILE *file = fopen("multiply_matrix.cl", "r");
-    if (!file) {
-        fprintf(stderr, "Failed to load kernel.\n");
+    cl_kernel kernel = tiled_kernel(config, t->storage, "multiply_matrix_tiled");
+    if (!kernel) {
+        return -1.0;
+    }
+    cl_int ret = clSetKernelArg(kernel, 0, sizeof(int), &t->M);
+    ret |= clSetKernelArg(kernel, 1, sizeof(int), &t->N);
+    ret |= clSetKernelArg(kernel, 2, sizeof(int), &t->K);
+    ret |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &t->A);
+    ret |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &t->B);
+    ret |= clSetKernelArg(kernel, 5, sizeof(cl_mem), &t->C);
+    if (t->row_scales) {
+        ret |= clSetKernelArg(kernel, 6, sizeof(cl_mem), &t->row_scales);
+        ret |= clSetKernelArg(kernel, 7, sizeof(cl_mem), &t->col_scales);
+    }
+    if (ret != CL_SUCCESS) {
+        return -1.0;
+    }
+    return autotune_time_kernel(runtime->queue, kernel, 2, global_size, local_size, 1, 3);
+}
+
+// Usage: matrix_multiplication_opencl [M N K] [naive|tiled|half|bf16|int8]
+// A is M x N, B is N x K and C is M x K. Tile sizes of the tiled kernel are
+// auto-tuned per device, see common/cl_autotune.h. half, bf16 and int8 run the
+// tiled kernel on inputs stored in that type (int8 with per-row scales for A
+// and per-column scales for B) and report the error against fp32.
+// MATRIX_A and MATRIX_B name .mat files (common/matrix_file.h) to multiply
+// instead of random matrices, and set M, N and K; MATRIX_C saves C.
+int main(int argc, char **argv) {
+    // Initialize matrices dimensions
+    int M = 100, N = 100, K = 100;
+    int use_tiled = 1;
+    const storage_type *storage = &storage_types[0];
+    int arg = 1;
+    if (argc > 3) {
+        M = atoi(argv[1]);
+        N = atoi(argv[2]);
+        K = atoi(argv[3]);
+        arg = 4;
+    }
+    if (argc > arg) {
+        use_tiled = strcmp(argv[arg], "naive") != 0;
+        for (int i = 0; i < (int)(sizeof(storage_types) / sizeof(storage_types[0])); i++) {
+            if (strcmp(argv[arg], storage_types[i].name) == 0) {
+                storage = &storage_types[i];
+            }
+        }
+    }
+    int is_int8 = storage->element_size == sizeof(int8_t);
+    if (M <= 0 || N <= 0 || K <= 0) {
+        fprintf(stderr, "Matrix dimensions must be positive\n");
         exit(EXIT_FAILURE);
     }
-    char *source_str = (char*)malloc(MAX_SOURCE_SIZE);
-    size_t source_size = fread(source_str, 1, MAX_SOURCE_SIZE, file);
-    fclose(file);
 
-    // Get platform and device information
-    cl_platform_id platform_id = NULL;
-    cl_device_id device_id = NULL;
-    cl_uint ret_num_devices;
-    cl_uint ret_num_platforms;
-    cl_int ret = clGetPlatformIDs(1, &platform_id, &ret_num_platforms);
-    checkError(ret, "Failed to get platform IDs");
+    // Input files are read in place through their mappings
+    matrix_file fileA, fileB;
+    float *A = matrix_file_from_env("MATRIX_A", &fileA, &M, &N);
+    int N2 = N;
+    float *B = matrix_file_from_env("MATRIX_B", &fileB, &N2, &K);
+    if (!A != !B || N2 != N) {
+        fprintf(stderr, "MATRIX_A and MATRIX_B must both be set, with as many columns in A as rows in B\n");
+        exit(EXIT_FAILURE);
+    }
+    int loaded = A != NULL;
 
-    ret = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_GPU, 1, &device_id, &ret_num_devices);
-    checkError(ret, "Failed to get device IDs");
+    // Allocate memory for matrices A and B; C is only read from its device buffer
+    if (!loaded) {
+        A = (float *)malloc(M * N * sizeof(float));
+        B = (float *)malloc(N * K * sizeof(float));
+    }
 
-    // Create OpenCL context
-    cl_context context = clCreateContext(NULL, 1, &device_id, NULL, NULL, &ret);
+    // Populate matrices A and B with random values for demonstration
+    for (int i = 0; !loaded && i < M * N; i++) {
+        A[i] = rand() % 100;
+    }
+    for (int i = 0; !loaded && i < N * K; i++) {
+        B[i] = rand() % 100;
+    }
+
+    // Device, context and profiling queue come from the shared runtime
+    cl_int ret;
+    cl_runtime *runtime = cl_runtime_get();
+    cl_device_id device_id = runtime->device;
+    cl_context context = runtime->context;
+    cl_command_queue command_queue = runtime->queue;
 
-    // Create command queue with profiling enabled
-    cl_command_queue command_queue = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &ret);
+    // Buffers written and read in place through map/unmap: zero-copy on
+    // devices that share memory with the host, pinned staging otherwise
+    cl_buffer bufferA, bufferB, bufferC;
+    ret = cl_buffer_create(&bufferA, context, device_id, command_queue, CL_MEM_READ_ONLY, (size_t)M * N * storage->element_size);
+    ret |= cl_buffer_create(&bufferB, context, device_id, command_queue, CL_MEM_READ_ONLY, (size_t)N * K * storage->element_size);
+    ret |= cl_buffer_create(&bufferC, context, device_id, command_queue, CL_MEM_WRITE_ONLY, (size_t)M * K * sizeof(float));
+    checkError(ret, "Failed to create buffers");
+    cl_mem memobjA = bufferA.mem, memobjB = bufferB.mem, memobjC = bufferC.mem;
 
-    // Create memory buffers on the device
-    cl_mem memobjA = clCreateBuffer(context, CL_MEM_READ_ONLY, M * N * sizeof(float), NULL, &ret);
-    cl_mem memobjB = clCreateBuffer(context, CL_MEM_READ_ONLY, N * K * sizeof(float), NULL, &ret);
-    cl_mem memobjC = clCreateBuffer(context, CL_MEM_WRITE_ONLY, M * K * sizeof(float), NULL, &ret);
+    // A and B in the storage type, converted straight into the mapped buffers
+    void *A_stored = cl_buffer_map(&bufferA, command_queue, CL_MAP_WRITE_INVALIDATE_REGION, &ret);
+    checkError(ret, "Failed to map A");
+    void *B_stored = cl_buffer_map(&bufferB, command_queue, CL_MAP_WRITE_INVALIDATE_REGION, &ret);
+    checkError(ret, "Failed to map B");
+    float *row_scales = NULL, *col_scales = NULL;
+    if (storage == &storage_types[0]) {
+        memcpy(A_stored, A, (size_t)M * N * sizeof(float));
+        memcpy(B_stored, B, (size_t)N * K * sizeof(float));
+    } else if (is_int8) {
+        row_scales = (float *)malloc(M * sizeof(float));
+        col_scales = (float *)malloc(K * sizeof(float));
+        gemm_quantize_rows(M, N, A, N, (int8_t *)A_stored, N, row_scales);
+        gemm_quantize_cols(N, K, B, K, (int8_t *)B_stored, K, col_scales);
+    } else if (strcmp(storage->name, "bf16") == 0) {
+        gemm_convert_bf16((uint16_t *)A_stored, A, (size_t)M * N);
+        gemm_convert_bf16((uint16_t *)B_stored, B, (size_t)N * K);
+    } else {
+        gemm_convert_f16((uint16_t *)A_stored, A, (size_t)M * N);
+        gemm_convert_f16((uint16_t *)B_stored, B, (size_t)N * K);
+    }
+
+    cl_mem memobjRowScales = NULL, memobjColScales = NULL;
+    if (is_int8) {
+        memobjRowScales = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, M * sizeof(float), row_scales, &ret);
+        checkError(ret, "Failed to create row scales buffer");
+        memobjColScales = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, K * sizeof(float), col_scales, &ret);
+        checkError(ret, "Failed to create column scales buffer");
+    }
 
-    // Copy matrices to the device
-    ret = clEnqueueWriteBuffer(command_queue, memobjA, CL_TRUE, 0, M * N * sizeof(float), A, 0, NULL, NULL);
-    ret |= clEnqueueWriteBuffer(command_queue, memobjB, CL_TRUE, 0, N * K * sizeof(float), B, 0, NULL, NULL);
+    // Hand A and B to the device
+    ret = cl_buffer_unmap(&bufferA, command_queue);
+    ret |= cl_buffer_unmap(&bufferB, command_queue);
     checkError(ret, "Failed to write data to device");
 
-    // Create program from kernel source
-    cl_program program = clCreateProgramWithSource(context, 1, (const char **)&source_str, (const size_t *)&source_size, &ret);
+    // Pick the tile sizes: tuned database entry, fresh search, or defaults
+    autotune_config config;
+    if (use_tiled) {
+        cl_profile profile;
+        int ts, tsk, wptm, wptn;
+        cl_profile_query(device_id, &profile);
+        cl_profile_gemm_tiles(&profile, &ts, &tsk, &wptm, &wptn);
+        int ts_values[4], tsk_values[4], wptm_values[4], wptn_values[4];
+        autotune_param params[] = {
+            {"TS", ts_values, prefer_value(tile_sizes, 3, ts, ts_values)},
+            {"TSK", tsk_values, prefer_value(tile_depths, 3, tsk, tsk_values)},
+            {"WPTM", wptm_values, prefer_value(work_sizes, 3, wptm, wptm_values)},
+            {"WPTN", wptn_values, prefer_value(work_sizes, 3, wptn, wptn_values)},
+        };
+        // Best tiles depend on the problem size, so tune per power-of-two size class
+        char tuning_key[128];
+        int size_class[3] = {1, 1, 1};
+        while (size_class[0] < M) size_class[0] *= 2;
+        while (size_class[1] < N) size_class[1] *= 2;
+        while (size_class[2] < K) size_class[2] *= 2;
+        // and per storage type, fp32 keeps the plain key
+        snprintf(tuning_key, sizeof(tuning_key), "multiply_matrix_tiled%s%s/%dx%dx%d",
+                 storage == &storage_types[0] ? "" : "_", storage == &storage_types[0] ? "" : storage->name,
+                 size_class[0], size_class[1], size_class[2]);
+        tiled_tuning tuning = {M, N, K, memobjA, memobjB, memobjC, storage, memobjRowScales, memobjColScales};
+        autotune_get(device_id, tuning_key, params, 4, measure_tiled, &tuning, &config);
+        printf("Tiles: TS=%d TSK=%d WPTM=%d WPTN=%d\n", autotune_value(&config, "TS", 64),
+               autotune_value(&config, "TSK", 16), autotune_value(&config, "WPTM", 4),
+               autotune_value(&config, "WPTN", 4));
+    } else {
+        config.num_params = 0;
+    }
 
-    // Build the program
-    ret = clBuildProgram(program, 1, &device_id, NULL, NULL, NULL);
-    if (ret != CL_SUCCESS) {
-        // Determine the reason for the error
-        char build_log[2048];
-        clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, sizeof(build_log), build_log, NULL);
-        fprintf(stderr, "Error in kernel build:\n%s\n", build_log);
+    // The kernel with the chosen tile sizes baked in; the tuner already built it
+    cl_kernel kernel = tiled_kernel(&config, storage, use_tiled ? "multiply_matrix_tiled" : "multiply_matrix");
+    if (!kernel) {
         exit(1);
     }
 
-    // Create the OpenCL kernel
-    cl_kernel kernel = clCreateKernel(program, "multiply_matrix", &ret);
-
     // Set the arguments of the kernel
     ret = clSetKernelArg(kernel, 0, sizeof(int), (void *)&M);
     ret |= clSetKernelArg(kernel, 1, sizeof(int), (void *)&N);
@@ -88,12 +274,23 @@ int main() {
     ret |= clSetKernelArg(kernel, 3, sizeof(cl_mem), (void *)&memobjA);
     ret |= clSetKernelArg(kernel, 4, sizeof(cl_mem), (void *)&memobjB);
     ret |= clSetKernelArg(kernel, 5, sizeof(cl_mem), (void *)&memobjC);
+    if (is_int8) {
+        ret |= clSetKernelArg(kernel, 6, sizeof(cl_mem), (void *)&memobjRowScales);
+        ret |= clSetKernelArg(kernel, 7, sizeof(cl_mem), (void *)&memobjColScales);
+    }
     checkError(ret, "Failed to set kernel arguments");
 
     // Execute the OpenCL kernel
-    size_t global_item_size[2] = {M, K}; // Process the entire lists
     cl_event event;
-    ret = clEnqueueNDRangeKernel(command_queue, kernel, 2, NULL, global_item_size, NULL, 0, NULL, &event); // NULL local work size lets OpenCL decide
+    if (use_tiled) {
+        size_t global_item_size[2], local_item_size[2];
+        tiled_launch_size(&config, M, K, global_item_size, local_item_size);
+        ret = clEnqueueNDRangeKernel(command_queue, kernel, 2, NULL, global_item_size, local_item_size, 0, NULL, &event);
+    } else {
+        size_t global_item_size[2] = {M, K}; // Process the entire lists
+        ret = clEnqueueNDRangeKernel(command_queue, kernel, 2, NULL, global_item_size, NULL, 0, NULL, &event); // NULL local work size lets OpenCL decide
+    }
+    cl_trace_command(use_tiled ? "multiply_matrix_tiled" : "multiply_matrix", command_queue, &event, ret);
     checkError(ret, "Failed to enqueue NDRange kernel");
 
     // Wait for the kernel to complete
@@ -107,26 +304,53 @@ int main() {
     checkError(ret, "Failed to get event profiling info");
 
     double execution_time_ms = (double)(time_end - time_start) * 1e-6; // Convert from nanoseconds to milliseconds
-    printf("Kernel Execution Time: %0.3f ms\n", execution_time_ms);
+    printf("Kernel: %s, storage: %s, size: %d x %d x %d\n", use_tiled ? "multiply_matrix_tiled" : "multiply_matrix",
+           storage == &storage_types[0] ? "fp32" : storage->name, M, N, K);
+    printf("Kernel Execution Time: %0.3f ms (%.2f GFLOP/s)\n", execution_time_ms,
+           2.0 * M * N * K / (execution_time_ms * 1.0e6));
+    printf("Runtime setup: %.3f ms, %d program builds (%d cached): %.3f ms, %d registry hits\n",
+           runtime->init_ms, runtime->programs_built, runtime->programs_cached, runtime->build_ms,
+           runtime->program_hits);
 
     // Read the result back to the host
-    ret = clEnqueueReadBuffer(command_queue, memobjC, CL_TRUE, 0, M * K * sizeof(float), C, 0, NULL, NULL);
+    float *C = (float *)cl_buffer_map(&bufferC, command_queue, CL_MAP_READ, &ret);
     checkError(ret, "Failed to read output array C");
+    printf("Buffers: %s\n", bufferC.zero_copy ? "zero-copy" : "pinned staging");
+
+    // Spot-check a few entries against the fp32 product on the host
+    double max_error = 0.0;
+    for (int s = 0; s < 64; s++) {
+        int i = rand() % M, j = rand() % K;
+        double sum = 0.0;
+        for (int n = 0; n < N; n++) {
+            sum += (double)A[i * N + n] * B[n * K + j];
+        }
+        double error = fabs(sum - C[i * K + j]) / (fabs(sum) + 1.0);
+        if (error > max_error) max_error = error;
+    }
+    printf("Max relative error vs fp32 (64 samples): %g\n", max_error);
+    matrix_file_save_env("MATRIX_C", M, K, C);
 
     // Cleanup
-    ret = clReleaseKernel(kernel);
-    ret |= clReleaseProgram(program);
-    ret |= clReleaseMemObject(memobjA);
-    ret |= clReleaseMemObject(memobjB);
-    ret |= clReleaseMemObject(memobjC);
-    ret |= clReleaseCommandQueue(command_queue);
-    ret |= clReleaseContext(context);
-    checkError(ret, "Failed during cleanup");
-
-    free(A);
-    free(B);
-    free(C);
-    free(source_str);
+    clReleaseEvent(event);
+    cl_buffer_release(&bufferA);
+    cl_buffer_release(&bufferB);
+    cl_buffer_release(&bufferC); // also unmaps C
+    if (is_int8) {
+        ret = clReleaseMemObject(memobjRowScales);
+        ret |= clReleaseMemObject(memobjColScales);
+        checkError(ret, "Failed during cleanup");
+    }
+
+    if (loaded) {
+        matrix_file_close(&fileA);
+        matrix_file_close(&fileB);
+    } else {
+        free(A);
+        free(B);
+    }
+    free(row_scales);
+    free(col_scales);
 
     return 0;
 }
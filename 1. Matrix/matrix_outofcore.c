@@ -0,0 +1,191 @@
+#include "thread_pool.c"
+#include "simd_kernels.c"
+#include "gemm.c"
+#include "gemm_ooc.c"
+#include "sgemm_opencl.c"
+#include "gemm_ooc_opencl.c"
+#include "../common/cl_autotune.c"
+#include "../common/cl_source.c"
+#include "../common/cl_cache.c"
+#include "../common/cl_profile.c"
+#include "../common/trace.c"
+#include "../common/cl_trace.c"
+#include "../common/cl_runtime.c"
+#include "../common/cl_pipeline.c"
+#include "../common/mapped_file.c"
+#include "../common/matrix_file.c"
+#include "../common/bench.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <CL/cl.h>
+
+// Out-of-core GEMM on matrices stored in files (see gemm_ooc.h).
+//
+// Usage: matrix_outofcore [host|opencl] [M N K] [memory_mb] [dir]
+// A (M x K) and B (K x N) are f32 .mat files (common/matrix_file.h),
+// dir/ooc_A.mat and dir/ooc_B.mat, generated on the first run; C goes to
+// dir/ooc_C.mat. MATRIX_A, MATRIX_B and MATRIX_C name other files instead,
+// and the shape then comes from the A and B files. memory_mb bounds the
+// memory the tiles may occupy. Pick sizes whose files exceed RAM to see the
+// disk-bound case; the program drops the files from the page cache first, so
+// smaller sizes read from disk too.
+
+void checkError(cl_int error, const char *message) {
+    if (error != CL_SUCCESS) {
+        fprintf(stderr, "%s: %d\n", message, error);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Maps path as a rows x cols matrix, streaming random values into it a row
+// at a time first unless it already has that shape
+void map_input(matrix_file *matrix, const char *path, int rows, int cols) {
+    FILE *in = fopen(path, "rb");
+    if (in) {
+        fclose(in);
+        // A file that fails to load is closed already
+        if (matrix_file_load(matrix, path) == 0) {
+            if (matrix->header.rows == (uint64_t)rows && matrix->header.cols == (uint64_t)cols &&
+                matrix->header.dtype == MATRIX_F32) {
+                return;
+            }
+            matrix_file_close(matrix);
+        }
+    }
+
+    printf("Writing %s (%d x %d, %.1f MB)\n", path, rows, cols, (double)rows * cols * sizeof(float) / 1e6);
+    matrix_file_writer writer;
+    if (matrix_file_writer_open(&writer, path, MATRIX_F32, MATRIX_ROW_MAJOR, (uint64_t)cols) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    float *row = (float *)malloc((size_t)cols * sizeof(float));
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            row[j] = (float)(rand() % 100) / 100.0f;
+        }
+        if (matrix_file_write(&writer, row, 1) != 0) {
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(row);
+    if (matrix_file_writer_close(&writer) != 0 || matrix_file_load(matrix, path) != 0) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Cold sequential read of a mapping, one float per page, in GB/s
+double read_bandwidth(mapped_file *file) {
+    mapped_file_uncache(file);
+    const volatile char *data = (const volatile char *)file->data;
+    double start = bench_now_ms();
+    mapped_file_advise(file, 0, file->size, MAPPED_FILE_WILLNEED);
+    char sum = 0;
+    for (size_t i = 0; i < file->size; i += 4096) {
+        sum += data[i];
+    }
+    double ms = bench_now_ms() - start;
+    (void)sum;
+    mapped_file_uncache(file);
+    return file->size / (ms * 1e6);
+}
+
+int main(int argc, char **argv) {
+    int device = argc > 1 && strcmp(argv[1], "opencl") == 0;
+    if (argc > 1 && !device && strcmp(argv[1], "host") != 0) {
+        fprintf(stderr, "Backend must be host or opencl\n");
+        exit(EXIT_FAILURE);
+    }
+    int M = 8192, N = 8192, K = 8192;
+    int arg = 2;
+    if (argc > 4) {
+        M = atoi(argv[2]);
+        N = atoi(argv[3]);
+        K = atoi(argv[4]);
+        arg = 5;
+    }
+    size_t memory_mb = argc > arg ? (size_t)atol(argv[arg++]) : 256;
+    const char *dir = argc > arg ? argv[arg++] : ".";
+    if (M <= 0 || N <= 0 || K <= 0 || memory_mb == 0) {
+        fprintf(stderr, "Matrix dimensions and memory must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char path_a[512], path_b[512], path_c[512];
+    snprintf(path_a, sizeof(path_a), "%s/ooc_A.mat", dir);
+    snprintf(path_b, sizeof(path_b), "%s/ooc_B.mat", dir);
+    snprintf(path_c, sizeof(path_c), "%s/ooc_C.mat", dir);
+    if (getenv("MATRIX_C")) {
+        snprintf(path_c, sizeof(path_c), "%s", getenv("MATRIX_C"));
+    }
+    matrix_file A, B, C;
+    if (matrix_file_from_env("MATRIX_A", &A, &M, &K)) {
+        int rows_b;
+        if (!matrix_file_from_env("MATRIX_B", &B, &rows_b, &N) || rows_b != K) {
+            fprintf(stderr, "MATRIX_B must be set too, with as many rows as MATRIX_A has columns\n");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        map_input(&A, path_a, M, K);
+        map_input(&B, path_b, K, N);
+    }
+    if (matrix_file_create(&C, path_c, (uint64_t)M, (uint64_t)N, MATRIX_F32, MATRIX_ROW_MAJOR) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    gemm_ooc_plan plan;
+    if (gemm_ooc_plan_tiles(M, N, K, memory_mb << 20, &plan) != 0) {
+        fprintf(stderr, "%zu MiB is too little memory for %d x %d x %d\n", memory_mb, M, N, K);
+        exit(EXIT_FAILURE);
+    }
+    double files = ((double)M * K + (double)K * N + (double)M * N) * sizeof(float);
+    double traffic = plan.bytes_read + plan.bytes_written;
+    printf("gemm M=%d N=%d K=%d on %s, files %.1f MB\n", M, N, K, device ? "opencl" : "host", files / 1e6);
+    printf("Tiles %d x %d x %d, %s, working set %.1f MiB of %zu MiB\n", plan.tile_m, plan.tile_n, plan.tile_k,
+           plan.keep_a ? "A panel kept per block row" : "all tiles streamed", plan.working_set / 1048576.0, memory_mb);
+    printf("Planned disk traffic %.1f MB (%.2fx the file sizes)\n", traffic / 1e6, traffic / files);
+
+    double disk_gbs = read_bandwidth(&B.file);
+    printf("Cold sequential read: %.2f GB/s\n", disk_gbs);
+    mapped_file_uncache(&A.file);
+
+    gemm_ooc_stats stats;
+    if (device) {
+        cl_runtime *runtime = cl_runtime_get();
+        const cl_source *source = cl_source_get("multiply_matrix.cl");
+        sgemm_opencl_kernel sgemm;
+        cl_int err = sgemm_opencl_init(&sgemm, runtime->context, runtime->device, source->source, source->size, NULL);
+        checkError(err, "Failed to build sgemm_tiled");
+        err = gemm_ooc_opencl(runtime->context, runtime->device, &sgemm, 3, &A, &B, &C, &plan, &stats);
+        checkError(err, "Failed to run the out-of-core GEMM");
+        sgemm_opencl_release(&sgemm);
+    } else if (gemm_ooc_host(&A, &B, &C, &plan, &stats) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    double moved = stats.bytes_read + stats.bytes_written;
+    double gbs = moved / (stats.total_ms * 1e6);
+    printf("%d steps in %.1f ms (compute %.1f ms): %.2f GFLOP/s, %.2f GB/s through the files "
+           "(%.0f%% of the cold read)\n", stats.steps, stats.total_ms, stats.compute_ms,
+           2.0 * M * N * K / (stats.total_ms * 1e6), gbs, 100.0 * gbs / disk_gbs);
+
+    // Spot check against products straight from the files
+    const float *a = (const float *)A.data, *b = (const float *)B.data, *c = (const float *)C.data;
+    double max_error = 0.0;
+    for (int s = 0; s < 64; s++) {
+        int i = rand() % M, j = rand() % N;
+        double expected = 0.0;
+        for (int p = 0; p < K; p++) {
+            expected += (double)a[(size_t)i * K + p] * b[(size_t)p * N + j];
+        }
+        double error = fabs(expected - c[(size_t)i * N + j]) / (fabs(expected) + 1.0);
+        if (error > max_error) max_error = error;
+    }
+    printf("Max relative error (64 samples): %g\n", max_error);
+
+    matrix_file_close(&A);
+    matrix_file_close(&B);
+    matrix_file_close(&C);
+    return max_error > 1e-3 ? 1 : 0;
+}
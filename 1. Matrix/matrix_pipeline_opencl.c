@@ -0,0 +1,304 @@
+#include "sgemm_opencl.c"
+#include "../common/cl_autotune.c"
+#include "../common/cl_source.c"
+#include "../common/cl_cache.c"
+#include "../common/cl_profile.c"
+#include "../common/trace.c"
+#include "../common/cl_trace.c"
+#include "../common/cl_runtime.c"
+#include "../common/cl_pipeline.c"
+#include "../common/bench.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <CL/cl.h>
+
+#define SLOTS 2 // device buffer sets per stage: double buffering
+
+// Chunked execution of an element-wise add and a GEMM, with the transfers of
+// one slab hidden behind the compute of another (see common/cl_pipeline.h).
+//
+// Usage: matrix_pipeline_opencl add [rows cols] [slabs] [queues]
+//        matrix_pipeline_opencl gemm [M N K] [slabs] [queues]
+// add splits C = A + B into slabs of rows. gemm splits C = A * B (A is
+// M x K, B is K x N, as in sgemm) into slabs of rows of A and C; B is sent
+// once, with the first slab. Each operation runs once as a single slab,
+// where nothing can overlap, and once in slabs on 2 or 3 queues.
+
+void checkError(cl_int error, const char *message) {
+    if (error != CL_SUCCESS) {
+        fprintf(stderr, "%s: %d\n", message, error);
+        exit(EXIT_FAILURE);
+    }
+}
+
+typedef struct {
+    int gemm;
+    int rows;          // rows of A and C
+    int cols;          // add: columns of A, B and C; gemm: N
+    int depth;         // gemm: K
+    int slab_rows;
+    float *A, *B, *C;  // pinned host memory
+    cl_mem in[SLOTS], out[SLOTS];
+    cl_mem in_b[SLOTS]; // add: slab of B
+    cl_mem full_b;      // gemm: all of B
+    cl_kernel add;
+    sgemm_opencl_kernel sgemm;
+    size_t add_local;
+    cl_uint compute_units;
+} pipeline_job;
+
+static int slab_first(const pipeline_job *job, int slab) {
+    return slab * job->slab_rows;
+}
+
+static int slab_count(const pipeline_job *job, int slab) {
+    int rows = job->rows - slab_first(job, slab);
+    return rows < job->slab_rows ? rows : job->slab_rows;
+}
+
+static int input_cols(const pipeline_job *job) {
+    return job->gemm ? job->depth : job->cols;
+}
+
+cl_int upload_slab(void *user, int slab, int slot, cl_command_queue queue,
+                   cl_uint num_wait, const cl_event *wait, cl_pipeline_events *done) {
+    pipeline_job *job = (pipeline_job *)user;
+    size_t offset = (size_t)slab_first(job, slab) * input_cols(job);
+    size_t bytes = (size_t)slab_count(job, slab) * input_cols(job) * sizeof(float);
+    cl_event *event = cl_trace_event(cl_pipeline_next(done));
+    cl_int err = clEnqueueWriteBuffer(queue, job->in[slot], CL_FALSE, 0, bytes, job->A + offset,
+                                      num_wait, wait, event);
+    cl_trace_command("write A slab", queue, event, err);
+    if (err == CL_SUCCESS && !job->gemm) {
+        event = cl_trace_event(cl_pipeline_next(done));
+        err = clEnqueueWriteBuffer(queue, job->in_b[slot], CL_FALSE, 0, bytes, job->B + offset,
+                                   0, NULL, event);
+        cl_trace_command("write B slab", queue, event, err);
+    } else if (err == CL_SUCCESS && slab == 0) {
+        event = cl_trace_event(cl_pipeline_next(done));
+        err = clEnqueueWriteBuffer(queue, job->full_b, CL_FALSE, 0, (size_t)job->depth * job->cols * sizeof(float),
+                                   job->B, 0, NULL, event);
+        cl_trace_command("write B", queue, event, err);
+    }
+    return err;
+}
+
+cl_int compute_slab(void *user, int slab, int slot, cl_command_queue queue,
+                    cl_uint num_wait, const cl_event *wait, cl_pipeline_events *done) {
+    pipeline_job *job = (pipeline_job *)user;
+    int rows = slab_count(job, slab);
+    if (job->gemm) {
+        // sgemm_opencl() takes no wait list; the barrier holds it back instead
+        cl_event *barrier = cl_trace_event(NULL);
+        cl_int err = clEnqueueBarrierWithWaitList(queue, num_wait, wait, barrier);
+        cl_trace_command("wait for slab", queue, barrier, err);
+        if (err != CL_SUCCESS) {
+            return err;
+        }
+        return sgemm_opencl(&job->sgemm, queue, GEMM_NO_TRANS, GEMM_NO_TRANS, rows, job->cols, job->depth,
+                            1.0f, job->in[slot], 0, job->depth, job->full_b, 0, job->cols,
+                            0.0f, job->out[slot], 0, job->cols, cl_pipeline_next(done));
+    }
+
+    int num_elements = rows * job->cols;
+    size_t groups = ((size_t)num_elements / 4 + job->add_local - 1) / job->add_local;
+    size_t max_groups = (size_t)job->compute_units * 8;
+    if (groups > max_groups) groups = max_groups;
+    if (groups < 1) groups = 1;
+    size_t global_size = groups * job->add_local;
+    cl_int err = clSetKernelArg(job->add, 0, sizeof(cl_mem), &job->in[slot]);
+    err |= clSetKernelArg(job->add, 1, sizeof(cl_mem), &job->in_b[slot]);
+    err |= clSetKernelArg(job->add, 2, sizeof(cl_mem), &job->out[slot]);
+    err |= clSetKernelArg(job->add, 3, sizeof(int), &num_elements);
+    if (err != CL_SUCCESS) {
+        return err;
+    }
+    cl_event *event = cl_trace_event(cl_pipeline_next(done));
+    err = clEnqueueNDRangeKernel(queue, job->add, 1, NULL, &global_size, &job->add_local,
+                                 num_wait, wait, event);
+    cl_trace_command("add_matrix_vec", queue, event, err);
+    return err;
+}
+
+cl_int download_slab(void *user, int slab, int slot, cl_command_queue queue,
+                     cl_uint num_wait, const cl_event *wait, cl_pipeline_events *done) {
+    pipeline_job *job = (pipeline_job *)user;
+    size_t offset = (size_t)slab_first(job, slab) * job->cols;
+    size_t bytes = (size_t)slab_count(job, slab) * job->cols * sizeof(float);
+    cl_event *event = cl_trace_event(cl_pipeline_next(done));
+    cl_int err = clEnqueueReadBuffer(queue, job->out[slot], CL_FALSE, 0, bytes, job->C + offset,
+                                     num_wait, wait, event);
+    cl_trace_command("read C slab", queue, event, err);
+    return err;
+}
+
+// Slot buffers for slabs of slab_rows rows, then one pipelined run
+cl_pipeline_stats run_job(pipeline_job *job, cl_pipeline *pipeline, int num_slabs, double *host_ms) {
+    cl_int err;
+    job->slab_rows = (job->rows + num_slabs - 1) / num_slabs;
+    num_slabs = (job->rows + job->slab_rows - 1) / job->slab_rows;
+    for (int s = 0; s < SLOTS; s++) {
+        job->in[s] = clCreateBuffer(pipeline->context, CL_MEM_READ_ONLY,
+                                    (size_t)job->slab_rows * input_cols(job) * sizeof(float), NULL, &err);
+        checkError(err, "Failed to create input buffer");
+        job->out[s] = clCreateBuffer(pipeline->context, CL_MEM_WRITE_ONLY,
+                                     (size_t)job->slab_rows * job->cols * sizeof(float), NULL, &err);
+        checkError(err, "Failed to create output buffer");
+        job->in_b[s] = NULL;
+        if (!job->gemm) {
+            job->in_b[s] = clCreateBuffer(pipeline->context, CL_MEM_READ_ONLY,
+                                          (size_t)job->slab_rows * job->cols * sizeof(float), NULL, &err);
+            checkError(err, "Failed to create input buffer");
+        }
+    }
+
+    cl_pipeline_stats stats;
+    double start = bench_now_ms();
+    err = cl_pipeline_run(pipeline, num_slabs, SLOTS, upload_slab, compute_slab, download_slab, job, &stats);
+    *host_ms = bench_now_ms() - start;
+    checkError(err, "Failed to run pipeline");
+
+    for (int s = 0; s < SLOTS; s++) {
+        clReleaseMemObject(job->in[s]);
+        clReleaseMemObject(job->out[s]);
+        if (job->in_b[s]) {
+            clReleaseMemObject(job->in_b[s]);
+        }
+    }
+    return stats;
+}
+
+void print_stats(const char *label, const cl_pipeline_stats *stats, double host_ms) {
+    printf("%-26s span %8.3f ms (host %8.3f ms), upload %8.3f, compute %8.3f, download %8.3f\n",
+           label, stats->span_ms, host_ms, stats->upload_ms, stats->compute_ms, stats->download_ms);
+}
+
+int main(int argc, char **argv) {
+    pipeline_job job;
+    memset(&job, 0, sizeof(job));
+    job.gemm = argc > 1 && strcmp(argv[1], "gemm") == 0;
+    if (argc > 1 && !job.gemm && strcmp(argv[1], "add") != 0) {
+        fprintf(stderr, "Operation must be add or gemm\n");
+        exit(EXIT_FAILURE);
+    }
+    int num_dims = job.gemm ? 3 : 2;
+    int dims[3] = {4096, 4096, 1};
+    if (job.gemm) {
+        dims[0] = dims[1] = dims[2] = 2048;
+    }
+    int arg = 2;
+    if (argc > 1 + num_dims) {
+        for (int d = 0; d < num_dims; d++) {
+            dims[d] = atoi(argv[arg++]);
+        }
+    }
+    int num_slabs = argc > arg ? atoi(argv[arg++]) : 8;
+    int num_queues = argc > arg ? atoi(argv[arg++]) : 3;
+    job.rows = dims[0];
+    job.cols = dims[1];
+    job.depth = dims[2];
+    if (job.rows <= 0 || job.cols <= 0 || job.depth <= 0 || num_slabs <= 0) {
+        fprintf(stderr, "Matrix dimensions and slab count must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+
+    cl_runtime *runtime = cl_runtime_get();
+    cl_pipeline pipeline;
+    cl_int err = cl_pipeline_create(&pipeline, runtime->context, runtime->device, num_queues);
+    checkError(err, "Failed to create pipeline queues (2 or 3)");
+
+    // Pinned host operands, so the copies run asynchronously
+    size_t a_count = (size_t)job.rows * input_cols(&job);
+    size_t b_count = job.gemm ? (size_t)job.depth * job.cols : a_count;
+    size_t c_count = (size_t)job.rows * job.cols;
+    job.A = (float *)cl_pipeline_pinned(&pipeline, a_count * sizeof(float), &err);
+    checkError(err, "Failed to allocate pinned memory");
+    job.B = (float *)cl_pipeline_pinned(&pipeline, b_count * sizeof(float), &err);
+    checkError(err, "Failed to allocate pinned memory");
+    job.C = (float *)cl_pipeline_pinned(&pipeline, c_count * sizeof(float), &err);
+    checkError(err, "Failed to allocate pinned memory");
+    float *C_single = (float *)malloc(c_count * sizeof(float));
+    for (size_t i = 0; i < a_count; i++) {
+        job.A[i] = (float)(rand() % 100) / 100.0f;
+    }
+    for (size_t i = 0; i < b_count; i++) {
+        job.B[i] = (float)(rand() % 100) / 100.0f;
+    }
+
+    if (job.gemm) {
+        job.full_b = clCreateBuffer(runtime->context, CL_MEM_READ_ONLY, b_count * sizeof(float), NULL, &err);
+        checkError(err, "Failed to create buffer for B");
+        // Tiles tuned for multiply_matrix_tiled on the full problem, if any
+        char device_key[AUTOTUNE_KEY_SIZE], tuning_key[128];
+        int size_class[3] = {1, 1, 1};
+        while (size_class[0] < job.rows) size_class[0] *= 2;
+        while (size_class[1] < job.depth) size_class[1] *= 2;
+        while (size_class[2] < job.cols) size_class[2] *= 2;
+        snprintf(tuning_key, sizeof(tuning_key), "multiply_matrix_tiled/%dx%dx%d",
+                 size_class[0], size_class[1], size_class[2]);
+        autotune_device_key(runtime->device, device_key, sizeof(device_key));
+        autotune_config config;
+        int tuned = autotune_lookup(device_key, tuning_key, &config) == 0;
+        const cl_source *source = cl_source_get("multiply_matrix.cl");
+        err = sgemm_opencl_init(&job.sgemm, runtime->context, runtime->device, source->source, source->size,
+                                tuned ? &config : NULL);
+        checkError(err, "Failed to build sgemm_tiled");
+        printf("gemm M=%d N=%d K=%d\n", job.rows, job.cols, job.depth);
+    } else {
+        job.add = cl_runtime_kernel("add_matrix.cl", "-DVW=4", "add_matrix_vec");
+        if (!job.add) {
+            exit(EXIT_FAILURE);
+        }
+        job.add_local = 256;
+        clGetDeviceInfo(runtime->device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(job.compute_units),
+                        &job.compute_units, NULL);
+        printf("add %d x %d\n", job.rows, job.cols);
+    }
+
+    // One slab: upload, compute and download strictly one after the other
+    double host_ms;
+    cl_pipeline_stats single = run_job(&job, &pipeline, 1, &host_ms);
+    print_stats("single slab:", &single, host_ms);
+    memcpy(C_single, job.C, c_count * sizeof(float));
+    memset(job.C, 0, c_count * sizeof(float));
+
+    cl_pipeline_stats chunked = run_job(&job, &pipeline, num_slabs, &host_ms);
+    char label[64];
+    snprintf(label, sizeof(label), "%d slabs, %d queues:", num_slabs, num_queues);
+    print_stats(label, &chunked, host_ms);
+    printf("Overlap efficiency: %.1f%% of the hideable %.3f ms hidden, %.2fx faster than one slab "
+           "(bound %.3f ms)\n", 100.0 * chunked.efficiency, chunked.serial_ms - chunked.bound_ms,
+           single.span_ms / chunked.span_ms, chunked.bound_ms);
+
+    // Slabs must not change the result, and the result must be right
+    size_t mismatches = 0;
+    for (size_t i = 0; i < c_count; i++) {
+        if (job.C[i] != C_single[i]) mismatches++;
+    }
+    double max_error = 0.0;
+    for (int s = 0; s < 64; s++) {
+        int i = rand() % job.rows, j = rand() % job.cols;
+        double expected = 0.0;
+        if (job.gemm) {
+            for (int p = 0; p < job.depth; p++) {
+                expected += (double)job.A[(size_t)i * job.depth + p] * job.B[(size_t)p * job.cols + j];
+            }
+        } else {
+            expected = (double)job.A[(size_t)i * job.cols + j] + job.B[(size_t)i * job.cols + j];
+        }
+        double error = fabs(expected - job.C[(size_t)i * job.cols + j]) / (fabs(expected) + 1.0);
+        if (error > max_error) max_error = error;
+    }
+    printf("Differences to the single slab: %zu, max relative error (64 samples): %g\n", mismatches, max_error);
+
+    if (job.gemm) {
+        sgemm_opencl_release(&job.sgemm);
+        clReleaseMemObject(job.full_b);
+    }
+    cl_pipeline_release(&pipeline);
+    free(C_single);
+
+    return mismatches ? 1 : 0;
+}
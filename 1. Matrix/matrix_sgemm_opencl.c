@@ -0,0 +1,218 @@
+#include "thread_pool.c"
+#include "simd_kernels.c"
+#include "gemm.c"
+#include "sgemm_opencl.c"
+#include "../common/cl_autotune.c"
+#include "../common/cl_source.c"
+#include "../common/cl_cache.c"
+#include "../common/cl_profile.c"
+#include "../common/trace.c"
+#include "../common/cl_trace.c"
+#include "../common/bench.c"
+#include "../common/cl_runtime.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <CL/cl.h>
+
+#define BORDER 3 // rows and columns of padding around every operand
+
+// BLAS-style sgemm on the host and the device: C = alpha * op(A) * op(B) + beta * C.
+//
+// Usage: matrix_sgemm_opencl [M N K] [NN|NT|TN|TT] [alpha beta]
+// Every operand is stored as a sub-block of a larger array (BORDER rows and
+// columns around it), so both backends run on strided, offset views of the
+// data, and transposed operands are stored transposed.
+
+void checkError(cl_int error, const char *message) {
+    if (error != CL_SUCCESS) {
+        fprintf(stderr, "%s: %d\n", message, error);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// A rows x cols view inside a (rows + 2 * BORDER) x (cols + 2 * BORDER) array
+typedef struct {
+    float *data;
+    int rows, cols;
+    int ld;
+    int offset;
+} matrix_view;
+
+matrix_view view_alloc(int rows, int cols) {
+    matrix_view view;
+    view.rows = rows;
+    view.cols = cols;
+    view.ld = cols + 2 * BORDER;
+    view.offset = BORDER * view.ld + BORDER;
+    size_t count = (size_t)(rows + 2 * BORDER) * view.ld;
+    view.data = gemm_alloc(count);
+    for (size_t i = 0; i < count; i++) {
+        view.data[i] = (float)(rand() % 100) / 100.0f;
+    }
+    return view;
+}
+
+size_t view_size(const matrix_view *view) {
+    return (size_t)(view->rows + 2 * BORDER) * view->ld * sizeof(float);
+}
+
+float view_at(const matrix_view *view, int i, int j) {
+    return view->data[view->offset + (size_t)i * view->ld + j];
+}
+
+int main(int argc, char **argv) {
+    int M = 512, N = 512, K = 512;
+    gemm_trans transA = GEMM_NO_TRANS, transB = GEMM_NO_TRANS;
+    float alpha = 1.5f, beta = 0.5f;
+    int arg = 1;
+    if (argc > 3) {
+        M = atoi(argv[1]);
+        N = atoi(argv[2]);
+        K = atoi(argv[3]);
+        arg = 4;
+    }
+    if (argc > arg) {
+        if (strlen(argv[arg]) != 2 || strspn(argv[arg], "NT") != 2) {
+            fprintf(stderr, "Transposes must be NN, NT, TN or TT\n");
+            exit(EXIT_FAILURE);
+        }
+        transA = argv[arg][0] == 'T' ? GEMM_TRANS : GEMM_NO_TRANS;
+        transB = argv[arg][1] == 'T' ? GEMM_TRANS : GEMM_NO_TRANS;
+        arg++;
+    }
+    if (argc > arg + 1) {
+        alpha = (float)atof(argv[arg]);
+        beta = (float)atof(argv[arg + 1]);
+    }
+    if (M <= 0 || N <= 0 || K <= 0) {
+        fprintf(stderr, "Matrix dimensions must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // op(A) is M x K and op(B) K x N, stored transposed when requested
+    matrix_view A = transA == GEMM_TRANS ? view_alloc(K, M) : view_alloc(M, K);
+    matrix_view B = transB == GEMM_TRANS ? view_alloc(N, K) : view_alloc(K, N);
+    matrix_view C = view_alloc(M, N);
+    float *C_initial = gemm_alloc(view_size(&C) / sizeof(float));
+    float *C_device = gemm_alloc(view_size(&C) / sizeof(float));
+    memcpy(C_initial, C.data, view_size(&C));
+
+    printf("sgemm %c%c, M=%d N=%d K=%d, alpha=%g beta=%g, lda=%d ldb=%d ldc=%d\n",
+           transA == GEMM_TRANS ? 'T' : 'N', transB == GEMM_TRANS ? 'T' : 'N', M, N, K, alpha, beta,
+           A.ld, B.ld, C.ld);
+    double flops = 2.0 * M * N * K;
+
+    // Host
+    thread_pool *pool = thread_pool_default();
+    double start = bench_now_ms();
+    sgemm(transA, transB, M, N, K, alpha, A.data + A.offset, A.ld, B.data + B.offset, B.ld,
+          beta, C.data + C.offset, C.ld);
+    double host_ms = bench_now_ms() - start;
+    printf("Host Execution Time: %.3f ms (%.2f GFLOP/s, %d threads)\n", host_ms,
+           flops / (host_ms * 1.0e6), thread_pool_size(pool));
+
+    // Kernel source, embedded at build time (see common/cl_source.h)
+    const cl_source *kernel_source = cl_source_get("multiply_matrix.cl");
+    const char *source_str = kernel_source->source;
+    size_t source_size = kernel_source->size;
+
+    // The shared runtime's device: the first GPU, else any device, or the
+    // type in CL_RUNTIME_DEVICE (see common/cl_runtime.h)
+    cl_runtime *runtime = cl_runtime_get();
+    cl_device_id device_id = runtime->device;
+    cl_context context = runtime->context;
+    cl_command_queue command_queue = runtime->queue;
+    cl_int ret;
+
+    // Whole arrays go to the device; the kernel only touches the views
+    cl_mem memobjA = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, view_size(&A), A.data, &ret);
+    checkError(ret, "Failed to create buffer for A");
+    cl_mem memobjB = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, view_size(&B), B.data, &ret);
+    checkError(ret, "Failed to create buffer for B");
+    cl_mem memobjC = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, view_size(&C), C_initial, &ret);
+    checkError(ret, "Failed to create buffer for C");
+
+    // Tiles tuned for multiply_matrix_tiled on this size class, if any
+    char device_key[AUTOTUNE_KEY_SIZE], tuning_key[128];
+    int size_class[3] = {1, 1, 1};
+    while (size_class[0] < M) size_class[0] *= 2;
+    while (size_class[1] < K) size_class[1] *= 2;
+    while (size_class[2] < N) size_class[2] *= 2;
+    snprintf(tuning_key, sizeof(tuning_key), "multiply_matrix_tiled/%dx%dx%d",
+             size_class[0], size_class[1], size_class[2]);
+    autotune_device_key(device_id, device_key, sizeof(device_key));
+    autotune_config config;
+    int tuned = autotune_lookup(device_key, tuning_key, &config) == 0;
+
+    sgemm_opencl_kernel kernel;
+    ret = sgemm_opencl_init(&kernel, context, device_id, source_str, source_size, tuned ? &config : NULL);
+    checkError(ret, "Failed to build sgemm_tiled");
+    printf("Tiles: TS=%d TSK=%d WPTM=%d WPTN=%d (%s)\n", kernel.ts, kernel.tsk, kernel.wptm, kernel.wptn,
+           tuned ? "tuned" : "defaults");
+
+    cl_event event;
+    ret = sgemm_opencl(&kernel, command_queue, transA, transB, M, N, K, alpha, memobjA, A.offset, A.ld,
+                       memobjB, B.offset, B.ld, beta, memobjC, C.offset, C.ld, &event);
+    checkError(ret, "Failed to enqueue sgemm");
+    clWaitForEvents(1, &event);
+    cl_ulong time_start, time_end;
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+    clReleaseEvent(event);
+    double kernel_ms = (double)(time_end - time_start) * 1e-6;
+    printf("Kernel Execution Time: %0.3f ms (%.2f GFLOP/s)\n", kernel_ms, flops / (kernel_ms * 1.0e6));
+
+    cl_event *read_event = cl_trace_event(NULL);
+    ret = clEnqueueReadBuffer(command_queue, memobjC, CL_TRUE, 0, view_size(&C), C_device, 0, NULL, read_event);
+    cl_trace_command("read C", command_queue, read_event, ret);
+    checkError(ret, "Failed to read output array C");
+
+    // Spot-check both results against a double-precision reference, and make
+    // sure neither backend wrote outside the C view
+    double host_error = 0.0, device_error = 0.0;
+    for (int s = 0; s < 256; s++) {
+        int i = rand() % M, j = rand() % N;
+        double sum = 0.0;
+        for (int p = 0; p < K; p++) {
+            double a = transA == GEMM_TRANS ? view_at(&A, p, i) : view_at(&A, i, p);
+            double b = transB == GEMM_TRANS ? view_at(&B, j, p) : view_at(&B, p, j);
+            sum += a * b;
+        }
+        size_t index = C.offset + (size_t)i * C.ld + j;
+        double expected = alpha * sum + beta * C_initial[index];
+        double scale = fabs(expected) + 1.0;
+        host_error = fmax(host_error, fabs(C.data[index] - expected) / scale);
+        device_error = fmax(device_error, fabs(C_device[index] - expected) / scale);
+    }
+    int outside = 0;
+    for (int i = 0; i < C.rows + 2 * BORDER; i++) {
+        for (int j = 0; j < C.ld; j++) {
+            int inside = i >= BORDER && i < BORDER + M && j >= BORDER && j < BORDER + N;
+            size_t index = (size_t)i * C.ld + j;
+            if (!inside && (C.data[index] != C_initial[index] || C_device[index] != C_initial[index])) {
+                outside++;
+            }
+        }
+    }
+    printf("Max relative error (256 samples): host %g, device %g\n", host_error, device_error);
+    if (outside) {
+        printf("%d entries outside the C view were modified\n", outside);
+    }
+
+    // Cleanup
+    sgemm_opencl_release(&kernel);
+    ret = clReleaseMemObject(memobjA);
+    ret |= clReleaseMemObject(memobjB);
+    ret |= clReleaseMemObject(memobjC);
+    checkError(ret, "Failed during cleanup");
+
+    gemm_free(A.data);
+    gemm_free(B.data);
+    gemm_free(C.data);
+    gemm_free(C_initial);
+    gemm_free(C_device);
+
+    return outside ? 1 : 0;
+}
@@ -0,0 +1,415 @@
+#include "thread_pool.c"
+#include "simd_kernels.c"
+#include "gemm.c"
+#include "sparse.c"
+#include "../common/bench.c"
+#include "../common/cl_source.c"
+#include "../common/cl_cache.c"
+#include "../common/cl_profile.c"
+#include "../common/trace.c"
+#include "../common/cl_trace.c"
+#include "../common/cl_runtime.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <CL/cl.h>
+
+#define LONG_ROW 64        // rows with more nonzeros get a work-group of their own
+#define VECTOR_GROUP 64    // work-items per long row, a power of two
+#define ELL_MAX_FILL 4.0   // skip ELLPACK when padding would store more than this per nonzero
+
+// Sparse products on the host pool and on the device, for the CSR, ELLPACK
+// and SELL-C-sigma layouts of sparse.h, against the dense GEMM.
+//
+// Usage: matrix_sparse_opencl [rows cols] [density] [N]
+// A is rows x cols with about density * cols nonzeros per row on average and
+// a heavy tail of long rows; x has cols entries and X is cols x N.
+
+void checkError(cl_int error, const char *message) {
+    if (error != CL_SUCCESS) {
+        fprintf(stderr, "%s: %d\n", message, error);
+        exit(EXIT_FAILURE);
+    }
+}
+
+double event_time_ms(cl_event event) {
+    cl_ulong time_start, time_end;
+    clWaitForEvents(1, &event);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+    clReleaseEvent(event);
+    return (double)(time_end - time_start) * 1e-6;
+}
+
+double max_relative_error(const float *result, const float *reference, size_t count) {
+    double max_error = 0.0, max_value = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        double error = fabs((double)result[i] - reference[i]);
+        if (error > max_error) max_error = error;
+        if (fabs(reference[i]) > max_value) max_value = fabs(reference[i]);
+    }
+    return max_value > 0.0 ? max_error / max_value : max_error;
+}
+
+cl_mem create_buffer(cl_context context, size_t size, const void *data) {
+    cl_int ret;
+    cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE | (data ? CL_MEM_COPY_HOST_PTR : 0),
+                                   size ? size : sizeof(float), (void *)data, &ret);
+    checkError(ret, "Failed to create buffer");
+    return buffer;
+}
+
+cl_kernel create_kernel(cl_program program, const char *name) {
+    cl_int ret;
+    cl_kernel kernel = clCreateKernel(program, name, &ret);
+    checkError(ret, "Failed to create kernel");
+    return kernel;
+}
+
+// Sets the arguments from a list of (size, pointer) pairs
+void set_args(cl_kernel kernel, int count, const size_t *sizes, const void *const *values) {
+    cl_int ret = CL_SUCCESS;
+    for (int i = 0; i < count; i++) {
+        ret |= clSetKernelArg(kernel, i, sizes[i], values[i]);
+    }
+    checkError(ret, "Failed to set kernel arguments");
+}
+
+double launch(cl_command_queue queue, cl_kernel kernel, cl_uint dims, const size_t *global_size, const size_t *local_size) {
+    cl_event event;
+    cl_event *traced = cl_trace_event(&event);
+    cl_int ret = clEnqueueNDRangeKernel(queue, kernel, dims, NULL, global_size, local_size, 0, NULL, traced);
+    if (trace_enabled()) {
+        char name[64] = "";
+        clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, sizeof(name) - 1, name, NULL);
+        cl_trace_command(name, queue, traced, ret);
+    }
+    checkError(ret, "Failed to enqueue NDRange kernel");
+    return event_time_ms(event);
+}
+
+// Blocking read of size bytes, traced as name
+cl_int read_buffer(cl_command_queue queue, cl_mem buffer, size_t size, void *host, const char *name) {
+    cl_event *event = cl_trace_event(NULL);
+    cl_int ret = clEnqueueReadBuffer(queue, buffer, CL_TRUE, 0, size, host, 0, NULL, event);
+    cl_trace_command(name, queue, event, ret);
+    return ret;
+}
+
+size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+int main(int argc, char **argv) {
+    int rows = 4096, cols = 4096, N = 32;
+    double density = 0.02;
+    int arg = 1;
+    if (argc > 2) {
+        rows = atoi(argv[1]);
+        cols = atoi(argv[2]);
+        arg = 3;
+    }
+    if (argc > arg) {
+        density = atof(argv[arg++]);
+    }
+    if (argc > arg) {
+        N = atoi(argv[arg]);
+    }
+    if (rows <= 0 || cols <= 0 || N <= 0 || density <= 0.0 || density > 1.0) {
+        fprintf(stderr, "Dimensions must be positive and density in (0, 1]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Dense A with a heavy-tailed row length: about density * cols on average,
+    // a few rows many times longer, the kind of input an even row split handles badly
+    float *A = gemm_alloc((size_t)rows * cols);
+    memset(A, 0, (size_t)rows * cols * sizeof(float));
+    for (int i = 0; i < rows; i++) {
+        double u = (rand() + 1.0) / ((double)RAND_MAX + 1.0);
+        int length = (int)(0.5 * density * cols / sqrt(u));
+        if (length > cols) length = cols;
+        for (int k = 0; k < length; k++) {
+            A[(size_t)i * cols + rand() % cols] = (float)(rand() % 100) / 100.0f + 0.01f;
+        }
+    }
+    float *x = gemm_alloc(cols);
+    float *X = gemm_alloc((size_t)cols * N);
+    for (int j = 0; j < cols; j++) {
+        x[j] = (float)(rand() % 100) / 100.0f;
+    }
+    for (size_t j = 0; j < (size_t)cols * N; j++) {
+        X[j] = (float)(rand() % 100) / 100.0f;
+    }
+
+    // Conversions from dense
+    csr_matrix csr;
+    ell_matrix ell;
+    sell_matrix sell;
+    double start = bench_now_ms();
+    if (csr_from_dense(&csr, rows, cols, A, cols, 0.0f) != 0) {
+        fprintf(stderr, "Failed to allocate CSR matrix\n");
+        exit(EXIT_FAILURE);
+    }
+    double csr_ms = bench_now_ms() - start;
+    start = bench_now_ms();
+    if (sell_from_csr(&sell, &csr, SELL_C, SELL_SIGMA) != 0) {
+        fprintf(stderr, "Failed to allocate SELL matrix\n");
+        exit(EXIT_FAILURE);
+    }
+    double sell_ms = bench_now_ms() - start;
+    int max_row = 0;
+    for (int i = 0; i < rows; i++) {
+        int length = csr.row_ptr[i + 1] - csr.row_ptr[i];
+        if (length > max_row) max_row = length;
+    }
+    int use_ell = (double)max_row * rows <= ELL_MAX_FILL * csr.nnz;
+    if (use_ell && ell_from_csr(&ell, &csr) != 0) {
+        fprintf(stderr, "Failed to allocate ELLPACK matrix\n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Matrix: %d x %d, %d nonzeros (%.2f%%), longest row %d, average %.1f\n", rows, cols, csr.nnz,
+           100.0 * csr.nnz / ((double)rows * cols), max_row, (double)csr.nnz / rows);
+    printf("Conversion: dense to CSR %.2f ms, CSR to SELL-%d-%d %.2f ms\n", csr_ms, sell.C, sell.sigma, sell_ms);
+    if (use_ell) {
+        printf("Stored entries per nonzero: ELL %.2f, SELL %.2f\n", ell_fill(&ell, csr.nnz), sell_fill(&sell, csr.nnz));
+    } else {
+        printf("Stored entries per nonzero: ELL %.2f (skipped), SELL %.2f\n",
+               (double)max_row * rows / csr.nnz, sell_fill(&sell, csr.nnz));
+    }
+
+    // Host: references from the dense GEMM, then the sparse products
+    thread_pool *pool = thread_pool_default();
+    float *y_reference = gemm_alloc(rows);
+    float *Y_reference = gemm_alloc((size_t)rows * N);
+    float *y = gemm_alloc(rows);
+    float *Y = gemm_alloc((size_t)rows * N);
+    gemm_parallel(pool, rows, 1, cols, A, cols, x, 1, y_reference, 1);
+    start = bench_now_ms();
+    gemm_parallel(pool, rows, N, cols, A, cols, X, N, Y_reference, N);
+    double dense_ms = bench_now_ms() - start;
+
+    double spmv_flops = 2.0 * csr.nnz, spmm_flops = 2.0 * csr.nnz * N;
+    printf("Host, %d threads:\n", thread_pool_size(pool));
+    printf("  dense GEMM      %8.3f ms\n", dense_ms);
+
+    spmv_csr(pool, &csr, x, y); // warm-up
+    start = bench_now_ms();
+    spmv_csr(pool, &csr, x, y);
+    double ms = bench_now_ms() - start;
+    printf("  SpMV CSR        %8.3f ms (%.2f GFLOP/s), error %g\n", ms, spmv_flops / (ms * 1.0e6),
+           max_relative_error(y, y_reference, rows));
+
+    spmv_sell(pool, &sell, x, y);
+    start = bench_now_ms();
+    spmv_sell(pool, &sell, x, y);
+    ms = bench_now_ms() - start;
+    printf("  SpMV SELL       %8.3f ms (%.2f GFLOP/s), error %g\n", ms, spmv_flops / (ms * 1.0e6),
+           max_relative_error(y, y_reference, rows));
+
+    start = bench_now_ms();
+    spmm_csr(pool, &csr, N, X, N, Y, N);
+    ms = bench_now_ms() - start;
+    printf("  SpMM CSR        %8.3f ms (%.2f GFLOP/s, %.1fx dense), error %g\n", ms, spmm_flops / (ms * 1.0e6),
+           dense_ms / ms, max_relative_error(Y, Y_reference, (size_t)rows * N));
+
+    start = bench_now_ms();
+    spmm_sell(pool, &sell, N, X, N, Y, N);
+    ms = bench_now_ms() - start;
+    printf("  SpMM SELL       %8.3f ms (%.2f GFLOP/s, %.1fx dense), error %g\n", ms, spmm_flops / (ms * 1.0e6),
+           dense_ms / ms, max_relative_error(Y, Y_reference, (size_t)rows * N));
+
+    // Kernel source, embedded at build time (see common/cl_source.h)
+    const cl_source *kernel_source = cl_source_get("sparse_matrix.cl");
+    const char *source_str = kernel_source->source;
+    size_t source_size = kernel_source->size;
+
+    // The shared runtime's device: the first GPU, else any device, or the
+    // type in CL_RUNTIME_DEVICE (see common/cl_runtime.h)
+    cl_runtime *runtime = cl_runtime_get();
+    cl_device_id device_id = runtime->device;
+    cl_context context = runtime->context;
+    cl_command_queue command_queue = runtime->queue;
+    cl_int ret;
+
+    // Build the program, or load it from the binary cache (common/cl_cache.h)
+    cl_program program = cl_cache_build(context, device_id, source_str, source_size, kernel_source->hash, NULL,
+                                        &ret, NULL);
+    if (!program) {
+        checkError(ret, "Failed to create program");
+    }
+    if (ret != CL_SUCCESS) {
+        char build_log[2048];
+        clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, sizeof(build_log), build_log, NULL);
+        fprintf(stderr, "Error in kernel build:\n%s\n", build_log);
+        exit(1);
+    }
+
+    // Rows binned by length: short ones one per work-item, long ones one per work-group
+    int *short_rows = (int *)malloc(rows * sizeof(int));
+    int *long_rows = (int *)malloc(rows * sizeof(int));
+    int *all_rows = (int *)malloc(rows * sizeof(int));
+    int num_short, num_long;
+    csr_bin_rows(&csr, LONG_ROW, short_rows, &num_short, long_rows, &num_long);
+    for (int i = 0; i < rows; i++) {
+        all_rows[i] = i;
+    }
+
+    // Device buffers
+    cl_mem memRowPtr = create_buffer(context, (rows + 1) * sizeof(int), csr.row_ptr);
+    cl_mem memColIdx = create_buffer(context, csr.nnz * sizeof(int), csr.col_idx);
+    cl_mem memValues = create_buffer(context, csr.nnz * sizeof(float), csr.values);
+    cl_mem memShortRows = create_buffer(context, num_short * sizeof(int), short_rows);
+    cl_mem memLongRows = create_buffer(context, num_long * sizeof(int), long_rows);
+    cl_mem memAllRows = create_buffer(context, rows * sizeof(int), all_rows);
+    size_t sell_entries = sell.slice_ptr[sell.num_slices];
+    cl_mem memSlicePtr = create_buffer(context, (sell.num_slices + 1) * sizeof(int), sell.slice_ptr);
+    cl_mem memSliceWidth = create_buffer(context, sell.num_slices * sizeof(int), sell.slice_width);
+    cl_mem memPerm = create_buffer(context, rows * sizeof(int), sell.perm);
+    cl_mem memSellColIdx = create_buffer(context, sell_entries * sizeof(int), sell.col_idx);
+    cl_mem memSellValues = create_buffer(context, sell_entries * sizeof(float), sell.values);
+    cl_mem memEllColIdx = NULL, memEllValues = NULL;
+    if (use_ell) {
+        memEllColIdx = create_buffer(context, (size_t)ell.width * rows * sizeof(int), ell.col_idx);
+        memEllValues = create_buffer(context, (size_t)ell.width * rows * sizeof(float), ell.values);
+    }
+    cl_mem memX = create_buffer(context, cols * sizeof(float), x);
+    cl_mem memXN = create_buffer(context, (size_t)cols * N * sizeof(float), X);
+    cl_mem memY = create_buffer(context, rows * sizeof(float), NULL);
+    cl_mem memYN = create_buffer(context, (size_t)rows * N * sizeof(float), NULL);
+
+    size_t int_size = sizeof(int), mem_size = sizeof(cl_mem);
+    size_t local_size[2], global_size[2];
+    printf("Device (%d short rows, %d long rows of more than %d nonzeros):\n", num_short, num_long, LONG_ROW);
+
+    // SpMV CSR: both bins back to back
+    cl_kernel scalar_kernel = create_kernel(program, "spmv_csr_scalar");
+    cl_kernel vector_kernel = create_kernel(program, "spmv_csr_vector");
+    ms = 0.0;
+    if (num_short > 0) {
+        size_t sizes[] = {int_size, mem_size, mem_size, mem_size, mem_size, mem_size, mem_size};
+        const void *values[] = {&num_short, &memShortRows, &memRowPtr, &memColIdx, &memValues, &memX, &memY};
+        set_args(scalar_kernel, 7, sizes, values);
+        local_size[0] = 64;
+        global_size[0] = round_up(num_short, local_size[0]);
+        ms += launch(command_queue, scalar_kernel, 1, global_size, local_size);
+    }
+    if (num_long > 0) {
+        size_t sizes[] = {int_size, mem_size, mem_size, mem_size, mem_size, mem_size, mem_size, VECTOR_GROUP * sizeof(float)};
+        const void *values[] = {&num_long, &memLongRows, &memRowPtr, &memColIdx, &memValues, &memX, &memY, NULL};
+        set_args(vector_kernel, 8, sizes, values);
+        local_size[0] = VECTOR_GROUP;
+        global_size[0] = (size_t)num_long * VECTOR_GROUP;
+        ms += launch(command_queue, vector_kernel, 1, global_size, local_size);
+    }
+    ret = read_buffer(command_queue, memY, rows * sizeof(float), y, "read y");
+    checkError(ret, "Failed to read y");
+    printf("  SpMV CSR        %8.3f ms (%.2f GFLOP/s), error %g\n", ms, spmv_flops / (ms * 1.0e6),
+           max_relative_error(y, y_reference, rows));
+
+    // SpMV ELL
+    cl_kernel ell_kernel = NULL;
+    if (use_ell) {
+        ell_kernel = create_kernel(program, "spmv_ell");
+        size_t sizes[] = {int_size, int_size, mem_size, mem_size, mem_size, mem_size};
+        const void *values[] = {&rows, &ell.width, &memEllColIdx, &memEllValues, &memX, &memY};
+        set_args(ell_kernel, 6, sizes, values);
+        local_size[0] = 64;
+        global_size[0] = round_up(rows, local_size[0]);
+        ms = launch(command_queue, ell_kernel, 1, global_size, local_size);
+        ret = read_buffer(command_queue, memY, rows * sizeof(float), y, "read y");
+        checkError(ret, "Failed to read y");
+        printf("  SpMV ELL        %8.3f ms (%.2f GFLOP/s), error %g\n", ms, spmv_flops / (ms * 1.0e6),
+               max_relative_error(y, y_reference, rows));
+    }
+
+    // SpMV SELL: one work-group per slice
+    cl_kernel sell_kernel = create_kernel(program, "spmv_sell");
+    {
+        size_t sizes[] = {int_size, int_size, mem_size, mem_size, mem_size, mem_size, mem_size, mem_size, mem_size};
+        const void *values[] = {&rows, &sell.C, &memSlicePtr, &memSliceWidth, &memPerm, &memSellColIdx,
+                                &memSellValues, &memX, &memY};
+        set_args(sell_kernel, 9, sizes, values);
+        local_size[0] = sell.C;
+        global_size[0] = (size_t)sell.num_slices * sell.C;
+        ms = launch(command_queue, sell_kernel, 1, global_size, local_size);
+        ret = read_buffer(command_queue, memY, rows * sizeof(float), y, "read y");
+        checkError(ret, "Failed to read y");
+        printf("  SpMV SELL       %8.3f ms (%.2f GFLOP/s), error %g\n", ms, spmv_flops / (ms * 1.0e6),
+               max_relative_error(y, y_reference, rows));
+    }
+
+    // SpMM CSR over all rows
+    cl_kernel spmm_csr_kernel = create_kernel(program, "spmm_csr");
+    {
+        size_t sizes[] = {int_size, int_size, mem_size, mem_size, mem_size, mem_size, mem_size, mem_size};
+        const void *values[] = {&rows, &N, &memAllRows, &memRowPtr, &memColIdx, &memValues, &memXN, &memYN};
+        set_args(spmm_csr_kernel, 8, sizes, values);
+        local_size[0] = N < 32 ? N : 32;
+        local_size[1] = 64 / local_size[0] > 0 ? 64 / local_size[0] : 1;
+        global_size[0] = round_up(N, local_size[0]);
+        global_size[1] = round_up(rows, local_size[1]);
+        ms = launch(command_queue, spmm_csr_kernel, 2, global_size, local_size);
+        ret = read_buffer(command_queue, memYN, (size_t)rows * N * sizeof(float), Y, "read Y");
+        checkError(ret, "Failed to read Y");
+        printf("  SpMM CSR        %8.3f ms (%.2f GFLOP/s), error %g\n", ms, spmm_flops / (ms * 1.0e6),
+               max_relative_error(Y, Y_reference, (size_t)rows * N));
+    }
+
+    // SpMM SELL
+    cl_kernel spmm_sell_kernel = create_kernel(program, "spmm_sell");
+    {
+        size_t sizes[] = {int_size, int_size, int_size, mem_size, mem_size, mem_size, mem_size, mem_size, mem_size, mem_size};
+        const void *values[] = {&rows, &N, &sell.C, &memSlicePtr, &memSliceWidth, &memPerm, &memSellColIdx,
+                                &memSellValues, &memXN, &memYN};
+        set_args(spmm_sell_kernel, 10, sizes, values);
+        local_size[0] = N < 32 ? N : 32;
+        local_size[1] = 64 / local_size[0] > 0 ? 64 / local_size[0] : 1;
+        global_size[0] = round_up(N, local_size[0]);
+        global_size[1] = round_up(rows, local_size[1]);
+        ms = launch(command_queue, spmm_sell_kernel, 2, global_size, local_size);
+        ret = read_buffer(command_queue, memYN, (size_t)rows * N * sizeof(float), Y, "read Y");
+        checkError(ret, "Failed to read Y");
+        printf("  SpMM SELL       %8.3f ms (%.2f GFLOP/s), error %g\n", ms, spmm_flops / (ms * 1.0e6),
+               max_relative_error(Y, Y_reference, (size_t)rows * N));
+    }
+
+    // Cleanup
+    cl_mem buffers[] = {memRowPtr, memColIdx, memValues, memShortRows, memLongRows, memAllRows, memSlicePtr,
+                        memSliceWidth, memPerm, memSellColIdx, memSellValues, memX, memXN, memY, memYN};
+    ret = CL_SUCCESS;
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++) {
+        ret |= clReleaseMemObject(buffers[i]);
+    }
+    if (use_ell) {
+        ret |= clReleaseMemObject(memEllColIdx);
+        ret |= clReleaseMemObject(memEllValues);
+        ret |= clReleaseKernel(ell_kernel);
+    }
+    ret |= clReleaseKernel(scalar_kernel);
+    ret |= clReleaseKernel(vector_kernel);
+    ret |= clReleaseKernel(sell_kernel);
+    ret |= clReleaseKernel(spmm_csr_kernel);
+    ret |= clReleaseKernel(spmm_sell_kernel);
+    ret |= clReleaseProgram(program);
+    checkError(ret, "Failed during cleanup");
+
+    csr_free(&csr);
+    sell_free(&sell);
+    if (use_ell) {
+        ell_free(&ell);
+    }
+    gemm_free(A);
+    gemm_free(x);
+    gemm_free(X);
+    gemm_free(y);
+    gemm_free(Y);
+    gemm_free(y_reference);
+    gemm_free(Y_reference);
+    free(short_rows);
+    free(long_rows);
+    free(all_rows);
+
+    return 0;
+}
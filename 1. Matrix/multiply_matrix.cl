@@ -11,3 +11,326 @@ __kernel void multiply_matrix(const int M, const int N, const int K,
         C[row * K + col] = sum;
     }
 }
+
+
+// Tiled variant. Each work-group computes a TSM x TSN block of C, staging
+// TSM x TSK tiles of A and TSK x TSN tiles of B in local memory, and each
+// work-item keeps a WPTM x WPTN block of C in registers. Tile sizes are set
+// at build time with -D; edges are zero-padded so M, N and K can be anything.
+//
+// Launch with local size {TSN / WPTN, TSM / WPTM} and a global size rounded up
+// to {ceil(K / TSN) * TSN / WPTN, ceil(M / TSM) * TSM / WPTM}. Dimension 0 runs
+// along the columns of C so neighbouring work-items touch neighbouring addresses.
+//
+// A and B may be stored in reduced precision, selected with one of
+//   -DSTORAGE_HALF  fp16 (half), widened with vload_half, fp32 accumulation
+//   -DSTORAGE_BF16  bfloat16 (ushort, upper half of an fp32), fp32 accumulation
+//   -DSTORAGE_INT8  int8 (char), int32 accumulation; the kernel then takes two
+//                   more arguments, row_scales (M) and col_scales (K), and
+//                   writes C = acc * row_scales[row] * col_scales[col]
+// C is always fp32. Without a STORAGE define A and B are fp32.
+//
+// Tile sizes left out fall back on the tiles cl_profile_gemm_tiles() picks
+// for the device, passed in as DEV_GEMM_* with the rest of the profile (see
+// common/cl_profile.h), so they fit its local memory and work-group limits.
+// Without the profile the defaults are 64 x 64 x 16 tiles with 4 x 4 per
+// work-item. The A tile is padded by one column against bank conflicts only
+// where local memory is real.
+#ifdef DEV_GEMM_TS
+#define TS_DEFAULT DEV_GEMM_TS
+#define TSK_DEFAULT DEV_GEMM_TSK
+#define WPTM_DEFAULT DEV_GEMM_WPTM
+#define WPTN_DEFAULT DEV_GEMM_WPTN
+#else
+#define TS_DEFAULT 64
+#define TSK_DEFAULT 16
+#define WPTM_DEFAULT 4
+#define WPTN_DEFAULT 4
+#endif
+#if defined(DEV_LOCAL_MEM_DEDICATED) && !DEV_LOCAL_MEM_DEDICATED
+#define LOCAL_PAD 0
+#else
+#define LOCAL_PAD 1
+#endif
+#ifndef TSM
+#define TSM TS_DEFAULT
+#endif
+#ifndef TSN
+#define TSN TS_DEFAULT
+#endif
+#ifndef TSK
+#define TSK TSK_DEFAULT
+#endif
+#ifndef WPTM
+#define WPTM WPTM_DEFAULT
+#endif
+#ifndef WPTN
+#define WPTN WPTN_DEFAULT
+#endif
+#define RTSM (TSM / WPTM)
+#define RTSN (TSN / WPTN)
+
+#if defined(STORAGE_HALF)
+typedef half storage_t;
+typedef float acc_t;
+#define LOAD_STORAGE(p, i) vload_half(i, p)
+#define MAD(a, b, c) mad(a, b, c)
+#elif defined(STORAGE_BF16)
+typedef ushort storage_t;
+typedef float acc_t;
+#define LOAD_STORAGE(p, i) as_float((uint)(p)[i] << 16)
+#define MAD(a, b, c) mad(a, b, c)
+#elif defined(STORAGE_INT8)
+typedef char storage_t;
+typedef int acc_t;
+#define LOAD_STORAGE(p, i) ((int)(p)[i])
+#define MAD(a, b, c) mad24(a, b, c) // |a|, |b| <= 127 fit the 24-bit multiplier
+#else
+typedef float storage_t;
+typedef float acc_t;
+#define LOAD_STORAGE(p, i) (p)[i]
+#define MAD(a, b, c) mad(a, b, c)
+#endif
+
+__kernel __attribute__((reqd_work_group_size(RTSN, RTSM, 1)))
+void multiply_matrix_tiled(const int M, const int N, const int K,
+                           __global const storage_t* A, __global const storage_t* B, __global float* C
+#ifdef STORAGE_INT8
+                           , __global const float* row_scales, __global const float* col_scales
+#endif
+                           ) {
+    const int tidn = get_local_id(0);
+    const int tidm = get_local_id(1);
+    const int tid = tidm * RTSN + tidn;
+    const int offsetN = get_group_id(0) * TSN;
+    const int offsetM = get_group_id(1) * TSM;
+
+    // +1 padding keeps the transposed A stores free of bank conflicts
+    __local acc_t Asub[TSK][TSM + LOCAL_PAD];
+    __local acc_t Bsub[TSK][TSN];
+
+    acc_t acc[WPTM][WPTN];
+    #pragma unroll
+    for (int wm = 0; wm < WPTM; wm++) {
+        #pragma unroll
+        for (int wn = 0; wn < WPTN; wn++) {
+            acc[wm][wn] = 0;
+        }
+    }
+
+    const int numTiles = (N + TSK - 1) / TSK;
+    for (int t = 0; t < numTiles; t++) {
+        const int tiledN = t * TSK;
+
+        // Cooperative loads, consecutive work-items read consecutive addresses
+        for (int l = tid; l < TSM * TSK; l += RTSM * RTSN) {
+            int r = l / TSK;
+            int k = l % TSK;
+            int row = offsetM + r;
+            int inner = tiledN + k;
+            Asub[k][r] = (row < M && inner < N) ? LOAD_STORAGE(A, row * N + inner) : 0;
+        }
+        for (int l = tid; l < TSK * TSN; l += RTSM * RTSN) {
+            int k = l / TSN;
+            int c = l % TSN;
+            int inner = tiledN + k;
+            int col = offsetN + c;
+            Bsub[k][c] = (inner < N && col < K) ? LOAD_STORAGE(B, inner * K + col) : 0;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        #pragma unroll
+        for (int k = 0; k < TSK; k++) {
+            acc_t Breg[WPTN];
+            #pragma unroll
+            for (int wn = 0; wn < WPTN; wn++) {
+                Breg[wn] = Bsub[k][tidn + wn * RTSN];
+            }
+            #pragma unroll
+            for (int wm = 0; wm < WPTM; wm++) {
+                acc_t Areg = Asub[k][tidm + wm * RTSM];
+                #pragma unroll
+                for (int wn = 0; wn < WPTN; wn++) {
+                    acc[wm][wn] = MAD(Areg, Breg[wn], acc[wm][wn]);
+                }
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    #pragma unroll
+    for (int wm = 0; wm < WPTM; wm++) {
+        int row = offsetM + tidm + wm * RTSM;
+        #pragma unroll
+        for (int wn = 0; wn < WPTN; wn++) {
+            int col = offsetN + tidn + wn * RTSN;
+            if (row < M && col < K) {
+#ifdef STORAGE_INT8
+                C[row * K + col] = (float)acc[wm][wn] * row_scales[row] * col_scales[col];
+#else
+                C[row * K + col] = acc[wm][wn];
+#endif
+            }
+        }
+    }
+}
+
+
+// BLAS-style variant: C = alpha * op(A) * op(B) + beta * C, row-major, with
+// op(A) M x K, op(B) K x N and C M x N. Unlike the kernels above this one uses
+// the BLAS names for the dimensions. transA/transB select op(X) = X^T, and
+// every operand is addressed as X[offset + row * ldX + col] with the row and
+// column of the array as stored, so transposed operands and sub-blocks of
+// larger matrices are read in place. beta == 0 writes C without reading it.
+//
+// Same tiling and launch shape as multiply_matrix_tiled, with the M x N of
+// C: local size {TSN / WPTN, TSM / WPTM}, global size rounded up to
+// {ceil(N / TSN) * TSN / WPTN, ceil(M / TSM) * TSM / WPTM}. Always fp32.
+__kernel __attribute__((reqd_work_group_size(RTSN, RTSM, 1)))
+void sgemm_tiled(const int transA, const int transB, const int M, const int N, const int K,
+                 const float alpha, __global const float* A, const int offset_a, const int lda,
+                 __global const float* B, const int offset_b, const int ldb,
+                 const float beta, __global float* C, const int offset_c, const int ldc) {
+    const int tidn = get_local_id(0);
+    const int tidm = get_local_id(1);
+    const int tid = tidm * RTSN + tidn;
+    const int offsetN = get_group_id(0) * TSN;
+    const int offsetM = get_group_id(1) * TSM;
+
+    __local float Asub[TSK][TSM + LOCAL_PAD];
+    __local float Bsub[TSK][TSN];
+
+    float acc[WPTM][WPTN];
+    #pragma unroll
+    for (int wm = 0; wm < WPTM; wm++) {
+        #pragma unroll
+        for (int wn = 0; wn < WPTN; wn++) {
+            acc[wm][wn] = 0.0f;
+        }
+    }
+
+    A += offset_a;
+    B += offset_b;
+    const int numTiles = (K + TSK - 1) / TSK;
+    for (int t = 0; t < numTiles; t++) {
+        const int tiledK = t * TSK;
+
+        // Consecutive work-items take consecutive addresses of the array as
+        // stored, which runs along k for A and along n for B unless transposed
+        for (int l = tid; l < TSM * TSK; l += RTSM * RTSN) {
+            const int r = transA ? l % TSM : l / TSK;
+            const int k = transA ? l / TSM : l % TSK;
+            const int row = offsetM + r;
+            const int inner = tiledK + k;
+            float value = 0.0f;
+            if (row < M && inner < K) {
+                value = transA ? A[inner * lda + row] : A[row * lda + inner];
+            }
+            Asub[k][r] = value;
+        }
+        for (int l = tid; l < TSK * TSN; l += RTSM * RTSN) {
+            const int k = transB ? l % TSK : l / TSN;
+            const int c = transB ? l / TSK : l % TSN;
+            const int inner = tiledK + k;
+            const int col = offsetN + c;
+            float value = 0.0f;
+            if (inner < K && col < N) {
+                value = transB ? B[col * ldb + inner] : B[inner * ldb + col];
+            }
+            Bsub[k][c] = value;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        #pragma unroll
+        for (int k = 0; k < TSK; k++) {
+            float Breg[WPTN];
+            #pragma unroll
+            for (int wn = 0; wn < WPTN; wn++) {
+                Breg[wn] = Bsub[k][tidn + wn * RTSN];
+            }
+            #pragma unroll
+            for (int wm = 0; wm < WPTM; wm++) {
+                float Areg = Asub[k][tidm + wm * RTSM];
+                #pragma unroll
+                for (int wn = 0; wn < WPTN; wn++) {
+                    acc[wm][wn] = mad(Areg, Breg[wn], acc[wm][wn]);
+                }
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    C += offset_c;
+    #pragma unroll
+    for (int wm = 0; wm < WPTM; wm++) {
+        int row = offsetM + tidm + wm * RTSM;
+        #pragma unroll
+        for (int wn = 0; wn < WPTN; wn++) {
+            int col = offsetN + tidn + wn * RTSN;
+            if (row < M && col < N) {
+                float result = alpha * acc[wm][wn];
+                if (beta != 0.0f) {
+                    result = mad(beta, C[row * ldc + col], result);
+                }
+                C[row * ldc + col] = result;
+            }
+        }
+    }
+}
+
+// Batched variant for many small products of the same shape, all in one
+// launch: C[b] (M x K) = A[b] (M x N) * B[b] (N x K) for b < batch.
+//
+// Each work-group takes per_group consecutive products, copies their A and B
+// into local memory (scratch holds per_group * (M * N + N * K) floats) and its
+// work-items walk over all C entries of the group, so several tiny products
+// share one work-group and a large one still keeps every work-item busy.
+// Launch 1-D with ceil(batch / per_group) work-groups of any size.
+//
+// Matrix b starts at b * stride_a/b/c floats, or, when offsets is not NULL,
+// at offsets[3 * b + 0/1/2], which allows arbitrary pointer-array batches
+// inside the three buffers.
+__kernel void multiply_matrix_batched(const int M, const int N, const int K,
+                                      const int batch, const int per_group,
+                                      __global const float* A, const int stride_a,
+                                      __global const float* B, const int stride_b,
+                                      __global float* C, const int stride_c,
+                                      __global const int* offsets,
+                                      __local float* scratch) {
+    const int first = get_group_id(0) * per_group;
+    const int count = min(per_group, batch - first);
+    const int lid = get_local_id(0);
+    const int ls = get_local_size(0);
+    const int size_a = M * N;
+    const int size_b = N * K;
+    const int size_c = M * K;
+    __local float* As = scratch;
+    __local float* Bs = scratch + per_group * size_a;
+
+    for (int e = lid; e < count * size_a; e += ls) {
+        const int b = first + e / size_a;
+        const long base = offsets ? offsets[3 * b] : (long)b * stride_a;
+        As[e] = A[base + e % size_a];
+    }
+    for (int e = lid; e < count * size_b; e += ls) {
+        const int b = first + e / size_b;
+        const long base = offsets ? offsets[3 * b + 1] : (long)b * stride_b;
+        Bs[e] = B[base + e % size_b];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int e = lid; e < count * size_c; e += ls) {
+        const int m = e / size_c;
+        const int row = (e % size_c) / K;
+        const int col = e % K;
+        __local const float* a = As + m * size_a + row * N;
+        __local const float* b = Bs + m * size_b + col;
+        float sum = 0.0f;
+        for (int i = 0; i < N; i++) {
+            sum += a[i] * b[i * K];
+        }
+        const int g = first + m;
+        const long base = offsets ? offsets[3 * g + 2] : (long)g * stride_c;
+        C[base + row * K + col] = sum;
+    }
+}
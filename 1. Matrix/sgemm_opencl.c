@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "sgemm_opencl.h"
+#include "../common/cl_trace.h"
+
+cl_int sgemm_opencl_init(sgemm_opencl_kernel *sgemm, cl_context context, cl_device_id device,
+                         const char *source, size_t source_size, const autotune_config *config) {
+    // Without tuned values, the tiles that fit this device
+    cl_profile profile;
+    cl_profile_query(device, &profile);
+    cl_profile_gemm_tiles(&profile, &sgemm->ts, &sgemm->tsk, &sgemm->wptm, &sgemm->wptn);
+    if (config) {
+        sgemm->ts = autotune_value(config, "TS", sgemm->ts);
+        sgemm->tsk = autotune_value(config, "TSK", sgemm->tsk);
+        sgemm->wptm = autotune_value(config, "WPTM", sgemm->wptm);
+        sgemm->wptn = autotune_value(config, "WPTN", sgemm->wptn);
+    }
+    sgemm->kernel = NULL;
+
+    char build_options[256];
+    snprintf(build_options, sizeof(build_options), "-DTSM=%d -DTSN=%d -DTSK=%d -DWPTM=%d -DWPTN=%d",
+             sgemm->ts, sgemm->ts, sgemm->tsk, sgemm->wptm, sgemm->wptn);
+
+    cl_int ret;
+    sgemm->program = cl_cache_build(context, device, source, source_size, 0, build_options, &ret, NULL);
+    if (!sgemm->program) {
+        return ret;
+    }
+    if (ret != CL_SUCCESS) {
+        char build_log[2048];
+        clGetProgramBuildInfo(sgemm->program, device, CL_PROGRAM_BUILD_LOG, sizeof(build_log), build_log, NULL);
+        fprintf(stderr, "Error in kernel build:\n%s\n", build_log);
+        return ret;
+    }
+    sgemm->kernel = clCreateKernel(sgemm->program, "sgemm_tiled", &ret);
+    return ret;
+}
+
+void sgemm_opencl_release(sgemm_opencl_kernel *sgemm) {
+    if (sgemm->kernel) {
+        clReleaseKernel(sgemm->kernel);
+    }
+    if (sgemm->program) {
+        clReleaseProgram(sgemm->program);
+    }
+    sgemm->kernel = NULL;
+    sgemm->program = NULL;
+}
+
+cl_int sgemm_opencl(const sgemm_opencl_kernel *sgemm, cl_command_queue queue,
+                    gemm_trans transA, gemm_trans transB, int M, int N, int K,
+                    float alpha, cl_mem A, int offset_a, int lda,
+                    cl_mem B, int offset_b, int ldb,
+                    float beta, cl_mem C, int offset_c, int ldc, cl_event *event) {
+    int cols_a = transA == GEMM_TRANS ? M : K;
+    int cols_b = transB == GEMM_TRANS ? K : N;
+    if (M < 0 || N < 0 || K < 0 || offset_a < 0 || offset_b < 0 || offset_c < 0 ||
+        lda < (cols_a > 1 ? cols_a : 1) || ldb < (cols_b > 1 ? cols_b : 1) || ldc < (N > 1 ? N : 1)) {
+        return CL_INVALID_VALUE;
+    }
+    if (M == 0 || N == 0) {
+        return CL_SUCCESS;
+    }
+
+    int trans_a = transA == GEMM_TRANS, trans_b = transB == GEMM_TRANS;
+    cl_kernel kernel = sgemm->kernel;
+    cl_int ret = clSetKernelArg(kernel, 0, sizeof(int), &trans_a);
+    ret |= clSetKernelArg(kernel, 1, sizeof(int), &trans_b);
+    ret |= clSetKernelArg(kernel, 2, sizeof(int), &M);
+    ret |= clSetKernelArg(kernel, 3, sizeof(int), &N);
+    ret |= clSetKernelArg(kernel, 4, sizeof(int), &K);
+    ret |= clSetKernelArg(kernel, 5, sizeof(float), &alpha);
+    ret |= clSetKernelArg(kernel, 6, sizeof(cl_mem), &A);
+    ret |= clSetKernelArg(kernel, 7, sizeof(int), &offset_a);
+    ret |= clSetKernelArg(kernel, 8, sizeof(int), &lda);
+    ret |= clSetKernelArg(kernel, 9, sizeof(cl_mem), &B);
+    ret |= clSetKernelArg(kernel, 10, sizeof(int), &offset_b);
+    ret |= clSetKernelArg(kernel, 11, sizeof(int), &ldb);
+    ret |= clSetKernelArg(kernel, 12, sizeof(float), &beta);
+    ret |= clSetKernelArg(kernel, 13, sizeof(cl_mem), &C);
+    ret |= clSetKernelArg(kernel, 14, sizeof(int), &offset_c);
+    ret |= clSetKernelArg(kernel, 15, sizeof(int), &ldc);
+    if (ret != CL_SUCCESS) {
+        return ret;
+    }
+
+    // One work-item per WPTM x WPTN block of C, grid rounded up to whole tiles
+    size_t local_size[2] = {(size_t)(sgemm->ts / sgemm->wptn), (size_t)(sgemm->ts / sgemm->wptm)};
+    size_t global_size[2] = {(size_t)(N + sgemm->ts - 1) / sgemm->ts * local_size[0],
+                             (size_t)(M + sgemm->ts - 1) / sgemm->ts * local_size[1]};
+    cl_event *traced = cl_trace_event(event);
+    ret = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_size, local_size, 0, NULL, traced);
+    cl_trace_command("sgemm_tiled", queue, traced, ret);
+    return ret;
+}
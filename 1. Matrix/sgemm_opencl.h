@@ -0,0 +1,39 @@
+#ifndef SGEMM_OPENCL_H
+#define SGEMM_OPENCL_H
+
+#include <CL/cl.h>
+#include "gemm.h"
+#include "../common/cl_autotune.h"
+#include "../common/cl_cache.h"
+#include "../common/cl_profile.h"
+
+// Device counterpart of sgemm() in gemm.h, on the sgemm_tiled kernel of
+// multiply_matrix.cl: C = alpha * op(A) * op(B) + beta * C, row-major.
+//
+// A, B and C are buffers plus an element offset, so sub-blocks of larger
+// matrices and transposed operands are passed as they are stored, with no
+// sub-buffers or staging copies. Offsets and strides are in floats.
+
+typedef struct {
+    cl_program program;
+    cl_kernel kernel;
+    int ts, tsk, wptm, wptn;
+} sgemm_opencl_kernel;
+
+// Builds multiply_matrix.cl from source with the tile sizes of config
+// (TS, TSK, WPTM, WPTN as tuned for multiply_matrix_tiled), or the tiles
+// cl_profile_gemm_tiles() picks for the device if config is NULL. Prints the
+// build log on failure.
+cl_int sgemm_opencl_init(sgemm_opencl_kernel *sgemm, cl_context context, cl_device_id device,
+                         const char *source, size_t source_size, const autotune_config *config);
+void sgemm_opencl_release(sgemm_opencl_kernel *sgemm);
+
+// Enqueues one product. Invalid arguments return CL_INVALID_VALUE without
+// enqueuing anything; event may be NULL.
+cl_int sgemm_opencl(const sgemm_opencl_kernel *sgemm, cl_command_queue queue,
+                    gemm_trans transA, gemm_trans transB, int M, int N, int K,
+                    float alpha, cl_mem A, int offset_a, int lda,
+                    cl_mem B, int offset_b, int ldb,
+                    float beta, cl_mem C, int offset_c, int ldc, cl_event *event);
+
+#endif
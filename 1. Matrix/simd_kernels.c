@@ -0,0 +1,579 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "simd_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// Keep the scalar variant genuinely scalar so it is a fair baseline
+#if defined(__GNUC__) && !defined(__clang__)
+#define SIMD_NO_VECTORIZE __attribute__((optimize("no-tree-vectorize")))
+#else
+#define SIMD_NO_VECTORIZE
+#endif
+
+// Copy a register tile spilled to memory into (a corner of) C
+static void simd_store_tile(const float *tile, float *C, int ldc, int mr, int nr, int accumulate) {
+    for (int i = 0; i < mr; i++) {
+        float *c = C + (size_t)i * ldc;
+        const float *t = tile + i * GEMM_NR;
+        if (accumulate) {
+            for (int j = 0; j < nr; j++) c[j] += t[j];
+        } else {
+            for (int j = 0; j < nr; j++) c[j] = t[j];
+        }
+    }
+}
+
+// Scale an int32 tile and store or add it into (a corner of) C
+static void simd_store_tile_i32(const int32_t *tile, float *C, int ldc, int mr, int nr, int accumulate,
+                                const float *row_scale, const float *col_scale) {
+    for (int i = 0; i < mr; i++) {
+        float *c = C + (size_t)i * ldc;
+        const int32_t *t = tile + i * GEMM_NR;
+        float rs = row_scale ? row_scale[i] : 1.0f;
+        for (int j = 0; j < nr; j++) {
+            float value = (float)t[j] * rs * (col_scale ? col_scale[j] : 1.0f);
+            c[j] = accumulate ? c[j] + value : value;
+        }
+    }
+}
+
+// ---------------------------------------------------------------- conversions
+
+uint16_t simd_f32_to_f16(float value) {
+    uint32_t x;
+    memcpy(&x, &value, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t abs = x & 0x7fffffff;
+    if (abs >= 0x7f800000) {
+        return (uint16_t)(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0)); // inf, nan
+    }
+    if (abs >= 0x477ff000) {
+        return (uint16_t)(sign | 0x7c00); // rounds past the largest half
+    }
+    if (abs < 0x38800000) {
+        // Subnormal half: shift the implicit-one mantissa into place, round to nearest even
+        if (abs < 0x33000000) return (uint16_t)sign;
+        uint32_t exponent = abs >> 23;
+        uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t midpoint = 1u << (shift - 1);
+        if (rest > midpoint || (rest == midpoint && (half & 1))) half++;
+        return (uint16_t)(sign | half);
+    }
+    uint32_t half = ((abs >> 13) - (112 << 10));
+    uint32_t rest = abs & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+    return (uint16_t)(sign | half);
+}
+
+float simd_f16_to_f32(uint16_t value) {
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t x;
+    if (exponent == 0x1f) {
+        x = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+        x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else {
+        // Zero or subnormal: mantissa * 2^-24 is exact in float
+        float f = (float)mantissa * (1.0f / 16777216.0f);
+        memcpy(&x, &f, sizeof(x));
+        x |= sign;
+    }
+    float result;
+    memcpy(&result, &x, sizeof(result));
+    return result;
+}
+
+uint16_t simd_f32_to_bf16(float value) {
+    uint32_t x;
+    memcpy(&x, &value, sizeof(x));
+    if ((x & 0x7fffffff) > 0x7f800000) {
+        return (uint16_t)((x >> 16) | 0x40); // keep nan a quiet nan
+    }
+    x += 0x7fff + ((x >> 16) & 1);
+    return (uint16_t)(x >> 16);
+}
+
+float simd_bf16_to_f32(uint16_t value) {
+    uint32_t x = (uint32_t)value << 16;
+    float result;
+    memcpy(&result, &x, sizeof(result));
+    return result;
+}
+
+// ---------------------------------------------------------------- scalar
+
+SIMD_NO_VECTORIZE
+static void simd_gemm_scalar(int kc, const float *a, const float *b,
+                             float *C, int ldc, int mr, int nr, int accumulate) {
+    float acc[GEMM_MR * GEMM_NR] = {0};
+    for (int p = 0; p < kc; p++) {
+        for (int i = 0; i < GEMM_MR; i++) {
+            float ai = a[i];
+            for (int j = 0; j < GEMM_NR; j++) {
+                acc[i * GEMM_NR + j] += ai * b[j];
+            }
+        }
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+    simd_store_tile(acc, C, ldc, mr, nr, accumulate);
+}
+
+SIMD_NO_VECTORIZE
+static void simd_add_scalar(float *result, const float *x, const float *y, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        result[i] = x[i] + y[i];
+    }
+}
+
+SIMD_NO_VECTORIZE
+static void simd_gemm_i8_scalar(int kp, const int16_t *a, const int16_t *b,
+                                float *C, int ldc, int mr, int nr, int accumulate,
+                                const float *row_scale, const float *col_scale) {
+    int32_t acc[GEMM_MR * GEMM_NR] = {0};
+    for (int p = 0; p < kp; p++) {
+        for (int i = 0; i < GEMM_MR; i++) {
+            int32_t a0 = a[2 * i], a1 = a[2 * i + 1];
+            for (int j = 0; j < GEMM_NR; j++) {
+                acc[i * GEMM_NR + j] += a0 * b[2 * j] + a1 * b[2 * j + 1];
+            }
+        }
+        a += 2 * GEMM_MR;
+        b += 2 * GEMM_NR;
+    }
+    simd_store_tile_i32(acc, C, ldc, mr, nr, accumulate, row_scale, col_scale);
+}
+
+static void simd_f16_scalar(float *dst, const uint16_t *src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = simd_f16_to_f32(src[i]);
+    }
+}
+
+#ifdef SIMD_X86
+
+// ---------------------------------------------------------------- SSE2
+// 16 xmm registers cannot hold a 6x16 tile, so the tile is done as two
+// 6x8 halves: 12 accumulators + 2 B vectors + 1 broadcast.
+
+__attribute__((target("sse2")))
+static void simd_gemm_sse(int kc, const float *a, const float *b,
+                          float *C, int ldc, int mr, int nr, int accumulate) {
+    float tile[GEMM_MR * GEMM_NR] __attribute__((aligned(64)));
+    for (int half = 0; half < GEMM_NR; half += 8) {
+        __m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+        __m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+        __m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+        __m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+        __m128 c40 = _mm_setzero_ps(), c41 = _mm_setzero_ps();
+        __m128 c50 = _mm_setzero_ps(), c51 = _mm_setzero_ps();
+        const float *pa = a;
+        const float *pb = b + half;
+        for (int p = 0; p < kc; p++) {
+            __m128 b0 = _mm_load_ps(pb);
+            __m128 b1 = _mm_load_ps(pb + 4);
+            __m128 ai;
+            ai = _mm_set1_ps(pa[0]); c00 = _mm_add_ps(c00, _mm_mul_ps(ai, b0)); c01 = _mm_add_ps(c01, _mm_mul_ps(ai, b1));
+            ai = _mm_set1_ps(pa[1]); c10 = _mm_add_ps(c10, _mm_mul_ps(ai, b0)); c11 = _mm_add_ps(c11, _mm_mul_ps(ai, b1));
+            ai = _mm_set1_ps(pa[2]); c20 = _mm_add_ps(c20, _mm_mul_ps(ai, b0)); c21 = _mm_add_ps(c21, _mm_mul_ps(ai, b1));
+            ai = _mm_set1_ps(pa[3]); c30 = _mm_add_ps(c30, _mm_mul_ps(ai, b0)); c31 = _mm_add_ps(c31, _mm_mul_ps(ai, b1));
+            ai = _mm_set1_ps(pa[4]); c40 = _mm_add_ps(c40, _mm_mul_ps(ai, b0)); c41 = _mm_add_ps(c41, _mm_mul_ps(ai, b1));
+            ai = _mm_set1_ps(pa[5]); c50 = _mm_add_ps(c50, _mm_mul_ps(ai, b0)); c51 = _mm_add_ps(c51, _mm_mul_ps(ai, b1));
+            pa += GEMM_MR;
+            pb += GEMM_NR;
+        }
+        float *t = tile + half;
+        _mm_store_ps(t + 0 * GEMM_NR, c00); _mm_store_ps(t + 0 * GEMM_NR + 4, c01);
+        _mm_store_ps(t + 1 * GEMM_NR, c10); _mm_store_ps(t + 1 * GEMM_NR + 4, c11);
+        _mm_store_ps(t + 2 * GEMM_NR, c20); _mm_store_ps(t + 2 * GEMM_NR + 4, c21);
+        _mm_store_ps(t + 3 * GEMM_NR, c30); _mm_store_ps(t + 3 * GEMM_NR + 4, c31);
+        _mm_store_ps(t + 4 * GEMM_NR, c40); _mm_store_ps(t + 4 * GEMM_NR + 4, c41);
+        _mm_store_ps(t + 5 * GEMM_NR, c50); _mm_store_ps(t + 5 * GEMM_NR + 4, c51);
+    }
+    simd_store_tile(tile, C, ldc, mr, nr, accumulate);
+}
+
+__attribute__((target("sse2")))
+static void simd_add_sse(float *result, const float *x, const float *y, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128 r0 = _mm_add_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i));
+        __m128 r1 = _mm_add_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(y + i + 4));
+        __m128 r2 = _mm_add_ps(_mm_loadu_ps(x + i + 8), _mm_loadu_ps(y + i + 8));
+        __m128 r3 = _mm_add_ps(_mm_loadu_ps(x + i + 12), _mm_loadu_ps(y + i + 12));
+        _mm_storeu_ps(result + i, r0);
+        _mm_storeu_ps(result + i + 4, r1);
+        _mm_storeu_ps(result + i + 8, r2);
+        _mm_storeu_ps(result + i + 12, r3);
+    }
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(result + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+    }
+    for (; i < n; i++) {
+        result[i] = x[i] + y[i];
+    }
+}
+
+// ---------------------------------------------------------------- AVX2 + FMA
+// 6x16 tile = 12 ymm accumulators, 2 B vectors, 1 broadcast.
+
+#define SIMD_AVX2_ROW(i)                                   \
+    ai = _mm256_broadcast_ss(pa + (i));                    \
+    c##i##0 = _mm256_fmadd_ps(ai, b0, c##i##0);            \
+    c##i##1 = _mm256_fmadd_ps(ai, b1, c##i##1);
+
+#define SIMD_AVX2_STORE(i)                                                         \
+    if (accumulate) {                                                              \
+        c##i##0 = _mm256_add_ps(c##i##0, _mm256_loadu_ps(C + (size_t)(i) * ldc));     \
+        c##i##1 = _mm256_add_ps(c##i##1, _mm256_loadu_ps(C + (size_t)(i) * ldc + 8)); \
+    }                                                                              \
+    _mm256_storeu_ps(C + (size_t)(i) * ldc, c##i##0);                              \
+    _mm256_storeu_ps(C + (size_t)(i) * ldc + 8, c##i##1);
+
+__attribute__((target("avx2,fma")))
+static void simd_gemm_avx2(int kc, const float *a, const float *b,
+                           float *C, int ldc, int mr, int nr, int accumulate) {
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+    const float *pa = a;
+    const float *pb = b;
+    for (int p = 0; p < kc; p++) {
+        __m256 b0 = _mm256_load_ps(pb);
+        __m256 b1 = _mm256_load_ps(pb + 8);
+        __m256 ai;
+        SIMD_AVX2_ROW(0) SIMD_AVX2_ROW(1) SIMD_AVX2_ROW(2)
+        SIMD_AVX2_ROW(3) SIMD_AVX2_ROW(4) SIMD_AVX2_ROW(5)
+        pa += GEMM_MR;
+        pb += GEMM_NR;
+    }
+
+    if (mr == GEMM_MR && nr == GEMM_NR) {
+        SIMD_AVX2_STORE(0) SIMD_AVX2_STORE(1) SIMD_AVX2_STORE(2)
+        SIMD_AVX2_STORE(3) SIMD_AVX2_STORE(4) SIMD_AVX2_STORE(5)
+        return;
+    }
+    float tile[GEMM_MR * GEMM_NR] __attribute__((aligned(64)));
+    _mm256_store_ps(tile + 0 * GEMM_NR, c00); _mm256_store_ps(tile + 0 * GEMM_NR + 8, c01);
+    _mm256_store_ps(tile + 1 * GEMM_NR, c10); _mm256_store_ps(tile + 1 * GEMM_NR + 8, c11);
+    _mm256_store_ps(tile + 2 * GEMM_NR, c20); _mm256_store_ps(tile + 2 * GEMM_NR + 8, c21);
+    _mm256_store_ps(tile + 3 * GEMM_NR, c30); _mm256_store_ps(tile + 3 * GEMM_NR + 8, c31);
+    _mm256_store_ps(tile + 4 * GEMM_NR, c40); _mm256_store_ps(tile + 4 * GEMM_NR + 8, c41);
+    _mm256_store_ps(tile + 5 * GEMM_NR, c50); _mm256_store_ps(tile + 5 * GEMM_NR + 8, c51);
+    simd_store_tile(tile, C, ldc, mr, nr, accumulate);
+}
+
+#undef SIMD_AVX2_ROW
+#undef SIMD_AVX2_STORE
+
+__attribute__((target("avx2,fma")))
+static void simd_add_avx2(float *result, const float *x, const float *y, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256 r0 = _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i));
+        __m256 r1 = _mm256_add_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(y + i + 8));
+        __m256 r2 = _mm256_add_ps(_mm256_loadu_ps(x + i + 16), _mm256_loadu_ps(y + i + 16));
+        __m256 r3 = _mm256_add_ps(_mm256_loadu_ps(x + i + 24), _mm256_loadu_ps(y + i + 24));
+        _mm256_storeu_ps(result + i, r0);
+        _mm256_storeu_ps(result + i + 8, r1);
+        _mm256_storeu_ps(result + i + 16, r2);
+        _mm256_storeu_ps(result + i + 24, r3);
+    }
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(result + i, _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+    }
+    for (; i < n; i++) {
+        result[i] = x[i] + y[i];
+    }
+}
+
+// int8: each 32-bit lane of madd multiplies a pair of k and adds the two
+// products, so one instruction covers 8 columns x 2 k steps.
+
+#define SIMD_AVX2_I8_ROW(i)                                                   \
+    ai = _mm256_set1_epi32(*(const int32_t *)(pa + 2 * (i)));                 \
+    c##i##0 = _mm256_add_epi32(c##i##0, _mm256_madd_epi16(ai, b0));           \
+    c##i##1 = _mm256_add_epi32(c##i##1, _mm256_madd_epi16(ai, b1));
+
+__attribute__((target("avx2,fma")))
+static void simd_gemm_i8_avx2(int kp, const int16_t *a, const int16_t *b,
+                              float *C, int ldc, int mr, int nr, int accumulate,
+                              const float *row_scale, const float *col_scale) {
+    __m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+    __m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+    __m256i c20 = _mm256_setzero_si256(), c21 = _mm256_setzero_si256();
+    __m256i c30 = _mm256_setzero_si256(), c31 = _mm256_setzero_si256();
+    __m256i c40 = _mm256_setzero_si256(), c41 = _mm256_setzero_si256();
+    __m256i c50 = _mm256_setzero_si256(), c51 = _mm256_setzero_si256();
+    const int16_t *pa = a;
+    const int16_t *pb = b;
+    for (int p = 0; p < kp; p++) {
+        __m256i b0 = _mm256_load_si256((const __m256i *)pb);
+        __m256i b1 = _mm256_load_si256((const __m256i *)(pb + 16));
+        __m256i ai;
+        SIMD_AVX2_I8_ROW(0) SIMD_AVX2_I8_ROW(1) SIMD_AVX2_I8_ROW(2)
+        SIMD_AVX2_I8_ROW(3) SIMD_AVX2_I8_ROW(4) SIMD_AVX2_I8_ROW(5)
+        pa += 2 * GEMM_MR;
+        pb += 2 * GEMM_NR;
+    }
+    int32_t tile[GEMM_MR * GEMM_NR] __attribute__((aligned(64)));
+    _mm256_store_si256((__m256i *)(tile + 0 * GEMM_NR), c00); _mm256_store_si256((__m256i *)(tile + 0 * GEMM_NR + 8), c01);
+    _mm256_store_si256((__m256i *)(tile + 1 * GEMM_NR), c10); _mm256_store_si256((__m256i *)(tile + 1 * GEMM_NR + 8), c11);
+    _mm256_store_si256((__m256i *)(tile + 2 * GEMM_NR), c20); _mm256_store_si256((__m256i *)(tile + 2 * GEMM_NR + 8), c21);
+    _mm256_store_si256((__m256i *)(tile + 3 * GEMM_NR), c30); _mm256_store_si256((__m256i *)(tile + 3 * GEMM_NR + 8), c31);
+    _mm256_store_si256((__m256i *)(tile + 4 * GEMM_NR), c40); _mm256_store_si256((__m256i *)(tile + 4 * GEMM_NR + 8), c41);
+    _mm256_store_si256((__m256i *)(tile + 5 * GEMM_NR), c50); _mm256_store_si256((__m256i *)(tile + 5 * GEMM_NR + 8), c51);
+    simd_store_tile_i32(tile, C, ldc, mr, nr, accumulate, row_scale, col_scale);
+}
+
+#undef SIMD_AVX2_I8_ROW
+
+__attribute__((target("avx2,f16c")))
+static void simd_f16_avx2(float *dst, const uint16_t *src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + i))));
+    }
+    for (; i < n; i++) {
+        dst[i] = simd_f16_to_f32(src[i]);
+    }
+}
+
+// ---------------------------------------------------------------- AVX-512
+// A 6x16 tile is only 6 zmm accumulators, too few to hide FMA latency, so
+// even and odd k steps go to separate accumulator sets that are summed at the end.
+
+#define SIMD_AVX512_STEP(c, pa, b0)                                   \
+    c##0 = _mm512_fmadd_ps(_mm512_set1_ps((pa)[0]), b0, c##0);       \
+    c##1 = _mm512_fmadd_ps(_mm512_set1_ps((pa)[1]), b0, c##1);       \
+    c##2 = _mm512_fmadd_ps(_mm512_set1_ps((pa)[2]), b0, c##2);       \
+    c##3 = _mm512_fmadd_ps(_mm512_set1_ps((pa)[3]), b0, c##3);       \
+    c##4 = _mm512_fmadd_ps(_mm512_set1_ps((pa)[4]), b0, c##4);       \
+    c##5 = _mm512_fmadd_ps(_mm512_set1_ps((pa)[5]), b0, c##5);
+
+__attribute__((target("avx512f")))
+static void simd_gemm_avx512(int kc, const float *a, const float *b,
+                             float *C, int ldc, int mr, int nr, int accumulate) {
+    __m512 c0 = _mm512_setzero_ps(), c1 = _mm512_setzero_ps(), c2 = _mm512_setzero_ps();
+    __m512 c3 = _mm512_setzero_ps(), c4 = _mm512_setzero_ps(), c5 = _mm512_setzero_ps();
+    __m512 d0 = _mm512_setzero_ps(), d1 = _mm512_setzero_ps(), d2 = _mm512_setzero_ps();
+    __m512 d3 = _mm512_setzero_ps(), d4 = _mm512_setzero_ps(), d5 = _mm512_setzero_ps();
+    const float *pa = a;
+    const float *pb = b;
+    int p = 0;
+    for (; p + 2 <= kc; p += 2) {
+        __m512 b0 = _mm512_load_ps(pb);
+        __m512 b1 = _mm512_load_ps(pb + GEMM_NR);
+        SIMD_AVX512_STEP(c, pa, b0)
+        SIMD_AVX512_STEP(d, pa + GEMM_MR, b1)
+        pa += 2 * GEMM_MR;
+        pb += 2 * GEMM_NR;
+    }
+    if (p < kc) {
+        __m512 b0 = _mm512_load_ps(pb);
+        SIMD_AVX512_STEP(c, pa, b0)
+    }
+    c0 = _mm512_add_ps(c0, d0); c1 = _mm512_add_ps(c1, d1); c2 = _mm512_add_ps(c2, d2);
+    c3 = _mm512_add_ps(c3, d3); c4 = _mm512_add_ps(c4, d4); c5 = _mm512_add_ps(c5, d5);
+
+    if (nr == GEMM_NR) {
+        // Full-width rows: masked-free vector stores, rows past mr are skipped
+        __m512 rows[GEMM_MR] = {c0, c1, c2, c3, c4, c5};
+        for (int i = 0; i < mr; i++) {
+            float *c = C + (size_t)i * ldc;
+            __m512 r = accumulate ? _mm512_add_ps(rows[i], _mm512_loadu_ps(c)) : rows[i];
+            _mm512_storeu_ps(c, r);
+        }
+        return;
+    }
+    // Ragged right edge: masked loads/stores of the first nr lanes
+    __mmask16 mask = (__mmask16)((1u << nr) - 1);
+    __m512 rows[GEMM_MR] = {c0, c1, c2, c3, c4, c5};
+    for (int i = 0; i < mr; i++) {
+        float *c = C + (size_t)i * ldc;
+        __m512 r = rows[i];
+        if (accumulate) {
+            r = _mm512_add_ps(r, _mm512_maskz_loadu_ps(mask, c));
+        }
+        _mm512_mask_storeu_ps(c, mask, r);
+    }
+}
+
+#undef SIMD_AVX512_STEP
+
+__attribute__((target("avx512f")))
+static void simd_add_avx512(float *result, const float *x, const float *y, size_t n) {
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512 r0 = _mm512_add_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i));
+        __m512 r1 = _mm512_add_ps(_mm512_loadu_ps(x + i + 16), _mm512_loadu_ps(y + i + 16));
+        __m512 r2 = _mm512_add_ps(_mm512_loadu_ps(x + i + 32), _mm512_loadu_ps(y + i + 32));
+        __m512 r3 = _mm512_add_ps(_mm512_loadu_ps(x + i + 48), _mm512_loadu_ps(y + i + 48));
+        _mm512_storeu_ps(result + i, r0);
+        _mm512_storeu_ps(result + i + 16, r1);
+        _mm512_storeu_ps(result + i + 32, r2);
+        _mm512_storeu_ps(result + i + 48, r3);
+    }
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(result + i, _mm512_add_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+    }
+    if (i < n) {
+        __mmask16 mask = (__mmask16)((1u << (n - i)) - 1);
+        __m512 r = _mm512_add_ps(_mm512_maskz_loadu_ps(mask, x + i), _mm512_maskz_loadu_ps(mask, y + i));
+        _mm512_mask_storeu_ps(result + i, mask, r);
+    }
+}
+
+// int8 on AVX-512BW: one zmm of madd covers all 16 columns; as in the float
+// kernel, even and odd pair steps use separate accumulators.
+
+#define SIMD_AVX512_I8_STEP(c, pa, b0)                                                    \
+    c##0 = _mm512_add_epi32(c##0, _mm512_madd_epi16(_mm512_set1_epi32(((const int32_t *)(pa))[0]), b0)); \
+    c##1 = _mm512_add_epi32(c##1, _mm512_madd_epi16(_mm512_set1_epi32(((const int32_t *)(pa))[1]), b0)); \
+    c##2 = _mm512_add_epi32(c##2, _mm512_madd_epi16(_mm512_set1_epi32(((const int32_t *)(pa))[2]), b0)); \
+    c##3 = _mm512_add_epi32(c##3, _mm512_madd_epi16(_mm512_set1_epi32(((const int32_t *)(pa))[3]), b0)); \
+    c##4 = _mm512_add_epi32(c##4, _mm512_madd_epi16(_mm512_set1_epi32(((const int32_t *)(pa))[4]), b0)); \
+    c##5 = _mm512_add_epi32(c##5, _mm512_madd_epi16(_mm512_set1_epi32(((const int32_t *)(pa))[5]), b0));
+
+__attribute__((target("avx512f,avx512bw")))
+static void simd_gemm_i8_avx512(int kp, const int16_t *a, const int16_t *b,
+                                float *C, int ldc, int mr, int nr, int accumulate,
+                                const float *row_scale, const float *col_scale) {
+    __m512i c0 = _mm512_setzero_si512(), c1 = _mm512_setzero_si512(), c2 = _mm512_setzero_si512();
+    __m512i c3 = _mm512_setzero_si512(), c4 = _mm512_setzero_si512(), c5 = _mm512_setzero_si512();
+    __m512i d0 = _mm512_setzero_si512(), d1 = _mm512_setzero_si512(), d2 = _mm512_setzero_si512();
+    __m512i d3 = _mm512_setzero_si512(), d4 = _mm512_setzero_si512(), d5 = _mm512_setzero_si512();
+    const int16_t *pa = a;
+    const int16_t *pb = b;
+    int p = 0;
+    for (; p + 2 <= kp; p += 2) {
+        __m512i b0 = _mm512_load_si512((const void *)pb);
+        __m512i b1 = _mm512_load_si512((const void *)(pb + 2 * GEMM_NR));
+        SIMD_AVX512_I8_STEP(c, pa, b0)
+        SIMD_AVX512_I8_STEP(d, pa + 2 * GEMM_MR, b1)
+        pa += 4 * GEMM_MR;
+        pb += 4 * GEMM_NR;
+    }
+    if (p < kp) {
+        __m512i b0 = _mm512_load_si512((const void *)pb);
+        SIMD_AVX512_I8_STEP(c, pa, b0)
+    }
+    int32_t tile[GEMM_MR * GEMM_NR] __attribute__((aligned(64)));
+    _mm512_store_si512((void *)(tile + 0 * GEMM_NR), _mm512_add_epi32(c0, d0));
+    _mm512_store_si512((void *)(tile + 1 * GEMM_NR), _mm512_add_epi32(c1, d1));
+    _mm512_store_si512((void *)(tile + 2 * GEMM_NR), _mm512_add_epi32(c2, d2));
+    _mm512_store_si512((void *)(tile + 3 * GEMM_NR), _mm512_add_epi32(c3, d3));
+    _mm512_store_si512((void *)(tile + 4 * GEMM_NR), _mm512_add_epi32(c4, d4));
+    _mm512_store_si512((void *)(tile + 5 * GEMM_NR), _mm512_add_epi32(c5, d5));
+    simd_store_tile_i32(tile, C, ldc, mr, nr, accumulate, row_scale, col_scale);
+}
+
+#undef SIMD_AVX512_I8_STEP
+
+__attribute__((target("avx512f")))
+static void simd_f16_avx512(float *dst, const uint16_t *src, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(src + i))));
+    }
+    for (; i < n; i++) {
+        dst[i] = simd_f16_to_f32(src[i]);
+    }
+}
+
+#endif // SIMD_X86
+
+// ---------------------------------------------------------------- dispatch
+
+// The SSE tier has no int8 or half kernels of its own and uses the scalar ones
+static const simd_kernels simd_table[SIMD_ISA_COUNT] = {
+    {SIMD_SCALAR, "scalar", simd_gemm_scalar, simd_add_scalar, simd_gemm_i8_scalar, simd_f16_scalar},
+#ifdef SIMD_X86
+    {SIMD_SSE, "sse", simd_gemm_sse, simd_add_sse, simd_gemm_i8_scalar, simd_f16_scalar},
+    {SIMD_AVX2, "avx2", simd_gemm_avx2, simd_add_avx2, simd_gemm_i8_avx2, simd_f16_avx2},
+    {SIMD_AVX512, "avx512", simd_gemm_avx512, simd_add_avx512, simd_gemm_i8_avx512, simd_f16_avx512},
+#else
+    {SIMD_SSE, "sse", simd_gemm_scalar, simd_add_scalar, simd_gemm_i8_scalar, simd_f16_scalar},
+    {SIMD_AVX2, "avx2", simd_gemm_scalar, simd_add_scalar, simd_gemm_i8_scalar, simd_f16_scalar},
+    {SIMD_AVX512, "avx512", simd_gemm_scalar, simd_add_scalar, simd_gemm_i8_scalar, simd_f16_scalar},
+#endif
+};
+
+static simd_kernels simd_active;
+static const simd_kernels *simd_selected = NULL;
+
+simd_isa simd_detect(void) {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2")) return SIMD_SSE;
+#endif
+    return SIMD_SCALAR;
+}
+
+const char *simd_isa_name(simd_isa isa) {
+    return (isa >= 0 && isa < SIMD_ISA_COUNT) ? simd_table[isa].name : "unknown";
+}
+
+int simd_parse_isa(const char *name, simd_isa *isa) {
+    for (int i = 0; i < SIMD_ISA_COUNT; i++) {
+        if (strcmp(name, simd_table[i].name) == 0) {
+            *isa = (simd_isa)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static pthread_once_t simd_once = PTHREAD_ONCE_INIT;
+
+static simd_isa simd_select(simd_isa isa) {
+    simd_isa best = simd_detect();
+    if (isa < 0 || isa > best) {
+        isa = best;
+    }
+    simd_active = simd_table[isa];
+#ifdef SIMD_X86
+    if (isa == SIMD_AVX512 && !__builtin_cpu_supports("avx512bw")) {
+        simd_active.gemm_i8_kernel = simd_gemm_i8_avx2;
+    }
+#endif
+    simd_selected = &simd_active;
+    return isa;
+}
+
+// Default selection. The first simd_get() may come from several pool
+// workers at once, so it runs exactly once.
+static void simd_init(void) {
+    simd_isa isa = simd_detect();
+    const char *env = getenv("MATRIX_SIMD");
+    if (env && simd_parse_isa(env, &isa) != 0) {
+        fprintf(stderr, "Unknown MATRIX_SIMD '%s', using %s\n", env, simd_isa_name(isa));
+    }
+    simd_select(isa);
+}
+
+simd_isa simd_set_isa(simd_isa isa) {
+    pthread_once(&simd_once, simd_init);
+    return simd_select(isa);
+}
+
+const simd_kernels *simd_get(void) {
+    pthread_once(&simd_once, simd_init);
+    return simd_selected;
+}
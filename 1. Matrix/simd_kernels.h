@@ -0,0 +1,63 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gemm.h"
+
+// Hand-vectorized inner kernels for the host matrix code. One binary carries
+// every variant (compiled with per-function target attributes) and picks the
+// widest one the CPU supports on first use. Set MATRIX_SIMD=scalar|sse|avx2|avx512
+// or call simd_set_isa() to force a variant; requests above what the CPU
+// supports fall back to the best supported one. simd_get() is safe to call
+// from any thread; call simd_set_isa() before starting parallel work.
+typedef enum {
+    SIMD_SCALAR = 0,
+    SIMD_SSE,    // SSE2, 4 floats
+    SIMD_AVX2,   // AVX2 + FMA, 8 floats
+    SIMD_AVX512, // AVX-512F, 16 floats
+    SIMD_ISA_COUNT
+} simd_isa;
+
+// C[mr x nr] (=|+=) packed a (GEMM_MR x kc) * packed b (kc x GEMM_NR).
+// Packing layouts are the ones produced by gemm.c; mr <= GEMM_MR, nr <= GEMM_NR.
+typedef void (*simd_gemm_kernel_fn)(int kc, const float *a, const float *b,
+                                    float *C, int ldc, int mr, int nr, int accumulate);
+
+// result[i] = x[i] + y[i] for i < n
+typedef void (*simd_add_fn)(float *result, const float *x, const float *y, size_t n);
+
+// int8 GEMM tile with int32 accumulation over kp pairs of k. a holds
+// kp x GEMM_MR and b kp x GEMM_NR pairs of int16 (sign-extended int8, two
+// consecutive k per pair). The int32 tile is scaled by row_scale[i] *
+// col_scale[j] (either may be NULL for 1) and then stored or added to C.
+typedef void (*simd_gemm_i8_kernel_fn)(int kp, const int16_t *a, const int16_t *b,
+                                       float *C, int ldc, int mr, int nr, int accumulate,
+                                       const float *row_scale, const float *col_scale);
+
+// IEEE half to float, dst[i] = src[i] for i < n
+typedef void (*simd_f16_fn)(float *dst, const uint16_t *src, size_t n);
+
+typedef struct {
+    simd_isa isa;
+    const char *name;
+    simd_gemm_kernel_fn gemm_kernel;
+    simd_add_fn add;
+    simd_gemm_i8_kernel_fn gemm_i8_kernel; // AVX-512 tier needs AVX-512BW, else the AVX2 one
+    simd_f16_fn f16_to_f32;                // F16C on the AVX2 and AVX-512 tiers
+} simd_kernels;
+
+// Scalar conversions between float and the 16-bit storage formats,
+// round to nearest even
+uint16_t simd_f32_to_f16(float value);
+float simd_f16_to_f32(uint16_t value);
+uint16_t simd_f32_to_bf16(float value);
+float simd_bf16_to_f32(uint16_t value);
+
+simd_isa simd_detect(void);               // best ISA supported by this CPU
+const simd_kernels *simd_get(void);       // current selection
+simd_isa simd_set_isa(simd_isa isa);      // returns the ISA actually selected
+const char *simd_isa_name(simd_isa isa);
+int simd_parse_isa(const char *name, simd_isa *isa);
+
+#endif
@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sparse.h"
+
+#define SPARSE_TASKS_PER_THREAD 4 // extra tasks give the work stealing room to even out
+
+int csr_from_dense(csr_matrix *csr, int rows, int cols, const float *A, int lda, float threshold) {
+    int nnz = 0;
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            nnz += fabsf(A[(size_t)i * lda + j]) > threshold;
+        }
+    }
+
+    csr->rows = rows;
+    csr->cols = cols;
+    csr->nnz = nnz;
+    csr->row_ptr = (int *)malloc((rows + 1) * sizeof(int));
+    csr->col_idx = (int *)malloc((nnz ? nnz : 1) * sizeof(int));
+    csr->values = (float *)malloc((nnz ? nnz : 1) * sizeof(float));
+    if (!csr->row_ptr || !csr->col_idx || !csr->values) {
+        csr_free(csr);
+        return -1;
+    }
+
+    int k = 0;
+    for (int i = 0; i < rows; i++) {
+        csr->row_ptr[i] = k;
+        for (int j = 0; j < cols; j++) {
+            float a = A[(size_t)i * lda + j];
+            if (fabsf(a) > threshold) {
+                csr->col_idx[k] = j;
+                csr->values[k] = a;
+                k++;
+            }
+        }
+    }
+    csr->row_ptr[rows] = k;
+    return 0;
+}
+
+void csr_to_dense(const csr_matrix *csr, float *A, int lda) {
+    for (int i = 0; i < csr->rows; i++) {
+        float *a = A + (size_t)i * lda;
+        memset(a, 0, csr->cols * sizeof(float));
+        for (int k = csr->row_ptr[i]; k < csr->row_ptr[i + 1]; k++) {
+            a[csr->col_idx[k]] = csr->values[k];
+        }
+    }
+}
+
+void csr_free(csr_matrix *csr) {
+    free(csr->row_ptr);
+    free(csr->col_idx);
+    free(csr->values);
+    csr->row_ptr = NULL;
+    csr->col_idx = NULL;
+    csr->values = NULL;
+}
+
+int ell_from_csr(ell_matrix *ell, const csr_matrix *csr) {
+    int width = 0;
+    for (int i = 0; i < csr->rows; i++) {
+        int length = csr->row_ptr[i + 1] - csr->row_ptr[i];
+        if (length > width) width = length;
+    }
+
+    size_t count = (size_t)width * csr->rows;
+    ell->rows = csr->rows;
+    ell->cols = csr->cols;
+    ell->width = width;
+    ell->col_idx = (int *)calloc(count ? count : 1, sizeof(int));
+    ell->values = (float *)calloc(count ? count : 1, sizeof(float));
+    if (!ell->col_idx || !ell->values) {
+        ell_free(ell);
+        return -1;
+    }
+
+    for (int i = 0; i < csr->rows; i++) {
+        for (int k = csr->row_ptr[i]; k < csr->row_ptr[i + 1]; k++) {
+            size_t slot = (size_t)(k - csr->row_ptr[i]) * csr->rows + i;
+            ell->col_idx[slot] = csr->col_idx[k];
+            ell->values[slot] = csr->values[k];
+        }
+    }
+    return 0;
+}
+
+void ell_free(ell_matrix *ell) {
+    free(ell->col_idx);
+    free(ell->values);
+    ell->col_idx = NULL;
+    ell->values = NULL;
+}
+
+double ell_fill(const ell_matrix *ell, int nnz) {
+    return nnz ? (double)ell->width * ell->rows / nnz : 1.0;
+}
+
+// Sort key for SELL: longer rows first, original order among equal lengths
+typedef struct {
+    int length;
+    int row;
+} sell_row;
+
+static int sell_row_compare(const void *a, const void *b) {
+    const sell_row *x = (const sell_row *)a;
+    const sell_row *y = (const sell_row *)b;
+    if (x->length != y->length) {
+        return y->length - x->length;
+    }
+    return x->row - y->row;
+}
+
+int sell_from_csr(sell_matrix *sell, const csr_matrix *csr, int C, int sigma) {
+    if (C <= 0) C = SELL_C;
+    if (sigma <= 0) sigma = SELL_SIGMA;
+    sigma = (sigma + C - 1) / C * C;
+
+    int rows = csr->rows;
+    int num_slices = (rows + C - 1) / C;
+    memset(sell, 0, sizeof(*sell));
+    sell->rows = rows;
+    sell->cols = csr->cols;
+    sell->C = C;
+    sell->sigma = sigma;
+    sell->num_slices = num_slices;
+    sell->slice_ptr = (int *)malloc((num_slices + 1) * sizeof(int));
+    sell->slice_width = (int *)malloc((num_slices ? num_slices : 1) * sizeof(int));
+    sell->perm = (int *)malloc((rows ? rows : 1) * sizeof(int));
+    sell_row *order = (sell_row *)malloc((rows ? rows : 1) * sizeof(sell_row));
+    if (!sell->slice_ptr || !sell->slice_width || !sell->perm || !order) {
+        free(order);
+        sell_free(sell);
+        return -1;
+    }
+
+    // Sort each window of sigma rows by length; sigma is a whole number of slices
+    for (int i = 0; i < rows; i++) {
+        order[i].length = csr->row_ptr[i + 1] - csr->row_ptr[i];
+        order[i].row = i;
+    }
+    for (int w = 0; w < rows; w += sigma) {
+        int count = rows - w < sigma ? rows - w : sigma;
+        qsort(order + w, count, sizeof(sell_row), sell_row_compare);
+    }
+    for (int p = 0; p < rows; p++) {
+        sell->perm[p] = order[p].row;
+    }
+
+    // Slice widths and offsets
+    size_t total = 0;
+    for (int s = 0; s < num_slices; s++) {
+        int width = 0;
+        for (int p = s * C; p < (s + 1) * C && p < rows; p++) {
+            if (order[p].length > width) width = order[p].length;
+        }
+        sell->slice_width[s] = width;
+        sell->slice_ptr[s] = (int)total;
+        total += (size_t)width * C;
+    }
+    sell->slice_ptr[num_slices] = (int)total;
+    free(order);
+
+    sell->col_idx = (int *)calloc(total ? total : 1, sizeof(int));
+    sell->values = (float *)calloc(total ? total : 1, sizeof(float));
+    if (!sell->col_idx || !sell->values) {
+        sell_free(sell);
+        return -1;
+    }
+    for (int p = 0; p < rows; p++) {
+        int s = p / C, lane = p % C, row = sell->perm[p];
+        for (int k = csr->row_ptr[row]; k < csr->row_ptr[row + 1]; k++) {
+            size_t slot = sell->slice_ptr[s] + (size_t)(k - csr->row_ptr[row]) * C + lane;
+            sell->col_idx[slot] = csr->col_idx[k];
+            sell->values[slot] = csr->values[k];
+        }
+    }
+    return 0;
+}
+
+void sell_free(sell_matrix *sell) {
+    free(sell->slice_ptr);
+    free(sell->slice_width);
+    free(sell->perm);
+    free(sell->col_idx);
+    free(sell->values);
+    sell->slice_ptr = NULL;
+    sell->slice_width = NULL;
+    sell->perm = NULL;
+    sell->col_idx = NULL;
+    sell->values = NULL;
+}
+
+double sell_fill(const sell_matrix *sell, int nnz) {
+    return nnz ? (double)sell->slice_ptr[sell->num_slices] / nnz : 1.0;
+}
+
+void csr_bin_rows(const csr_matrix *csr, int threshold, int *short_rows, int *num_short,
+                  int *long_rows, int *num_long) {
+    *num_short = 0;
+    *num_long = 0;
+    for (int i = 0; i < csr->rows; i++) {
+        if (csr->row_ptr[i + 1] - csr->row_ptr[i] > threshold) {
+            long_rows[(*num_long)++] = i;
+        } else {
+            short_rows[(*num_short)++] = i;
+        }
+    }
+}
+
+// First index i in [0, count] with prefix[i] + i >= target. prefix is a
+// nondecreasing offset array (row_ptr, slice_ptr), so each item costs its
+// entries plus one, which keeps runs of empty rows from piling onto one task.
+static int sparse_split(const int *prefix, int count, double target) {
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if ((double)prefix[mid] + mid < target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+typedef struct {
+    const int *prefix;  // row_ptr or slice_ptr
+    int count;          // rows or slices
+    int num_tasks;
+    const void *A;
+    int N;
+    const float *X;
+    int ldx;
+    float *Y;
+    int ldy;
+} sparse_job;
+
+static void sparse_task_range(const sparse_job *job, int task, int *first, int *last) {
+    double total = (double)job->prefix[job->count] + job->count;
+    *first = sparse_split(job->prefix, job->count, total * task / job->num_tasks);
+    *last = sparse_split(job->prefix, job->count, total * (task + 1) / job->num_tasks);
+}
+
+static void spmv_csr_task(void *arg, int task, int worker) {
+    (void)worker;
+    const sparse_job *job = (const sparse_job *)arg;
+    const csr_matrix *A = (const csr_matrix *)job->A;
+    int first, last;
+    sparse_task_range(job, task, &first, &last);
+    for (int i = first; i < last; i++) {
+        float sum = 0.0f;
+        for (int k = A->row_ptr[i]; k < A->row_ptr[i + 1]; k++) {
+            sum += A->values[k] * job->X[A->col_idx[k]];
+        }
+        job->Y[i] = sum;
+    }
+}
+
+static void spmm_csr_task(void *arg, int task, int worker) {
+    (void)worker;
+    const sparse_job *job = (const sparse_job *)arg;
+    const csr_matrix *A = (const csr_matrix *)job->A;
+    int first, last;
+    sparse_task_range(job, task, &first, &last);
+    for (int i = first; i < last; i++) {
+        float *restrict y = job->Y + (size_t)i * job->ldy;
+        memset(y, 0, job->N * sizeof(float));
+        for (int k = A->row_ptr[i]; k < A->row_ptr[i + 1]; k++) {
+            float a = A->values[k];
+            const float *restrict x = job->X + (size_t)A->col_idx[k] * job->ldx;
+            for (int j = 0; j < job->N; j++) {
+                y[j] += a * x[j];
+            }
+        }
+    }
+}
+
+// One slice at a time, all C lanes together so the inner loop vectorizes
+static void spmv_sell_task(void *arg, int task, int worker) {
+    (void)worker;
+    const sparse_job *job = (const sparse_job *)arg;
+    const sell_matrix *A = (const sell_matrix *)job->A;
+    float acc[1024];
+    int first, last;
+    sparse_task_range(job, task, &first, &last);
+    for (int s = first; s < last; s++) {
+        const int C = A->C;
+        for (int lane = 0; lane < C; lane++) {
+            acc[lane] = 0.0f;
+        }
+        for (int j = 0; j < A->slice_width[s]; j++) {
+            const float *v = A->values + A->slice_ptr[s] + (size_t)j * C;
+            const int *c = A->col_idx + A->slice_ptr[s] + (size_t)j * C;
+            for (int lane = 0; lane < C; lane++) {
+                acc[lane] += v[lane] * job->X[c[lane]];
+            }
+        }
+        for (int p = s * C, lane = 0; lane < C && p < A->rows; p++, lane++) {
+            job->Y[A->perm[p]] = acc[lane];
+        }
+    }
+}
+
+static void spmm_sell_task(void *arg, int task, int worker) {
+    (void)worker;
+    const sparse_job *job = (const sparse_job *)arg;
+    const sell_matrix *A = (const sell_matrix *)job->A;
+    int first, last;
+    sparse_task_range(job, task, &first, &last);
+    for (int s = first; s < last; s++) {
+        const int C = A->C;
+        for (int p = s * C, lane = 0; lane < C && p < A->rows; p++, lane++) {
+            float *restrict y = job->Y + (size_t)A->perm[p] * job->ldy;
+            memset(y, 0, job->N * sizeof(float));
+            for (int j = 0; j < A->slice_width[s]; j++) {
+                size_t slot = A->slice_ptr[s] + (size_t)j * C + lane;
+                float a = A->values[slot];
+                const float *restrict x = job->X + (size_t)A->col_idx[slot] * job->ldx;
+                for (int n = 0; n < job->N; n++) {
+                    y[n] += a * x[n];
+                }
+            }
+        }
+    }
+}
+
+static void sparse_run(thread_pool *pool, sparse_job *job, thread_pool_fn fn) {
+    if (!pool) {
+        pool = thread_pool_default();
+    }
+    job->num_tasks = thread_pool_size(pool) * SPARSE_TASKS_PER_THREAD;
+    if (job->num_tasks > job->count) {
+        job->num_tasks = job->count;
+    }
+    if (job->num_tasks > 0) {
+        thread_pool_run(pool, job->num_tasks, fn, job);
+    }
+}
+
+void spmv_csr(thread_pool *pool, const csr_matrix *A, const float *x, float *y) {
+    sparse_job job = {A->row_ptr, A->rows, 0, A, 1, x, 1, y, 1};
+    sparse_run(pool, &job, spmv_csr_task);
+}
+
+void spmv_sell(thread_pool *pool, const sell_matrix *A, const float *x, float *y) {
+    if (A->C > 1024) {
+        fprintf(stderr, "spmv_sell supports slices of up to 1024 rows, got %d\n", A->C);
+        exit(EXIT_FAILURE);
+    }
+    sparse_job job = {A->slice_ptr, A->num_slices, 0, A, 1, x, 1, y, 1};
+    sparse_run(pool, &job, spmv_sell_task);
+}
+
+void spmm_csr(thread_pool *pool, const csr_matrix *A, int N, const float *X, int ldx, float *Y, int ldy) {
+    sparse_job job = {A->row_ptr, A->rows, 0, A, N, X, ldx, Y, ldy};
+    sparse_run(pool, &job, spmm_csr_task);
+}
+
+void spmm_sell(thread_pool *pool, const sell_matrix *A, int N, const float *X, int ldx, float *Y, int ldy) {
+    sparse_job job = {A->slice_ptr, A->num_slices, 0, A, N, X, ldx, Y, ldy};
+    sparse_run(pool, &job, spmm_sell_task);
+}
@@ -0,0 +1,83 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include "thread_pool.h"
+
+// Sparse matrix storage and products for the host matrix code.
+//
+// CSR keeps the nonzeros of each row back to back. ELLPACK pads every row to
+// the longest one and stores the result column-major (entry j of row i at
+// j * rows + i), so consecutive rows are consecutive in memory; it is only
+// worth it when the row lengths are close. SELL-C-sigma cuts the rows into
+// slices of C and pads each slice to its own longest row, after sorting the
+// rows by length inside windows of sigma rows so that a slice holds rows of
+// similar length. Padding entries have value 0 and column 0.
+//
+// Values are float, indices int; a matrix is limited to INT_MAX nonzeros.
+
+typedef struct {
+    int rows, cols;
+    int nnz;
+    int *row_ptr;   // rows + 1 entries, row i is [row_ptr[i], row_ptr[i + 1])
+    int *col_idx;   // nnz
+    float *values;  // nnz
+} csr_matrix;
+
+typedef struct {
+    int rows, cols;
+    int width;      // longest row, entries per row after padding
+    int *col_idx;   // width * rows, column-major
+    float *values;
+} ell_matrix;
+
+typedef struct {
+    int rows, cols;
+    int C, sigma;
+    int num_slices;   // ceil(rows / C), the last slice is padded with empty rows
+    int *slice_ptr;   // num_slices + 1 offsets, slice s holds slice_width[s] * C entries
+    int *slice_width;
+    int *perm;        // rows entries, perm[p] is the original row stored at position p
+    int *col_idx;     // entry j of position p = s * C + lane at slice_ptr[s] + j * C + lane
+    float *values;
+} sell_matrix;
+
+#define SELL_C 32        // rows per slice: a multiple of the SIMD width, one OpenCL work-group
+#define SELL_SIGMA 1024  // sorting window
+
+// Conversions return 0 on success and -1 if an allocation failed, in which
+// case nothing needs to be freed. Entries with |a| <= threshold are dropped.
+int csr_from_dense(csr_matrix *csr, int rows, int cols, const float *A, int lda, float threshold);
+void csr_to_dense(const csr_matrix *csr, float *A, int lda);
+void csr_free(csr_matrix *csr);
+
+int ell_from_csr(ell_matrix *ell, const csr_matrix *csr);
+void ell_free(ell_matrix *ell);
+
+// C <= 0 and sigma <= 0 use SELL_C and SELL_SIGMA; sigma is rounded up to a multiple of C
+int sell_from_csr(sell_matrix *sell, const csr_matrix *csr, int C, int sigma);
+void sell_free(sell_matrix *sell);
+
+// Stored entries per nonzero, 1.0 for CSR
+double ell_fill(const ell_matrix *ell, int nnz);
+double sell_fill(const sell_matrix *sell, int nnz);
+
+// Splits the rows of csr into those with more than threshold nonzeros and the
+// rest, each list in row order. The lists need csr->rows entries between them.
+void csr_bin_rows(const csr_matrix *csr, int threshold, int *short_rows, int *num_short,
+                  int *long_rows, int *num_long);
+
+// Products on the thread pool (NULL uses thread_pool_default()).
+//
+// Rows are handed out in tasks of about equal nonzero count plus row count,
+// found by bisecting row_ptr, so a few long rows no longer serialize the run
+// the way an even split by rows does; SELL balances over slice sizes the same
+// way. A single row is never split across tasks.
+//
+// spmv: y (rows) = A * x (cols)
+// spmm: Y (rows x N) = A * X (cols x N), row-major with leading dimensions
+void spmv_csr(thread_pool *pool, const csr_matrix *A, const float *x, float *y);
+void spmv_sell(thread_pool *pool, const sell_matrix *A, const float *x, float *y);
+void spmm_csr(thread_pool *pool, const csr_matrix *A, int N, const float *X, int ldx, float *Y, int ldy);
+void spmm_sell(thread_pool *pool, const sell_matrix *A, int N, const float *X, int ldx, float *Y, int ldy);
+
+#endif
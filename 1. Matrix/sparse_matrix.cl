@@ -0,0 +1,130 @@
+// Sparse matrix-vector (SpMV, y = A * x) and matrix-matrix (SpMM, Y = A * X)
+// products for the layouts of sparse.h. X and Y are row-major with N columns.
+
+// CSR, one work-item per row. rows lists the rows to compute (the short ones
+// from csr_bin_rows), so a run over a row list never meets a long row.
+__kernel void spmv_csr_scalar(const int num_rows, __global const int* rows,
+                              __global const int* row_ptr, __global const int* col_idx,
+                              __global const float* values, __global const float* x,
+                              __global float* y) {
+    const int r = get_global_id(0);
+    if (r < num_rows) {
+        const int row = rows[r];
+        float sum = 0.0f;
+        for (int k = row_ptr[row]; k < row_ptr[row + 1]; k++) {
+            sum = mad(values[k], x[col_idx[k]], sum);
+        }
+        y[row] = sum;
+    }
+}
+
+// CSR, one work-group per row for the long ones. The work-items stride over
+// the row together, so the reads of values and col_idx are coalesced, and
+// combine their partial sums in local memory (partial holds one float per
+// work-item; the local size must be a power of two).
+__kernel void spmv_csr_vector(const int num_rows, __global const int* rows,
+                              __global const int* row_ptr, __global const int* col_idx,
+                              __global const float* values, __global const float* x,
+                              __global float* y, __local float* partial) {
+    const int r = get_group_id(0);
+    const int lid = get_local_id(0);
+    const int ls = get_local_size(0);
+    if (r >= num_rows) {
+        return;
+    }
+    const int row = rows[r];
+    float sum = 0.0f;
+    for (int k = row_ptr[row] + lid; k < row_ptr[row + 1]; k += ls) {
+        sum = mad(values[k], x[col_idx[k]], sum);
+    }
+    partial[lid] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int offset = ls / 2; offset > 0; offset /= 2) {
+        if (lid < offset) {
+            partial[lid] += partial[lid + offset];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0) {
+        y[row] = partial[0];
+    }
+}
+
+// ELLPACK, one work-item per row. Column-major storage makes the reads of
+// neighbouring work-items adjacent; padding entries are zero.
+__kernel void spmv_ell(const int num_rows, const int width,
+                       __global const int* col_idx, __global const float* values,
+                       __global const float* x, __global float* y) {
+    const int row = get_global_id(0);
+    if (row < num_rows) {
+        float sum = 0.0f;
+        for (int j = 0; j < width; j++) {
+            const int slot = j * num_rows + row;
+            sum = mad(values[slot], x[col_idx[slot]], sum);
+        }
+        y[row] = sum;
+    }
+}
+
+// SELL-C-sigma, one work-group of C work-items per slice, each work-item one
+// row. Work-groups only run as long as their own slice, and rows sorted by
+// length keep the work-items of a slice busy for about the same time.
+__kernel void spmv_sell(const int num_rows, const int C,
+                        __global const int* slice_ptr, __global const int* slice_width,
+                        __global const int* perm, __global const int* col_idx,
+                        __global const float* values, __global const float* x,
+                        __global float* y) {
+    const int s = get_group_id(0);
+    const int lane = get_local_id(0);
+    const int p = s * C + lane;
+    if (lane >= C || p >= num_rows) {
+        return;
+    }
+    float sum = 0.0f;
+    const int width = slice_width[s];
+    for (int j = 0, slot = slice_ptr[s] + lane; j < width; j++, slot += C) {
+        sum = mad(values[slot], x[col_idx[slot]], sum);
+    }
+    y[perm[p]] = sum;
+}
+
+// CSR SpMM, work-item (j, r) computes Y[rows[r]][j]. The work-items of a row
+// read the same nonzeros and adjacent entries of X.
+__kernel void spmm_csr(const int num_rows, const int N, __global const int* rows,
+                       __global const int* row_ptr, __global const int* col_idx,
+                       __global const float* values, __global const float* X,
+                       __global float* Y) {
+    const int j = get_global_id(0);
+    const int r = get_global_id(1);
+    if (j < N && r < num_rows) {
+        const int row = rows[r];
+        float sum = 0.0f;
+        for (int k = row_ptr[row]; k < row_ptr[row + 1]; k++) {
+            sum = mad(values[k], X[col_idx[k] * N + j], sum);
+        }
+        Y[row * N + j] = sum;
+    }
+}
+
+// SELL-C-sigma SpMM, work-item (j, p) computes column j of the row stored at
+// position p, with p running over the sorted order so neighbouring rows of a
+// launch have similar lengths.
+__kernel void spmm_sell(const int num_rows, const int N, const int C,
+                        __global const int* slice_ptr, __global const int* slice_width,
+                        __global const int* perm, __global const int* col_idx,
+                        __global const float* values, __global const float* X,
+                        __global float* Y) {
+    const int j = get_global_id(0);
+    const int p = get_global_id(1);
+    if (j >= N || p >= num_rows) {
+        return;
+    }
+    const int s = p / C;
+    const int lane = p % C;
+    const int width = slice_width[s];
+    float sum = 0.0f;
+    for (int k = 0, slot = slice_ptr[s] + lane; k < width; k++, slot += C) {
+        sum = mad(values[slot], X[col_idx[slot] * N + j], sum);
+    }
+    Y[perm[p] * N + j] = sum;
+}
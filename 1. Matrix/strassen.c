@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "strassen.h"
+#include "gemm.h"
+
+// Arena chunks are rounded up to whole cache lines to keep every quadrant aligned
+#define STRASSEN_ROUND(count) (((count) + GEMM_ALIGN / sizeof(float) - 1) / (GEMM_ALIGN / sizeof(float)) * (GEMM_ALIGN / sizeof(float)))
+#define STRASSEN_ADD_ROWS 64 // rows per thread pool task in the quadrant additions
+
+static int strassen_is_leaf(int M, int N, int K, int cutoff) {
+    return M <= cutoff || N <= cutoff || K <= cutoff;
+}
+
+size_t strassen_workspace_size(int M, int N, int K, int cutoff) {
+    if (cutoff <= 0) cutoff = STRASSEN_CUTOFF;
+    size_t total = 0;
+    while (!strassen_is_leaf(M, N, K, cutoff)) {
+        size_t m = M / 2, n = N / 2, k = K / 2;
+        // X holds a quadrant of A and later one of C, Y a quadrant of B
+        total += STRASSEN_ROUND(m * (k > n ? k : n)) + STRASSEN_ROUND(k * n);
+        M /= 2;
+        N /= 2;
+        K /= 2;
+    }
+    return total;
+}
+
+int strassen_arena_init(strassen_arena *arena, size_t count) {
+    arena->data = count ? gemm_alloc(count) : NULL;
+    arena->capacity = arena->data ? count : 0;
+    arena->used = 0;
+    return count && !arena->data ? -1 : 0;
+}
+
+void strassen_arena_release(strassen_arena *arena) {
+    gemm_free(arena->data);
+    arena->data = NULL;
+    arena->capacity = 0;
+    arena->used = 0;
+}
+
+static float *strassen_arena_take(strassen_arena *arena, size_t count) {
+    count = STRASSEN_ROUND(count);
+    if (arena->used + count > arena->capacity) {
+        fprintf(stderr, "Strassen arena too small\n");
+        exit(EXIT_FAILURE);
+    }
+    float *ptr = arena->data + arena->used;
+    arena->used += count;
+    return ptr;
+}
+
+// Z = X + sign * Y over an m x n block, split by rows across the pool
+typedef struct {
+    int m, n;
+    const float *X;
+    int ldx;
+    const float *Y;
+    int ldy;
+    float *Z;
+    int ldz;
+    float sign;
+} strassen_add_job;
+
+static void strassen_add_task(void *arg, int task, int worker) {
+    (void)worker;
+    strassen_add_job *job = (strassen_add_job *)arg;
+    int i0 = task * STRASSEN_ADD_ROWS;
+    int i1 = i0 + STRASSEN_ADD_ROWS < job->m ? i0 + STRASSEN_ADD_ROWS : job->m;
+    for (int i = i0; i < i1; i++) {
+        const float *x = job->X + (size_t)i * job->ldx;
+        const float *y = job->Y + (size_t)i * job->ldy;
+        float *z = job->Z + (size_t)i * job->ldz;
+        if (job->sign > 0.0f) {
+            for (int j = 0; j < job->n; j++) z[j] = x[j] + y[j];
+        } else {
+            for (int j = 0; j < job->n; j++) z[j] = x[j] - y[j];
+        }
+    }
+}
+
+static void strassen_add(thread_pool *pool, int m, int n, const float *X, int ldx,
+                         const float *Y, int ldy, float *Z, int ldz, float sign) {
+    strassen_add_job job = {m, n, X, ldx, Y, ldy, Z, ldz, sign};
+    thread_pool_run(pool, (m + STRASSEN_ADD_ROWS - 1) / STRASSEN_ADD_ROWS, strassen_add_task, &job);
+}
+
+static void strassen_recurse(thread_pool *pool, int M, int N, int K,
+                             const float *A, int lda, const float *B, int ldb, float *C, int ldc,
+                             int cutoff, strassen_arena *arena);
+
+// C = A * B for even M, N, K, following the two-temporary schedule of the
+// Winograd variant (Boyer, Dumas, Pernet, Zhou, "Memory efficient scheduling
+// of Strassen-Winograd's matrix multiplication algorithm", 2009).
+static void strassen_level(thread_pool *pool, int M, int N, int K,
+                           const float *A, int lda, const float *B, int ldb, float *C, int ldc,
+                           int cutoff, strassen_arena *arena) {
+    int m = M / 2, n = N / 2, k = K / 2;
+    const float *A11 = A, *A12 = A + k, *A21 = A + (size_t)m * lda, *A22 = A21 + k;
+    const float *B11 = B, *B12 = B + n, *B21 = B + (size_t)k * ldb, *B22 = B21 + n;
+    float *C11 = C, *C12 = C + n, *C21 = C + (size_t)m * ldc, *C22 = C21 + n;
+
+    size_t mark = arena->used;
+    int ldx = k > n ? k : n;
+    float *X = strassen_arena_take(arena, (size_t)m * ldx);
+    float *Y = strassen_arena_take(arena, (size_t)k * n);
+
+    strassen_add(pool, m, k, A11, lda, A21, lda, X, ldx, -1.0f);               // S3 = A11 - A21
+    strassen_add(pool, k, n, B22, ldb, B12, ldb, Y, n, -1.0f);                 // T3 = B22 - B12
+    strassen_recurse(pool, m, n, k, X, ldx, Y, n, C21, ldc, cutoff, arena);    // P7 = S3 T3
+    strassen_add(pool, m, k, A21, lda, A22, lda, X, ldx, 1.0f);                // S1 = A21 + A22
+    strassen_add(pool, k, n, B12, ldb, B11, ldb, Y, n, -1.0f);                 // T1 = B12 - B11
+    strassen_recurse(pool, m, n, k, X, ldx, Y, n, C22, ldc, cutoff, arena);    // P5 = S1 T1
+    strassen_add(pool, m, k, X, ldx, A11, lda, X, ldx, -1.0f);                 // S2 = S1 - A11
+    strassen_add(pool, k, n, B22, ldb, Y, n, Y, n, -1.0f);                     // T2 = B22 - T1
+    strassen_recurse(pool, m, n, k, X, ldx, Y, n, C12, ldc, cutoff, arena);    // P6 = S2 T2
+    strassen_add(pool, m, k, A12, lda, X, ldx, X, ldx, -1.0f);                 // S4 = A12 - S2
+    strassen_recurse(pool, m, n, k, X, ldx, B22, ldb, C11, ldc, cutoff, arena);// P3 = S4 B22
+    strassen_recurse(pool, m, n, k, A11, lda, B11, ldb, X, ldx, cutoff, arena);// P1 = A11 B11
+    strassen_add(pool, m, n, X, ldx, C12, ldc, C12, ldc, 1.0f);                // U2 = P1 + P6
+    strassen_add(pool, m, n, C12, ldc, C21, ldc, C21, ldc, 1.0f);              // U3 = U2 + P7
+    strassen_add(pool, m, n, C12, ldc, C22, ldc, C12, ldc, 1.0f);              // U4 = U2 + P5
+    strassen_add(pool, m, n, C21, ldc, C22, ldc, C22, ldc, 1.0f);              // U7 = U3 + P5 = C22
+    strassen_add(pool, m, n, C12, ldc, C11, ldc, C12, ldc, 1.0f);              // U5 = U4 + P3 = C12
+    strassen_add(pool, k, n, Y, n, B21, ldb, Y, n, -1.0f);                     // T4 = T2 - B21
+    strassen_recurse(pool, m, n, k, A22, lda, Y, n, C11, ldc, cutoff, arena);  // P4 = A22 T4
+    strassen_add(pool, m, n, C21, ldc, C11, ldc, C21, ldc, -1.0f);             // U6 = U3 - P4 = C21
+    strassen_recurse(pool, m, n, k, A12, lda, B21, ldb, C11, ldc, cutoff, arena);// P2 = A12 B21
+    strassen_add(pool, m, n, X, ldx, C11, ldc, C11, ldc, 1.0f);                // U1 = P1 + P2 = C11
+
+    arena->used = mark;
+}
+
+static void strassen_recurse(thread_pool *pool, int M, int N, int K,
+                             const float *A, int lda, const float *B, int ldb, float *C, int ldc,
+                             int cutoff, strassen_arena *arena) {
+    if (strassen_is_leaf(M, N, K, cutoff)) {
+        gemm_parallel(pool, M, N, K, A, lda, B, ldb, C, ldc);
+        return;
+    }
+
+    // Even part by recursion, then peel the odd row, column and K term
+    int M2 = M & ~1, N2 = N & ~1, K2 = K & ~1;
+    strassen_level(pool, M2, N2, K2, A, lda, B, ldb, C, ldc, cutoff, arena);
+
+    if (K2 < K) {
+        const float *b = B + (size_t)K2 * ldb;
+        for (int i = 0; i < M2; i++) {
+            float a = A[(size_t)i * lda + K2];
+            float *c = C + (size_t)i * ldc;
+            for (int j = 0; j < N2; j++) c[j] += a * b[j];
+        }
+    }
+    if (N2 < N) {
+        for (int i = 0; i < M; i++) {
+            float sum = 0.0f;
+            for (int p = 0; p < K; p++) sum += A[(size_t)i * lda + p] * B[(size_t)p * ldb + N2];
+            C[(size_t)i * ldc + N2] = sum;
+        }
+    }
+    if (M2 < M) {
+        float *c = C + (size_t)M2 * ldc;
+        memset(c, 0, (size_t)N2 * sizeof(float));
+        for (int p = 0; p < K; p++) {
+            float a = A[(size_t)M2 * lda + p];
+            const float *b = B + (size_t)p * ldb;
+            for (int j = 0; j < N2; j++) c[j] += a * b[j];
+        }
+    }
+}
+
+// Shared arena for callers that do not bring their own
+static strassen_arena strassen_default_arena = {NULL, 0, 0};
+
+static void strassen_release_default_arena(void) {
+    strassen_arena_release(&strassen_default_arena);
+}
+
+void gemm_strassen(thread_pool *pool, int M, int N, int K,
+                   const float *A, int lda, const float *B, int ldb, float *C, int ldc,
+                   int cutoff, strassen_arena *arena) {
+    if (M <= 0 || N <= 0) {
+        return;
+    }
+    if (cutoff <= 0) {
+        cutoff = STRASSEN_CUTOFF;
+    }
+    if (!pool) {
+        pool = thread_pool_default();
+    }
+
+    size_t needed = strassen_workspace_size(M, N, K, cutoff);
+    if (!arena) {
+        arena = &strassen_default_arena;
+        if (arena->capacity < needed) {
+            if (!arena->data) {
+                atexit(strassen_release_default_arena);
+            }
+            strassen_arena_release(arena);
+            if (strassen_arena_init(arena, needed) != 0) {
+                fprintf(stderr, "Failed to allocate Strassen workspace\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    if (arena->capacity - arena->used < needed) {
+        fprintf(stderr, "Strassen arena too small: %zu floats free, %zu needed\n",
+                arena->capacity - arena->used, needed);
+        exit(EXIT_FAILURE);
+    }
+    strassen_recurse(pool, M, N, K, A, lda, B, ldb, C, ldc, cutoff, arena);
+}
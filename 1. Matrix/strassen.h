@@ -0,0 +1,42 @@
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+#include <stddef.h>
+#include "thread_pool.h"
+
+// Strassen-Winograd GEMM: C (M x N) = A (M x K) * B (K x N), row-major.
+//
+// Each level splits A, B and C into quadrants and forms the product from 7
+// half-size multiplications and 15 additions instead of 8 multiplications.
+// Below the cutoff (any dimension <= cutoff) it switches to gemm_parallel.
+// Odd dimensions are peeled: the even part recurses and the last row, column
+// and rank-1 term are fixed up directly.
+//
+// The result is less accurate than the blocked GEMM: the error bound grows
+// by roughly a factor of 3..6 per recursion level. Use it for large square
+// products where that is acceptable.
+//
+// Temporaries come from an arena sized once for the whole recursion, so no
+// level allocates. The schedule needs two quadrant-sized buffers per level,
+// about 2/3 of an n x n matrix in total for square n.
+#define STRASSEN_CUTOFF 1024
+
+typedef struct {
+    float *data;     // GEMM_ALIGN-aligned
+    size_t capacity; // floats
+    size_t used;
+} strassen_arena;
+
+// Floats of arena needed for one product of this shape
+size_t strassen_workspace_size(int M, int N, int K, int cutoff);
+
+int strassen_arena_init(strassen_arena *arena, size_t count);
+void strassen_arena_release(strassen_arena *arena);
+
+// cutoff <= 0 uses STRASSEN_CUTOFF. pool may be NULL to use thread_pool_default().
+// arena may be NULL to use a shared one that grows on demand and is kept for later calls.
+void gemm_strassen(thread_pool *pool, int M, int N, int K,
+                   const float *A, int lda, const float *B, int ldb, float *C, int ldc,
+                   int cutoff, strassen_arena *arena);
+
+#endif
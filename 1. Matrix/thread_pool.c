@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "thread_pool.h"
+
+// Remaining task indices of one worker: [next, end)
+typedef struct {
+    pthread_mutex_t lock;
+    int next;
+    int end;
+    char pad[64]; // keep neighbouring workers off the same cache line
+} thread_pool_slice;
+
+typedef struct {
+    thread_pool *pool;
+    int id;
+} thread_pool_worker;
+
+struct thread_pool {
+    int num_threads;
+    pthread_t *threads;
+    thread_pool_worker *workers;
+    thread_pool_slice *slices;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    unsigned long generation; // bumped for every job
+    int active;               // workers still busy with the current job
+    int shutdown;
+
+    thread_pool_fn fn;
+    void *arg;
+};
+
+int thread_pool_num_cores(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+#endif
+}
+
+// Take one index from the front of our own slice
+static int thread_pool_pop(thread_pool_slice *slice, int *task) {
+    int found = 0;
+    pthread_mutex_lock(&slice->lock);
+    if (slice->next < slice->end) {
+        *task = slice->next++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&slice->lock);
+    return found;
+}
+
+// Move the back half of the fullest other slice into ours
+static int thread_pool_steal(thread_pool *pool, int self) {
+    int victim = -1, best = 0;
+    for (int i = 1; i < pool->num_threads; i++) {
+        int v = (self + i) % pool->num_threads;
+        pthread_mutex_lock(&pool->slices[v].lock);
+        int left = pool->slices[v].end - pool->slices[v].next;
+        pthread_mutex_unlock(&pool->slices[v].lock);
+        if (left > best) {
+            best = left;
+            victim = v;
+        }
+    }
+    if (victim < 0) {
+        return 0;
+    }
+
+    thread_pool_slice *from = &pool->slices[victim];
+    int lo = 0, hi = 0;
+    // Re-check under the lock, the victim may have drained in the meantime
+    pthread_mutex_lock(&from->lock);
+    int left = from->end - from->next;
+    if (left > 0) {
+        hi = from->end;
+        lo = from->end - (left + 1) / 2;
+        from->end = lo;
+    }
+    pthread_mutex_unlock(&from->lock);
+    if (hi == lo) {
+        return 0;
+    }
+
+    thread_pool_slice *to = &pool->slices[self];
+    pthread_mutex_lock(&to->lock);
+    to->next = lo;
+    to->end = hi;
+    pthread_mutex_unlock(&to->lock);
+    return 1;
+}
+
+static void thread_pool_work(thread_pool *pool, int self) {
+    int task;
+    for (;;) {
+        while (thread_pool_pop(&pool->slices[self], &task)) {
+            pool->fn(pool->arg, task, self);
+        }
+        // Retry until every slice is empty; a failed steal can race with
+        // another thief, so only give up when nothing is left anywhere.
+        if (!thread_pool_steal(pool, self)) {
+            int left = 0;
+            for (int i = 0; i < pool->num_threads && !left; i++) {
+                pthread_mutex_lock(&pool->slices[i].lock);
+                left = pool->slices[i].end > pool->slices[i].next;
+                pthread_mutex_unlock(&pool->slices[i].lock);
+            }
+            if (!left) {
+                return;
+            }
+        }
+    }
+}
+
+static void *thread_pool_main(void *data) {
+    thread_pool_worker *worker = (thread_pool_worker *)data;
+    thread_pool *pool = worker->pool;
+    unsigned long seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        thread_pool_work(pool, worker->id);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+thread_pool *thread_pool_create(int num_threads) {
+    if (num_threads <= 0) {
+        const char *env = getenv("MATRIX_NUM_THREADS");
+        num_threads = env ? atoi(env) : 0;
+    }
+    if (num_threads <= 0) {
+        num_threads = thread_pool_num_cores();
+    }
+
+    thread_pool *pool = (thread_pool *)calloc(1, sizeof(thread_pool));
+    pool->num_threads = num_threads;
+    pool->threads = (pthread_t *)calloc(num_threads, sizeof(pthread_t));
+    pool->workers = (thread_pool_worker *)calloc(num_threads, sizeof(thread_pool_worker));
+    pool->slices = (thread_pool_slice *)calloc(num_threads, sizeof(thread_pool_slice));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int i = 0; i < num_threads; i++) {
+        pthread_mutex_init(&pool->slices[i].lock, NULL);
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+    }
+    // Worker 0 is whichever thread calls thread_pool_run
+    for (int i = 1; i < num_threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, thread_pool_main, &pool->workers[i]) != 0) {
+            fprintf(stderr, "Failed to create worker thread %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return pool;
+}
+
+void thread_pool_destroy(thread_pool *pool) {
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_mutex_destroy(&pool->slices[i].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool->workers);
+    free(pool->slices);
+    free(pool);
+}
+
+int thread_pool_size(const thread_pool *pool) {
+    return pool->num_threads;
+}
+
+void thread_pool_run(thread_pool *pool, int num_tasks, thread_pool_fn fn, void *arg) {
+    if (num_tasks <= 0) {
+        return;
+    }
+    if (pool->num_threads == 1 || num_tasks == 1) {
+        for (int i = 0; i < num_tasks; i++) {
+            fn(arg, i, 0);
+        }
+        return;
+    }
+
+    // Hand out contiguous, equally sized slices; stealing evens out the rest
+    for (int i = 0; i < pool->num_threads; i++) {
+        pool->slices[i].next = (int)((long long)num_tasks * i / pool->num_threads);
+        pool->slices[i].end = (int)((long long)num_tasks * (i + 1) / pool->num_threads);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->active = pool->num_threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    thread_pool_work(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static thread_pool *thread_pool_shared = NULL;
+
+static void thread_pool_release_shared(void) {
+    thread_pool_destroy(thread_pool_shared);
+    thread_pool_shared = NULL;
+}
+
+thread_pool *thread_pool_default(void) {
+    if (!thread_pool_shared) {
+        thread_pool_shared = thread_pool_create(0);
+        atexit(thread_pool_release_shared);
+    }
+    return thread_pool_shared;
+}
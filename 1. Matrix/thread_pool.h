@@ -0,0 +1,30 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Persistent worker pool for the host matrix code.
+//
+// thread_pool_run() executes fn(arg, task, worker) for every task index in
+// [0, num_tasks). Each worker starts with a contiguous slice of the indices and
+// takes them from the front; a worker that runs dry steals the back half of the
+// largest remaining slice of another worker. The calling thread takes part as
+// worker 0, so a pool of size 1 runs everything inline.
+typedef void (*thread_pool_fn)(void *arg, int task, int worker);
+
+typedef struct thread_pool thread_pool;
+
+// num_threads <= 0 uses MATRIX_NUM_THREADS from the environment, or the number
+// of online cores if that is not set.
+thread_pool *thread_pool_create(int num_threads);
+void thread_pool_destroy(thread_pool *pool);
+int thread_pool_size(const thread_pool *pool);
+
+// Blocks until every task has finished. Not reentrant: do not call it from
+// inside a task or from two threads at once on the same pool.
+void thread_pool_run(thread_pool *pool, int num_tasks, thread_pool_fn fn, void *arg);
+
+// Shared pool created on first use, released at exit.
+thread_pool *thread_pool_default(void);
+
+int thread_pool_num_cores(void);
+
+#endif
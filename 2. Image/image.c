@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include "image_ops.c"
+#include "../common/trace.c"
 
 
 void ReadImage(const char* filename, unsigned char** image, unsigned* width, unsigned* height) {
@@ -13,54 +15,6 @@ void ReadImage(const char* filename, unsigned char** image, unsigned* width, uns
     }
 }
 
-void ResizeImage(const unsigned char* inputImage, unsigned inputWidth, unsigned inputHeight,
-                 unsigned char** outputImage, unsigned* outputWidth, unsigned* outputHeight) {
-    *outputWidth = inputWidth / 4;
-    *outputHeight = inputHeight / 4;
-    *outputImage = (unsigned char*)malloc((*outputWidth) * (*outputHeight) * 4);
-
-    for (unsigned y = 0; y < *outputHeight; y++) {
-        for (unsigned x = 0; x < *outputWidth; x++) {
-            for (int i = 0; i < 4; i++) {
-                (*outputImage)[(y * (*outputWidth) + x) * 4 + i] =
-                    inputImage[(y * 4 * inputWidth + x * 4) * 4 + i];
-            }
-        }
-    }
-}
-
-void GrayScaleImage(const unsigned char* inputImage, unsigned inputWidth, unsigned inputHeight,
-                    unsigned char** outputImage) {
-    *outputImage = (unsigned char*)malloc(inputWidth * inputHeight);
-    for (unsigned i = 0; i < inputWidth * inputHeight; i++) {
-        unsigned char r = inputImage[i * 4];
-        unsigned char g = inputImage[i * 4 + 1];
-        unsigned char b = inputImage[i * 4 + 2];
-        (*outputImage)[i] = (unsigned char)(0.2126 * r + 0.7152 * g + 0.0722 * b);  // Y=0.2126R + 0.7152G + 0.0722B. 
-    }
-}
-
-void ApplyFilter(const unsigned char* grayImage, unsigned width, unsigned height,
-                 unsigned char** filteredImage) {
-    *filteredImage = (unsigned char*)malloc(width * height);
-    memset(*filteredImage, 0, width * height); // Initialize filtered image
-
-    // Simple averaging filter 
-    for (unsigned y = 2; y < height - 2; y++) {
-        for (unsigned x = 2; x < width - 2; x++) {
-            unsigned sum = 0;
-            for (int dy = -2; dy <= 2; dy++) {
-                for (int dx = -2; dx <= 2; dx++) {
-                    sum += grayImage[(y + dy) * width + (x + dx)];
-                }
-            }
-            (*filteredImage)[y * width + x] = sum / 25;
-        }
-    }
-}
-
-
-
 void WriteImage(const char* filename, const unsigned char* image, unsigned width, unsigned height) {
     unsigned error = lodepng_encode_file(filename, image, width, height, LCT_GREY, 8);
     if (error) {
@@ -89,7 +43,9 @@ int main() {
 
     // Reading and decoding the image
     start = clock();
+    trace_begin("ReadImage");
     ReadImage(inputFile, &image, &width, &height);
+    trace_end();
 
     end = clock();
     cpu_time_used = ((double) (end - start)) * 1000.0 / CLOCKS_PER_SEC; 
@@ -100,29 +56,37 @@ int main() {
 
     // Resizing the image
     start = clock();
+    trace_begin("ResizeImage");
     ResizeImage(image, width, height, &resizedImage, &resizedWidth, &resizedHeight);
+    trace_end();
     end = clock();
     cpu_time_used = ((double) (end - start)) * 1000.0 / CLOCKS_PER_SEC; 
     printf("ResizeImage took %.0f ms to execute \n", cpu_time_used);
 
     // Converting to grayscale
     start = clock();
+    trace_begin("GrayScaleImage");
     GrayScaleImage(resizedImage, resizedWidth, resizedHeight, &grayImage);
+    trace_end();
     end = clock();
     cpu_time_used = ((double) (end - start)) * 1000.0 / CLOCKS_PER_SEC;
     printf("GrayScaleImage took %.0f ms to execute \n", cpu_time_used);
 
     // Applying the filter
     start = clock();
+    trace_begin("ApplyFilter");
     ApplyFilter(grayImage, resizedWidth, resizedHeight, &filteredImage);
+    trace_end();
 
     end = clock();
-    cpu_time_used = ((double) (end - start)) * 1000.0 / CLOCKS_PER_SEC; /
+    cpu_time_used = ((double) (end - start)) * 1000.0 / CLOCKS_PER_SEC;
     printf("ApplyFilter took %.0f ms to execute \n", cpu_time_used);
 
     // Writing the resulting image
     start = clock();
+    trace_begin("WriteImage");
     WriteImage("D:/Mega/OULU/Multiprocessesor Proggramming/Projects/2. Image/image_0_bw.png", filteredImage, resizedWidth, resizedHeight);
+    trace_end();
     end = clock();
     cpu_time_used = ((double) (end - start)) * 1000.0 / CLOCKS_PER_SEC; 
     printf("WriteImage took %.0f ms to execute \n", cpu_time_used);
@@ -1,104 +1,369 @@
+#include "lodepng.c"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <CL/cl.h>
+#include "../common/cl_autotune.c"
+#include "../common/cl_source.c"
+#include "../common/cl_cache.c"
+#include "../common/cl_profile.c"
+#include "../common/trace.c"
+#include "../common/cl_trace.c"
+#include "../common/cl_devices.c"
+#include "../common/bench.c"
 
-#define MAX_SOURCE_SIZE (0x100000)
+#define FILTER_RADIUS 2 // apply_filter reads 2 rows above and below
+#define SHARD_GRANULE 16 // rows; the default work-group height
 
-int main() {
-    // Load the kernel source code into a string
-    FILE *fp;
-    char *source_str;
-    size_t source_size;
+// Candidate work-group shapes; the first values are the defaults when tuning is off
+static const int local_widths[] = {16, 8, 32, 4, 64, 1};
+static const int local_heights[] = {16, 8, 4, 2, 1};
 
-    fp = fopen("kernels.cl", "r");
-    if (!fp) {
-        fprintf(stderr, "Failed to load kernel.\n");
+void checkError(cl_int error, const char *message) {
+    if (error != CL_SUCCESS) {
+        fprintf(stderr, "%s: %d\n", message, error);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void ReadImage(const char* filename, unsigned char** image, unsigned* width, unsigned* height) {
+    unsigned error = lodepng_decode32_file(image, width, height, filename);
+    if (error) {
+        printf("Error %u: %s\n", error, lodepng_error_text(error));
         exit(1);
     }
+}
+
+void WriteImage(const char* filename, const unsigned char* image, unsigned width, unsigned height) {
+    unsigned error = lodepng_encode_file(filename, image, width, height, LCT_GREY, 8);
+    if (error) {
+        printf("Error %u: %s\n", error, lodepng_error_text(error));
+    }
+}
+
+// Global sizes are rounded up to whole work-groups, the kernels skip the excess
+size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
 
-    source_str = (char*)malloc(MAX_SOURCE_SIZE);
-    source_size = fread(source_str, 1, MAX_SOURCE_SIZE, fp);
-    fclose(fp);
+typedef struct {
+    cl_device_id device_id;
+    cl_command_queue queue;
+    cl_kernel kernel;
+    size_t width, height;
+    size_t halo;  // border of the local tile at argument 4, 0 if the kernel has none
+} image_tuning;
 
-    // Define width and height of the image
-    const int width = 2940; // Example width
-    const int height = 2016; // Example height
+// Bytes of the local tile of a kernel with a halo-pixel border around local_size
+size_t tile_bytes(const size_t local_size[2], size_t halo) {
+    return (local_size[0] + 2 * halo) * (local_size[1] + 2 * halo);
 }
-/*
-    // Define input and output arrays
-    uchar4 *input = (uchar4*)malloc(sizeof(uchar4) * width * height); // Input image
-    uchar *output = (uchar*)malloc(sizeof(uchar) * width * height); // Output image
 
-    // Get platform and device information
-    cl_platform_id platform_id = NULL;
-    cl_device_id device_id = NULL;
-    cl_uint ret_num_devices;
-    cl_uint ret_num_platforms;
+// autotune_measure_fn: time one kernel with one work-group shape
+double measure_image_kernel(const autotune_config *config, void *user) {
+    image_tuning *t = (image_tuning *)user;
+    size_t max_work_group;
+    clGetKernelWorkGroupInfo(t->kernel, t->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_work_group), &max_work_group, NULL);
+
+    size_t local_size[2] = {autotune_value(config, "LX", 16), autotune_value(config, "LY", 16)};
+    if (local_size[0] * local_size[1] > max_work_group) {
+        return -1.0;
+    }
+    if (t->halo && clSetKernelArg(t->kernel, 4, tile_bytes(local_size, t->halo), NULL) != CL_SUCCESS) {
+        return -1.0;
+    }
+    size_t global_size[2] = {round_up(t->width, local_size[0]), round_up(t->height, local_size[1])};
+    return autotune_time_kernel(t->queue, t->kernel, 2, global_size, local_size, 1, 3);
+}
 
-    clGetPlatformIDs(1, &platform_id, &ret_num_platforms);
-    clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_GPU, 1, &device_id, &ret_num_devices);
+// Work-group shape for one kernel: tuned database entry, fresh search, or default.
+// The kernel arguments must already be set, except the local tile of a kernel
+// with a halo, which is sized for each shape.
+void tune_local_size(cl_device_id device_id, cl_command_queue queue, cl_kernel kernel, const char *name,
+                     size_t width, size_t height, size_t halo, size_t local_size[2]) {
+    autotune_param params[] = {{"LX", local_widths, 6}, {"LY", local_heights, 5}};
+    image_tuning tuning = {device_id, queue, kernel, width, height, halo};
+    char tuning_key[128];
+    snprintf(tuning_key, sizeof(tuning_key), "%s/%zux%zu", name, width, height);
 
-    // Create an OpenCL context
-    cl_context context = clCreateContext(NULL, 1, &device_id, NULL, NULL, NULL);
+    autotune_config config;
+    autotune_get(device_id, tuning_key, params, 2, measure_image_kernel, &tuning, &config);
+    local_size[0] = autotune_value(&config, "LX", 16);
+    local_size[1] = autotune_value(&config, "LY", 16);
+    if (halo) {
+        checkError(clSetKernelArg(kernel, 4, tile_bytes(local_size, halo), NULL), name);
+    }
+}
 
-    // Create a command queue
-    cl_command_queue command_queue = clCreateCommandQueue(context, device_id, 0, NULL);
+// Enqueue a 2D kernel over width x height; the device time is read from event later
+void enqueue_kernel(cl_command_queue queue, cl_kernel kernel, size_t width, size_t height,
+                    const size_t local_size[2], const char *name, cl_event *event) {
+    size_t global_size[2] = {round_up(width, local_size[0]), round_up(height, local_size[1])};
+    char kernel_name[64] = "";
+    clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, sizeof(kernel_name) - 1, kernel_name, NULL);
+    event = cl_trace_event(event);
+    cl_int err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_size, local_size, 0, NULL, event);
+    cl_trace_command(kernel_name, queue, event, err);
+    checkError(err, name);
+}
 
-    // Create memory buffers on the device for each kernel argument
-    cl_mem input_mem_obj = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(uchar4) * width * height, NULL, NULL);
-    cl_mem output_mem_obj = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(uchar) * width * height, NULL, NULL);
+// Device time of a finished command in ms; releases the event
+double event_ms(cl_event event) {
+    cl_ulong start_time, end_time;
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_time, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, NULL);
+    clReleaseEvent(event);
+    return (end_time - start_time) * 1.0e-6;
+}
 
-    // Copy input data to input buffer
-    clEnqueueWriteBuffer(command_queue, input_mem_obj, CL_TRUE, 0, sizeof(uchar4) * width * height, input, 0, NULL, NULL);
+// One device's share of the resized image. The device computes output rows
+// [first, first + rows) plus up to FILTER_RADIUS halo rows on either side,
+// so apply_filter sees the same neighbours as on a single device, and only
+// uploads the input rows those need.
+typedef struct {
+    const cl_device_entry *dev;
+    unsigned first, rows;           // output rows of this shard
+    unsigned halo_first, halo_rows; // resized rows computed on the device
+    cl_program program;
+    cl_kernel resize_kernel, grayscale_kernel, filter_kernel;
+    cl_mem input_image, resized_image, resized_buffer, gray_buffer, filtered_buffer;
+    cl_sampler sampler;
+    int w, h;
+    size_t resize_local[2], grayscale_local[2], filter_local[2];
+    cl_event resize_event, grayscale_event, filter_event, read_event;
+} image_shard;
 
-    // Create a program from the kernel source
-    cl_program program = clCreateProgramWithSource(context, 1, (const char **)&source_str, (const size_t *)&source_size, NULL);
+// Build the kernels, create the buffers and pick work-group shapes for one shard
+void setup_shard(image_shard *shard, const cl_source *kernel_source, const unsigned char *image,
+                 unsigned width, unsigned resizedWidth) {
+    cl_context context = shard->dev->context;
+    cl_device_id device_id = shard->dev->device;
+    cl_int err;
 
-    // Build the program
-    clBuildProgram(program, 1, &device_id, NULL, NULL, NULL);
+    // Build the program for this device, specialized by its profile (the
+    // DEV_* defines, see common/cl_profile.h) and kept in the binary cache
+    shard->program = cl_cache_build(context, device_id, kernel_source->source, kernel_source->size,
+                                    kernel_source->hash, NULL, &err, NULL);
+    if (!shard->program) {
+        checkError(err, "Failed to create program");
+    }
+    if (err != CL_SUCCESS) {
+        char build_log[2048];
+        clGetProgramBuildInfo(shard->program, device_id, CL_PROGRAM_BUILD_LOG, sizeof(build_log), build_log, NULL);
+        fprintf(stderr, "Error in kernel build for %s:\n%s\n", shard->dev->name, build_log);
+        exit(1);
+    }
 
     // Create OpenCL kernels
-    cl_kernel resize_kernel = clCreateKernel(program, "resize_image", NULL);
-    cl_kernel grayscale_kernel = clCreateKernel(program, "grayscale_image", NULL);
-    cl_kernel filter_kernel = clCreateKernel(program, "apply_filter", NULL);
+    shard->resize_kernel = clCreateKernel(shard->program, "resize_image", &err);
+    checkError(err, "Failed to create resize_image kernel");
+    shard->grayscale_kernel = clCreateKernel(shard->program, "grayscale_image", &err);
+    checkError(err, "Failed to create grayscale_image kernel");
+    shard->filter_kernel = clCreateKernel(shard->program, "apply_filter", &err);
+    checkError(err, "Failed to create apply_filter kernel");
+
+    // Input and resized images are RGBA8 image objects so resize_image can sample them.
+    // resize_image samples every 4th row, so the shard needs input rows from 4 * halo_first.
+    size_t shard_pixels = (size_t)resizedWidth * shard->halo_rows;
+    cl_image_format format = {CL_RGBA, CL_UNSIGNED_INT8};
+    cl_image_desc input_desc;
+    memset(&input_desc, 0, sizeof(input_desc));
+    input_desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+    input_desc.image_width = width;
+    input_desc.image_height = (size_t)shard->halo_rows * 4;
+    const unsigned char *input_rows = image + (size_t)shard->halo_first * 4 * width * 4;
+    shard->input_image = clCreateImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &format, &input_desc,
+                                       (void *)input_rows, &err);
+    checkError(err, "Failed to create input image");
+
+    cl_image_desc resized_desc = input_desc;
+    resized_desc.image_width = resizedWidth;
+    resized_desc.image_height = shard->halo_rows;
+    shard->resized_image = clCreateImage(context, CL_MEM_READ_WRITE, &format, &resized_desc, NULL, &err);
+    checkError(err, "Failed to create resized image");
+
+    shard->sampler = clCreateSampler(context, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST, &err);
+    checkError(err, "Failed to create sampler");
+
+    // The grayscale and filter kernels work on plain buffers
+    shard->resized_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, shard_pixels * 4, NULL, &err);
+    checkError(err, "Failed to create resized buffer");
+    shard->gray_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, shard_pixels, NULL, &err);
+    checkError(err, "Failed to create grayscale buffer");
+    shard->filtered_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, shard_pixels, NULL, &err);
+    checkError(err, "Failed to create filtered buffer");
 
     // Set the arguments of each kernel
-    clSetKernelArg(resize_kernel, 0, sizeof(cl_mem), (void *)&input_mem_obj);
-    clSetKernelArg(resize_kernel, 1, sizeof(cl_mem), (void *)&output_mem_obj);
+    shard->w = (int)resizedWidth;
+    shard->h = (int)shard->halo_rows;
+    err = clSetKernelArg(shard->resize_kernel, 0, sizeof(cl_mem), (void *)&shard->input_image);
+    err |= clSetKernelArg(shard->resize_kernel, 1, sizeof(cl_mem), (void *)&shard->resized_image);
+    err |= clSetKernelArg(shard->resize_kernel, 2, sizeof(cl_sampler), (void *)&shard->sampler);
+    checkError(err, "Failed to set resize_image arguments");
 
-    clSetKernelArg(grayscale_kernel, 0, sizeof(cl_mem), (void *)&input_mem_obj);
-    clSetKernelArg(grayscale_kernel, 1, sizeof(cl_mem), (void *)&output_mem_obj);
+    err = clSetKernelArg(shard->grayscale_kernel, 0, sizeof(cl_mem), (void *)&shard->resized_buffer);
+    err |= clSetKernelArg(shard->grayscale_kernel, 1, sizeof(cl_mem), (void *)&shard->gray_buffer);
+    err |= clSetKernelArg(shard->grayscale_kernel, 2, sizeof(int), (void *)&shard->w);
+    err |= clSetKernelArg(shard->grayscale_kernel, 3, sizeof(int), (void *)&shard->h);
+    checkError(err, "Failed to set grayscale_image arguments");
 
-    clSetKernelArg(filter_kernel, 0, sizeof(cl_mem), (void *)&input_mem_obj);
-    clSetKernelArg(filter_kernel, 1, sizeof(cl_mem), (void *)&output_mem_obj);
+    err = clSetKernelArg(shard->filter_kernel, 0, sizeof(cl_mem), (void *)&shard->gray_buffer);
+    err |= clSetKernelArg(shard->filter_kernel, 1, sizeof(cl_mem), (void *)&shard->filtered_buffer);
+    err |= clSetKernelArg(shard->filter_kernel, 2, sizeof(int), (void *)&shard->w);
+    err |= clSetKernelArg(shard->filter_kernel, 3, sizeof(int), (void *)&shard->h);
+    checkError(err, "Failed to set apply_filter arguments");
 
-    // Define work-item dimensions
-    size_t global_work_size[2] = {width / 4, height / 4};
-    size_t local_work_size[2] = {1, 1};
+    // Pick the work-group shape of every kernel for this device
+    cl_command_queue queue = shard->dev->queue;
+    tune_local_size(device_id, queue, shard->resize_kernel, "resize_image", resizedWidth, shard->halo_rows, 0, shard->resize_local);
+    tune_local_size(device_id, queue, shard->grayscale_kernel, "grayscale_image", resizedWidth, shard->halo_rows, 0, shard->grayscale_local);
+    tune_local_size(device_id, queue, shard->filter_kernel, "apply_filter", resizedWidth, shard->halo_rows, FILTER_RADIUS, shard->filter_local);
+}
+
+// Enqueue the whole chain of one shard without waiting, reading its output
+// rows straight into their place in the full filtered image
+void enqueue_shard(image_shard *shard, unsigned char *filteredImage, unsigned resizedWidth) {
+    cl_command_queue queue = shard->dev->queue;
+    size_t shard_pixels = (size_t)resizedWidth * shard->halo_rows;
+    enqueue_kernel(queue, shard->resize_kernel, resizedWidth, shard->halo_rows, shard->resize_local,
+                   "Failed to run resize_image", &shard->resize_event);
+
+    size_t origin[3] = {0, 0, 0};
+    size_t region[3] = {resizedWidth, shard->halo_rows, 1};
+    cl_event *event = cl_trace_event(NULL);
+    cl_int err = clEnqueueCopyImageToBuffer(queue, shard->resized_image, shard->resized_buffer, origin, region, 0, 0, NULL, event);
+    cl_trace_command("copy resized image", queue, event, err);
+    checkError(err, "Failed to copy resized image");
+
+    enqueue_kernel(queue, shard->grayscale_kernel, resizedWidth, shard->halo_rows, shard->grayscale_local,
+                   "Failed to run grayscale_image", &shard->grayscale_event);
+
+    // apply_filter leaves the 2-pixel border untouched, so clear it first. On
+    // inner shards that border is halo and is not read back.
+    cl_uchar zero = 0;
+    event = cl_trace_event(NULL);
+    err = clEnqueueFillBuffer(queue, shard->filtered_buffer, &zero, sizeof(zero), 0, shard_pixels, 0, NULL, event);
+    cl_trace_command("clear filtered buffer", queue, event, err);
+    checkError(err, "Failed to clear filtered buffer");
+
+    enqueue_kernel(queue, shard->filter_kernel, resizedWidth, shard->halo_rows, shard->filter_local,
+                   "Failed to run apply_filter", &shard->filter_event);
+
+    // Read the output rows from the output buffer
+    size_t offset = (size_t)(shard->first - shard->halo_first) * resizedWidth;
+    err = clEnqueueReadBuffer(queue, shard->filtered_buffer, CL_FALSE, offset, (size_t)shard->rows * resizedWidth,
+                              filteredImage + (size_t)shard->first * resizedWidth, 0, NULL, &shard->read_event);
+    cl_trace_command("read filtered rows", queue, &shard->read_event, err);
+    checkError(err, "Failed to read filtered image");
+    clFlush(queue);
+}
+
+void release_shard(image_shard *shard) {
+    clReleaseKernel(shard->resize_kernel);
+    clReleaseKernel(shard->grayscale_kernel);
+    clReleaseKernel(shard->filter_kernel);
+    clReleaseProgram(shard->program);
+    clReleaseSampler(shard->sampler);
+    clReleaseMemObject(shard->input_image);
+    clReleaseMemObject(shard->resized_image);
+    clReleaseMemObject(shard->resized_buffer);
+    clReleaseMemObject(shard->gray_buffer);
+    clReleaseMemObject(shard->filtered_buffer);
+}
+
+// Usage: image_opencl [input.png [output.png]]
+// The rows of the resized image are split evenly over every device selected
+// by CL_DEVICES (see common/cl_devices.h); each runs the whole chain on its
+// rows and the results are gathered into one image.
+int main(int argc, char **argv) {
+    const char* inputFile = argc > 1 ? argv[1] : "image_0.png";
+    const char* outputFile = argc > 2 ? argv[2] : "image_0_bw_opencl.png";
+
+    // Kernel source, embedded at build time (see common/cl_source.h)
+    const cl_source *kernel_source = cl_source_get("kernels.cl");
 
-    // Execute the OpenCL kernels
-    clEnqueueNDRangeKernel(command_queue, resize_kernel, 2, NULL, global_work_size, local_work_size, 0, NULL, NULL);
-    clEnqueueNDRangeKernel(command_queue, grayscale_kernel, 2, NULL, global_work_size, local_work_size, 0, NULL, NULL);
-    clEnqueueNDRangeKernel(command_queue, filter_kernel, 2, NULL, global_work_size, local_work_size, 0, NULL, NULL);
+    // Read the input image
+    unsigned char *image = NULL;
+    unsigned width, height;
+    trace_begin("ReadImage");
+    ReadImage(inputFile, &image, &width, &height);
+    trace_end();
+    printf("Image width: %d \n", width);
+    printf("Image height: %d \n", height);
 
-    // Read the output data from the output buffer
-    clEnqueueReadBuffer(command_queue, output_mem_obj, CL_TRUE, 0, sizeof(uchar) * width * height, output, 0, NULL, NULL);
+    unsigned resizedWidth = width / 4;
+    unsigned resizedHeight = height / 4;
+    size_t resizedPixels = (size_t)resizedWidth * resizedHeight;
+    unsigned char *filteredImage = (unsigned char*)malloc(resizedPixels);
+
+    // Every selected device of every platform, each with its own context and queue
+    cl_devices devices;
+    cl_devices_open(&devices);
+    cl_devices_print(&devices, stdout);
+
+    // Output rows of each device, extended by the filter halo
+    int first[CL_DEVICES_MAX + 1];
+    cl_devices_split(&devices, (int)resizedHeight, SHARD_GRANULE, first);
+    image_shard shards[CL_DEVICES_MAX];
+    int num_shards = 0;
+    for (int d = 0; d < devices.count; d++) {
+        if (first[d + 1] == first[d]) {
+            continue;
+        }
+        image_shard *shard = &shards[num_shards++];
+        memset(shard, 0, sizeof(*shard));
+        shard->dev = &devices.devices[d];
+        shard->first = (unsigned)first[d];
+        shard->rows = (unsigned)(first[d + 1] - first[d]);
+        shard->halo_first = shard->first > FILTER_RADIUS ? shard->first - FILTER_RADIUS : 0;
+        unsigned halo_end = shard->first + shard->rows + FILTER_RADIUS;
+        if (halo_end > resizedHeight) halo_end = resizedHeight;
+        shard->halo_rows = halo_end - shard->halo_first;
+        trace_begin("setup shard");
+        setup_shard(shard, kernel_source, image, width, resizedWidth);
+        trace_end();
+    }
+
+    // Start every device, then gather
+    trace_begin("run shards");
+    double start = bench_now_ms();
+    for (int s = 0; s < num_shards; s++) {
+        enqueue_shard(&shards[s], filteredImage, resizedWidth);
+    }
+    for (int s = 0; s < num_shards; s++) {
+        checkError(clFinish(shards[s].dev->queue), "Failed to finish shard");
+    }
+    double wall_ms = bench_now_ms() - start;
+    trace_end();
+
+    for (int s = 0; s < num_shards; s++) {
+        image_shard *shard = &shards[s];
+        printf("%s: rows %u-%u (%u with halo)\n", shard->dev->name, shard->first, shard->first + shard->rows - 1,
+               shard->halo_rows);
+        printf("  resize_image took %.3f ms (work-group %zu x %zu)\n", event_ms(shard->resize_event),
+               shard->resize_local[0], shard->resize_local[1]);
+        printf("  grayscale_image took %.3f ms (work-group %zu x %zu)\n", event_ms(shard->grayscale_event),
+               shard->grayscale_local[0], shard->grayscale_local[1]);
+        printf("  apply_filter took %.3f ms (work-group %zu x %zu)\n", event_ms(shard->filter_event),
+               shard->filter_local[0], shard->filter_local[1]);
+        clReleaseEvent(shard->read_event);
+    }
+    printf("All %d device(s) took %.3f ms\n", num_shards, wall_ms);
+
+    trace_begin("WriteImage");
+    WriteImage(outputFile, filteredImage, resizedWidth, resizedHeight);
+    trace_end();
+
+    // Device timestamps are collected before the queues go away
+    trace_write();
 
     // Clean up
-    clFlush(command_queue);
-    clFinish(command_queue);
-    clReleaseKernel(resize_kernel);
-    clReleaseKernel(grayscale_kernel);
-    clReleaseKernel(filter_kernel);
-    clReleaseProgram(program);
-    clReleaseMemObject(input_mem_obj);
-    clReleaseMemObject(output_mem_obj);
-    clReleaseCommandQueue(command_queue);
-    clReleaseContext(context);
-    free(source_str);
-    free(input);
-    free(output);
+    for (int s = 0; s < num_shards; s++) {
+        release_shard(&shards[s]);
+    }
+    cl_devices_release(&devices);
+    free(image);
+    free(filteredImage);
 
     return 0;
 }
-*/
@@ -0,0 +1,49 @@
+#include <stdlib.h>
+#include <string.h>
+#include "image_ops.h"
+
+void ResizeImage(const unsigned char* inputImage, unsigned inputWidth, unsigned inputHeight,
+                 unsigned char** outputImage, unsigned* outputWidth, unsigned* outputHeight) {
+    *outputWidth = inputWidth / 4;
+    *outputHeight = inputHeight / 4;
+    *outputImage = (unsigned char*)malloc((*outputWidth) * (*outputHeight) * 4);
+
+    for (unsigned y = 0; y < *outputHeight; y++) {
+        for (unsigned x = 0; x < *outputWidth; x++) {
+            for (int i = 0; i < 4; i++) {
+                (*outputImage)[(y * (*outputWidth) + x) * 4 + i] =
+                    inputImage[(y * 4 * inputWidth + x * 4) * 4 + i];
+            }
+        }
+    }
+}
+
+void GrayScaleImage(const unsigned char* inputImage, unsigned inputWidth, unsigned inputHeight,
+                    unsigned char** outputImage) {
+    *outputImage = (unsigned char*)malloc(inputWidth * inputHeight);
+    for (unsigned i = 0; i < inputWidth * inputHeight; i++) {
+        unsigned char r = inputImage[i * 4];
+        unsigned char g = inputImage[i * 4 + 1];
+        unsigned char b = inputImage[i * 4 + 2];
+        (*outputImage)[i] = (unsigned char)(0.2126 * r + 0.7152 * g + 0.0722 * b);  // Y=0.2126R + 0.7152G + 0.0722B. 
+    }
+}
+
+void ApplyFilter(const unsigned char* grayImage, unsigned width, unsigned height,
+                 unsigned char** filteredImage) {
+    *filteredImage = (unsigned char*)malloc(width * height);
+    memset(*filteredImage, 0, width * height); // Initialize filtered image
+
+    // Simple averaging filter 
+    for (unsigned y = 2; y < height - 2; y++) {
+        for (unsigned x = 2; x < width - 2; x++) {
+            unsigned sum = 0;
+            for (int dy = -2; dy <= 2; dy++) {
+                for (int dx = -2; dx <= 2; dx++) {
+                    sum += grayImage[(y + dy) * width + (x + dx)];
+                }
+            }
+            (*filteredImage)[y * width + x] = sum / 25;
+        }
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef IMAGE_OPS_H
+#define IMAGE_OPS_H
+
+// Host versions of the kernels in kernels.cl, and the reference they are
+// checked against. Images are RGBA8 or 8-bit gray, row-major without padding;
+// every function allocates its output with malloc.
+
+// Keeps every 4th pixel of every 4th row
+void ResizeImage(const unsigned char* inputImage, unsigned inputWidth, unsigned inputHeight,
+                 unsigned char** outputImage, unsigned* outputWidth, unsigned* outputHeight);
+
+// Y = 0.2126R + 0.7152G + 0.0722B
+void GrayScaleImage(const unsigned char* inputImage, unsigned inputWidth, unsigned inputHeight,
+                    unsigned char** outputImage);
+
+// 5 x 5 box filter; the 2-pixel border is left at 0
+void ApplyFilter(const unsigned char* grayImage, unsigned width, unsigned height,
+                 unsigned char** filteredImage);
+
+#endif
@@ -1,20 +1,65 @@
 //kernels.cl
+// The global size may be rounded up to a multiple of the work-group size,
+// so every kernel ignores work-items outside the image.
 __kernel void resize_image(__read_only image2d_t srcImg, __write_only image2d_t dstImg, sampler_t sampler) {
     int2 coord = (int2)(get_global_id(0), get_global_id(1));
+    if (coord.x >= get_image_width(dstImg) || coord.y >= get_image_height(dstImg)) {
+        return;
+    }
     float2 coordSrc = (float2)(coord.x * 4, coord.y * 4);
     uint4 pixel = read_imageui(srcImg, sampler, coordSrc);
     write_imageui(dstImg, coord, pixel);
 }
 
-__kernel void grayscale_image(__global const uchar4* input, __global uchar* output, const int width) {
+__kernel void grayscale_image(__global const uchar4* input, __global uchar* output, const int width, const int height) {
     int x = get_global_id(0);
     int y = get_global_id(1);
+    if (x >= width || y >= height) {
+        return;
+    }
     int i = y * width + x;
     uchar4 pixel = input[i];
     output[i] = (uchar)(0.2126f * pixel.x + 0.7152f * pixel.y + 0.0722f * pixel.z);
 }
 
-__kernel void apply_filter(__global const uchar* input, __global uchar* output, const int width, const int height) {
+// 5 x 5 box filter. tile is local memory of (local width + 4) x (local height
+// + 4) bytes. Where local memory is real (DEV_LOCAL_MEM_DEDICATED from the
+// device profile) each work-group stages its pixels plus the 2-pixel border
+// there once instead of reading every pixel 25 times from global memory; the
+// global size must then be a multiple of the work-group size, which it is.
+// Elsewhere (CPU devices) the caches do that job and tile is unused.
+#if DEV_LOCAL_MEM_DEDICATED
+__kernel void apply_filter(__global const uchar* input, __global uchar* output, const int width, const int height,
+                           __local uchar* tile) {
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    const int lx = get_local_id(0);
+    const int ly = get_local_id(1);
+    const int tile_width = get_local_size(0) + 4;
+    const int tile_height = get_local_size(1) + 4;
+    const int x0 = get_group_id(0) * get_local_size(0) - 2;
+    const int y0 = get_group_id(1) * get_local_size(1) - 2;
+
+    for (int i = ly * get_local_size(0) + lx; i < tile_width * tile_height; i += get_local_size(0) * get_local_size(1)) {
+        int tx = x0 + i % tile_width;
+        int ty = y0 + i / tile_width;
+        tile[i] = (tx >= 0 && ty >= 0 && tx < width && ty < height) ? input[ty * width + tx] : 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (x >= 2 && y >= 2 && x < (width - 2) && y < (height - 2)) {
+        uint sum = 0;
+        for (int dy = 0; dy < 5; dy++) {
+            for (int dx = 0; dx < 5; dx++) {
+                sum += tile[(ly + dy) * tile_width + lx + dx];
+            }
+        }
+        output[y * width + x] = sum / 25;
+    }
+}
+#else
+__kernel void apply_filter(__global const uchar* input, __global uchar* output, const int width, const int height,
+                           __local uchar* tile) {
     int x = get_global_id(0);
     int y = get_global_id(1);
     if (x >= 2 && y >= 2 && x < (width - 2) && y < (height - 2)) {
@@ -27,3 +72,4 @@ __kernel void apply_filter(__global const uchar* input, __global uchar* output,
         output[y * width + x] = sum / 25;
     }
 }
+#endif
@@ -0,0 +1,825 @@
+#include "../1. Matrix/thread_pool.c"
+#include "../1. Matrix/simd_kernels.c"
+#include "../1. Matrix/gemm.c"
+#include "../1. Matrix/sgemm_opencl.c"
+#include "../2. Image/image_ops.c"
+#include "../common/cl_autotune.c"
+#include "../common/cl_source.c"
+#include "../common/cl_cache.c"
+#include "../common/cl_profile.c"
+#include "../common/trace.c"
+#include "../common/cl_trace.c"
+#include "../common/cl_devices.c"
+#include "../common/bench.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <CL/cl.h>
+
+// Correctness and performance regression runner for every backend.
+//
+// Every operation of add_matrix.cl, multiply_matrix.cl (sgemm_tiled with all
+// four transposes, multiply_matrix and multiply_matrix_tiled) and kernels.cl
+// runs on every OpenCL device selected by CL_DEVICES, and the element-wise
+// add and the GEMMs also on the host, over a grid of sizes n: n x n matrices,
+// and a 4n x 4n input image for a n x n output. Each result is compared
+// element by element with a host reference and the median time of --reps
+// calls is turned into a throughput. With --baseline, throughputs are
+// compared with an earlier --save-baseline file of the same machine.
+//
+// Usage: regression_opencl [--op add|gemm|image|all] [--backend host|opencl|all]
+//                          [--sizes 64,100,...] [--warmup W] [--reps N]
+//                          [--baseline file] [--save-baseline file] [--threshold percent]
+// The exit status is 1 if any result is out of tolerance, or any throughput
+// is more than --threshold percent (10 by default) below its baseline.
+
+#define MAX_SIZES 32
+
+void checkError(cl_int error, const char *message) {
+    if (error != CL_SUCCESS) {
+        fprintf(stderr, "%s: %d\n", message, error);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// An element passes if it is within max_ulp units in the last place of the
+// reference or within max_abs of it
+typedef struct {
+    double max_ulp;
+    double max_abs;
+} tolerance;
+
+// Element-wise adds are exact, resize and filter only move or sum bytes in
+// integers. grayscale_image weighs in float where the host weighs in double,
+// which may round the other way. GEMM tolerances grow with K (see gemm_tolerance).
+static const tolerance exact = {0.0, 0.0};
+static const tolerance grayscale_tolerance = {0.0, 1.0};
+
+typedef struct {
+    const char *op;       // "add", "gemm", "image"
+    const char *backend;  // "host" or the device name
+    const char *variant;  // kernel or host function
+    int size;
+    double work;          // flops, or output pixels of the image kernels
+    const char *unit;     // of work / 1e9 per second
+    double max_ulp;       // largest errors seen
+    double max_abs;
+    size_t failed;        // elements out of tolerance
+    double ms;            // median time of one call
+} regression_case;
+
+typedef struct {
+    char key[512];
+    double rate;
+} baseline_entry;
+
+typedef struct {
+    int warmup;
+    int reps;
+    double threshold;     // percent
+    baseline_entry *baseline;
+    int baseline_count;
+    FILE *save;
+    int cases, failed, slower;
+} run_options;
+
+// ---------------------------------------------------------------- checks
+
+// Distance in representable floats; adjacent floats are 1 apart across zero
+static int64_t ordered_bits(float value) {
+    int32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits < 0 ? (int64_t)INT32_MIN - bits : bits;
+}
+
+double ulp_distance(float a, float b) {
+    if (isnan(a) || isnan(b)) {
+        return INFINITY;
+    }
+    int64_t distance = ordered_bits(a) - ordered_bits(b);
+    return (double)(distance < 0 ? -distance : distance);
+}
+
+void check_floats(regression_case *c, const float *result, const double *reference, size_t count, tolerance tol) {
+    for (size_t i = 0; i < count; i++) {
+        double ulp = ulp_distance(result[i], (float)reference[i]);
+        double diff = isnan(result[i]) ? INFINITY : fabs(result[i] - reference[i]);
+        if (ulp > c->max_ulp) c->max_ulp = ulp;
+        if (diff > c->max_abs) c->max_abs = diff;
+        if (ulp > tol.max_ulp && diff > tol.max_abs) c->failed++;
+    }
+}
+
+// One unit of an 8-bit channel is also its ulp
+void check_bytes(regression_case *c, const unsigned char *result, const unsigned char *reference, size_t count,
+                 tolerance tol) {
+    for (size_t i = 0; i < count; i++) {
+        double diff = abs((int)result[i] - (int)reference[i]);
+        if (diff > c->max_abs) c->max_abs = c->max_ulp = diff;
+        if (diff > tol.max_ulp && diff > tol.max_abs) c->failed++;
+    }
+}
+
+// The summation error of a length-K dot product of non-negative terms is at
+// most K * FLT_EPSILON relative to the result, about K units in the last
+// place; a wrong tile or index is off by far more
+tolerance gemm_tolerance(int K) {
+    tolerance tol = {(double)K, 0.0};
+    return tol;
+}
+
+// ---------------------------------------------------------------- baseline
+
+void baseline_key(const regression_case *c, char *key, size_t size) {
+    snprintf(key, size, "%s\t%s\t%s\t%d", c->op, c->backend, c->variant, c->size);
+}
+
+// Lines of op, backend, variant, size, rate and unit, tab-separated; # starts a comment
+void baseline_load(run_options *opts, const char *path) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "Failed to open baseline %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    char line[512];
+    int capacity = 0;
+    while (fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *unit = strrchr(line, '\t');
+        if (line[0] == '#' || !unit) continue;
+        *unit = '\0';
+        char *rate = strrchr(line, '\t');
+        if (!rate) continue;
+        *rate = '\0';
+        if (opts->baseline_count == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            opts->baseline = (baseline_entry *)realloc(opts->baseline, capacity * sizeof(baseline_entry));
+        }
+        baseline_entry *entry = &opts->baseline[opts->baseline_count++];
+        snprintf(entry->key, sizeof(entry->key), "%s", line);
+        entry->rate = atof(rate + 1);
+    }
+    fclose(in);
+}
+
+const baseline_entry *baseline_find(const run_options *opts, const char *key) {
+    for (int i = 0; i < opts->baseline_count; i++) {
+        if (strcmp(opts->baseline[i].key, key) == 0) return &opts->baseline[i];
+    }
+    return NULL;
+}
+
+// Prints one finished case, compares it with the baseline and saves it
+void report(run_options *opts, const regression_case *c) {
+    char key[512];
+    baseline_key(c, key, sizeof(key));
+    double rate = c->work / (c->ms * 1.0e6);
+    const baseline_entry *base = baseline_find(opts, key);
+    double change = base && base->rate > 0.0 ? (rate / base->rate - 1.0) * 100.0 : 0.0;
+    int slower = base && change < -opts->threshold;
+
+    const char *status = c->failed ? "FAIL" : slower ? "SLOW" : "ok";
+    printf("%-4s %-5s %-24.24s %-21s %5d  %6.0f ulp %9.3g abs  %9.3f %s", status, c->op, c->backend, c->variant,
+           c->size, c->max_ulp, c->max_abs, rate, c->unit);
+    if (c->failed) printf("  (%zu wrong)", c->failed);
+    if (base) printf("  baseline %.3f (%+.1f%%)", base->rate, change);
+    printf("\n");
+
+    opts->cases++;
+    if (c->failed) opts->failed++;
+    if (slower) opts->slower++;
+    if (opts->save) fprintf(opts->save, "%s\t%.6g\t%s\n", key, rate, c->unit);
+}
+
+// ---------------------------------------------------------------- timing
+
+typedef struct {
+    int n;
+    float *A, *At, *B, *Bt;  // At and Bt hold the transposes, so op(At) = A
+    double *C_ref;           // A * B
+    float *x, *y;
+    double *sum_ref;         // x + y
+    unsigned char *image;    // 4n x 4n RGBA
+    unsigned char *resized, *gray, *filtered;  // host references
+} test_data;
+
+// Median of opts->reps samples after opts->warmup calls; fn returns the ms of one call
+double median_ms(const run_options *opts, double (*fn)(void *), void *arg) {
+    double *samples = (double *)malloc(opts->reps * sizeof(double));
+    for (int r = 0; r < opts->warmup + opts->reps; r++) {
+        double elapsed = fn(arg);
+        if (r >= opts->warmup) samples[r - opts->warmup] = elapsed;
+    }
+    double median = bench_summarize(samples, opts->reps).median;
+    free(samples);
+    return median;
+}
+
+// Device time of a finished command in ms; releases the event
+double event_ms(cl_event event) {
+    cl_ulong start = 0, end = 0;
+    clWaitForEvents(1, &event);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+    clReleaseEvent(event);
+    return (end - start) * 1.0e-6;
+}
+
+typedef struct {
+    cl_command_queue queue;
+    cl_kernel kernel;
+    cl_uint dims;
+    size_t global_size[2];
+    const size_t *local_size;  // NULL to let the driver choose
+} kernel_launch;
+
+double run_kernel(void *arg) {
+    const kernel_launch *launch = (const kernel_launch *)arg;
+    char name[64] = "";
+    clGetKernelInfo(launch->kernel, CL_KERNEL_FUNCTION_NAME, sizeof(name) - 1, name, NULL);
+    cl_event event;
+    cl_event *traced = cl_trace_event(&event);
+    cl_int err = clEnqueueNDRangeKernel(launch->queue, launch->kernel, launch->dims, NULL, launch->global_size,
+                                        launch->local_size, 0, NULL, traced);
+    cl_trace_command(name, launch->queue, traced, err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Failed to run %s: %d\n", name, err);
+        exit(EXIT_FAILURE);
+    }
+    return event_ms(event);
+}
+
+typedef struct {
+    const sgemm_opencl_kernel *sgemm;
+    cl_command_queue queue;
+    gemm_trans transA, transB;
+    int n;
+    cl_mem A, B, C;
+} sgemm_launch;
+
+double run_sgemm(void *arg) {
+    const sgemm_launch *launch = (const sgemm_launch *)arg;
+    cl_event event;
+    cl_int err = sgemm_opencl(launch->sgemm, launch->queue, launch->transA, launch->transB, launch->n, launch->n,
+                              launch->n, 1.0f, launch->A, 0, launch->n, launch->B, 0, launch->n, 0.0f, launch->C, 0,
+                              launch->n, &event);
+    checkError(err, "Failed to run sgemm_tiled");
+    return event_ms(event);
+}
+
+// ---------------------------------------------------------------- host
+
+typedef struct {
+    const test_data *data;
+    gemm_trans transA, transB;
+    float *out;
+} host_launch;
+
+double run_host_add(void *arg) {
+    const host_launch *launch = (const host_launch *)arg;
+    size_t count = (size_t)launch->data->n * launch->data->n;
+    double start = bench_now_ms();
+    simd_get()->add(launch->out, launch->data->x, launch->data->y, count);
+    return bench_now_ms() - start;
+}
+
+double run_host_sgemm(void *arg) {
+    const host_launch *launch = (const host_launch *)arg;
+    const test_data *data = launch->data;
+    int n = data->n;
+    double start = bench_now_ms();
+    sgemm(launch->transA, launch->transB, n, n, n, 1.0f, launch->transA == GEMM_TRANS ? data->At : data->A, n,
+          launch->transB == GEMM_TRANS ? data->Bt : data->B, n, 0.0f, launch->out, n);
+    return bench_now_ms() - start;
+}
+
+static const char *transpose_names[2][2] = {{"NN", "NT"}, {"TN", "TT"}};
+
+void host_add(run_options *opts, const test_data *data) {
+    size_t count = (size_t)data->n * data->n;
+    host_launch launch = {data, GEMM_NO_TRANS, GEMM_NO_TRANS, gemm_alloc(count)};
+    regression_case c = {.op = "add", .backend = "host", .variant = simd_get()->name,
+                         .size = data->n, .work = (double)count, .unit = "GFLOP/s"};
+    c.ms = median_ms(opts, run_host_add, &launch);
+    check_floats(&c, launch.out, data->sum_ref, count, exact);
+    report(opts, &c);
+    gemm_free(launch.out);
+}
+
+void host_gemm(run_options *opts, const test_data *data) {
+    int n = data->n;
+    size_t count = (size_t)n * n;
+    char variants[4][16];
+    for (int t = 0; t < 4; t++) {
+        host_launch launch = {data, t / 2 ? GEMM_TRANS : GEMM_NO_TRANS, t % 2 ? GEMM_TRANS : GEMM_NO_TRANS,
+                              gemm_alloc(count)};
+        snprintf(variants[t], sizeof(variants[t]), "sgemm %s", transpose_names[t / 2][t % 2]);
+        regression_case c = {.op = "gemm", .backend = "host", .variant = variants[t],
+                             .size = n, .work = 2.0 * n * n * n, .unit = "GFLOP/s"};
+        c.ms = median_ms(opts, run_host_sgemm, &launch);
+        check_floats(&c, launch.out, data->C_ref, count, gemm_tolerance(n));
+        report(opts, &c);
+        gemm_free(launch.out);
+    }
+}
+
+// ---------------------------------------------------------------- OpenCL
+
+typedef struct {
+    const cl_device_entry *dev;
+    cl_profile profile;
+    cl_program add_program, image_program;
+    cl_kernel add, add_vec, resize, grayscale, filter, naive, tiled;
+    sgemm_opencl_kernel sgemm;
+    size_t image_local[2];
+} device_state;
+
+cl_program build_program(const device_state *state, const char *name) {
+    const cl_source *source = cl_source_get(name);
+    cl_int err;
+    cl_program program = cl_cache_build(state->dev->context, state->dev->device, source->source, source->size,
+                                        source->hash, NULL, &err, NULL);
+    if (!program) {
+        checkError(err, "Failed to create program");
+    }
+    if (err != CL_SUCCESS) {
+        char build_log[2048];
+        clGetProgramBuildInfo(program, state->dev->device, CL_PROGRAM_BUILD_LOG, sizeof(build_log), build_log, NULL);
+        fprintf(stderr, "Error in %s build for %s:\n%s\n", name, state->dev->name, build_log);
+        exit(EXIT_FAILURE);
+    }
+    return program;
+}
+
+cl_kernel create_kernel(cl_program program, const char *name) {
+    cl_int err;
+    cl_kernel kernel = clCreateKernel(program, name, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create kernel %s: %d\n", name, err);
+        exit(EXIT_FAILURE);
+    }
+    return kernel;
+}
+
+// Builds only the programs of the selected operations
+void device_setup(device_state *state, const cl_device_entry *dev, int run_add, int run_gemm, int run_image) {
+    memset(state, 0, sizeof(*state));
+    state->dev = dev;
+    cl_profile_query(dev->device, &state->profile);
+    if (run_add) {
+        state->add_program = build_program(state, "add_matrix.cl");
+        state->add = create_kernel(state->add_program, "add_matrix");
+        state->add_vec = create_kernel(state->add_program, "add_matrix_vec");
+    }
+    if (run_gemm) {
+        const cl_source *source = cl_source_get("multiply_matrix.cl");
+        checkError(sgemm_opencl_init(&state->sgemm, dev->context, dev->device, source->source, source->size, NULL),
+                   "Failed to build multiply_matrix.cl");
+        state->naive = create_kernel(state->sgemm.program, "multiply_matrix");
+        state->tiled = create_kernel(state->sgemm.program, "multiply_matrix_tiled");
+    }
+    if (run_image) {
+        state->image_program = build_program(state, "kernels.cl");
+        state->resize = create_kernel(state->image_program, "resize_image");
+        state->grayscale = create_kernel(state->image_program, "grayscale_image");
+        state->filter = create_kernel(state->image_program, "apply_filter");
+        state->image_local[0] = state->image_local[1] = state->profile.max_work_group_size >= 256 ? 16 : 8;
+    }
+}
+
+void device_release(device_state *state) {
+    cl_kernel kernels[] = {state->add, state->add_vec, state->resize, state->grayscale, state->filter,
+                           state->naive, state->tiled};
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (kernels[i]) clReleaseKernel(kernels[i]);
+    }
+    if (state->add_program) clReleaseProgram(state->add_program);
+    if (state->image_program) clReleaseProgram(state->image_program);
+    sgemm_opencl_release(&state->sgemm);
+}
+
+cl_mem create_buffer(const device_state *state, cl_mem_flags flags, size_t size, const void *host) {
+    cl_int err;
+    cl_mem buffer = clCreateBuffer(state->dev->context, flags | (host ? CL_MEM_COPY_HOST_PTR : 0), size,
+                                   (void *)host, &err);
+    checkError(err, "Failed to create buffer");
+    return buffer;
+}
+
+void read_buffer(const device_state *state, cl_mem buffer, size_t size, void *host) {
+    cl_event *event = cl_trace_event(NULL);
+    cl_int err = clEnqueueReadBuffer(state->dev->queue, buffer, CL_TRUE, 0, size, host, 0, NULL, event);
+    cl_trace_command("read result", state->dev->queue, event, err);
+    checkError(err, "Failed to read result");
+}
+
+// Fills size bytes of buffer with pattern, traced as name
+void fill_buffer(const device_state *state, cl_mem buffer, const void *pattern, size_t pattern_size, size_t size,
+                 const char *name) {
+    cl_event *event = cl_trace_event(NULL);
+    cl_int err = clEnqueueFillBuffer(state->dev->queue, buffer, pattern, pattern_size, 0, size, 0, NULL, event);
+    cl_trace_command(name, state->dev->queue, event, err);
+    checkError(err, "Failed to clear buffer");
+}
+
+size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+void device_add(run_options *opts, const device_state *state, const test_data *data) {
+    int n = data->n, num_elements = n * n;
+    size_t count = (size_t)num_elements, bytes = count * sizeof(float);
+    cl_mem x = create_buffer(state, CL_MEM_READ_ONLY, bytes, data->x);
+    cl_mem y = create_buffer(state, CL_MEM_READ_ONLY, bytes, data->y);
+    cl_mem out = create_buffer(state, CL_MEM_WRITE_ONLY, bytes, NULL);
+    float *result = gemm_alloc(count);
+
+    // add_matrix covers the n x n range exactly
+    cl_int err = clSetKernelArg(state->add, 0, sizeof(cl_mem), &x);
+    err |= clSetKernelArg(state->add, 1, sizeof(cl_mem), &y);
+    err |= clSetKernelArg(state->add, 2, sizeof(cl_mem), &out);
+    checkError(err, "Failed to set add_matrix arguments");
+    kernel_launch launch = {state->dev->queue, state->add, 2, {(size_t)n, (size_t)n}, NULL};
+    regression_case c = {.op = "add", .backend = state->dev->name, .variant = "add_matrix",
+                         .size = n, .work = (double)count, .unit = "GFLOP/s"};
+    c.ms = median_ms(opts, run_kernel, &launch);
+    read_buffer(state, out, bytes, result);
+    check_floats(&c, result, data->sum_ref, count, exact);
+    report(opts, &c);
+
+    // add_matrix_vec: enough work-groups to fill the device, the grid-stride loop covers the rest
+    err = clSetKernelArg(state->add_vec, 0, sizeof(cl_mem), &x);
+    err |= clSetKernelArg(state->add_vec, 1, sizeof(cl_mem), &y);
+    err |= clSetKernelArg(state->add_vec, 2, sizeof(cl_mem), &out);
+    err |= clSetKernelArg(state->add_vec, 3, sizeof(int), &num_elements);
+    checkError(err, "Failed to set add_matrix_vec arguments");
+    fill_buffer(state, out, &(float){NAN}, sizeof(float), bytes, "clear output");
+    int vector_width = cl_profile_vector_width(&state->profile);
+    size_t local_size = state->profile.max_work_group_size < 256 ? state->profile.max_work_group_size : 256;
+    size_t needed = ((count + vector_width - 1) / vector_width + local_size - 1) / local_size;
+    size_t groups = (size_t)state->profile.compute_units * 8;
+    if (groups > needed) groups = needed;
+    kernel_launch launch_vec = {state->dev->queue, state->add_vec, 1, {groups * local_size, 0}, &local_size};
+    regression_case c_vec = {.op = "add", .backend = state->dev->name, .variant = "add_matrix_vec",
+                             .size = n, .work = (double)count, .unit = "GFLOP/s"};
+    c_vec.ms = median_ms(opts, run_kernel, &launch_vec);
+    read_buffer(state, out, bytes, result);
+    check_floats(&c_vec, result, data->sum_ref, count, exact);
+    report(opts, &c_vec);
+
+    gemm_free(result);
+    clReleaseMemObject(x);
+    clReleaseMemObject(y);
+    clReleaseMemObject(out);
+}
+
+void device_gemm(run_options *opts, const device_state *state, const test_data *data) {
+    int n = data->n;
+    size_t count = (size_t)n * n, bytes = count * sizeof(float);
+    double flops = 2.0 * n * n * n;
+    tolerance tol = gemm_tolerance(n);
+    cl_mem A = create_buffer(state, CL_MEM_READ_ONLY, bytes, data->A);
+    cl_mem At = create_buffer(state, CL_MEM_READ_ONLY, bytes, data->At);
+    cl_mem B = create_buffer(state, CL_MEM_READ_ONLY, bytes, data->B);
+    cl_mem Bt = create_buffer(state, CL_MEM_READ_ONLY, bytes, data->Bt);
+    cl_mem C = create_buffer(state, CL_MEM_READ_WRITE, bytes, NULL);
+    float *result = gemm_alloc(count);
+    const float zero = 0.0f;
+
+    // sgemm_tiled with every transpose; beta = 0, and C starts cleared so an
+    // element the kernel skips shows as wrong
+    char variants[4][24];
+    for (int t = 0; t < 4; t++) {
+        fill_buffer(state, C, &zero, sizeof(zero), bytes, "clear C");
+        sgemm_launch launch = {&state->sgemm, state->dev->queue, t / 2 ? GEMM_TRANS : GEMM_NO_TRANS,
+                               t % 2 ? GEMM_TRANS : GEMM_NO_TRANS, n, t / 2 ? At : A, t % 2 ? Bt : B, C};
+        snprintf(variants[t], sizeof(variants[t]), "sgemm_tiled %s", transpose_names[t / 2][t % 2]);
+        regression_case c = {.op = "gemm", .backend = state->dev->name, .variant = variants[t],
+                             .size = n, .work = flops, .unit = "GFLOP/s"};
+        c.ms = median_ms(opts, run_sgemm, &launch);
+        read_buffer(state, C, bytes, result);
+        check_floats(&c, result, data->C_ref, count, tol);
+        report(opts, &c);
+    }
+
+    // multiply_matrix and multiply_matrix_tiled take (M, N, K, A, B, C), here all n x n
+    cl_kernel kernels[2] = {state->naive, state->tiled};
+    const char *names[2] = {"multiply_matrix", "multiply_matrix_tiled"};
+    int ts = state->sgemm.ts;
+    size_t tiled_local[2] = {(size_t)(ts / state->sgemm.wptn), (size_t)(ts / state->sgemm.wptm)};
+    for (int k = 0; k < 2; k++) {
+        cl_int err = CL_SUCCESS;
+        for (cl_uint a = 0; a < 3; a++) err |= clSetKernelArg(kernels[k], a, sizeof(int), &n);
+        err |= clSetKernelArg(kernels[k], 3, sizeof(cl_mem), &A);
+        err |= clSetKernelArg(kernels[k], 4, sizeof(cl_mem), &B);
+        err |= clSetKernelArg(kernels[k], 5, sizeof(cl_mem), &C);
+        checkError(err, "Failed to set GEMM arguments");
+        fill_buffer(state, C, &zero, sizeof(zero), bytes, "clear C");
+        kernel_launch launch = {state->dev->queue, kernels[k], 2, {(size_t)n, (size_t)n}, NULL};
+        if (k == 1) {
+            size_t tiles = (size_t)(n + ts - 1) / ts;
+            launch.global_size[0] = tiles * tiled_local[0];
+            launch.global_size[1] = tiles * tiled_local[1];
+            launch.local_size = tiled_local;
+        }
+        regression_case c = {.op = "gemm", .backend = state->dev->name, .variant = names[k],
+                             .size = n, .work = flops, .unit = "GFLOP/s"};
+        c.ms = median_ms(opts, run_kernel, &launch);
+        read_buffer(state, C, bytes, result);
+        check_floats(&c, result, data->C_ref, count, tol);
+        report(opts, &c);
+    }
+
+    gemm_free(result);
+    clReleaseMemObject(A);
+    clReleaseMemObject(At);
+    clReleaseMemObject(B);
+    clReleaseMemObject(Bt);
+    clReleaseMemObject(C);
+}
+
+// Each image kernel runs on the host reference of its input, so an error
+// shows in the kernel that made it
+void device_image(run_options *opts, const device_state *state, const test_data *data) {
+    cl_context context = state->dev->context;
+    cl_command_queue queue = state->dev->queue;
+    size_t n = (size_t)data->n, pixels = n * n;
+    const size_t *local = state->image_local;
+    unsigned char *result = (unsigned char *)malloc(pixels * 4);
+    cl_int err;
+
+    // resize_image samples an image object
+    cl_image_format format = {CL_RGBA, CL_UNSIGNED_INT8};
+    cl_image_desc desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+    desc.image_width = desc.image_height = 4 * n;
+    cl_mem input = clCreateImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &format, &desc,
+                                 data->image, &err);
+    checkError(err, "Failed to create input image");
+    desc.image_width = desc.image_height = n;
+    cl_mem resized = clCreateImage(context, CL_MEM_WRITE_ONLY, &format, &desc, NULL, &err);
+    checkError(err, "Failed to create resized image");
+    cl_sampler sampler = clCreateSampler(context, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST, &err);
+    checkError(err, "Failed to create sampler");
+    err = clSetKernelArg(state->resize, 0, sizeof(cl_mem), &input);
+    err |= clSetKernelArg(state->resize, 1, sizeof(cl_mem), &resized);
+    err |= clSetKernelArg(state->resize, 2, sizeof(cl_sampler), &sampler);
+    checkError(err, "Failed to set resize_image arguments");
+    kernel_launch launch = {queue, state->resize, 2, {round_up(n, local[0]), round_up(n, local[1])}, local};
+    regression_case c = {.op = "image", .backend = state->dev->name, .variant = "resize_image",
+                         .size = (int)n, .work = (double)pixels, .unit = "Gpixel/s"};
+    c.ms = median_ms(opts, run_kernel, &launch);
+    size_t origin[3] = {0, 0, 0}, region[3] = {n, n, 1};
+    cl_event *event = cl_trace_event(NULL);
+    err = clEnqueueReadImage(queue, resized, CL_TRUE, origin, region, 0, 0, result, 0, NULL, event);
+    cl_trace_command("read resized image", queue, event, err);
+    checkError(err, "Failed to read resized image");
+    check_bytes(&c, result, data->resized, pixels * 4, exact);
+    report(opts, &c);
+
+    // grayscale_image and apply_filter work on buffers
+    int width = (int)n, height = (int)n;
+    cl_mem rgba = create_buffer(state, CL_MEM_READ_ONLY, pixels * 4, data->resized);
+    cl_mem gray = create_buffer(state, CL_MEM_READ_WRITE, pixels, NULL);
+    err = clSetKernelArg(state->grayscale, 0, sizeof(cl_mem), &rgba);
+    err |= clSetKernelArg(state->grayscale, 1, sizeof(cl_mem), &gray);
+    err |= clSetKernelArg(state->grayscale, 2, sizeof(int), &width);
+    err |= clSetKernelArg(state->grayscale, 3, sizeof(int), &height);
+    checkError(err, "Failed to set grayscale_image arguments");
+    launch.kernel = state->grayscale;
+    regression_case c_gray = {.op = "image", .backend = state->dev->name, .variant = "grayscale_image",
+                              .size = (int)n, .work = (double)pixels, .unit = "Gpixel/s"};
+    c_gray.ms = median_ms(opts, run_kernel, &launch);
+    read_buffer(state, gray, pixels, result);
+    check_bytes(&c_gray, result, data->gray, pixels, grayscale_tolerance);
+    report(opts, &c_gray);
+
+    // apply_filter leaves the border alone, which must stay 0 as on the host
+    cl_mem gray_ref = create_buffer(state, CL_MEM_READ_ONLY, pixels, data->gray);
+    const cl_uchar zero = 0;
+    fill_buffer(state, gray, &zero, sizeof(zero), pixels, "clear filtered buffer");
+    err = clSetKernelArg(state->filter, 0, sizeof(cl_mem), &gray_ref);
+    err |= clSetKernelArg(state->filter, 1, sizeof(cl_mem), &gray);
+    err |= clSetKernelArg(state->filter, 2, sizeof(int), &width);
+    err |= clSetKernelArg(state->filter, 3, sizeof(int), &height);
+    err |= clSetKernelArg(state->filter, 4, (local[0] + 4) * (local[1] + 4), NULL);
+    checkError(err, "Failed to set apply_filter arguments");
+    launch.kernel = state->filter;
+    regression_case c_filter = {.op = "image", .backend = state->dev->name, .variant = "apply_filter",
+                                .size = (int)n, .work = (double)pixels, .unit = "Gpixel/s"};
+    c_filter.ms = median_ms(opts, run_kernel, &launch);
+    read_buffer(state, gray, pixels, result);
+    check_bytes(&c_filter, result, data->filtered, pixels, exact);
+    report(opts, &c_filter);
+
+    free(result);
+    clReleaseSampler(sampler);
+    clReleaseMemObject(input);
+    clReleaseMemObject(resized);
+    clReleaseMemObject(rgba);
+    clReleaseMemObject(gray);
+    clReleaseMemObject(gray_ref);
+}
+
+// ---------------------------------------------------------------- data
+
+float *random_matrix(size_t count) {
+    float *matrix = gemm_alloc(count);
+    for (size_t i = 0; i < count; i++) {
+        matrix[i] = (float)rand() / RAND_MAX;
+    }
+    return matrix;
+}
+
+float *transposed(const float *X, int n) {
+    float *T = gemm_alloc((size_t)n * n);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            T[(size_t)j * n + i] = X[(size_t)i * n + j];
+        }
+    }
+    return T;
+}
+
+// Inputs in [0, 1), so GEMM sums have no cancellation, and the references
+void data_init(test_data *data, int n, int run_add, int run_gemm, int run_image) {
+    memset(data, 0, sizeof(*data));
+    data->n = n;
+    size_t count = (size_t)n * n;
+    srand(n);
+    if (run_add) {
+        data->x = random_matrix(count);
+        data->y = random_matrix(count);
+        data->sum_ref = (double *)malloc(count * sizeof(double));
+        for (size_t i = 0; i < count; i++) {
+            data->sum_ref[i] = data->x[i] + data->y[i];
+        }
+    }
+    if (run_gemm) {
+        data->A = random_matrix(count);
+        data->B = random_matrix(count);
+        data->At = transposed(data->A, n);
+        data->Bt = transposed(data->B, n);
+        data->C_ref = (double *)calloc(count, sizeof(double));
+        for (int i = 0; i < n; i++) {
+            double *row = data->C_ref + (size_t)i * n;
+            for (int p = 0; p < n; p++) {
+                double a = data->A[(size_t)i * n + p];
+                const float *b = data->B + (size_t)p * n;
+                for (int j = 0; j < n; j++) row[j] += a * b[j];
+            }
+        }
+    }
+    if (run_image) {
+        size_t input_bytes = count * 16 * 4;
+        data->image = (unsigned char *)malloc(input_bytes);
+        for (size_t i = 0; i < input_bytes; i++) {
+            data->image[i] = (unsigned char)(rand() & 0xff);
+        }
+        unsigned width, height;
+        ResizeImage(data->image, 4 * n, 4 * n, &data->resized, &width, &height);
+        GrayScaleImage(data->resized, width, height, &data->gray);
+        ApplyFilter(data->gray, width, height, &data->filtered);
+    }
+}
+
+void data_release(test_data *data) {
+    gemm_free(data->x);
+    gemm_free(data->y);
+    gemm_free(data->A);
+    gemm_free(data->B);
+    gemm_free(data->At);
+    gemm_free(data->Bt);
+    free(data->sum_ref);
+    free(data->C_ref);
+    free(data->image);
+    free(data->resized);
+    free(data->gray);
+    free(data->filtered);
+}
+
+// ---------------------------------------------------------------- driver
+
+int parse_sizes(const char *text, int *sizes) {
+    int count = 0;
+    while (*text && count < MAX_SIZES) {
+        sizes[count] = atoi(text);
+        if (sizes[count] <= 0) {
+            return -1;
+        }
+        count++;
+        text = strchr(text, ',');
+        if (!text) break;
+        text++;
+    }
+    return count;
+}
+
+void usage(void) {
+    fprintf(stderr, "Usage: regression_opencl [--op add|gemm|image|all] [--backend host|opencl|all]\n"
+                    "                         [--sizes 64,100,...] [--warmup W] [--reps N]\n"
+                    "                         [--baseline file] [--save-baseline file] [--threshold percent]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    const char *op = "all", *backend = "all", *baseline = NULL, *save = NULL;
+    // Odd sizes leave partial tiles and work-groups at the edges
+    int sizes[MAX_SIZES] = {64, 100, 256, 511, 1024};
+    int num_sizes = 5;
+    run_options opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.warmup = 1;
+    opts.reps = 5;
+    opts.threshold = 10.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) usage();
+        if (strcmp(argv[i], "--op") == 0) {
+            op = argv[++i];
+        } else if (strcmp(argv[i], "--backend") == 0) {
+            backend = argv[++i];
+        } else if (strcmp(argv[i], "--sizes") == 0) {
+            num_sizes = parse_sizes(argv[++i], sizes);
+            if (num_sizes <= 0) usage();
+        } else if (strcmp(argv[i], "--warmup") == 0) {
+            opts.warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--reps") == 0) {
+            opts.reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--baseline") == 0) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "--save-baseline") == 0) {
+            save = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0) {
+            opts.threshold = atof(argv[++i]);
+        } else {
+            usage();
+        }
+    }
+    if (opts.reps <= 0 || opts.warmup < 0 || opts.threshold < 0.0) usage();
+    for (int s = 0; s < num_sizes; s++) {
+        // apply_filter needs a 5 x 5 neighbourhood
+        if (sizes[s] < 5) usage();
+    }
+
+    int run_add = strcmp(op, "all") == 0 || strcmp(op, "add") == 0;
+    int run_gemm = strcmp(op, "all") == 0 || strcmp(op, "gemm") == 0;
+    int run_image = strcmp(op, "all") == 0 || strcmp(op, "image") == 0;
+    int run_host = strcmp(backend, "all") == 0 || strcmp(backend, "host") == 0;
+    int run_opencl = strcmp(backend, "all") == 0 || strcmp(backend, "opencl") == 0;
+    if (!run_add && !run_gemm && !run_image) usage();
+
+    cl_uint num_platforms = 0;
+    if (run_opencl && (clGetPlatformIDs(0, NULL, &num_platforms) != CL_SUCCESS || num_platforms == 0)) {
+        fprintf(stderr, "No OpenCL platform, skipping OpenCL runs\n");
+        run_opencl = 0;
+    }
+    cl_devices devices;
+    device_state states[CL_DEVICES_MAX];
+    if (run_opencl) {
+        cl_devices_open(&devices);
+        cl_devices_print(&devices, stdout);
+        for (int d = 0; d < devices.count; d++) {
+            device_setup(&states[d], &devices.devices[d], run_add, run_gemm, run_image);
+        }
+    }
+
+    if (baseline) baseline_load(&opts, baseline);
+    if (save) {
+        opts.save = fopen(save, "w");
+        if (!opts.save) {
+            fprintf(stderr, "Failed to open %s\n", save);
+            return 1;
+        }
+        fprintf(opts.save, "# op\tbackend\tvariant\tsize\trate\tunit\n");
+    }
+
+    for (int s = 0; s < num_sizes; s++) {
+        test_data data;
+        data_init(&data, sizes[s], run_add, run_gemm, run_image);
+        if (run_host && run_add) host_add(&opts, &data);
+        if (run_host && run_gemm) host_gemm(&opts, &data);
+        for (int d = 0; run_opencl && d < devices.count; d++) {
+            if (run_add) device_add(&opts, &states[d], &data);
+            if (run_gemm) device_gemm(&opts, &states[d], &data);
+            if (run_image) device_image(&opts, &states[d], &data);
+        }
+        data_release(&data);
+    }
+
+    printf("%d cases: %d out of tolerance, %d more than %.0f%% below the baseline\n", opts.cases, opts.failed,
+           opts.slower, opts.threshold);
+
+    if (opts.save) fclose(opts.save);
+    free(opts.baseline);
+    if (run_opencl) {
+        for (int d = 0; d < devices.count; d++) {
+            device_release(&states[d]);
+        }
+        cl_devices_release(&devices);
+    }
+    return opts.failed || opts.slower ? 1 : 0;
+}
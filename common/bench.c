@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "bench.h"
+
+double bench_now_ms(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec * 1.0e-6;
+#endif
+}
+
+static int bench_compare(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static double bench_percentile(const double *sorted, int count, double percent) {
+    int rank = (int)ceil(percent / 100.0 * count);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+
+bench_stats bench_summarize(double *samples, int count) {
+    bench_stats stats = {0.0, 0.0, 0.0, 0.0, 0.0};
+    if (count <= 0) {
+        return stats;
+    }
+    qsort(samples, count, sizeof(double), bench_compare);
+
+    double sum = 0.0;
+    for (int i = 0; i < count; i++) sum += samples[i];
+    stats.mean = sum / count;
+    double var = 0.0;
+    for (int i = 0; i < count; i++) var += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+    stats.stddev = count > 1 ? sqrt(var / (count - 1)) : 0.0;
+
+    stats.min = samples[0];
+    stats.median = count % 2 ? samples[count / 2] : 0.5 * (samples[count / 2 - 1] + samples[count / 2]);
+    stats.p95 = bench_percentile(samples, count, 95.0);
+    return stats;
+}
+
+int bench_parse_format(const char *name, bench_format *format) {
+    if (strcmp(name, "csv") == 0) {
+        *format = BENCH_CSV;
+    } else if (strcmp(name, "json") == 0) {
+        *format = BENCH_JSON;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Rates use the median, which is robust to the odd slow repetition
+static double bench_rate(double amount, double time_ms) {
+    return time_ms > 0.0 ? amount / (time_ms * 1.0e6) : 0.0;
+}
+
+void bench_begin(bench_writer *writer, FILE *out, bench_format format) {
+    writer->out = out;
+    writer->format = format;
+    writer->count = 0;
+    if (format == BENCH_CSV) {
+        fprintf(out, "op,backend,variant,M,N,K,reps,"
+                     "transfer_min_ms,transfer_median_ms,transfer_p95_ms,"
+                     "kernel_min_ms,kernel_median_ms,kernel_p95_ms,"
+                     "total_min_ms,total_median_ms,total_p95_ms,"
+                     "kernel_gflops,total_gflops,kernel_gbps,max_rel_error\n");
+    } else {
+        fprintf(out, "[\n");
+    }
+}
+
+static void bench_write_stats_json(FILE *out, const char *name, const bench_stats *s) {
+    fprintf(out, "\"%s\": {\"min_ms\": %.6f, \"median_ms\": %.6f, \"p95_ms\": %.6f, "
+                 "\"mean_ms\": %.6f, \"stddev_ms\": %.6f}",
+            name, s->min, s->median, s->p95, s->mean, s->stddev);
+}
+
+void bench_write(bench_writer *writer, const bench_record *r) {
+    double kernel_gflops = bench_rate(r->flops, r->kernel.median);
+    double total_gflops = bench_rate(r->flops, r->total.median);
+    double kernel_gbps = bench_rate(r->bytes, r->kernel.median);
+    FILE *out = writer->out;
+
+    // Unchecked records leave the error column empty (CSV) or null (JSON)
+    char error[32] = "";
+    if (r->has_error) {
+        snprintf(error, sizeof(error), "%.3e", r->max_error);
+    }
+
+    if (writer->format == BENCH_CSV) {
+        fprintf(out, "%s,%s,%s,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.3f,%.3f,%.3f,%s\n",
+                r->op, r->backend, r->variant, r->M, r->N, r->K, r->reps,
+                r->transfer.min, r->transfer.median, r->transfer.p95,
+                r->kernel.min, r->kernel.median, r->kernel.p95,
+                r->total.min, r->total.median, r->total.p95,
+                kernel_gflops, total_gflops, kernel_gbps, error);
+    } else {
+        fprintf(out, "%s  {\"op\": \"%s\", \"backend\": \"%s\", \"variant\": \"%s\", "
+                     "\"M\": %d, \"N\": %d, \"K\": %d, \"reps\": %d,\n   ",
+                writer->count ? ",\n" : "", r->op, r->backend, r->variant, r->M, r->N, r->K, r->reps);
+        bench_write_stats_json(out, "transfer", &r->transfer);
+        fprintf(out, ",\n   ");
+        bench_write_stats_json(out, "kernel", &r->kernel);
+        fprintf(out, ",\n   ");
+        bench_write_stats_json(out, "total", &r->total);
+        fprintf(out, ",\n   \"kernel_gflops\": %.3f, \"total_gflops\": %.3f, \"kernel_gbps\": %.3f, "
+                     "\"max_rel_error\": %s}",
+                kernel_gflops, total_gflops, kernel_gbps, r->has_error ? error : "null");
+    }
+    fflush(out);
+    writer->count++;
+}
+
+void bench_end(bench_writer *writer) {
+    if (writer->format == BENCH_JSON) {
+        fprintf(writer->out, "%s]\n", writer->count ? "\n" : "");
+    }
+    fflush(writer->out);
+}
@@ -0,0 +1,50 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+
+// Timing statistics and CSV/JSON result output for the benchmark programs.
+
+typedef struct {
+    double min;
+    double median;
+    double p95;
+    double mean;
+    double stddev;
+} bench_stats;
+
+// One measured configuration. Times are in ms; transfer is zero for host runs.
+typedef struct {
+    const char *op;       // "add", "gemm", ...
+    const char *backend;  // "host", "opencl"
+    const char *variant;  // kernel or algorithm name
+    int M, N, K;
+    int reps;
+    double flops;         // floating-point operations per call
+    double bytes;         // minimum memory traffic per call
+    bench_stats transfer;
+    bench_stats kernel;
+    bench_stats total;
+    int has_error;        // set when the result was checked against a reference
+    double max_error;     // max |result - reference| / max |reference|
+} bench_record;
+
+typedef enum { BENCH_CSV, BENCH_JSON } bench_format;
+
+typedef struct {
+    FILE *out;
+    bench_format format;
+    int count;
+} bench_writer;
+
+double bench_now_ms(void);  // monotonic wall clock
+
+// Sorts samples in place
+bench_stats bench_summarize(double *samples, int count);
+
+int bench_parse_format(const char *name, bench_format *format);
+void bench_begin(bench_writer *writer, FILE *out, bench_format format);
+void bench_write(bench_writer *writer, const bench_record *record);
+void bench_end(bench_writer *writer);
+
+#endif
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cl_autotune.h"
+
+// Database format: one tab-separated line per tuned kernel
+//   <device key> \t <kernel key> \t NAME=value NAME=value ... \t <time ms>
+#define AUTOTUNE_LINE_SIZE 2048
+
+static const char *autotune_db_path(void) {
+    const char *path = getenv("CL_AUTOTUNE_DB");
+    return path ? path : "cl_autotune.db";
+}
+
+// 0 = never search, 1 = search on miss, 2 = always search
+static int autotune_mode(void) {
+    const char *mode = getenv("CL_AUTOTUNE");
+    if (!mode) return 1;
+    if (strcmp(mode, "force") == 0) return 2;
+    return atoi(mode) != 0;
+}
+
+// Tabs and newlines would break the line format
+static void autotune_sanitize(char *text) {
+    for (; *text; text++) {
+        if (*text == '\t' || *text == '\n' || *text == '\r') *text = ' ';
+    }
+}
+
+void autotune_device_key(cl_device_id device, char *key, size_t size) {
+    char name[256] = "", driver[256] = "";
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name), name, NULL);
+    clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(driver), driver, NULL);
+    snprintf(key, size, "%s / %s", name, driver);
+    autotune_sanitize(key);
+}
+
+static int autotune_parse_params(char *text, autotune_config *config) {
+    config->num_params = 0;
+    for (char *token = strtok(text, " "); token; token = strtok(NULL, " ")) {
+        char *eq = strchr(token, '=');
+        if (!eq || config->num_params == AUTOTUNE_MAX_PARAMS) return -1;
+        *eq = '\0';
+        int i = config->num_params++;
+        snprintf(config->names[i], AUTOTUNE_NAME_SIZE, "%s", token);
+        config->values[i] = atoi(eq + 1);
+    }
+    return 0;
+}
+
+static void autotune_format_line(char *line, size_t size, const char *device_key,
+                                 const char *kernel_key, const autotune_config *config) {
+    int used = snprintf(line, size, "%s\t%s\t", device_key, kernel_key);
+    for (int i = 0; i < config->num_params && used < (int)size; i++) {
+        used += snprintf(line + used, size - used, "%s%s=%d", i ? " " : "",
+                         config->names[i], config->values[i]);
+    }
+    if (used < (int)size) {
+        snprintf(line + used, size - used, "\t%.6f\n", config->time_ms);
+    }
+}
+
+int autotune_lookup(const char *device_key, const char *kernel_key, autotune_config *config) {
+    FILE *db = fopen(autotune_db_path(), "r");
+    if (!db) return -1;
+
+    char line[AUTOTUNE_LINE_SIZE];
+    int found = -1;
+    while (found != 0 && fgets(line, sizeof(line), db)) {
+        char *fields[4];
+        char *cursor = line;
+        int n = 0;
+        for (; n < 4 && cursor; n++) {
+            fields[n] = cursor;
+            cursor = strchr(cursor, '\t');
+            if (cursor) *cursor++ = '\0';
+        }
+        if (n < 4 || strcmp(fields[0], device_key) != 0 || strcmp(fields[1], kernel_key) != 0) {
+            continue;
+        }
+        if (autotune_parse_params(fields[2], config) == 0) {
+            config->time_ms = atof(fields[3]);
+            found = 0;
+        }
+    }
+    fclose(db);
+    return found;
+}
+
+int autotune_store(const char *device_key, const char *kernel_key, const autotune_config *config) {
+    const char *path = autotune_db_path();
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) return -1;
+
+    // Copy every other entry, then append ours; rename makes the update atomic
+    FILE *db = fopen(path, "r");
+    if (db) {
+        char line[AUTOTUNE_LINE_SIZE];
+        size_t dlen = strlen(device_key), klen = strlen(kernel_key);
+        while (fgets(line, sizeof(line), db)) {
+            int same = strncmp(line, device_key, dlen) == 0 && line[dlen] == '\t' &&
+                       strncmp(line + dlen + 1, kernel_key, klen) == 0 && line[dlen + 1 + klen] == '\t';
+            if (!same) fputs(line, out);
+        }
+        fclose(db);
+    }
+
+    char line[AUTOTUNE_LINE_SIZE];
+    autotune_format_line(line, sizeof(line), device_key, kernel_key, config);
+    fputs(line, out);
+    fclose(out);
+
+    remove(path); // rename() does not replace on Windows
+    return rename(tmp_path, path);
+}
+
+static void autotune_defaults(const autotune_param *params, int num_params, autotune_config *config) {
+    config->num_params = num_params;
+    config->time_ms = -1.0;
+    for (int i = 0; i < num_params; i++) {
+        snprintf(config->names[i], AUTOTUNE_NAME_SIZE, "%s", params[i].name);
+        config->values[i] = params[i].values[0];
+    }
+}
+
+int autotune_search(const autotune_param *params, int num_params,
+                    autotune_measure_fn measure, void *user, autotune_config *best) {
+    autotune_config candidate;
+    int index[AUTOTUNE_MAX_PARAMS] = {0};
+    int found = 0;
+
+    autotune_defaults(params, num_params, &candidate);
+    autotune_defaults(params, num_params, best);
+
+    // Odometer over the cartesian product of the candidate lists
+    for (;;) {
+        for (int i = 0; i < num_params; i++) {
+            candidate.values[i] = params[i].values[index[i]];
+        }
+        double time_ms = measure(&candidate, user);
+        if (time_ms >= 0.0 && (!found || time_ms < best->time_ms)) {
+            *best = candidate;
+            best->time_ms = time_ms;
+            found = 1;
+        }
+
+        int i = 0;
+        while (i < num_params && ++index[i] == params[i].count) {
+            index[i++] = 0;
+        }
+        if (i == num_params) break;
+    }
+    return found ? 0 : -1;
+}
+
+void autotune_get(cl_device_id device, const char *kernel_key,
+                  const autotune_param *params, int num_params,
+                  autotune_measure_fn measure, void *user, autotune_config *config) {
+    char device_key[AUTOTUNE_KEY_SIZE];
+    char key[AUTOTUNE_KEY_SIZE];
+    autotune_device_key(device, device_key, sizeof(device_key));
+    snprintf(key, sizeof(key), "%s", kernel_key);
+    autotune_sanitize(key);
+
+    int mode = autotune_mode();
+    if (mode < 2 && autotune_lookup(device_key, key, config) == 0 && config->num_params == num_params) {
+        return;
+    }
+    if (mode == 0) {
+        autotune_defaults(params, num_params, config);
+        return;
+    }
+
+    printf("Auto-tuning %s...\n", key);
+    if (autotune_search(params, num_params, measure, user, config) != 0) {
+        fprintf(stderr, "Auto-tuning %s: no valid configuration, using defaults\n", key);
+        autotune_defaults(params, num_params, config);
+        return;
+    }
+    if (autotune_store(device_key, key, config) != 0) {
+        fprintf(stderr, "Failed to write auto-tuning database %s\n", autotune_db_path());
+    }
+}
+
+int autotune_value(const autotune_config *config, const char *name, int fallback) {
+    for (int i = 0; i < config->num_params; i++) {
+        if (strcmp(config->names[i], name) == 0) return config->values[i];
+    }
+    return fallback;
+}
+
+double autotune_time_kernel(cl_command_queue queue, cl_kernel kernel, cl_uint dims,
+                            const size_t *global_size, const size_t *local_size,
+                            int warmup, int reps) {
+    double best = -1.0;
+    for (int r = 0; r < warmup + reps; r++) {
+        cl_event event;
+        cl_int err = clEnqueueNDRangeKernel(queue, kernel, dims, NULL, global_size, local_size, 0, NULL, &event);
+        if (err != CL_SUCCESS) return -1.0;
+        err = clWaitForEvents(1, &event);
+        cl_ulong start = 0, end = 0;
+        err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+        err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+        clReleaseEvent(event);
+        if (err != CL_SUCCESS) return -1.0;
+
+        double time_ms = (end - start) * 1.0e-6;
+        if (r >= warmup && (best < 0.0 || time_ms < best)) best = time_ms;
+    }
+    return best;
+}
@@ -0,0 +1,67 @@
+#ifndef CL_AUTOTUNE_H
+#define CL_AUTOTUNE_H
+
+#include <stddef.h>
+#include <CL/cl.h>
+
+// Launch-parameter auto-tuner shared by the matrix and image programs.
+//
+// A configuration is a small set of named integers (work-group shape, tile
+// sizes, vector width, ...). autotune_get() first looks the kernel up in an
+// on-disk database keyed by device name and driver version; on a miss, or
+// when re-tuning is forced, it tries every combination of the candidate
+// values, keeps the fastest and writes it back, so later runs skip the search.
+//
+// Environment:
+//   CL_AUTOTUNE=0      never search, use the database or the defaults
+//   CL_AUTOTUNE=1      search on a database miss (default)
+//   CL_AUTOTUNE=force  search even if the database has an entry
+//   CL_AUTOTUNE_DB     database path (default: cl_autotune.db)
+
+#define AUTOTUNE_MAX_PARAMS 8
+#define AUTOTUNE_NAME_SIZE 16
+#define AUTOTUNE_KEY_SIZE 512
+
+typedef struct {
+    int num_params;
+    char names[AUTOTUNE_MAX_PARAMS][AUTOTUNE_NAME_SIZE];
+    int values[AUTOTUNE_MAX_PARAMS];
+    double time_ms;  // best measured time, < 0 if not measured
+} autotune_config;
+
+// Candidate values of one parameter. values[0] is the default.
+typedef struct {
+    const char *name;
+    const int *values;
+    int count;
+} autotune_param;
+
+// Run one candidate and return its time in ms, or a negative value when the
+// configuration is not valid for the device (too much local memory, build
+// failure, work-group too large, ...).
+typedef double (*autotune_measure_fn)(const autotune_config *config, void *user);
+
+void autotune_device_key(cl_device_id device, char *key, size_t size);
+
+int autotune_lookup(const char *device_key, const char *kernel_key, autotune_config *config);
+int autotune_store(const char *device_key, const char *kernel_key, const autotune_config *config);
+
+// Exhaustive search; returns 0 if at least one candidate was valid
+int autotune_search(const autotune_param *params, int num_params,
+                    autotune_measure_fn measure, void *user, autotune_config *best);
+
+// Database lookup, then search and store on a miss. Falls back to the
+// defaults (first candidate of every parameter) if nothing is usable.
+void autotune_get(cl_device_id device, const char *kernel_key,
+                  const autotune_param *params, int num_params,
+                  autotune_measure_fn measure, void *user, autotune_config *config);
+
+int autotune_value(const autotune_config *config, const char *name, int fallback);
+
+// Profiled kernel time: warmup launches, then the minimum over reps launches.
+// The queue needs CL_QUEUE_PROFILING_ENABLE. Returns < 0 if the launch fails.
+double autotune_time_kernel(cl_command_queue queue, cl_kernel kernel, cl_uint dims,
+                            const size_t *global_size, const size_t *local_size,
+                            int warmup, int reps);
+
+#endif
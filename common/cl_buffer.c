@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <unistd.h>
+#endif
+#include "cl_buffer.h"
+#include "cl_trace.h"
+
+static size_t cl_buffer_page_size(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? (size_t)size : 4096;
+#endif
+}
+
+int cl_buffer_zero_copy(cl_device_id device) {
+    const char *mode = getenv("CL_BUFFER");
+    if (mode && strcmp(mode, "staged") == 0) return 0;
+    if (mode && strcmp(mode, "zero") == 0) return 1;
+
+    cl_device_type type = 0;
+    cl_bool unified = CL_FALSE;
+    clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified), &unified, NULL);
+    return (type & CL_DEVICE_TYPE_CPU) || unified == CL_TRUE;
+}
+
+// Whole pages, so the allocation also satisfies the size rules some drivers
+// have for CL_MEM_USE_HOST_PTR (a multiple of 64 bytes on Intel)
+void *cl_buffer_host_alloc(size_t size) {
+    size_t page = cl_buffer_page_size();
+    size_t rounded = (size + page - 1) / page * page;
+    if (rounded == 0) rounded = page;
+#ifdef _WIN32
+    return _aligned_malloc(rounded, page);
+#else
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, page, rounded) != 0) {
+        return NULL;
+    }
+    return ptr;
+#endif
+}
+
+void cl_buffer_host_free(void *ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+cl_int cl_buffer_create(cl_buffer *buffer, cl_context context, cl_device_id device, cl_command_queue queue,
+                        cl_mem_flags flags, size_t size) {
+    cl_int err;
+    memset(buffer, 0, sizeof(*buffer));
+    buffer->size = size;
+    buffer->queue = queue;
+    buffer->zero_copy = cl_buffer_zero_copy(device);
+
+    if (buffer->zero_copy) {
+        buffer->host = cl_buffer_host_alloc(size);
+        if (!buffer->host) {
+            return CL_OUT_OF_HOST_MEMORY;
+        }
+        buffer->mem = clCreateBuffer(context, flags | CL_MEM_USE_HOST_PTR, size, buffer->host, &err);
+        if (err != CL_SUCCESS) {
+            cl_buffer_host_free(buffer->host);
+            buffer->host = NULL;
+        }
+        return err;
+    }
+
+    buffer->mem = clCreateBuffer(context, flags, size, NULL, &err);
+    if (err != CL_SUCCESS) {
+        return err;
+    }
+    buffer->staging = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, NULL, &err);
+    if (err == CL_SUCCESS) {
+        // Mapped for the lifetime of the buffer; the driver keeps it pinned
+        buffer->host = clEnqueueMapBuffer(queue, buffer->staging, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size,
+                                          0, NULL, NULL, &err);
+    }
+    if (err != CL_SUCCESS) {
+        cl_buffer_release(buffer);
+    }
+    return err;
+}
+
+void cl_buffer_release(cl_buffer *buffer) {
+    if (buffer->mapped) {
+        cl_buffer_unmap(buffer, buffer->queue);
+    }
+    if (buffer->upload) {
+        clWaitForEvents(1, &buffer->upload);
+        clReleaseEvent(buffer->upload);
+    }
+    if (buffer->staging) {
+        if (buffer->host) {
+            clEnqueueUnmapMemObject(buffer->queue, buffer->staging, buffer->host, 0, NULL, NULL);
+        }
+        clReleaseMemObject(buffer->staging);
+    }
+    if (buffer->mem) {
+        clReleaseMemObject(buffer->mem);
+    }
+    if (buffer->zero_copy && buffer->host) {
+        // The driver may use the memory until the commands on it are done
+        clFinish(buffer->queue);
+        cl_buffer_host_free(buffer->host);
+    }
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+void *cl_buffer_map(cl_buffer *buffer, cl_command_queue queue, cl_map_flags flags, cl_int *err) {
+    *err = CL_SUCCESS;
+    if (buffer->mapped) {
+        *err = CL_INVALID_OPERATION;
+        return NULL;
+    }
+
+    if (buffer->zero_copy) {
+        cl_event *event = cl_trace_event(NULL);
+        buffer->mapped = clEnqueueMapBuffer(queue, buffer->mem, CL_TRUE, flags, 0, buffer->size,
+                                            0, NULL, event, err);
+        cl_trace_command("map buffer", queue, event, *err);
+    } else {
+        // The staging memory is still being read by the last upload
+        if (buffer->upload) {
+            *err = clWaitForEvents(1, &buffer->upload);
+            clReleaseEvent(buffer->upload);
+            buffer->upload = NULL;
+        }
+        if (*err == CL_SUCCESS && (flags & CL_MAP_READ)) {
+            cl_event *event = cl_trace_event(NULL);
+            *err = clEnqueueReadBuffer(queue, buffer->mem, CL_TRUE, 0, buffer->size, buffer->host,
+                                       0, NULL, event);
+            cl_trace_command("read buffer", queue, event, *err);
+        }
+        if (*err == CL_SUCCESS) {
+            buffer->mapped = buffer->host;
+        }
+    }
+    if (*err != CL_SUCCESS) {
+        buffer->mapped = NULL;
+        return NULL;
+    }
+    buffer->map_flags = flags;
+    return buffer->mapped;
+}
+
+cl_int cl_buffer_unmap(cl_buffer *buffer, cl_command_queue queue) {
+    if (!buffer->mapped) {
+        return CL_INVALID_OPERATION;
+    }
+    cl_int err = CL_SUCCESS;
+    if (buffer->zero_copy) {
+        cl_event *event = cl_trace_event(NULL);
+        err = clEnqueueUnmapMemObject(queue, buffer->mem, buffer->mapped, 0, NULL, event);
+        cl_trace_command("unmap buffer", queue, event, err);
+    } else if (buffer->map_flags & (CL_MAP_WRITE | CL_MAP_WRITE_INVALIDATE_REGION)) {
+        // Commands after this on the in-order queue see the data; the host
+        // may not touch the staging memory until the next map
+        err = clEnqueueWriteBuffer(queue, buffer->mem, CL_FALSE, 0, buffer->size, buffer->host,
+                                   0, NULL, &buffer->upload);
+        cl_trace_command("write buffer", queue, &buffer->upload, err);
+    }
+    buffer->mapped = NULL;
+    return err;
+}
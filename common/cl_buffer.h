@@ -0,0 +1,63 @@
+#ifndef CL_BUFFER_H
+#define CL_BUFFER_H
+
+#include <stddef.h>
+#include <CL/cl.h>
+
+// Device buffers that the host fills and reads through map/unmap.
+//
+// On devices that share memory with the host (CPU devices, integrated GPUs
+// reporting CL_DEVICE_HOST_UNIFIED_MEMORY) the buffer wraps page-aligned
+// host memory with CL_MEM_USE_HOST_PTR, so mapping it returns that memory
+// and no copy is made. On discrete devices the buffer lives in device memory
+// and is paired with a pinned CL_MEM_ALLOC_HOST_PTR staging buffer that stays
+// mapped: unmapping after a write starts a non-blocking upload from it, and
+// mapping for reading downloads into it, both at full DMA speed.
+//
+// Usage:
+//   float *p = cl_buffer_map(&b, queue, CL_MAP_WRITE_INVALIDATE_REGION, &err);
+//   ... fill p ...
+//   cl_buffer_unmap(&b, queue);        // kernels may now use b.mem
+//   p = cl_buffer_map(&b, queue, CL_MAP_READ, &err);
+//   ... read p ...
+//   cl_buffer_unmap(&b, queue);
+//
+// Maps are blocking and a buffer is mapped at most once at a time.
+//
+// Environment:
+//   CL_BUFFER=staged   use the staging path even on shared-memory devices
+//   CL_BUFFER=zero     use the zero-copy path even on discrete devices
+
+typedef struct {
+    cl_mem mem;          // the buffer to pass to kernels
+    cl_mem staging;      // pinned staging buffer, NULL when zero-copy
+    void *host;          // page-aligned memory behind mem, or the mapped staging buffer
+    void *mapped;        // pointer returned by the current map, NULL if not mapped
+    cl_map_flags map_flags;
+    cl_event upload;     // pending upload from the staging buffer
+    cl_command_queue queue; // queue the staging buffer was mapped on
+    size_t size;
+    int zero_copy;
+} cl_buffer;
+
+// Whether buffers of device are created zero-copy (after the CL_BUFFER override)
+int cl_buffer_zero_copy(cl_device_id device);
+
+// Page-aligned host memory, freed with cl_buffer_host_free()
+void *cl_buffer_host_alloc(size_t size);
+void cl_buffer_host_free(void *ptr);
+
+// flags is the kernel access, CL_MEM_READ_ONLY, CL_MEM_WRITE_ONLY or CL_MEM_READ_WRITE
+cl_int cl_buffer_create(cl_buffer *buffer, cl_context context, cl_device_id device, cl_command_queue queue,
+                        cl_mem_flags flags, size_t size);
+void cl_buffer_release(cl_buffer *buffer);
+
+// Host view of the whole buffer. CL_MAP_READ sees what kernels wrote before;
+// CL_MAP_WRITE_INVALIDATE_REGION skips that. Returns NULL and sets *err on failure.
+void *cl_buffer_map(cl_buffer *buffer, cl_command_queue queue, cl_map_flags flags, cl_int *err);
+
+// Ends the host view; after a write map the data is on its way to the device
+// and the next command on queue sees it
+cl_int cl_buffer_unmap(cl_buffer *buffer, cl_command_queue queue);
+
+#endif
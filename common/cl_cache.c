@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include "cl_cache.h"
+#include "cl_profile.h"
+#include "trace.h"
+
+// File format: header, then the binary as returned by CL_PROGRAM_BINARIES.
+// The key is repeated in the header so a renamed or colliding file is a miss.
+#define CL_CACHE_MAGIC 0x42505243u // "CRPB"
+#define CL_CACHE_VERSION 1u
+#define CL_CACHE_MAX_BINARY (256u << 20)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t size;
+} cl_cache_header;
+
+static const char *cl_cache_dir(void) {
+    const char *dir = getenv("CL_CACHE_DIR");
+    return dir ? dir : "cl_cache";
+}
+
+static int cl_cache_enabled(void) {
+    const char *mode = getenv("CL_CACHE");
+    return !mode || atoi(mode) != 0;
+}
+
+// Strings are hashed with their terminator so "ab" + "c" differs from "a" + "bc"
+static uint64_t cl_cache_hash_string(uint64_t hash, const char *text) {
+    return cl_source_hash(hash, text, strlen(text) + 1);
+}
+
+uint64_t cl_cache_key(cl_device_id device, uint64_t source_hash, const char *options) {
+    char name[256] = "", driver[256] = "";
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name), name, NULL);
+    clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(driver), driver, NULL);
+
+    uint64_t hash = cl_source_hash(CL_SOURCE_HASH_SEED, &source_hash, sizeof(source_hash));
+    hash = cl_cache_hash_string(hash, options ? options : "");
+    hash = cl_cache_hash_string(hash, name);
+    hash = cl_cache_hash_string(hash, driver);
+    return hash;
+}
+
+static void cl_cache_path(uint64_t key, char *path, size_t size) {
+    snprintf(path, size, "%s/%016llx.bin", cl_cache_dir(), (unsigned long long)key);
+}
+
+// Binary stored under key, or NULL (and *size 0) on a miss
+static unsigned char *cl_cache_read(uint64_t key, size_t *size) {
+    char path[1024];
+    cl_cache_path(key, path, sizeof(path));
+    *size = 0;
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    cl_cache_header header;
+    unsigned char *binary = NULL;
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == CL_CACHE_MAGIC &&
+        header.version == CL_CACHE_VERSION && header.key == key &&
+        header.size > 0 && header.size <= CL_CACHE_MAX_BINARY) {
+        binary = (unsigned char *)malloc((size_t)header.size);
+        if (fread(binary, 1, (size_t)header.size, file) == header.size) {
+            *size = (size_t)header.size;
+        } else {
+            free(binary);
+            binary = NULL;
+        }
+    }
+    fclose(file);
+    return binary;
+}
+
+static void cl_cache_write(uint64_t key, const unsigned char *binary, size_t size) {
+    const char *dir = cl_cache_dir();
+#ifdef _WIN32
+    if (_mkdir(dir) != 0 && errno != EEXIST) {
+#else
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+#endif
+        return;
+    }
+
+    char path[1024], tmp_path[1040];
+    cl_cache_path(key, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        return;
+    }
+    cl_cache_header header = {CL_CACHE_MAGIC, CL_CACHE_VERSION, key, size};
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+
+    // Write then rename, so a concurrent reader never sees half a file
+    if (ok) {
+        remove(path); // rename() does not replace on Windows
+        ok = rename(tmp_path, path) == 0;
+    }
+    if (!ok) {
+        remove(tmp_path);
+    }
+}
+
+// Stores the binary of a freshly built single-device program
+static void cl_cache_store(cl_program program, uint64_t key) {
+    size_t size = 0;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) != CL_SUCCESS ||
+        size == 0 || size > CL_CACHE_MAX_BINARY) {
+        return;
+    }
+    unsigned char *binary = (unsigned char *)malloc(size);
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binary), &binary, NULL) == CL_SUCCESS) {
+        cl_cache_write(key, binary, size);
+    }
+    free(binary);
+}
+
+cl_program cl_cache_build(cl_context context, cl_device_id device, const char *source, size_t source_size,
+                          uint64_t source_hash, const char *options, cl_int *err, int *cached) {
+    if (cached) {
+        *cached = 0;
+    }
+
+    // Every program sees the capabilities of its device as DEV_* defines
+    cl_profile profile;
+    cl_profile_query(device, &profile);
+    char defines[512], full_options[2048];
+    cl_profile_defines(&profile, defines, sizeof(defines));
+    snprintf(full_options, sizeof(full_options), "%s %s", defines, options ? options : "");
+    options = full_options;
+
+    int enabled = cl_cache_enabled();
+    uint64_t key = 0;
+    if (enabled) {
+        if (source_hash == 0) {
+            source_hash = cl_source_hash(CL_SOURCE_HASH_SEED, source, source_size);
+        }
+        key = cl_cache_key(device, source_hash, options);
+
+        size_t size;
+        unsigned char *binary = cl_cache_read(key, &size);
+        if (binary) {
+            const unsigned char *binaries[] = {binary};
+            cl_int status;
+            cl_program program = clCreateProgramWithBinary(context, 1, &device, &size, binaries, &status, err);
+            free(binary);
+            // A binary still has to be "built"; a driver update that kept
+            // the version string is caught here and rebuilt from source
+            if (*err == CL_SUCCESS && status == CL_SUCCESS) {
+                trace_begin("clBuildProgram (cached binary)");
+                *err = clBuildProgram(program, 1, &device, options, NULL, NULL);
+                trace_end();
+                if (*err == CL_SUCCESS) {
+                    if (cached) {
+                        *cached = 1;
+                    }
+                    return program;
+                }
+            }
+            if (program) {
+                clReleaseProgram(program);
+            }
+        }
+    }
+
+    cl_program program = clCreateProgramWithSource(context, 1, &source, &source_size, err);
+    if (*err != CL_SUCCESS) {
+        return NULL;
+    }
+    trace_begin("clBuildProgram");
+    *err = clBuildProgram(program, 1, &device, options, NULL, NULL);
+    trace_end();
+    if (*err == CL_SUCCESS && enabled) {
+        cl_cache_store(program, key);
+    }
+    return program;
+}
@@ -0,0 +1,36 @@
+#ifndef CL_CACHE_H
+#define CL_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <CL/cl.h>
+#include "cl_source.h"
+
+// On-disk cache of built OpenCL programs.
+//
+// The first build of a program reads CL_PROGRAM_BINARIES and writes them to
+// the cache directory under a 64-bit hash of the source, the build options,
+// the device name and the driver version. Later runs create the program from
+// that binary instead of compiling the source. A changed source, option,
+// device or driver gives a new key; a binary the driver rejects, or a
+// truncated or foreign file, falls back to a source build that replaces it.
+//
+// Environment:
+//   CL_CACHE=0      always build from source, never read or write the cache
+//   CL_CACHE_DIR    cache directory (default: cl_cache), created if missing
+
+// Cache key of a source with the given cl_source_hash() and options on device
+uint64_t cl_cache_key(cl_device_id device, uint64_t source_hash, const char *options);
+
+// Program for device built from source with options (NULL for none), from the
+// cache when possible. source_hash is the cl_source_hash() of the source, as
+// embedded in cl_sources.h, or 0 to hash it here. *err is the status of the
+// create or build; on a build failure the program is still returned so the
+// caller can read the build log. cached (may be NULL) is set to 1 if the
+// binary came from the cache. The DEV_* defines of the device profile (see
+// cl_profile.h) are added in front of options, and builds show as host
+// scopes in the trace (trace.h); include cl_profile.c and trace.c too.
+cl_program cl_cache_build(cl_context context, cl_device_id device, const char *source, size_t source_size,
+                          uint64_t source_hash, const char *options, cl_int *err, int *cached);
+
+#endif
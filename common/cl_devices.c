@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cl_devices.h"
+
+static void cl_devices_check(cl_int error, const char *message) {
+    if (error != CL_SUCCESS) {
+        fprintf(stderr, "%s: %d\n", message, error);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Whether the device at index of all devices, of the given type, is selected
+static int cl_devices_selected(const char *selection, int index, cl_device_type type) {
+    if (!selection || !*selection || strcmp(selection, "all") == 0) {
+        return 1;
+    }
+    if (strcmp(selection, "gpu") == 0) {
+        return (type & CL_DEVICE_TYPE_GPU) != 0;
+    }
+    if (strcmp(selection, "cpu") == 0) {
+        return (type & CL_DEVICE_TYPE_CPU) != 0;
+    }
+    for (const char *p = selection; *p;) {
+        char *end;
+        long value = strtol(p, &end, 10);
+        if (end == p) {
+            fprintf(stderr, "CL_DEVICES=%s: expected all, gpu, cpu or a list of device indices\n", selection);
+            exit(EXIT_FAILURE);
+        }
+        if (value == index) {
+            return 1;
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return 0;
+}
+
+void cl_devices_open(cl_devices *list) {
+    memset(list, 0, sizeof(*list));
+    const char *selection = getenv("CL_DEVICES");
+
+    cl_platform_id platforms[CL_DEVICES_MAX_PLATFORMS];
+    cl_uint num_platforms = 0;
+    cl_int err = clGetPlatformIDs(CL_DEVICES_MAX_PLATFORMS, platforms, &num_platforms);
+    cl_devices_check(err, "Failed to get platform IDs");
+    if (num_platforms > CL_DEVICES_MAX_PLATFORMS) num_platforms = CL_DEVICES_MAX_PLATFORMS;
+
+    int index = 0;
+    for (cl_uint p = 0; p < num_platforms; p++) {
+        cl_device_id devices[CL_DEVICES_MAX];
+        cl_uint num_devices = 0;
+        if (clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, CL_DEVICES_MAX, devices, &num_devices) != CL_SUCCESS) {
+            continue;
+        }
+        if (num_devices > CL_DEVICES_MAX) num_devices = CL_DEVICES_MAX;
+        for (cl_uint d = 0; d < num_devices; d++, index++) {
+            cl_device_type type = 0;
+            clGetDeviceInfo(devices[d], CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+            if (list->count == CL_DEVICES_MAX || !cl_devices_selected(selection, index, type)) {
+                continue;
+            }
+            cl_device_entry *entry = &list->devices[list->count];
+            entry->platform = platforms[p];
+            entry->device = devices[d];
+            entry->type = type;
+            clGetPlatformInfo(platforms[p], CL_PLATFORM_NAME, sizeof(entry->platform_name) - 1,
+                              entry->platform_name, NULL);
+            clGetDeviceInfo(devices[d], CL_DEVICE_NAME, sizeof(entry->name) - 1, entry->name, NULL);
+            clGetDeviceInfo(devices[d], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(entry->compute_units),
+                            &entry->compute_units, NULL);
+
+            entry->context = clCreateContext(NULL, 1, &devices[d], NULL, NULL, &err);
+            if (err == CL_SUCCESS) {
+                entry->queue = clCreateCommandQueue(entry->context, devices[d], CL_QUEUE_PROFILING_ENABLE, &err);
+                if (err != CL_SUCCESS) clReleaseContext(entry->context);
+            }
+            if (err != CL_SUCCESS) {
+                fprintf(stderr, "Skipping %s (%s): %d\n", entry->name, entry->platform_name, err);
+                memset(entry, 0, sizeof(*entry));
+                continue;
+            }
+            list->count++;
+        }
+    }
+    if (list->count == 0) {
+        cl_devices_check(CL_DEVICE_NOT_FOUND, "Failed to get device IDs");
+    }
+}
+
+void cl_devices_release(cl_devices *list) {
+    for (int d = 0; d < list->count; d++) {
+        clReleaseCommandQueue(list->devices[d].queue);
+        clReleaseContext(list->devices[d].context);
+    }
+    memset(list, 0, sizeof(*list));
+}
+
+void cl_devices_split(const cl_devices *list, int rows, int granule, int *first) {
+    int count = list->count > 0 ? list->count : 1;
+    int units = (rows + granule - 1) / granule;
+    first[0] = 0;
+    for (int d = 0; d < count; d++) {
+        // The first units % count devices get one granule more
+        int share = units / count + (d < units % count);
+        first[d + 1] = first[d] + share * granule;
+        if (first[d + 1] > rows) first[d + 1] = rows;
+    }
+}
+
+void cl_devices_print(const cl_devices *list, FILE *out) {
+    for (int d = 0; d < list->count; d++) {
+        const cl_device_entry *entry = &list->devices[d];
+        const char *type = entry->type & CL_DEVICE_TYPE_GPU ? "GPU"
+                           : entry->type & CL_DEVICE_TYPE_CPU ? "CPU"
+                           : entry->type & CL_DEVICE_TYPE_ACCELERATOR ? "accelerator" : "other";
+        fprintf(out, "Device %d: %s %s (%s), %u compute units\n", d, type, entry->name, entry->platform_name,
+                entry->compute_units);
+    }
+}
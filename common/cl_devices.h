@@ -0,0 +1,56 @@
+#ifndef CL_DEVICES_H
+#define CL_DEVICES_H
+
+#include <stdio.h>
+#include <CL/cl.h>
+
+// Every OpenCL device of every platform, each with its own context and
+// profiling-enabled in-order queue, for programs that shard one job across
+// all of them.
+//
+// cl_runtime.h picks a single device; this is the multi-device counterpart.
+// Contexts are not shared between devices, even on the same platform, so
+// each device can be driven on its own and buffers never migrate implicitly.
+// A program gives every device a range of rows, enqueues its part without
+// blocking, and gathers the results once all queues have finished.
+//
+// Environment:
+//   CL_DEVICES=all|gpu|cpu  device types to use (all by default)
+//   CL_DEVICES=0,2          devices by index in the order listed by
+//                           cl_devices_print() of CL_DEVICES=all
+
+#define CL_DEVICES_MAX 16
+#define CL_DEVICES_MAX_PLATFORMS 16
+
+typedef struct {
+    cl_platform_id platform;
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+    cl_device_type type;
+    char platform_name[128];
+    char name[128];
+    cl_uint compute_units;
+} cl_device_entry;
+
+typedef struct {
+    int count;
+    cl_device_entry devices[CL_DEVICES_MAX];
+} cl_devices;
+
+// Enumerates the devices selected by CL_DEVICES and creates their contexts
+// and queues. Devices whose context fails are reported and skipped. Exits,
+// like checkError(), when no device is left.
+void cl_devices_open(cl_devices *list);
+
+void cl_devices_release(cl_devices *list);
+
+// Splits rows into list->count contiguous ranges, as even as possible in
+// multiples of granule; device d gets rows [first[d], first[d + 1]).
+// first must hold list->count + 1 entries.
+void cl_devices_split(const cl_devices *list, int rows, int granule, int *first);
+
+// One line per device: index, type, name, platform and compute units
+void cl_devices_print(const cl_devices *list, FILE *out);
+
+#endif
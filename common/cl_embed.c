@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "cl_source.h"
+
+// Build step that embeds OpenCL kernel files into the host programs.
+//
+// Usage: cl_embed <output header> <file.cl> [<file.cl> ...]
+// Writes one string constant per file plus the cl_embedded_sources table
+// read by cl_source.c. Files are registered by name without directory, so
+// two kernels with the same file name are rejected. Carriage returns are
+// dropped, so the header and the hashes do not depend on the checkout's
+// line endings.
+
+#define EMBED_MAX_SIZE (0x100000)
+#define EMBED_MAX_FILES 64
+
+typedef struct {
+    const char *path;
+    const char *name;
+    char symbol[256];
+    char *text;
+    size_t size;
+    uint64_t hash;
+} embed_file;
+
+static const char *embed_basename(const char *path) {
+    const char *name = path;
+    for (const char *c = path; *c; c++) {
+        if (*c == '/' || *c == '\\') name = c + 1;
+    }
+    return name;
+}
+
+static void embed_read(embed_file *file) {
+    FILE *in = fopen(file->path, "rb");
+    if (!in) {
+        fprintf(stderr, "Failed to open %s\n", file->path);
+        exit(EXIT_FAILURE);
+    }
+    file->text = (char *)malloc(EMBED_MAX_SIZE + 1);
+    size_t size = fread(file->text, 1, EMBED_MAX_SIZE + 1, in);
+    fclose(in);
+    if (size > EMBED_MAX_SIZE) {
+        fprintf(stderr, "%s is larger than %d bytes\n", file->path, EMBED_MAX_SIZE);
+        exit(EXIT_FAILURE);
+    }
+
+    file->size = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (file->text[i] != '\r') file->text[file->size++] = file->text[i];
+    }
+    file->text[file->size] = '\0';
+    file->hash = cl_source_hash(CL_SOURCE_HASH_SEED, file->text, file->size);
+
+    file->name = embed_basename(file->path);
+    size_t n = snprintf(file->symbol, sizeof(file->symbol), "cl_source_%s", file->name);
+    for (size_t i = 0; i < n && i < sizeof(file->symbol) - 1; i++) {
+        if (!isalnum((unsigned char)file->symbol[i])) file->symbol[i] = '_';
+    }
+}
+
+// One string literal per source line, escaped
+static void embed_write_text(FILE *out, const embed_file *file) {
+    fprintf(out, "static const char %s[] =\n", file->symbol);
+    if (file->size == 0) {
+        fprintf(out, "    \"\";\n\n");
+        return;
+    }
+    int open = 0;
+    for (size_t i = 0; i < file->size; i++) {
+        unsigned char c = (unsigned char)file->text[i];
+        if (!open) {
+            fprintf(out, "    \"");
+            open = 1;
+        }
+        if (c == '\n') {
+            fprintf(out, "\\n\"\n");
+            open = 0;
+        } else if (c == '\\' || c == '"' || c == '?') { // '?' avoids trigraphs
+            fprintf(out, "\\%c", c);
+        } else if (c == '\t') {
+            fprintf(out, "\\t");
+        } else if (c < 0x20 || c >= 0x7f) {
+            fprintf(out, "\\%03o", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    if (open) {
+        fprintf(out, "\"\n");
+    }
+    fprintf(out, "    ;\n\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3 || argc - 2 > EMBED_MAX_FILES) {
+        fprintf(stderr, "Usage: %s <output header> <file.cl> [<file.cl> ...] (at most %d files)\n",
+                argv[0], EMBED_MAX_FILES);
+        return EXIT_FAILURE;
+    }
+
+    int num_files = argc - 2;
+    embed_file files[EMBED_MAX_FILES];
+    for (int i = 0; i < num_files; i++) {
+        files[i].path = argv[i + 2];
+        embed_read(&files[i]);
+        for (int j = 0; j < i; j++) {
+            if (strcmp(files[i].name, files[j].name) == 0) {
+                fprintf(stderr, "%s and %s have the same name\n", files[j].path, files[i].path);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    // Write next to the target and rename, so a failed run keeps the old header
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", argv[1]);
+    FILE *out = fopen(tmp_path, "wb");
+    if (!out) {
+        fprintf(stderr, "Failed to create %s\n", tmp_path);
+        return EXIT_FAILURE;
+    }
+    fprintf(out, "// Generated by common/cl_embed.c, do not edit. Rerun the \"Embed OpenCL kernel\n"
+                 "// sources\" task after changing a kernel.\n"
+                 "#ifndef CL_SOURCES_H\n"
+                 "#define CL_SOURCES_H\n\n"
+                 "#include \"cl_source.h\"\n\n");
+    for (int i = 0; i < num_files; i++) {
+        fprintf(out, "// %s\n", files[i].path);
+        embed_write_text(out, &files[i]);
+    }
+    fprintf(out, "static const cl_source cl_embedded_sources[] = {\n");
+    for (int i = 0; i < num_files; i++) {
+        fprintf(out, "    {\"%s\", %s, %zu, 0x%016llxULL},\n", files[i].name, files[i].symbol, files[i].size,
+                (unsigned long long)files[i].hash);
+    }
+    fprintf(out, "};\n\n#endif\n");
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Failed to write %s\n", tmp_path);
+        return EXIT_FAILURE;
+    }
+    remove(argv[1]); // rename() does not replace on Windows
+    if (rename(tmp_path, argv[1]) != 0) {
+        fprintf(stderr, "Failed to replace %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < num_files; i++) {
+        free(files[i].text);
+    }
+    return 0;
+}
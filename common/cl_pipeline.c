@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cl_pipeline.h"
+
+typedef struct cl_pipeline_pinned_block {
+    cl_mem mem;
+    void *host;
+    struct cl_pipeline_pinned_block *next;
+} cl_pipeline_pinned_block;
+
+cl_event *cl_pipeline_next(cl_pipeline_events *done) {
+    if (done->count == CL_PIPELINE_MAX_EVENTS) {
+        fprintf(stderr, "More than %d commands in one pipeline stage\n", CL_PIPELINE_MAX_EVENTS);
+        exit(EXIT_FAILURE);
+    }
+    return &done->events[done->count++];
+}
+
+cl_int cl_pipeline_create(cl_pipeline *pipeline, cl_context context, cl_device_id device, int num_queues) {
+    memset(pipeline, 0, sizeof(*pipeline));
+    if (num_queues < 2 || num_queues > 3) {
+        return CL_INVALID_VALUE;
+    }
+    pipeline->context = context;
+    pipeline->num_queues = num_queues;
+    cl_int err = CL_SUCCESS;
+    for (int i = 0; i < num_queues && err == CL_SUCCESS; i++) {
+        pipeline->queues[i] = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+    }
+    if (err != CL_SUCCESS) {
+        cl_pipeline_release(pipeline);
+    }
+    return err;
+}
+
+void cl_pipeline_release(cl_pipeline *pipeline) {
+    while (pipeline->pinned) {
+        cl_pipeline_pinned_block *block = pipeline->pinned;
+        pipeline->pinned = block->next;
+        clEnqueueUnmapMemObject(pipeline->queues[0], block->mem, block->host, 0, NULL, NULL);
+        clFinish(pipeline->queues[0]);
+        clReleaseMemObject(block->mem);
+        free(block);
+    }
+    for (int i = 0; i < 3; i++) {
+        if (pipeline->queues[i]) {
+            clReleaseCommandQueue(pipeline->queues[i]);
+        }
+    }
+    memset(pipeline, 0, sizeof(*pipeline));
+}
+
+void *cl_pipeline_pinned(cl_pipeline *pipeline, size_t size, cl_int *err) {
+    cl_mem mem = clCreateBuffer(pipeline->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, NULL, err);
+    if (*err != CL_SUCCESS) {
+        return NULL;
+    }
+    void *host = clEnqueueMapBuffer(pipeline->queues[0], mem, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size,
+                                    0, NULL, NULL, err);
+    if (*err != CL_SUCCESS) {
+        clReleaseMemObject(mem);
+        return NULL;
+    }
+    cl_pipeline_pinned_block *block = (cl_pipeline_pinned_block *)malloc(sizeof(cl_pipeline_pinned_block));
+    block->mem = mem;
+    block->host = host;
+    block->next = pipeline->pinned;
+    pipeline->pinned = block;
+    return host;
+}
+
+// Commands of one stage finish in order, so the last event stands for all
+static cl_uint cl_pipeline_after(const cl_pipeline_events *stage, cl_event *wait, cl_uint num_wait) {
+    if (stage->count > 0) {
+        wait[num_wait++] = stage->events[stage->count - 1];
+    }
+    return num_wait;
+}
+
+// Busy time of the events of one stage; widens [*first, *last] to cover them
+static double cl_pipeline_busy_ms(const cl_pipeline_events *stages, int num_slabs,
+                                  cl_ulong *first, cl_ulong *last) {
+    double busy = 0.0;
+    for (int i = 0; i < num_slabs; i++) {
+        for (int e = 0; e < stages[i].count; e++) {
+            cl_ulong start = 0, end = 0;
+            clGetEventProfilingInfo(stages[i].events[e], CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+            clGetEventProfilingInfo(stages[i].events[e], CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+            busy += (double)(end - start) * 1e-6;
+            if (start < *first) *first = start;
+            if (end > *last) *last = end;
+        }
+    }
+    return busy;
+}
+
+cl_int cl_pipeline_run(cl_pipeline *pipeline, int num_slabs, int slots, cl_pipeline_stage_fn upload,
+                       cl_pipeline_stage_fn compute, cl_pipeline_stage_fn download, void *user,
+                       cl_pipeline_stats *stats) {
+    // One slot would make the compute of slab i wait for a download that is
+    // only enqueued after it
+    if (num_slabs <= 0 || slots < 2) {
+        return CL_INVALID_VALUE;
+    }
+    cl_pipeline_events *uploads = (cl_pipeline_events *)calloc((size_t)num_slabs * 3, sizeof(cl_pipeline_events));
+    cl_pipeline_events *computes = uploads + num_slabs;
+    cl_pipeline_events *downloads = computes + num_slabs;
+    cl_command_queue upload_queue = pipeline->queues[0];
+    cl_command_queue compute_queue = pipeline->queues[1];
+    cl_command_queue download_queue = pipeline->num_queues == 3 ? pipeline->queues[2] : pipeline->queues[0];
+
+    // Issue order upload(i), compute(i), download(i - 1): when upload and
+    // download share a queue, the next upload is queued before the download
+    // that has to wait for the current compute
+    cl_int err = CL_SUCCESS;
+    for (int i = 0; i <= num_slabs && err == CL_SUCCESS; i++) {
+        cl_event wait[2];
+        cl_uint num_wait;
+        if (i < num_slabs) {
+            int slot = i % slots;
+            num_wait = i >= slots ? cl_pipeline_after(&computes[i - slots], wait, 0) : 0;
+            err = upload(user, i, slot, upload_queue, num_wait, wait, &uploads[i]);
+            if (err != CL_SUCCESS) break;
+
+            num_wait = cl_pipeline_after(&uploads[i], wait, 0);
+            if (i >= slots) {
+                num_wait = cl_pipeline_after(&downloads[i - slots], wait, num_wait);
+            }
+            err = compute(user, i, slot, compute_queue, num_wait, wait, &computes[i]);
+            if (err != CL_SUCCESS) break;
+        }
+        if (i > 0) {
+            num_wait = cl_pipeline_after(&computes[i - 1], wait, 0);
+            err = download(user, i - 1, (i - 1) % slots, download_queue, num_wait, wait, &downloads[i - 1]);
+        }
+        for (int q = 0; q < pipeline->num_queues; q++) {
+            clFlush(pipeline->queues[q]);
+        }
+    }
+    for (int q = 0; q < pipeline->num_queues; q++) {
+        clFinish(pipeline->queues[q]);
+    }
+
+    if (err == CL_SUCCESS && stats) {
+        cl_ulong first = (cl_ulong)-1, last = 0;
+        stats->upload_ms = cl_pipeline_busy_ms(uploads, num_slabs, &first, &last);
+        stats->compute_ms = cl_pipeline_busy_ms(computes, num_slabs, &first, &last);
+        stats->download_ms = cl_pipeline_busy_ms(downloads, num_slabs, &first, &last);
+        stats->span_ms = last > first ? (double)(last - first) * 1e-6 : 0.0;
+        stats->serial_ms = stats->upload_ms + stats->compute_ms + stats->download_ms;
+        double copies_ms = stats->upload_ms + stats->download_ms;
+        if (pipeline->num_queues == 3) {
+            copies_ms = stats->upload_ms > stats->download_ms ? stats->upload_ms : stats->download_ms;
+        }
+        stats->bound_ms = copies_ms > stats->compute_ms ? copies_ms : stats->compute_ms;
+        double hideable = stats->serial_ms - stats->bound_ms;
+        stats->efficiency = hideable > 0.0 ? (stats->serial_ms - stats->span_ms) / hideable : 1.0;
+        if (stats->efficiency < 0.0) stats->efficiency = 0.0;
+        if (stats->efficiency > 1.0) stats->efficiency = 1.0;
+    }
+
+    for (int i = 0; i < num_slabs * 3; i++) {
+        for (int e = 0; e < uploads[i].count; e++) {
+            clReleaseEvent(uploads[i].events[e]);
+        }
+    }
+    free(uploads);
+    return err;
+}
@@ -0,0 +1,71 @@
+#ifndef CL_PIPELINE_H
+#define CL_PIPELINE_H
+
+#include <stddef.h>
+#include <CL/cl.h>
+
+// Chunked execution that overlaps transfers with compute.
+//
+// The work is split into slabs, and each slab goes through three stages:
+// upload, compute and download. Each stage is a callback that enqueues its
+// commands. Stages run on their own in-order queues (upload and download
+// share one when only two queues are asked for). Events chain them, so the
+// upload of slab i+1, the compute of slab i and the download of slab i-1
+// run at the same time.
+//
+// Slabs cycle through `slots` sets of device buffers (2 = double
+// buffering). The upload of slab i waits for the compute of slab i - slots,
+// and the compute of slab i waits for the download of slab i - slots, so a
+// slot is only reused once nothing reads it.
+//
+// Transfers only overlap when the host memory is pinned;
+// cl_pipeline_pinned() allocates such memory.
+
+#define CL_PIPELINE_MAX_EVENTS 8 // commands per stage and slab
+
+// Events of the commands one stage enqueued for one slab, in order
+typedef struct {
+    cl_event events[CL_PIPELINE_MAX_EVENTS];
+    int count;
+} cl_pipeline_events;
+
+// Where a stage callback stores the event of its next command
+cl_event *cl_pipeline_next(cl_pipeline_events *done);
+
+// Enqueues one stage of slab on queue (using the buffers of slot). The first
+// command waits on the num_wait events of wait; later commands on the same
+// in-order queue follow it. Every command records its event through
+// cl_pipeline_next(done).
+typedef cl_int (*cl_pipeline_stage_fn)(void *user, int slab, int slot, cl_command_queue queue,
+                                       cl_uint num_wait, const cl_event *wait, cl_pipeline_events *done);
+
+typedef struct {
+    cl_context context;
+    cl_command_queue queues[3]; // upload, compute, download
+    int num_queues;
+    struct cl_pipeline_pinned_block *pinned;
+} cl_pipeline;
+
+// From the profiling counters of one run, in ms
+typedef struct {
+    double upload_ms, compute_ms, download_ms; // busy time of each stage
+    double serial_ms;     // sum of the three, the time without any overlap
+    double bound_ms;      // busiest queue, the time with perfect overlap
+    double span_ms;       // first command start to last command end
+    double efficiency;    // (serial - span) / (serial - bound): 1 = all hideable time hidden
+} cl_pipeline_stats;
+
+// num_queues is 2 or 3; queues are created with profiling enabled
+cl_int cl_pipeline_create(cl_pipeline *pipeline, cl_context context, cl_device_id device, int num_queues);
+void cl_pipeline_release(cl_pipeline *pipeline);
+
+// Pinned (CL_MEM_ALLOC_HOST_PTR, mapped) host memory, freed with the pipeline
+void *cl_pipeline_pinned(cl_pipeline *pipeline, size_t size, cl_int *err);
+
+// Runs num_slabs slabs over slots buffer sets and waits for the last one.
+// stats may be NULL.
+cl_int cl_pipeline_run(cl_pipeline *pipeline, int num_slabs, int slots, cl_pipeline_stage_fn upload,
+                       cl_pipeline_stage_fn compute, cl_pipeline_stage_fn download, void *user,
+                       cl_pipeline_stats *stats);
+
+#endif
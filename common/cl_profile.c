@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+#include "cl_profile.h"
+
+void cl_profile_query(cl_device_id device, cl_profile *profile) {
+    memset(profile, 0, sizeof(*profile));
+    clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(profile->type), &profile->type, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(profile->name) - 1, profile->name, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_VERSION, sizeof(profile->version) - 1, profile->version, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &profile->compute_units, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(cl_uint), &profile->clock_mhz, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &profile->global_mem_size, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &profile->max_work_group_size, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(profile->max_work_item_sizes),
+                    profile->max_work_item_sizes, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &profile->local_mem_size, NULL);
+
+    cl_device_local_mem_type local_type = CL_GLOBAL;
+    clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_TYPE, sizeof(local_type), &local_type, NULL);
+    profile->local_mem_dedicated = local_type == CL_LOCAL;
+
+    cl_device_mem_cache_type cache_type = CL_NONE;
+    clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_CACHE_TYPE, sizeof(cache_type), &cache_type, NULL);
+    if (cache_type != CL_NONE) {
+        clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_CACHELINE_SIZE, sizeof(cl_uint), &profile->cache_line, NULL);
+        clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_CACHE_SIZE, sizeof(cl_ulong), &profile->cache_size, NULL);
+    }
+
+    clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_CHAR, sizeof(cl_uint), &profile->vector_width_char, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT, sizeof(cl_uint), &profile->vector_width_int, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, sizeof(cl_uint), &profile->vector_width_float, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_HALF, sizeof(cl_uint), &profile->vector_width_half, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE, sizeof(cl_uint), &profile->vector_width_double, NULL);
+
+    // The extension string can be long; only its presence matters here
+    char extensions[8192] = "";
+    clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, sizeof(extensions) - 1, extensions, NULL);
+    profile->fp16 = strstr(extensions, "cl_khr_fp16") != NULL;
+    cl_device_fp_config double_config = 0;
+    clGetDeviceInfo(device, CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(double_config), &double_config, NULL);
+    profile->fp64 = double_config != 0 || strstr(extensions, "cl_khr_fp64") != NULL;
+
+    cl_bool unified = CL_FALSE;
+    clGetDeviceInfo(device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified), &unified, NULL);
+    profile->unified_memory = unified == CL_TRUE;
+}
+
+void cl_profile_defines(const cl_profile *profile, char *options, size_t size) {
+    int ts, tsk, wptm, wptn;
+    cl_profile_gemm_tiles(profile, &ts, &tsk, &wptm, &wptn);
+    snprintf(options, size,
+             "-DDEV_LOCAL_MEM=%llu -DDEV_LOCAL_MEM_DEDICATED=%d -DDEV_MAX_WORK_GROUP=%zu -DDEV_VECTOR_WIDTH=%d "
+             "-DDEV_CACHE_LINE=%u -DDEV_FP16=%d -DDEV_FP64=%d -DDEV_UNIFIED_MEMORY=%d -DDEV_CPU=%d "
+             "-DDEV_GEMM_TS=%d -DDEV_GEMM_TSK=%d -DDEV_GEMM_WPTM=%d -DDEV_GEMM_WPTN=%d",
+             (unsigned long long)profile->local_mem_size, profile->local_mem_dedicated,
+             profile->max_work_group_size, cl_profile_vector_width(profile), profile->cache_line, profile->fp16,
+             profile->fp64, profile->unified_memory, (profile->type & CL_DEVICE_TYPE_CPU) != 0, ts, tsk, wptm, wptn);
+}
+
+int cl_profile_vector_width(const cl_profile *profile) {
+    int width = 4;
+    while (width < 16 && (cl_uint)width < profile->vector_width_float) {
+        width *= 2;
+    }
+    return width;
+}
+
+int cl_profile_gemm_fits(const cl_profile *profile, int ts, int tsk, int wptm, int wptn) {
+    size_t work_group = (size_t)(ts / wptm) * (size_t)(ts / wptn);
+    cl_ulong local_bytes = (cl_ulong)(tsk * (ts + 1) + tsk * ts) * sizeof(float);
+    return ts % wptm == 0 && ts % wptn == 0 && work_group <= profile->max_work_group_size &&
+           (size_t)(ts / wptn) <= profile->max_work_item_sizes[0] &&
+           (size_t)(ts / wptm) <= profile->max_work_item_sizes[1] && local_bytes <= profile->local_mem_size;
+}
+
+void cl_profile_gemm_tiles(const cl_profile *profile, int *ts, int *tsk, int *wptm, int *wptn) {
+    // Candidates from the preferred to the most modest
+    static const int tiles[][4] = {
+        {64, 16, 4, 4}, {64, 16, 8, 8}, {32, 16, 4, 4}, {32, 8, 4, 4}, {16, 8, 2, 2}, {16, 8, 4, 4},
+    };
+    int first = profile->local_mem_dedicated ? 0 : 2;
+    int count = (int)(sizeof(tiles) / sizeof(tiles[0]));
+    int chosen = count - 1;
+    for (int i = first; i < count; i++) {
+        if (cl_profile_gemm_fits(profile, tiles[i][0], tiles[i][1], tiles[i][2], tiles[i][3])) {
+            chosen = i;
+            break;
+        }
+    }
+    *ts = tiles[chosen][0];
+    *tsk = tiles[chosen][1];
+    *wptm = tiles[chosen][2];
+    *wptn = tiles[chosen][3];
+}
+
+void cl_profile_print(const cl_profile *profile, FILE *out) {
+    const char *type = profile->type & CL_DEVICE_TYPE_GPU ? "GPU"
+                       : profile->type & CL_DEVICE_TYPE_CPU ? "CPU"
+                       : profile->type & CL_DEVICE_TYPE_ACCELERATOR ? "Accelerator" : "Other";
+    int ts, tsk, wptm, wptn;
+    cl_profile_gemm_tiles(profile, &ts, &tsk, &wptm, &wptn);
+    fprintf(out, "OpenCL Device: %s (%s)\n", profile->name, type);
+    fprintf(out, "OpenCL Device Version: %s\n", profile->version);
+    fprintf(out, "OpenCL Device Compute Units: %u at %u MHz\n", profile->compute_units, profile->clock_mhz);
+    fprintf(out, "Global memory: %llu MiB, cache line %u bytes, cache %llu KiB%s\n",
+            (unsigned long long)(profile->global_mem_size >> 20), profile->cache_line,
+            (unsigned long long)(profile->cache_size >> 10), profile->unified_memory ? ", shared with the host" : "");
+    fprintf(out, "Local memory: %llu KiB (%s)\n", (unsigned long long)(profile->local_mem_size >> 10),
+            profile->local_mem_dedicated ? "dedicated" : "emulated in global memory");
+    fprintf(out, "Max work-group: %zu (%zu x %zu x %zu)\n", profile->max_work_group_size,
+            profile->max_work_item_sizes[0], profile->max_work_item_sizes[1], profile->max_work_item_sizes[2]);
+    fprintf(out, "Preferred vector widths: char %u, int %u, float %u, half %u, double %u\n",
+            profile->vector_width_char, profile->vector_width_int, profile->vector_width_float,
+            profile->vector_width_half, profile->vector_width_double);
+    fprintf(out, "fp16: %s, fp64: %s\n", profile->fp16 ? "yes" : "no", profile->fp64 ? "yes" : "no");
+    fprintf(out, "Kernel defaults: vector width %d, GEMM tiles TS=%d TSK=%d WPTM=%d WPTN=%d\n",
+            cl_profile_vector_width(profile), ts, tsk, wptm, wptn);
+}
@@ -0,0 +1,69 @@
+#ifndef CL_PROFILE_H
+#define CL_PROFILE_H
+
+#include <stdio.h>
+#include <CL/cl.h>
+
+// Capabilities of one OpenCL device that decide how kernels should be built:
+// how much local memory a work-group gets and whether it is real on-chip
+// memory, how large work-groups may be, the vector widths the compiler
+// prefers, the cache line, half and double support, and whether the device
+// shares memory with the host.
+//
+// cl_cache_build() passes every program the profile of its device as -D
+// defines (see cl_profile_defines()), so kernel files can pick variants with
+// #if DEV_LOCAL_MEM_DEDICATED, DEV_VECTOR_WIDTH and so on. The host side
+// picks matching launch parameters with cl_profile_vector_width() and
+// cl_profile_gemm_tiles(); tuned values from cl_autotune.h still win.
+
+typedef struct {
+    cl_device_type type;
+    char name[128];
+    char version[128];
+    cl_uint compute_units;
+    cl_uint clock_mhz;
+    cl_ulong global_mem_size;
+    size_t max_work_group_size;
+    size_t max_work_item_sizes[3];
+    cl_ulong local_mem_size;
+    int local_mem_dedicated;   // CL_LOCAL: on-chip, not emulated in global memory
+    cl_uint cache_line;        // global memory cache line in bytes, 0 without a cache
+    cl_ulong cache_size;
+    cl_uint vector_width_char; // preferred widths reported by the driver
+    cl_uint vector_width_int;
+    cl_uint vector_width_float;
+    cl_uint vector_width_half;
+    cl_uint vector_width_double;
+    int fp16;                  // cl_khr_fp16
+    int fp64;                  // double precision with a non-empty CL_DEVICE_DOUBLE_FP_CONFIG
+    int unified_memory;        // CL_DEVICE_HOST_UNIFIED_MEMORY
+} cl_profile;
+
+void cl_profile_query(cl_device_id device, cl_profile *profile);
+
+// Build options describing profile:
+//   -DDEV_LOCAL_MEM=bytes -DDEV_LOCAL_MEM_DEDICATED=0|1 -DDEV_MAX_WORK_GROUP=n
+//   -DDEV_VECTOR_WIDTH=n -DDEV_CACHE_LINE=bytes -DDEV_FP16=0|1 -DDEV_FP64=0|1
+//   -DDEV_UNIFIED_MEMORY=0|1 -DDEV_CPU=0|1
+//   -DDEV_GEMM_TS=n -DDEV_GEMM_TSK=n -DDEV_GEMM_WPTM=n -DDEV_GEMM_WPTN=n
+//     (the tiles of cl_profile_gemm_tiles())
+void cl_profile_defines(const cl_profile *profile, char *options, size_t size);
+
+// Floats per load/store for element-wise kernels: 4, or the preferred float
+// width when the device asks for more (CPU SIMD), at most 16. GPUs report 1
+// since their lanes are scalar, but 16-byte accesses still halve the
+// instruction count there.
+int cl_profile_vector_width(const cl_profile *profile);
+
+// Whether the tiled GEMM kernels of multiply_matrix.cl fit the device with
+// these tile sizes: the work-group and the local tiles must both fit
+int cl_profile_gemm_fits(const cl_profile *profile, int ts, int tsk, int wptm, int wptn);
+
+// Default tiles for the tiled GEMM kernels: 64 x 64 tiles on 16 x 16
+// work-groups where they fit, larger register blocks where work-groups are
+// small, and 32 x 32 tiles where local memory is small or only emulated.
+void cl_profile_gemm_tiles(const cl_profile *profile, int *ts, int *tsk, int *wptm, int *wptn);
+
+void cl_profile_print(const cl_profile *profile, FILE *out);
+
+#endif
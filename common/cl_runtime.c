@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "cl_source.h"
+#include "cl_cache.h"
+#include "cl_runtime.h"
+#include "cl_trace.h"
+
+#define CL_RUNTIME_NAME_SIZE 256
+
+typedef struct cl_runtime_source_entry {
+    char name[CL_RUNTIME_NAME_SIZE];
+    const char *source;
+    size_t size;
+    uint64_t hash;
+    char *owned;  // copy of a source registered by the caller, else NULL
+    struct cl_runtime_source_entry *next;
+} cl_runtime_source_entry;
+
+typedef struct cl_runtime_kernel_entry {
+    char name[CL_RUNTIME_NAME_SIZE];
+    cl_kernel kernel;
+    struct cl_runtime_kernel_entry *next;
+} cl_runtime_kernel_entry;
+
+typedef struct cl_runtime_program_entry {
+    const cl_runtime_source_entry *source;
+    char *options;
+    cl_program program;
+    cl_runtime_kernel_entry *kernels;
+    struct cl_runtime_program_entry *next;
+} cl_runtime_program_entry;
+
+static cl_runtime cl_runtime_state;
+static int cl_runtime_ready = 0;
+static cl_runtime_source_entry *cl_runtime_sources = NULL;
+static cl_runtime_program_entry *cl_runtime_programs = NULL;
+
+static double cl_runtime_now_ms(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec * 1.0e-6;
+#endif
+}
+
+static void cl_runtime_check(cl_int error, const char *message) {
+    if (error != CL_SUCCESS) {
+        fprintf(stderr, "%s: %d\n", message, error);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// First device of the requested type over all platforms
+static int cl_runtime_find_device(cl_device_type type, cl_platform_id *platform, cl_device_id *device) {
+    cl_uint num_platforms = 0;
+    cl_platform_id platforms[16];
+    cl_int err = clGetPlatformIDs(16, platforms, &num_platforms);
+    cl_runtime_check(err, "Failed to get platform IDs");
+    for (cl_uint p = 0; p < num_platforms && p < 16; p++) {
+        cl_uint num_devices = 0;
+        if (clGetDeviceIDs(platforms[p], type, 1, device, &num_devices) == CL_SUCCESS && num_devices > 0) {
+            *platform = platforms[p];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+cl_runtime *cl_runtime_get(void) {
+    if (cl_runtime_ready) {
+        return &cl_runtime_state;
+    }
+
+    double start = cl_runtime_now_ms();
+    cl_runtime *rt = &cl_runtime_state;
+    memset(rt, 0, sizeof(*rt));
+
+    const char *requested = getenv("CL_RUNTIME_DEVICE");
+    int found;
+    if (requested && strcmp(requested, "cpu") == 0) {
+        found = cl_runtime_find_device(CL_DEVICE_TYPE_CPU, &rt->platform, &rt->device);
+    } else if (requested && strcmp(requested, "all") == 0) {
+        found = cl_runtime_find_device(CL_DEVICE_TYPE_ALL, &rt->platform, &rt->device);
+    } else {
+        found = cl_runtime_find_device(CL_DEVICE_TYPE_GPU, &rt->platform, &rt->device) ||
+                (!requested && cl_runtime_find_device(CL_DEVICE_TYPE_ALL, &rt->platform, &rt->device));
+    }
+    if (!found) {
+        cl_runtime_check(CL_DEVICE_NOT_FOUND, "Failed to get device IDs");
+    }
+
+    cl_int err;
+    rt->context = clCreateContext(NULL, 1, &rt->device, NULL, NULL, &err);
+    cl_runtime_check(err, "Failed to create context");
+    rt->queue = clCreateCommandQueue(rt->context, rt->device, CL_QUEUE_PROFILING_ENABLE, &err);
+    cl_runtime_check(err, "Failed to create command queue");
+
+    rt->init_ms = cl_runtime_now_ms() - start;
+    cl_runtime_ready = 1;
+    atexit(cl_runtime_release);
+    return rt;
+}
+
+void cl_runtime_release(void) {
+    while (cl_runtime_programs) {
+        cl_runtime_program_entry *program = cl_runtime_programs;
+        while (program->kernels) {
+            cl_runtime_kernel_entry *kernel = program->kernels;
+            program->kernels = kernel->next;
+            clReleaseKernel(kernel->kernel);
+            free(kernel);
+        }
+        clReleaseProgram(program->program);
+        free(program->options);
+        cl_runtime_programs = program->next;
+        free(program);
+    }
+    while (cl_runtime_sources) {
+        cl_runtime_source_entry *source = cl_runtime_sources;
+        cl_runtime_sources = source->next;
+        free(source->owned);
+        free(source);
+    }
+    if (cl_runtime_ready) {
+        clReleaseCommandQueue(cl_runtime_state.queue);
+        clReleaseContext(cl_runtime_state.context);
+        cl_runtime_ready = 0;
+    }
+}
+
+static cl_runtime_source_entry *cl_runtime_find_source(const char *name) {
+    for (cl_runtime_source_entry *entry = cl_runtime_sources; entry; entry = entry->next) {
+        if (strcmp(entry->name, name) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Registers source under name (copied), or the kernel file name from
+// cl_source_get() if source is NULL
+static cl_runtime_source_entry *cl_runtime_add_source(const char *name, const char *source, size_t size) {
+    if (strlen(name) >= CL_RUNTIME_NAME_SIZE) {
+        fprintf(stderr, "Kernel source name too long: %s\n", name);
+        exit(EXIT_FAILURE);
+    }
+    cl_runtime_source_entry *entry = (cl_runtime_source_entry *)malloc(sizeof(cl_runtime_source_entry));
+    strcpy(entry->name, name);
+    if (source) {
+        if (size == 0) {
+            size = strlen(source);
+        }
+        entry->owned = (char *)malloc(size + 1);
+        memcpy(entry->owned, source, size);
+        entry->owned[size] = '\0';
+        entry->source = entry->owned;
+        entry->size = size;
+        entry->hash = cl_source_hash(CL_SOURCE_HASH_SEED, source, size);
+    } else {
+        const cl_source *file = cl_source_get(name);
+        entry->owned = NULL;
+        entry->source = file->source;
+        entry->size = file->size;
+        entry->hash = file->hash;
+    }
+    entry->next = cl_runtime_sources;
+    cl_runtime_sources = entry;
+    return entry;
+}
+
+const char *cl_runtime_source(const char *name, size_t *size) {
+    cl_runtime_source_entry *entry = cl_runtime_find_source(name);
+    if (!entry) {
+        entry = cl_runtime_add_source(name, NULL, 0);
+    }
+    if (size) {
+        *size = entry->size;
+    }
+    return entry->source;
+}
+
+static cl_runtime_program_entry *cl_runtime_find_program(const char *name, const char *options) {
+    for (cl_runtime_program_entry *entry = cl_runtime_programs; entry; entry = entry->next) {
+        if (strcmp(entry->source->name, name) == 0 && strcmp(entry->options, options) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static cl_runtime_program_entry *cl_runtime_build(const char *name, const char *source, size_t source_size,
+                                                  const char *options) {
+    if (!options) {
+        options = "";
+    }
+    cl_runtime *rt = cl_runtime_get();
+    cl_runtime_program_entry *entry = cl_runtime_find_program(name, options);
+    if (entry) {
+        rt->program_hits++;
+        return entry;
+    }
+
+    cl_runtime_source_entry *text = cl_runtime_find_source(name);
+    if (!text) {
+        text = cl_runtime_add_source(name, source, source_size);
+    }
+
+    double start = cl_runtime_now_ms();
+    cl_int err;
+    int cached;
+    cl_program program = cl_cache_build(rt->context, rt->device, text->source, text->size, text->hash, options,
+                                        &err, &cached);
+    if (!program) {
+        fprintf(stderr, "Failed to create program %s: %d\n", name, err);
+        return NULL;
+    }
+    if (err != CL_SUCCESS) {
+        char build_log[4096];
+        clGetProgramBuildInfo(program, rt->device, CL_PROGRAM_BUILD_LOG, sizeof(build_log), build_log, NULL);
+        fprintf(stderr, "Error in kernel build of %s %s:\n%s\n", name, options, build_log);
+        clReleaseProgram(program);
+        return NULL;
+    }
+    rt->build_ms += cl_runtime_now_ms() - start;
+    rt->programs_built++;
+    rt->programs_cached += cached;
+
+    entry = (cl_runtime_program_entry *)malloc(sizeof(cl_runtime_program_entry));
+    entry->source = text;
+    entry->options = (char *)malloc(strlen(options) + 1);
+    strcpy(entry->options, options);
+    entry->program = program;
+    entry->kernels = NULL;
+    entry->next = cl_runtime_programs;
+    cl_runtime_programs = entry;
+    return entry;
+}
+
+cl_program cl_runtime_program(const char *name, const char *source, size_t source_size, const char *options) {
+    cl_runtime_program_entry *entry = cl_runtime_build(name, source, source_size, options);
+    return entry ? entry->program : NULL;
+}
+
+cl_kernel cl_runtime_kernel(const char *name, const char *options, const char *kernel_name) {
+    cl_runtime_program_entry *program = cl_runtime_build(name, NULL, 0, options);
+    if (!program) {
+        return NULL;
+    }
+    for (cl_runtime_kernel_entry *entry = program->kernels; entry; entry = entry->next) {
+        if (strcmp(entry->name, kernel_name) == 0) {
+            return entry->kernel;
+        }
+    }
+    if (strlen(kernel_name) >= CL_RUNTIME_NAME_SIZE) {
+        return NULL;
+    }
+
+    cl_int err;
+    cl_kernel kernel = clCreateKernel(program->program, kernel_name, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create kernel %s from %s: %d\n", kernel_name, name, err);
+        return NULL;
+    }
+    cl_runtime_kernel_entry *entry = (cl_runtime_kernel_entry *)malloc(sizeof(cl_runtime_kernel_entry));
+    strcpy(entry->name, kernel_name);
+    entry->kernel = kernel;
+    entry->next = program->kernels;
+    program->kernels = entry;
+    return kernel;
+}
+
+cl_int cl_runtime_dispatch(cl_kernel kernel, cl_uint dims, const size_t *global_size, const size_t *local_size,
+                           int num_args, const cl_runtime_arg *args, cl_event *event) {
+    for (int i = 0; i < num_args; i++) {
+        cl_int err = clSetKernelArg(kernel, i, args[i].size, args[i].value);
+        if (err != CL_SUCCESS) {
+            return err;
+        }
+    }
+    cl_command_queue queue = cl_runtime_get()->queue;
+    cl_event *traced = cl_trace_event(event);
+    cl_int err = clEnqueueNDRangeKernel(queue, kernel, dims, NULL, global_size, local_size, 0, NULL, traced);
+    if (trace_enabled()) {
+        char name[CL_RUNTIME_NAME_SIZE] = "";
+        clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, sizeof(name) - 1, name, NULL);
+        cl_trace_command(name, queue, traced, err);
+    }
+    return err;
+}
+
+double cl_runtime_event_ms(cl_event event) {
+    cl_ulong time_start = 0, time_end = 0;
+    clWaitForEvents(1, &event);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+    clReleaseEvent(event);
+    return (double)(time_end - time_start) * 1e-6;
+}
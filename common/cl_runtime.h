@@ -0,0 +1,75 @@
+#ifndef CL_RUNTIME_H
+#define CL_RUNTIME_H
+
+#include <stddef.h>
+#include <CL/cl.h>
+
+// Process-wide OpenCL runtime shared by the host programs.
+//
+// The platform, device, context and one profiling-enabled in-order queue are
+// created on the first call to cl_runtime_get() and kept until exit. Kernel
+// sources, built programs and kernel objects are registered by name the
+// first time they are asked for and returned from the registry afterwards,
+// so repeated operations only pay for setting arguments and enqueuing.
+// Programs are built through the on-disk binary cache of cl_cache.h, so
+// later runs skip the compiler too, and kernel files come from the sources
+// embedded by cl_source.h. Include cl_source.c, cl_cache.c, cl_profile.c,
+// trace.c and cl_trace.c alongside.
+//
+// Device selection: the first GPU of the first platform that has one, else
+// the first device of any type. CL_RUNTIME_DEVICE=cpu|gpu|all overrides the
+// type. Initialization failures are reported and exit, like checkError().
+//
+// Kernel objects hold their arguments, so a registered kernel must not be
+// dispatched from two threads at once.
+
+typedef struct {
+    cl_platform_id platform;
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+    double init_ms;        // time spent creating the above
+    double build_ms;       // total time spent building programs
+    int programs_built;    // including programs loaded from the binary cache
+    int programs_cached;   // of those, created from a cached binary
+    int program_hits;      // lookups answered from the registry
+} cl_runtime;
+
+cl_runtime *cl_runtime_get(void);
+
+// Releases everything; registered with atexit() by cl_runtime_get()
+void cl_runtime_release(void);
+
+// Kernel source by file name, see cl_source_get(). size may be NULL.
+const char *cl_runtime_source(const char *name, size_t *size);
+
+// Program built from the source registered as name with the given build
+// options (NULL for none). source may be NULL for the kernel file name, or
+// point at source_size bytes (0 for a NUL-terminated string) to register it
+// under name. Prints the build log and returns NULL if the build fails.
+cl_program cl_runtime_program(const char *name, const char *source, size_t source_size, const char *options);
+
+// Kernel kernel_name of program name built with options. Builds the program
+// from the kernel file name on first use. Returns NULL on failure.
+cl_kernel cl_runtime_kernel(const char *name, const char *options, const char *kernel_name);
+
+// One kernel argument: a value of size bytes, or local memory of size bytes
+// when value is NULL
+typedef struct {
+    size_t size;
+    const void *value;
+} cl_runtime_arg;
+
+#define CL_RUNTIME_ARG(x) ((cl_runtime_arg){sizeof(x), &(x)})
+#define CL_RUNTIME_LOCAL(bytes) ((cl_runtime_arg){(bytes), NULL})
+
+// Sets the arguments and enqueues on the shared queue. local may be NULL;
+// event may be NULL.
+cl_int cl_runtime_dispatch(cl_kernel kernel, cl_uint dims, const size_t *global_size, const size_t *local_size,
+                           int num_args, const cl_runtime_arg *args, cl_event *event);
+
+// Start to end of a finished command in ms, from the profiling counters;
+// releases the event
+double cl_runtime_event_ms(cl_event event);
+
+#endif
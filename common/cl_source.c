@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cl_source.h"
+#include "cl_sources.h"
+
+#define CL_SOURCE_MAX_SIZE (0x100000)
+
+typedef struct cl_source_entry {
+    cl_source source;
+    struct cl_source_entry *next;
+} cl_source_entry;
+
+// Sources read from disk, kept until exit
+static cl_source_entry *cl_source_loaded = NULL;
+
+static const cl_source *cl_source_load(const char *name, const char *dir) {
+    for (cl_source_entry *entry = cl_source_loaded; entry; entry = entry->next) {
+        if (strcmp(entry->source.name, name) == 0) {
+            return &entry->source;
+        }
+    }
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s%s%s", dir ? dir : "", dir ? "/" : "", name);
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Failed to load kernel %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    char *text = (char *)malloc(CL_SOURCE_MAX_SIZE + 1);
+    size_t size = fread(text, 1, CL_SOURCE_MAX_SIZE, file);
+    fclose(file);
+    text[size] = '\0';
+
+    cl_source_entry *entry = (cl_source_entry *)malloc(sizeof(cl_source_entry));
+    char *name_copy = (char *)malloc(strlen(name) + 1);
+    strcpy(name_copy, name);
+    entry->source.name = name_copy;
+    entry->source.source = text;
+    entry->source.size = size;
+    entry->source.hash = cl_source_hash(CL_SOURCE_HASH_SEED, text, size);
+    entry->next = cl_source_loaded;
+    cl_source_loaded = entry;
+    return &entry->source;
+}
+
+const cl_source *cl_source_get(const char *name) {
+    const char *dir = getenv("CL_SOURCE_DIR");
+    if (dir && *dir) {
+        return cl_source_load(name, dir);
+    }
+    for (size_t i = 0; i < sizeof(cl_embedded_sources) / sizeof(cl_embedded_sources[0]); i++) {
+        if (strcmp(cl_embedded_sources[i].name, name) == 0) {
+            return &cl_embedded_sources[i];
+        }
+    }
+    return cl_source_load(name, NULL);
+}
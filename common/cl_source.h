@@ -0,0 +1,46 @@
+#ifndef CL_SOURCE_H
+#define CL_SOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// OpenCL kernel sources compiled into the host programs.
+//
+// common/cl_embed.c turns every .cl file of the repo into a string constant
+// plus its hash in common/cl_sources.h (the "Embed OpenCL kernel sources"
+// task in .vscode/tasks.json runs it before each build), so programs need
+// neither file I/O nor a particular working directory to find their kernels,
+// and the binary cache key of cl_cache.h needs no hashing at startup.
+//
+// Environment:
+//   CL_SOURCE_DIR   development override: read <dir>/<name> from disk
+//                   instead, e.g. "." to try kernel edits without
+//                   regenerating the header
+//
+// A name that is not embedded (a kernel added since the header was
+// generated) is read from the working directory, like before.
+
+typedef struct {
+    const char *name;   // file name without directory, e.g. "add_matrix.cl"
+    const char *source; // NUL-terminated
+    size_t size;        // without the terminator
+    uint64_t hash;      // cl_source_hash() of the size bytes of source
+} cl_source;
+
+// FNV-1a over size bytes, continuing from hash (start with CL_SOURCE_HASH_SEED)
+#define CL_SOURCE_HASH_SEED 0xcbf29ce484222325ULL
+
+static inline uint64_t cl_source_hash(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Source of the kernel file name; loaded once per process when it comes from
+// disk. Exits if the file is neither embedded nor readable.
+const cl_source *cl_source_get(const char *name);
+
+#endif
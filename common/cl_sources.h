@@ -0,0 +1,623 @@
+// Generated by common/cl_embed.c, do not edit. Rerun the "Embed OpenCL kernel
+// sources" task after changing a kernel.
+#ifndef CL_SOURCES_H
+#define CL_SOURCES_H
+
+#include "cl_source.h"
+
+// 1. Matrix/add_matrix.cl
+static const char cl_source_add_matrix_cl[] =
+    "__kernel void add_matrix(__global const float* matrix_1,\n"
+    "                         __global const float* matrix_2,\n"
+    "                         __global float* result) {\n"
+    "    int i = get_global_id(0);\n"
+    "    int j = get_global_id(1);\n"
+    "\n"
+    "    int rows = get_global_size(0);\n"
+    "    int cols = get_global_size(1);\n"
+    "\n"
+    "    result[i * cols + j] = matrix_1[i * cols + j] + matrix_2[i * cols + j];\n"
+    "}\n"
+    "\n"
+    "// 1-D vectorized variant for any element count. Each work-item adds VW floats\n"
+    "// at a time (VW = 1, 2, 4, 8 or 16, set at build time with -DVW=...; by\n"
+    "// default the width of the device profile) and walks the array with a\n"
+    "// grid-stride loop, so the launch size can be chosen for the device instead\n"
+    "// of the matrix shape.\n"
+    "#ifndef VW\n"
+    "#ifdef DEV_VECTOR_WIDTH\n"
+    "#define VW DEV_VECTOR_WIDTH\n"
+    "#else\n"
+    "#define VW 4\n"
+    "#endif\n"
+    "#endif\n"
+    "\n"
+    "#define CAT_(a, b) a##b\n"
+    "#define CAT(a, b) CAT_(a, b)\n"
+    "#if VW == 1\n"
+    "#define VLOAD(i, p) ((p)[i])\n"
+    "#define VSTORE(v, i, p) ((p)[i] = (v))\n"
+    "#else\n"
+    "#define VLOAD(i, p) CAT(vload, VW)(i, p)\n"
+    "#define VSTORE(v, i, p) CAT(vstore, VW)(v, i, p)\n"
+    "#endif\n"
+    "\n"
+    "__kernel void add_matrix_vec(__global const float* matrix_1,\n"
+    "                             __global const float* matrix_2,\n"
+    "                             __global float* result,\n"
+    "                             const int num_elements) {\n"
+    "    const int stride = get_global_size(0);\n"
+    "    const int num_vectors = num_elements / VW;\n"
+    "\n"
+    "    for (int i = get_global_id(0); i < num_vectors; i += stride) {\n"
+    "        VSTORE(VLOAD(i, matrix_1) + VLOAD(i, matrix_2), i, result);\n"
+    "    }\n"
+    "\n"
+    "    // Fewer than VW elements are left over at the end\n"
+    "    for (int i = num_vectors * VW + get_global_id(0); i < num_elements; i += stride) {\n"
+    "        result[i] = matrix_1[i] + matrix_2[i];\n"
+    "    }\n"
+    "}\n"
+    ;
+
+// 1. Matrix/multiply_matrix.cl
+static const char cl_source_multiply_matrix_cl[] =
+    "__kernel void multiply_matrix(const int M, const int N, const int K,\n"
+    "                              __global float* A, __global float* B, __global float* C) {\n"
+    "    int row = get_global_id(0);\n"
+    "    int col = get_global_id(1);\n"
+    "\n"
+    "    if (row < M && col < K) {\n"
+    "        float sum = 0.0;\n"
+    "        for (int i = 0; i < N; ++i) {\n"
+    "            sum += A[row * N + i] * B[i * K + col];\n"
+    "        }\n"
+    "        C[row * K + col] = sum;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "\n"
+    "// Tiled variant. Each work-group computes a TSM x TSN block of C, staging\n"
+    "// TSM x TSK tiles of A and TSK x TSN tiles of B in local memory, and each\n"
+    "// work-item keeps a WPTM x WPTN block of C in registers. Tile sizes are set\n"
+    "// at build time with -D; edges are zero-padded so M, N and K can be anything.\n"
+    "//\n"
+    "// Launch with local size {TSN / WPTN, TSM / WPTM} and a global size rounded up\n"
+    "// to {ceil(K / TSN) * TSN / WPTN, ceil(M / TSM) * TSM / WPTM}. Dimension 0 runs\n"
+    "// along the columns of C so neighbouring work-items touch neighbouring addresses.\n"
+    "//\n"
+    "// A and B may be stored in reduced precision, selected with one of\n"
+    "//   -DSTORAGE_HALF  fp16 (half), widened with vload_half, fp32 accumulation\n"
+    "//   -DSTORAGE_BF16  bfloat16 (ushort, upper half of an fp32), fp32 accumulation\n"
+    "//   -DSTORAGE_INT8  int8 (char), int32 accumulation; the kernel then takes two\n"
+    "//                   more arguments, row_scales (M) and col_scales (K), and\n"
+    "//                   writes C = acc * row_scales[row] * col_scales[col]\n"
+    "// C is always fp32. Without a STORAGE define A and B are fp32.\n"
+    "//\n"
+    "// Tile sizes left out fall back on the tiles cl_profile_gemm_tiles() picks\n"
+    "// for the device, passed in as DEV_GEMM_* with the rest of the profile (see\n"
+    "// common/cl_profile.h), so they fit its local memory and work-group limits.\n"
+    "// Without the profile the defaults are 64 x 64 x 16 tiles with 4 x 4 per\n"
+    "// work-item. The A tile is padded by one column against bank conflicts only\n"
+    "// where local memory is real.\n"
+    "#ifdef DEV_GEMM_TS\n"
+    "#define TS_DEFAULT DEV_GEMM_TS\n"
+    "#define TSK_DEFAULT DEV_GEMM_TSK\n"
+    "#define WPTM_DEFAULT DEV_GEMM_WPTM\n"
+    "#define WPTN_DEFAULT DEV_GEMM_WPTN\n"
+    "#else\n"
+    "#define TS_DEFAULT 64\n"
+    "#define TSK_DEFAULT 16\n"
+    "#define WPTM_DEFAULT 4\n"
+    "#define WPTN_DEFAULT 4\n"
+    "#endif\n"
+    "#if defined(DEV_LOCAL_MEM_DEDICATED) && !DEV_LOCAL_MEM_DEDICATED\n"
+    "#define LOCAL_PAD 0\n"
+    "#else\n"
+    "#define LOCAL_PAD 1\n"
+    "#endif\n"
+    "#ifndef TSM\n"
+    "#define TSM TS_DEFAULT\n"
+    "#endif\n"
+    "#ifndef TSN\n"
+    "#define TSN TS_DEFAULT\n"
+    "#endif\n"
+    "#ifndef TSK\n"
+    "#define TSK TSK_DEFAULT\n"
+    "#endif\n"
+    "#ifndef WPTM\n"
+    "#define WPTM WPTM_DEFAULT\n"
+    "#endif\n"
+    "#ifndef WPTN\n"
+    "#define WPTN WPTN_DEFAULT\n"
+    "#endif\n"
+    "#define RTSM (TSM / WPTM)\n"
+    "#define RTSN (TSN / WPTN)\n"
+    "\n"
+    "#if defined(STORAGE_HALF)\n"
+    "typedef half storage_t;\n"
+    "typedef float acc_t;\n"
+    "#define LOAD_STORAGE(p, i) vload_half(i, p)\n"
+    "#define MAD(a, b, c) mad(a, b, c)\n"
+    "#elif defined(STORAGE_BF16)\n"
+    "typedef ushort storage_t;\n"
+    "typedef float acc_t;\n"
+    "#define LOAD_STORAGE(p, i) as_float((uint)(p)[i] << 16)\n"
+    "#define MAD(a, b, c) mad(a, b, c)\n"
+    "#elif defined(STORAGE_INT8)\n"
+    "typedef char storage_t;\n"
+    "typedef int acc_t;\n"
+    "#define LOAD_STORAGE(p, i) ((int)(p)[i])\n"
+    "#define MAD(a, b, c) mad24(a, b, c) // |a|, |b| <= 127 fit the 24-bit multiplier\n"
+    "#else\n"
+    "typedef float storage_t;\n"
+    "typedef float acc_t;\n"
+    "#define LOAD_STORAGE(p, i) (p)[i]\n"
+    "#define MAD(a, b, c) mad(a, b, c)\n"
+    "#endif\n"
+    "\n"
+    "__kernel __attribute__((reqd_work_group_size(RTSN, RTSM, 1)))\n"
+    "void multiply_matrix_tiled(const int M, const int N, const int K,\n"
+    "                           __global const storage_t* A, __global const storage_t* B, __global float* C\n"
+    "#ifdef STORAGE_INT8\n"
+    "                           , __global const float* row_scales, __global const float* col_scales\n"
+    "#endif\n"
+    "                           ) {\n"
+    "    const int tidn = get_local_id(0);\n"
+    "    const int tidm = get_local_id(1);\n"
+    "    const int tid = tidm * RTSN + tidn;\n"
+    "    const int offsetN = get_group_id(0) * TSN;\n"
+    "    const int offsetM = get_group_id(1) * TSM;\n"
+    "\n"
+    "    // +1 padding keeps the transposed A stores free of bank conflicts\n"
+    "    __local acc_t Asub[TSK][TSM + LOCAL_PAD];\n"
+    "    __local acc_t Bsub[TSK][TSN];\n"
+    "\n"
+    "    acc_t acc[WPTM][WPTN];\n"
+    "    #pragma unroll\n"
+    "    for (int wm = 0; wm < WPTM; wm++) {\n"
+    "        #pragma unroll\n"
+    "        for (int wn = 0; wn < WPTN; wn++) {\n"
+    "            acc[wm][wn] = 0;\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    const int numTiles = (N + TSK - 1) / TSK;\n"
+    "    for (int t = 0; t < numTiles; t++) {\n"
+    "        const int tiledN = t * TSK;\n"
+    "\n"
+    "        // Cooperative loads, consecutive work-items read consecutive addresses\n"
+    "        for (int l = tid; l < TSM * TSK; l += RTSM * RTSN) {\n"
+    "            int r = l / TSK;\n"
+    "            int k = l % TSK;\n"
+    "            int row = offsetM + r;\n"
+    "            int inner = tiledN + k;\n"
+    "            Asub[k][r] = (row < M && inner < N) \? LOAD_STORAGE(A, row * N + inner) : 0;\n"
+    "        }\n"
+    "        for (int l = tid; l < TSK * TSN; l += RTSM * RTSN) {\n"
+    "            int k = l / TSN;\n"
+    "            int c = l % TSN;\n"
+    "            int inner = tiledN + k;\n"
+    "            int col = offsetN + c;\n"
+    "            Bsub[k][c] = (inner < N && col < K) \? LOAD_STORAGE(B, inner * K + col) : 0;\n"
+    "        }\n"
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\n"
+    "        #pragma unroll\n"
+    "        for (int k = 0; k < TSK; k++) {\n"
+    "            acc_t Breg[WPTN];\n"
+    "            #pragma unroll\n"
+    "            for (int wn = 0; wn < WPTN; wn++) {\n"
+    "                Breg[wn] = Bsub[k][tidn + wn * RTSN];\n"
+    "            }\n"
+    "            #pragma unroll\n"
+    "            for (int wm = 0; wm < WPTM; wm++) {\n"
+    "                acc_t Areg = Asub[k][tidm + wm * RTSM];\n"
+    "                #pragma unroll\n"
+    "                for (int wn = 0; wn < WPTN; wn++) {\n"
+    "                    acc[wm][wn] = MAD(Areg, Breg[wn], acc[wm][wn]);\n"
+    "                }\n"
+    "            }\n"
+    "        }\n"
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "    }\n"
+    "\n"
+    "    #pragma unroll\n"
+    "    for (int wm = 0; wm < WPTM; wm++) {\n"
+    "        int row = offsetM + tidm + wm * RTSM;\n"
+    "        #pragma unroll\n"
+    "        for (int wn = 0; wn < WPTN; wn++) {\n"
+    "            int col = offsetN + tidn + wn * RTSN;\n"
+    "            if (row < M && col < K) {\n"
+    "#ifdef STORAGE_INT8\n"
+    "                C[row * K + col] = (float)acc[wm][wn] * row_scales[row] * col_scales[col];\n"
+    "#else\n"
+    "                C[row * K + col] = acc[wm][wn];\n"
+    "#endif\n"
+    "            }\n"
+    "        }\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "\n"
+    "// BLAS-style variant: C = alpha * op(A) * op(B) + beta * C, row-major, with\n"
+    "// op(A) M x K, op(B) K x N and C M x N. Unlike the kernels above this one uses\n"
+    "// the BLAS names for the dimensions. transA/transB select op(X) = X^T, and\n"
+    "// every operand is addressed as X[offset + row * ldX + col] with the row and\n"
+    "// column of the array as stored, so transposed operands and sub-blocks of\n"
+    "// larger matrices are read in place. beta == 0 writes C without reading it.\n"
+    "//\n"
+    "// Same tiling and launch shape as multiply_matrix_tiled, with the M x N of\n"
+    "// C: local size {TSN / WPTN, TSM / WPTM}, global size rounded up to\n"
+    "// {ceil(N / TSN) * TSN / WPTN, ceil(M / TSM) * TSM / WPTM}. Always fp32.\n"
+    "__kernel __attribute__((reqd_work_group_size(RTSN, RTSM, 1)))\n"
+    "void sgemm_tiled(const int transA, const int transB, const int M, const int N, const int K,\n"
+    "                 const float alpha, __global const float* A, const int offset_a, const int lda,\n"
+    "                 __global const float* B, const int offset_b, const int ldb,\n"
+    "                 const float beta, __global float* C, const int offset_c, const int ldc) {\n"
+    "    const int tidn = get_local_id(0);\n"
+    "    const int tidm = get_local_id(1);\n"
+    "    const int tid = tidm * RTSN + tidn;\n"
+    "    const int offsetN = get_group_id(0) * TSN;\n"
+    "    const int offsetM = get_group_id(1) * TSM;\n"
+    "\n"
+    "    __local float Asub[TSK][TSM + LOCAL_PAD];\n"
+    "    __local float Bsub[TSK][TSN];\n"
+    "\n"
+    "    float acc[WPTM][WPTN];\n"
+    "    #pragma unroll\n"
+    "    for (int wm = 0; wm < WPTM; wm++) {\n"
+    "        #pragma unroll\n"
+    "        for (int wn = 0; wn < WPTN; wn++) {\n"
+    "            acc[wm][wn] = 0.0f;\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    A += offset_a;\n"
+    "    B += offset_b;\n"
+    "    const int numTiles = (K + TSK - 1) / TSK;\n"
+    "    for (int t = 0; t < numTiles; t++) {\n"
+    "        const int tiledK = t * TSK;\n"
+    "\n"
+    "        // Consecutive work-items take consecutive addresses of the array as\n"
+    "        // stored, which runs along k for A and along n for B unless transposed\n"
+    "        for (int l = tid; l < TSM * TSK; l += RTSM * RTSN) {\n"
+    "            const int r = transA \? l % TSM : l / TSK;\n"
+    "            const int k = transA \? l / TSM : l % TSK;\n"
+    "            const int row = offsetM + r;\n"
+    "            const int inner = tiledK + k;\n"
+    "            float value = 0.0f;\n"
+    "            if (row < M && inner < K) {\n"
+    "                value = transA \? A[inner * lda + row] : A[row * lda + inner];\n"
+    "            }\n"
+    "            Asub[k][r] = value;\n"
+    "        }\n"
+    "        for (int l = tid; l < TSK * TSN; l += RTSM * RTSN) {\n"
+    "            const int k = transB \? l % TSK : l / TSN;\n"
+    "            const int c = transB \? l / TSK : l % TSN;\n"
+    "            const int inner = tiledK + k;\n"
+    "            const int col = offsetN + c;\n"
+    "            float value = 0.0f;\n"
+    "            if (inner < K && col < N) {\n"
+    "                value = transB \? B[col * ldb + inner] : B[inner * ldb + col];\n"
+    "            }\n"
+    "            Bsub[k][c] = value;\n"
+    "        }\n"
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\n"
+    "        #pragma unroll\n"
+    "        for (int k = 0; k < TSK; k++) {\n"
+    "            float Breg[WPTN];\n"
+    "            #pragma unroll\n"
+    "            for (int wn = 0; wn < WPTN; wn++) {\n"
+    "                Breg[wn] = Bsub[k][tidn + wn * RTSN];\n"
+    "            }\n"
+    "            #pragma unroll\n"
+    "            for (int wm = 0; wm < WPTM; wm++) {\n"
+    "                float Areg = Asub[k][tidm + wm * RTSM];\n"
+    "                #pragma unroll\n"
+    "                for (int wn = 0; wn < WPTN; wn++) {\n"
+    "                    acc[wm][wn] = mad(Areg, Breg[wn], acc[wm][wn]);\n"
+    "                }\n"
+    "            }\n"
+    "        }\n"
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "    }\n"
+    "\n"
+    "    C += offset_c;\n"
+    "    #pragma unroll\n"
+    "    for (int wm = 0; wm < WPTM; wm++) {\n"
+    "        int row = offsetM + tidm + wm * RTSM;\n"
+    "        #pragma unroll\n"
+    "        for (int wn = 0; wn < WPTN; wn++) {\n"
+    "            int col = offsetN + tidn + wn * RTSN;\n"
+    "            if (row < M && col < N) {\n"
+    "                float result = alpha * acc[wm][wn];\n"
+    "                if (beta != 0.0f) {\n"
+    "                    result = mad(beta, C[row * ldc + col], result);\n"
+    "                }\n"
+    "                C[row * ldc + col] = result;\n"
+    "            }\n"
+    "        }\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// Batched variant for many small products of the same shape, all in one\n"
+    "// launch: C[b] (M x K) = A[b] (M x N) * B[b] (N x K) for b < batch.\n"
+    "//\n"
+    "// Each work-group takes per_group consecutive products, copies their A and B\n"
+    "// into local memory (scratch holds per_group * (M * N + N * K) floats) and its\n"
+    "// work-items walk over all C entries of the group, so several tiny products\n"
+    "// share one work-group and a large one still keeps every work-item busy.\n"
+    "// Launch 1-D with ceil(batch / per_group) work-groups of any size.\n"
+    "//\n"
+    "// Matrix b starts at b * stride_a/b/c floats, or, when offsets is not NULL,\n"
+    "// at offsets[3 * b + 0/1/2], which allows arbitrary pointer-array batches\n"
+    "// inside the three buffers.\n"
+    "__kernel void multiply_matrix_batched(const int M, const int N, const int K,\n"
+    "                                      const int batch, const int per_group,\n"
+    "                                      __global const float* A, const int stride_a,\n"
+    "                                      __global const float* B, const int stride_b,\n"
+    "                                      __global float* C, const int stride_c,\n"
+    "                                      __global const int* offsets,\n"
+    "                                      __local float* scratch) {\n"
+    "    const int first = get_group_id(0) * per_group;\n"
+    "    const int count = min(per_group, batch - first);\n"
+    "    const int lid = get_local_id(0);\n"
+    "    const int ls = get_local_size(0);\n"
+    "    const int size_a = M * N;\n"
+    "    const int size_b = N * K;\n"
+    "    const int size_c = M * K;\n"
+    "    __local float* As = scratch;\n"
+    "    __local float* Bs = scratch + per_group * size_a;\n"
+    "\n"
+    "    for (int e = lid; e < count * size_a; e += ls) {\n"
+    "        const int b = first + e / size_a;\n"
+    "        const long base = offsets \? offsets[3 * b] : (long)b * stride_a;\n"
+    "        As[e] = A[base + e % size_a];\n"
+    "    }\n"
+    "    for (int e = lid; e < count * size_b; e += ls) {\n"
+    "        const int b = first + e / size_b;\n"
+    "        const long base = offsets \? offsets[3 * b + 1] : (long)b * stride_b;\n"
+    "        Bs[e] = B[base + e % size_b];\n"
+    "    }\n"
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\n"
+    "    for (int e = lid; e < count * size_c; e += ls) {\n"
+    "        const int m = e / size_c;\n"
+    "        const int row = (e % size_c) / K;\n"
+    "        const int col = e % K;\n"
+    "        __local const float* a = As + m * size_a + row * N;\n"
+    "        __local const float* b = Bs + m * size_b + col;\n"
+    "        float sum = 0.0f;\n"
+    "        for (int i = 0; i < N; i++) {\n"
+    "            sum += a[i] * b[i * K];\n"
+    "        }\n"
+    "        const int g = first + m;\n"
+    "        const long base = offsets \? offsets[3 * g + 2] : (long)g * stride_c;\n"
+    "        C[base + row * K + col] = sum;\n"
+    "    }\n"
+    "}\n"
+    ;
+
+// 1. Matrix/sparse_matrix.cl
+static const char cl_source_sparse_matrix_cl[] =
+    "// Sparse matrix-vector (SpMV, y = A * x) and matrix-matrix (SpMM, Y = A * X)\n"
+    "// products for the layouts of sparse.h. X and Y are row-major with N columns.\n"
+    "\n"
+    "// CSR, one work-item per row. rows lists the rows to compute (the short ones\n"
+    "// from csr_bin_rows), so a run over a row list never meets a long row.\n"
+    "__kernel void spmv_csr_scalar(const int num_rows, __global const int* rows,\n"
+    "                              __global const int* row_ptr, __global const int* col_idx,\n"
+    "                              __global const float* values, __global const float* x,\n"
+    "                              __global float* y) {\n"
+    "    const int r = get_global_id(0);\n"
+    "    if (r < num_rows) {\n"
+    "        const int row = rows[r];\n"
+    "        float sum = 0.0f;\n"
+    "        for (int k = row_ptr[row]; k < row_ptr[row + 1]; k++) {\n"
+    "            sum = mad(values[k], x[col_idx[k]], sum);\n"
+    "        }\n"
+    "        y[row] = sum;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// CSR, one work-group per row for the long ones. The work-items stride over\n"
+    "// the row together, so the reads of values and col_idx are coalesced, and\n"
+    "// combine their partial sums in local memory (partial holds one float per\n"
+    "// work-item; the local size must be a power of two).\n"
+    "__kernel void spmv_csr_vector(const int num_rows, __global const int* rows,\n"
+    "                              __global const int* row_ptr, __global const int* col_idx,\n"
+    "                              __global const float* values, __global const float* x,\n"
+    "                              __global float* y, __local float* partial) {\n"
+    "    const int r = get_group_id(0);\n"
+    "    const int lid = get_local_id(0);\n"
+    "    const int ls = get_local_size(0);\n"
+    "    if (r >= num_rows) {\n"
+    "        return;\n"
+    "    }\n"
+    "    const int row = rows[r];\n"
+    "    float sum = 0.0f;\n"
+    "    for (int k = row_ptr[row] + lid; k < row_ptr[row + 1]; k += ls) {\n"
+    "        sum = mad(values[k], x[col_idx[k]], sum);\n"
+    "    }\n"
+    "    partial[lid] = sum;\n"
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "    for (int offset = ls / 2; offset > 0; offset /= 2) {\n"
+    "        if (lid < offset) {\n"
+    "            partial[lid] += partial[lid + offset];\n"
+    "        }\n"
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "    }\n"
+    "    if (lid == 0) {\n"
+    "        y[row] = partial[0];\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// ELLPACK, one work-item per row. Column-major storage makes the reads of\n"
+    "// neighbouring work-items adjacent; padding entries are zero.\n"
+    "__kernel void spmv_ell(const int num_rows, const int width,\n"
+    "                       __global const int* col_idx, __global const float* values,\n"
+    "                       __global const float* x, __global float* y) {\n"
+    "    const int row = get_global_id(0);\n"
+    "    if (row < num_rows) {\n"
+    "        float sum = 0.0f;\n"
+    "        for (int j = 0; j < width; j++) {\n"
+    "            const int slot = j * num_rows + row;\n"
+    "            sum = mad(values[slot], x[col_idx[slot]], sum);\n"
+    "        }\n"
+    "        y[row] = sum;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// SELL-C-sigma, one work-group of C work-items per slice, each work-item one\n"
+    "// row. Work-groups only run as long as their own slice, and rows sorted by\n"
+    "// length keep the work-items of a slice busy for about the same time.\n"
+    "__kernel void spmv_sell(const int num_rows, const int C,\n"
+    "                        __global const int* slice_ptr, __global const int* slice_width,\n"
+    "                        __global const int* perm, __global const int* col_idx,\n"
+    "                        __global const float* values, __global const float* x,\n"
+    "                        __global float* y) {\n"
+    "    const int s = get_group_id(0);\n"
+    "    const int lane = get_local_id(0);\n"
+    "    const int p = s * C + lane;\n"
+    "    if (lane >= C || p >= num_rows) {\n"
+    "        return;\n"
+    "    }\n"
+    "    float sum = 0.0f;\n"
+    "    const int width = slice_width[s];\n"
+    "    for (int j = 0, slot = slice_ptr[s] + lane; j < width; j++, slot += C) {\n"
+    "        sum = mad(values[slot], x[col_idx[slot]], sum);\n"
+    "    }\n"
+    "    y[perm[p]] = sum;\n"
+    "}\n"
+    "\n"
+    "// CSR SpMM, work-item (j, r) computes Y[rows[r]][j]. The work-items of a row\n"
+    "// read the same nonzeros and adjacent entries of X.\n"
+    "__kernel void spmm_csr(const int num_rows, const int N, __global const int* rows,\n"
+    "                       __global const int* row_ptr, __global const int* col_idx,\n"
+    "                       __global const float* values, __global const float* X,\n"
+    "                       __global float* Y) {\n"
+    "    const int j = get_global_id(0);\n"
+    "    const int r = get_global_id(1);\n"
+    "    if (j < N && r < num_rows) {\n"
+    "        const int row = rows[r];\n"
+    "        float sum = 0.0f;\n"
+    "        for (int k = row_ptr[row]; k < row_ptr[row + 1]; k++) {\n"
+    "            sum = mad(values[k], X[col_idx[k] * N + j], sum);\n"
+    "        }\n"
+    "        Y[row * N + j] = sum;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// SELL-C-sigma SpMM, work-item (j, p) computes column j of the row stored at\n"
+    "// position p, with p running over the sorted order so neighbouring rows of a\n"
+    "// launch have similar lengths.\n"
+    "__kernel void spmm_sell(const int num_rows, const int N, const int C,\n"
+    "                        __global const int* slice_ptr, __global const int* slice_width,\n"
+    "                        __global const int* perm, __global const int* col_idx,\n"
+    "                        __global const float* values, __global const float* X,\n"
+    "                        __global float* Y) {\n"
+    "    const int j = get_global_id(0);\n"
+    "    const int p = get_global_id(1);\n"
+    "    if (j >= N || p >= num_rows) {\n"
+    "        return;\n"
+    "    }\n"
+    "    const int s = p / C;\n"
+    "    const int lane = p % C;\n"
+    "    const int width = slice_width[s];\n"
+    "    float sum = 0.0f;\n"
+    "    for (int k = 0, slot = slice_ptr[s] + lane; k < width; k++, slot += C) {\n"
+    "        sum = mad(values[slot], X[col_idx[slot] * N + j], sum);\n"
+    "    }\n"
+    "    Y[perm[p] * N + j] = sum;\n"
+    "}\n"
+    ;
+
+// 2. Image/kernels.cl
+static const char cl_source_kernels_cl[] =
+    "//kernels.cl\n"
+    "// The global size may be rounded up to a multiple of the work-group size,\n"
+    "// so every kernel ignores work-items outside the image.\n"
+    "__kernel void resize_image(__read_only image2d_t srcImg, __write_only image2d_t dstImg, sampler_t sampler) {\n"
+    "    int2 coord = (int2)(get_global_id(0), get_global_id(1));\n"
+    "    if (coord.x >= get_image_width(dstImg) || coord.y >= get_image_height(dstImg)) {\n"
+    "        return;\n"
+    "    }\n"
+    "    float2 coordSrc = (float2)(coord.x * 4, coord.y * 4);\n"
+    "    uint4 pixel = read_imageui(srcImg, sampler, coordSrc);\n"
+    "    write_imageui(dstImg, coord, pixel);\n"
+    "}\n"
+    "\n"
+    "__kernel void grayscale_image(__global const uchar4* input, __global uchar* output, const int width, const int height) {\n"
+    "    int x = get_global_id(0);\n"
+    "    int y = get_global_id(1);\n"
+    "    if (x >= width || y >= height) {\n"
+    "        return;\n"
+    "    }\n"
+    "    int i = y * width + x;\n"
+    "    uchar4 pixel = input[i];\n"
+    "    output[i] = (uchar)(0.2126f * pixel.x + 0.7152f * pixel.y + 0.0722f * pixel.z);\n"
+    "}\n"
+    "\n"
+    "// 5 x 5 box filter. tile is local memory of (local width + 4) x (local height\n"
+    "// + 4) bytes. Where local memory is real (DEV_LOCAL_MEM_DEDICATED from the\n"
+    "// device profile) each work-group stages its pixels plus the 2-pixel border\n"
+    "// there once instead of reading every pixel 25 times from global memory; the\n"
+    "// global size must then be a multiple of the work-group size, which it is.\n"
+    "// Elsewhere (CPU devices) the caches do that job and tile is unused.\n"
+    "#if DEV_LOCAL_MEM_DEDICATED\n"
+    "__kernel void apply_filter(__global const uchar* input, __global uchar* output, const int width, const int height,\n"
+    "                           __local uchar* tile) {\n"
+    "    const int x = get_global_id(0);\n"
+    "    const int y = get_global_id(1);\n"
+    "    const int lx = get_local_id(0);\n"
+    "    const int ly = get_local_id(1);\n"
+    "    const int tile_width = get_local_size(0) + 4;\n"
+    "    const int tile_height = get_local_size(1) + 4;\n"
+    "    const int x0 = get_group_id(0) * get_local_size(0) - 2;\n"
+    "    const int y0 = get_group_id(1) * get_local_size(1) - 2;\n"
+    "\n"
+    "    for (int i = ly * get_local_size(0) + lx; i < tile_width * tile_height; i += get_local_size(0) * get_local_size(1)) {\n"
+    "        int tx = x0 + i % tile_width;\n"
+    "        int ty = y0 + i / tile_width;\n"
+    "        tile[i] = (tx >= 0 && ty >= 0 && tx < width && ty < height) \? input[ty * width + tx] : 0;\n"
+    "    }\n"
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\n"
+    "    if (x >= 2 && y >= 2 && x < (width - 2) && y < (height - 2)) {\n"
+    "        uint sum = 0;\n"
+    "        for (int dy = 0; dy < 5; dy++) {\n"
+    "            for (int dx = 0; dx < 5; dx++) {\n"
+    "                sum += tile[(ly + dy) * tile_width + lx + dx];\n"
+    "            }\n"
+    "        }\n"
+    "        output[y * width + x] = sum / 25;\n"
+    "    }\n"
+    "}\n"
+    "#else\n"
+    "__kernel void apply_filter(__global const uchar* input, __global uchar* output, const int width, const int height,\n"
+    "                           __local uchar* tile) {\n"
+    "    int x = get_global_id(0);\n"
+    "    int y = get_global_id(1);\n"
+    "    if (x >= 2 && y >= 2 && x < (width - 2) && y < (height - 2)) {\n"
+    "        uint sum = 0;\n"
+    "        for (int dy = -2; dy <= 2; dy++) {\n"
+    "            for (int dx = -2; dx <= 2; dx++) {\n"
+    "                sum += input[(y + dy) * width + (x + dx)];\n"
+    "            }\n"
+    "        }\n"
+    "        output[y * width + x] = sum / 25;\n"
+    "    }\n"
+    "}\n"
+    "#endif\n"
+    ;
+
+static const cl_source cl_embedded_sources[] = {
+    {"add_matrix.cl", cl_source_add_matrix_cl, 1694, 0xe6e3fb94a69490faULL},
+    {"multiply_matrix.cl", cl_source_multiply_matrix_cl, 12631, 0xda25303dc283e482ULL},
+    {"sparse_matrix.cl", cl_source_sparse_matrix_cl, 5449, 0x681d9c92b0183328ULL},
+    {"kernels.cl", cl_source_kernels_cl, 3180, 0x43103e47c2b0c447ULL},
+};
+
+#endif
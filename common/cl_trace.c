@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cl_trace.h"
+
+#define CL_TRACE_MAX_QUEUES 32
+#define CL_TRACE_NAME_SIZE 64
+
+typedef struct {
+    char name[CL_TRACE_NAME_SIZE];
+    int queue;          // index into cl_trace_queues
+    cl_event event;     // retained
+    double host_us;     // trace clock right after the enqueue returned
+} cl_trace_entry;
+
+// Queues are retained until the trace is written, so a program may release
+// its own handles first
+typedef struct {
+    cl_command_queue queue;
+    double host_us;     // of the first command, to align the device clock
+    cl_ulong queued_ns;
+    int aligned;
+} cl_trace_queue;
+
+static cl_trace_entry *cl_trace_entries = NULL;
+static int cl_trace_count = 0, cl_trace_capacity = 0;
+static cl_trace_queue cl_trace_queues[CL_TRACE_MAX_QUEUES];
+static int cl_trace_num_queues = 0;
+static cl_event cl_trace_owned = NULL;
+
+static void cl_trace_flush(void);
+
+cl_event *cl_trace_event(cl_event *event) {
+    if (event || !trace_enabled()) {
+        return event;
+    }
+    cl_trace_owned = NULL;
+    return &cl_trace_owned;
+}
+
+// Index of queue, registering it and its track names on first sight
+static int cl_trace_queue_index(cl_command_queue queue) {
+    for (int i = 0; i < cl_trace_num_queues; i++) {
+        if (cl_trace_queues[i].queue == queue) return i;
+    }
+    if (cl_trace_num_queues == CL_TRACE_MAX_QUEUES) {
+        return -1;
+    }
+    if (cl_trace_num_queues == 0) {
+        trace_name_track(TRACE_PID_DEVICE, 0, "OpenCL");
+        trace_on_write(cl_trace_flush);
+    }
+    int index = cl_trace_num_queues++;
+    clRetainCommandQueue(queue);
+    cl_trace_queues[index].queue = queue;
+    cl_trace_queues[index].aligned = 0;
+
+    cl_device_id device = NULL;
+    char device_name[128] = "", track[192];
+    clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL);
+    if (device) clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(device_name) - 1, device_name, NULL);
+    snprintf(track, sizeof(track), "queue %d: %s", index, device_name);
+    trace_name_track(TRACE_PID_DEVICE, 2 * index + 1, track);
+    snprintf(track, sizeof(track), "queue %d: waiting", index);
+    trace_name_track(TRACE_PID_DEVICE, 2 * index + 2, track);
+    return index;
+}
+
+void cl_trace_command(const char *name, cl_command_queue queue, cl_event *event, cl_int err) {
+    int owned = event == &cl_trace_owned;
+    if (!event || !*event || !trace_enabled()) {
+        return;
+    }
+    cl_event handle = *event;
+    if (owned) {
+        cl_trace_owned = NULL;
+    }
+    int index = err == CL_SUCCESS ? cl_trace_queue_index(queue) : -1;
+    if (index < 0) {
+        if (owned) clReleaseEvent(handle);
+        return;
+    }
+    if (cl_trace_count == cl_trace_capacity) {
+        int capacity = cl_trace_capacity ? 2 * cl_trace_capacity : 256;
+        cl_trace_entry *entries = (cl_trace_entry *)realloc(cl_trace_entries, (size_t)capacity * sizeof(*entries));
+        if (!entries) {
+            if (owned) clReleaseEvent(handle);
+            return;
+        }
+        cl_trace_entries = entries;
+        cl_trace_capacity = capacity;
+    }
+    if (!owned) {
+        clRetainEvent(handle);
+    }
+    cl_trace_entry *entry = &cl_trace_entries[cl_trace_count++];
+    snprintf(entry->name, sizeof(entry->name), "%s", name);
+    entry->queue = index;
+    entry->event = handle;
+    entry->host_us = trace_now_us();
+}
+
+static void cl_trace_flush(void) {
+    for (int i = 0; i < cl_trace_count; i++) {
+        cl_trace_entry *entry = &cl_trace_entries[i];
+        cl_ulong times[4] = {0, 0, 0, 0};
+        static const cl_profiling_info counters[4] = {
+            CL_PROFILING_COMMAND_QUEUED, CL_PROFILING_COMMAND_SUBMIT,
+            CL_PROFILING_COMMAND_START, CL_PROFILING_COMMAND_END,
+        };
+        cl_int err = clWaitForEvents(1, &entry->event);
+        for (int c = 0; c < 4 && err == CL_SUCCESS; c++) {
+            err = clGetEventProfilingInfo(entry->event, counters[c], sizeof(cl_ulong), &times[c], NULL);
+        }
+        clReleaseEvent(entry->event);
+        if (err != CL_SUCCESS || times[3] < times[2] || times[2] < times[0]) {
+            continue;
+        }
+
+        // The host enqueue and QUEUED are the same moment on two clocks
+        cl_trace_queue *queue = &cl_trace_queues[entry->queue];
+        if (!queue->aligned) {
+            queue->host_us = entry->host_us;
+            queue->queued_ns = times[0];
+            queue->aligned = 1;
+        }
+        double offset = queue->host_us - (double)queue->queued_ns * 1e-3;
+        double queued = (double)times[0] * 1e-3 + offset;
+        double start = (double)times[2] * 1e-3 + offset;
+        char args[160];
+        snprintf(args, sizeof(args), "\"queued_us\": %.3f, \"submit_us\": %.3f, \"queue_latency_us\": %.3f",
+                 queued, (double)times[1] * 1e-3 + offset, start - queued);
+        trace_complete(entry->name, "device", TRACE_PID_DEVICE, 2 * entry->queue + 1, start,
+                       (double)(times[3] - times[2]) * 1e-3, args);
+        trace_complete(entry->name, "wait", TRACE_PID_DEVICE, 2 * entry->queue + 2, queued, start - queued, NULL);
+    }
+    free(cl_trace_entries);
+    cl_trace_entries = NULL;
+    cl_trace_count = cl_trace_capacity = 0;
+    for (int i = 0; i < cl_trace_num_queues; i++) {
+        clReleaseCommandQueue(cl_trace_queues[i].queue);
+    }
+    cl_trace_num_queues = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef CL_TRACE_H
+#define CL_TRACE_H
+
+#include <CL/cl.h>
+#include "trace.h"
+
+// Device side of the trace in trace.h: every traced command becomes a slice
+// from its CL_PROFILING_COMMAND_START to END on a track of its queue, and a
+// second slice on a "waiting" track covers QUEUED to START, so both idle
+// gaps and queue latency show. The SUBMIT time is kept in the slice args.
+//
+// Usage around any enqueue, whether or not the caller wants the event:
+//   cl_event *event = cl_trace_event(caller_event);  // caller_event may be NULL
+//   err = clEnqueueWriteBuffer(..., 0, NULL, event);
+//   cl_trace_command("write A", queue, event, err);
+// With tracing off cl_trace_event() returns its argument and
+// cl_trace_command() does nothing, so the enqueue is unchanged. With tracing
+// on a NULL event is replaced by one the tracer owns.
+//
+// Device timestamps are read when the trace is written, and moved onto the
+// host clock by the offset between the QUEUED time and the host clock at the
+// enqueue of the first command of each queue. The queue must have been
+// created with CL_QUEUE_PROFILING_ENABLE; commands without profiling data
+// are left out.
+
+cl_event *cl_trace_event(cl_event *event);
+
+// Records the command just enqueued on queue with the event from
+// cl_trace_event(); err is the status of the enqueue, nothing is recorded
+// unless it is CL_SUCCESS. The event stays valid for the caller.
+void cl_trace_command(const char *name, cl_command_queue queue, cl_event *event, cl_int err);
+
+#endif
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "mapped_file.h"
+
+static size_t mapped_file_page_size(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? (size_t)size : 4096;
+#endif
+}
+
+#ifdef _WIN32
+
+static int mapped_file_map(mapped_file *file, const char *path) {
+    DWORD protect = file->writable ? PAGE_READWRITE : PAGE_READONLY;
+    DWORD access = file->writable ? FILE_MAP_WRITE : FILE_MAP_READ;
+    file->mapping = CreateFileMappingA(file->file, NULL, protect, (DWORD)((unsigned long long)file->size >> 32),
+                                       (DWORD)(file->size & 0xffffffffu), NULL);
+    if (file->mapping) {
+        file->data = MapViewOfFile(file->mapping, access, 0, 0, file->size);
+    }
+    if (!file->data) {
+        fprintf(stderr, "Failed to map %s: error %lu\n", path, (unsigned long)GetLastError());
+        mapped_file_close(file);
+        return -1;
+    }
+    return 0;
+}
+
+int mapped_file_open(mapped_file *file, const char *path, int writable) {
+    memset(file, 0, sizeof(*file));
+    file->writable = writable;
+    file->file = CreateFileA(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ,
+                             NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+    if (file->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file->file, &size) || size.QuadPart == 0) {
+        fprintf(stderr, "Failed to open %s (missing or empty)\n", path);
+        if (file->file == INVALID_HANDLE_VALUE) file->file = NULL;
+        mapped_file_close(file);
+        return -1;
+    }
+    file->size = (size_t)size.QuadPart;
+    return mapped_file_map(file, path);
+}
+
+int mapped_file_create(mapped_file *file, const char *path, size_t size) {
+    memset(file, 0, sizeof(*file));
+    file->writable = 1;
+    file->size = size;
+    file->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file->file == INVALID_HANDLE_VALUE || size == 0) {
+        fprintf(stderr, "Failed to create %s\n", path);
+        if (file->file == INVALID_HANDLE_VALUE) file->file = NULL;
+        mapped_file_close(file);
+        return -1;
+    }
+    // The mapping extends the file to size
+    return mapped_file_map(file, path);
+}
+
+void mapped_file_close(mapped_file *file) {
+    if (file->data) UnmapViewOfFile(file->data);
+    if (file->mapping) CloseHandle(file->mapping);
+    if (file->file) CloseHandle(file->file);
+    mapped_file_init(file);
+}
+
+void mapped_file_init(mapped_file *file) {
+    memset(file, 0, sizeof(*file));
+}
+
+#else
+
+static int mapped_file_map(mapped_file *file, const char *path) {
+    int protect = file->writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *data = mmap(NULL, file->size, protect, MAP_SHARED, file->fd, 0);
+    if (data == MAP_FAILED) {
+        perror(path);
+        mapped_file_close(file);
+        return -1;
+    }
+    file->data = data;
+    return 0;
+}
+
+int mapped_file_open(mapped_file *file, const char *path, int writable) {
+    memset(file, 0, sizeof(*file));
+    file->writable = writable;
+    file->fd = open(path, writable ? O_RDWR : O_RDONLY);
+    struct stat info;
+    if (file->fd < 0 || fstat(file->fd, &info) != 0) {
+        perror(path);
+        mapped_file_close(file);
+        return -1;
+    }
+    if (info.st_size == 0) {
+        fprintf(stderr, "%s is empty\n", path);
+        mapped_file_close(file);
+        return -1;
+    }
+    file->size = (size_t)info.st_size;
+    return mapped_file_map(file, path);
+}
+
+int mapped_file_create(mapped_file *file, const char *path, size_t size) {
+    memset(file, 0, sizeof(*file));
+    file->writable = 1;
+    file->size = size;
+    file->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file->fd < 0 || size == 0 || ftruncate(file->fd, (off_t)size) != 0) {
+        perror(path);
+        mapped_file_close(file);
+        return -1;
+    }
+    return mapped_file_map(file, path);
+}
+
+void mapped_file_close(mapped_file *file) {
+    if (file->data) munmap(file->data, file->size);
+    if (file->fd >= 0) close(file->fd);
+    mapped_file_init(file);
+}
+
+void mapped_file_init(mapped_file *file) {
+    memset(file, 0, sizeof(*file));
+    file->fd = -1;
+}
+
+#endif
+
+void mapped_file_advise(const mapped_file *file, size_t offset, size_t size, mapped_file_advice advice) {
+    if (!file->data || offset >= file->size) return;
+    if (size > file->size - offset) size = file->size - offset;
+    size_t page = mapped_file_page_size();
+    size_t first, last;
+    if (advice == MAPPED_FILE_WILLNEED) {
+        first = offset / page * page;
+        last = offset + size;
+    } else {
+        first = (offset + page - 1) / page * page;
+        last = (offset + size) / page * page;
+        if (offset + size == file->size) last = offset + size; // the partial last page is ours alone
+    }
+    if (last <= first) return;
+    char *start = (char *)file->data + first;
+#ifdef _WIN32
+    if (advice == MAPPED_FILE_WILLNEED) {
+#if _WIN32_WINNT >= 0x0602
+        WIN32_MEMORY_RANGE_ENTRY range = {start, last - first};
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+    } else {
+        // Unlocking pages that are not locked removes them from the working set
+        VirtualUnlock(start, last - first);
+    }
+#else
+    madvise(start, last - first, advice == MAPPED_FILE_WILLNEED ? MADV_WILLNEED : MADV_DONTNEED);
+#endif
+}
+
+void mapped_file_flush(const mapped_file *file, size_t offset, size_t size, int wait) {
+    if (!file->data || !file->writable || offset >= file->size) return;
+    if (size > file->size - offset) size = file->size - offset;
+    size_t page = mapped_file_page_size();
+    size_t first = offset / page * page;
+    char *start = (char *)file->data + first;
+#ifdef _WIN32
+    FlushViewOfFile(start, offset + size - first);
+    if (wait) FlushFileBuffers(file->file);
+#else
+    msync(start, offset + size - first, wait ? MS_SYNC : MS_ASYNC);
+#endif
+}
+
+void mapped_file_uncache(const mapped_file *file) {
+#ifndef _WIN32
+    if (!file->data) return;
+    if (file->writable) {
+        msync(file->data, file->size, MS_SYNC);
+    }
+    madvise(file->data, file->size, MADV_DONTNEED);
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(file->fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+#else
+    (void)file;
+#endif
+}
@@ -0,0 +1,63 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Files mapped into memory, for data larger than RAM.
+//
+// Pages are read from disk on first touch and the OS may drop clean pages at
+// any time, so the memory a mapping occupies is whatever was touched and not
+// yet dropped. mapped_file_advise() lets the caller steer that: WILLNEED
+// starts reading a range ahead of use, DONTNEED releases a range that will
+// not be needed again. Released pages of a writable mapping are not lost;
+// they are written back to the file.
+//
+// Functions returning int return 0 on success, or print the reason and
+// return -1.
+
+typedef struct {
+    void *data;
+    size_t size;
+    int writable;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} mapped_file;
+
+typedef enum { MAPPED_FILE_WILLNEED, MAPPED_FILE_DONTNEED } mapped_file_advice;
+
+// Maps an existing file, read-only unless writable is set
+int mapped_file_open(mapped_file *file, const char *path, int writable);
+
+// Creates (or truncates) path with size bytes and maps it read-write. The new
+// contents are zero and take no disk space until written.
+int mapped_file_create(mapped_file *file, const char *path, size_t size);
+
+// Unmaps and closes; writes to a writable mapping reach the file eventually.
+// Closing a closed file does nothing.
+void mapped_file_close(mapped_file *file);
+
+// Puts file in the closed state without touching what it held, for files
+// embedded in zeroed structs (a zero descriptor would be stdin)
+void mapped_file_init(mapped_file *file);
+
+// Hint for the bytes [offset, offset + size). WILLNEED covers every page the
+// range touches, DONTNEED only the pages entirely inside it, so neighbouring
+// data is never dropped.
+void mapped_file_advise(const mapped_file *file, size_t offset, size_t size, mapped_file_advice advice);
+
+// Starts writing the modified pages of the range back to disk, and waits for
+// the writes if wait is set
+void mapped_file_flush(const mapped_file *file, size_t offset, size_t size, int wait);
+
+// Writes the file back and evicts it from the OS page cache, so the next
+// reads come from disk (for measuring cold reads). Does nothing on Windows.
+void mapped_file_uncache(const mapped_file *file);
+
+#endif
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matrix_file.h"
+
+typedef char matrix_file_header_is_64_bytes[sizeof(matrix_file_header) == 64 ? 1 : -1];
+
+static const struct {
+    matrix_dtype dtype;
+    const char *name;
+    size_t size;
+} matrix_dtypes[] = {
+    {MATRIX_F32, "f32", 4}, {MATRIX_F64, "f64", 8}, {MATRIX_F16, "f16", 2},
+    {MATRIX_BF16, "bf16", 2}, {MATRIX_I8, "i8", 1}, {MATRIX_I32, "i32", 4},
+};
+
+#define MATRIX_NUM_DTYPES (int)(sizeof(matrix_dtypes) / sizeof(matrix_dtypes[0]))
+
+// The version as it reads when the file was written in the other byte order
+#define MATRIX_FILE_VERSION_SWAPPED ((uint32_t)MATRIX_FILE_VERSION << 24)
+
+size_t matrix_dtype_size(matrix_dtype dtype) {
+    for (int i = 0; i < MATRIX_NUM_DTYPES; i++) {
+        if (matrix_dtypes[i].dtype == dtype) return matrix_dtypes[i].size;
+    }
+    return 0;
+}
+
+const char *matrix_dtype_name(matrix_dtype dtype) {
+    for (int i = 0; i < MATRIX_NUM_DTYPES; i++) {
+        if (matrix_dtypes[i].dtype == dtype) return matrix_dtypes[i].name;
+    }
+    return "unknown";
+}
+
+int matrix_dtype_parse(const char *name, matrix_dtype *dtype) {
+    for (int i = 0; i < MATRIX_NUM_DTYPES; i++) {
+        if (strcmp(matrix_dtypes[i].name, name) == 0) {
+            *dtype = matrix_dtypes[i].dtype;
+            return 0;
+        }
+    }
+    fprintf(stderr, "Unknown element type %s\n", name);
+    return -1;
+}
+
+// Header of a rows x cols matrix with the payload right after it
+static int matrix_file_header_init(matrix_file_header *header, uint64_t rows, uint64_t cols,
+                                   matrix_dtype dtype, matrix_layout layout) {
+    size_t size = matrix_dtype_size(dtype);
+    if (size == 0 || (layout != MATRIX_ROW_MAJOR && layout != MATRIX_COL_MAJOR)) {
+        fprintf(stderr, "Invalid matrix element type or layout\n");
+        return -1;
+    }
+    if (cols != 0 && rows > UINT64_MAX / cols / size) {
+        fprintf(stderr, "Matrix of %llu x %llu elements is too large\n", (unsigned long long)rows,
+                (unsigned long long)cols);
+        return -1;
+    }
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, MATRIX_FILE_MAGIC, sizeof(header->magic));
+    header->version = MATRIX_FILE_VERSION;
+    header->dtype = (uint32_t)dtype;
+    header->layout = (uint32_t)layout;
+    header->alignment = MATRIX_FILE_ALIGN;
+    header->rows = rows;
+    header->cols = cols;
+    header->data_offset = (sizeof(*header) + MATRIX_FILE_ALIGN - 1) / MATRIX_FILE_ALIGN * MATRIX_FILE_ALIGN;
+    header->data_size = rows * cols * size;
+    return 0;
+}
+
+// Empty matrix with a closed file, so matrix_file_close() is always safe
+static void matrix_file_reset(matrix_file *matrix) {
+    memset(matrix, 0, sizeof(*matrix));
+    mapped_file_init(&matrix->file);
+}
+
+int matrix_file_load(matrix_file *matrix, const char *path) {
+    matrix_file_reset(matrix);
+    if (mapped_file_open(&matrix->file, path, 0) != 0) {
+        return -1;
+    }
+    const char *problem = NULL;
+    matrix_file_header *header = &matrix->header;
+    if (matrix->file.size < sizeof(*header)) {
+        problem = "too small for a header";
+    } else {
+        memcpy(header, matrix->file.data, sizeof(*header));
+        size_t size = matrix_dtype_size((matrix_dtype)header->dtype);
+        uint64_t align = header->alignment;
+        if (memcmp(header->magic, MATRIX_FILE_MAGIC, sizeof(header->magic)) != 0) {
+            problem = "not a matrix file";
+        } else if (header->version == MATRIX_FILE_VERSION_SWAPPED) {
+            problem = "written on a host of the other byte order";
+        } else if (header->version != MATRIX_FILE_VERSION) {
+            problem = "unsupported version";
+        } else if (size == 0 || header->layout > MATRIX_COL_MAJOR) {
+            problem = "unknown element type or layout";
+        } else if (align < MATRIX_FILE_ALIGN || (align & (align - 1)) != 0 || header->data_offset % align != 0 ||
+                   header->data_offset < sizeof(*header)) {
+            problem = "misaligned payload";
+        } else if (header->cols != 0 && header->rows > UINT64_MAX / header->cols / size) {
+            problem = "impossible shape";
+        } else if (header->data_size != header->rows * header->cols * size ||
+                   header->data_offset > matrix->file.size ||
+                   header->data_size > matrix->file.size - header->data_offset) {
+            problem = "payload size does not match the shape or the file is truncated";
+        }
+    }
+    if (problem) {
+        fprintf(stderr, "%s: %s\n", path, problem);
+        matrix_file_close(matrix);
+        return -1;
+    }
+    matrix->data = (char *)matrix->file.data + header->data_offset;
+    return 0;
+}
+
+int matrix_file_create(matrix_file *matrix, const char *path, uint64_t rows, uint64_t cols,
+                       matrix_dtype dtype, matrix_layout layout) {
+    matrix_file_reset(matrix);
+    if (matrix_file_header_init(&matrix->header, rows, cols, dtype, layout) != 0 ||
+        mapped_file_create(&matrix->file, path, matrix->header.data_offset + matrix->header.data_size) != 0) {
+        return -1;
+    }
+    memcpy(matrix->file.data, &matrix->header, sizeof(matrix->header));
+    matrix->data = (char *)matrix->file.data + matrix->header.data_offset;
+    return 0;
+}
+
+void matrix_file_close(matrix_file *matrix) {
+    mapped_file_close(&matrix->file);
+    matrix_file_reset(matrix);
+}
+
+int matrix_file_writer_open(matrix_file_writer *writer, const char *path, matrix_dtype dtype,
+                            matrix_layout layout, uint64_t length) {
+    memset(writer, 0, sizeof(*writer));
+    if (matrix_file_header_init(&writer->header, 0, 0, dtype, layout) != 0) {
+        return -1;
+    }
+    writer->length = length;
+    writer->path = path;
+    writer->out = fopen(path, "wb");
+    if (!writer->out) {
+        perror(path);
+        return -1;
+    }
+    setvbuf(writer->out, NULL, _IOFBF, 1 << 20);
+
+    // The header is rewritten with the final shape on close
+    char start[MATRIX_FILE_ALIGN];
+    memset(start, 0, sizeof(start));
+    memcpy(start, &writer->header, sizeof(writer->header));
+    for (uint64_t written = 0; written < writer->header.data_offset; written += sizeof(start)) {
+        if (fwrite(start, sizeof(start), 1, writer->out) != 1) {
+            perror(path);
+            fclose(writer->out);
+            writer->out = NULL;
+            return -1;
+        }
+        memset(start, 0, sizeof(start));
+    }
+    return 0;
+}
+
+int matrix_file_write(matrix_file_writer *writer, const void *data, uint64_t count) {
+    size_t bytes = (size_t)(count * writer->length * matrix_dtype_size((matrix_dtype)writer->header.dtype));
+    if (!writer->out || fwrite(data, 1, bytes, writer->out) != bytes) {
+        perror(writer->path);
+        return -1;
+    }
+    writer->vectors += count;
+    return 0;
+}
+
+int matrix_file_writer_close(matrix_file_writer *writer) {
+    if (!writer->out) {
+        return -1;
+    }
+    matrix_file_header *header = &writer->header;
+    if (header->layout == MATRIX_ROW_MAJOR) {
+        header->rows = writer->vectors;
+        header->cols = writer->length;
+    } else {
+        header->rows = writer->length;
+        header->cols = writer->vectors;
+    }
+    header->data_size = header->rows * header->cols * matrix_dtype_size((matrix_dtype)header->dtype);
+    int failed = fflush(writer->out) != 0 || fseek(writer->out, 0, SEEK_SET) != 0 ||
+                 fwrite(header, sizeof(*header), 1, writer->out) != 1;
+    failed |= fclose(writer->out) != 0;
+    writer->out = NULL;
+    if (failed) {
+        perror(writer->path);
+        return -1;
+    }
+    return 0;
+}
+
+int matrix_file_save(const char *path, matrix_dtype dtype, matrix_layout layout, uint64_t rows, uint64_t cols,
+                     const void *data) {
+    matrix_file_writer writer;
+    uint64_t length = layout == MATRIX_ROW_MAJOR ? cols : rows;
+    uint64_t count = layout == MATRIX_ROW_MAJOR ? rows : cols;
+    if (matrix_file_writer_open(&writer, path, dtype, layout, length) != 0) {
+        return -1;
+    }
+    int err = matrix_file_write(&writer, data, count);
+    err |= matrix_file_writer_close(&writer);
+    return err ? -1 : 0;
+}
+
+float *matrix_file_from_env(const char *name, matrix_file *matrix, int *rows, int *cols) {
+    const char *path = getenv(name);
+    if (!path || !*path) {
+        return NULL;
+    }
+    if (matrix_file_load(matrix, path) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    const matrix_file_header *header = &matrix->header;
+    if (header->dtype != MATRIX_F32 || header->layout != MATRIX_ROW_MAJOR ||
+        header->rows == 0 || header->cols == 0 || header->rows > 0x7fffffff || header->cols > 0x7fffffff) {
+        fprintf(stderr, "%s=%s: expected a non-empty row-major f32 matrix, got %llu x %llu %s %s\n", name, path,
+                (unsigned long long)header->rows, (unsigned long long)header->cols,
+                matrix_dtype_name((matrix_dtype)header->dtype),
+                header->layout == MATRIX_ROW_MAJOR ? "row-major" : "column-major");
+        exit(EXIT_FAILURE);
+    }
+    *rows = (int)header->rows;
+    *cols = (int)header->cols;
+    return (float *)matrix->data;
+}
+
+void matrix_file_save_env(const char *name, int rows, int cols, const float *data) {
+    const char *path = getenv(name);
+    if (!path || !*path) {
+        return;
+    }
+    if (matrix_file_save(path, MATRIX_F32, MATRIX_ROW_MAJOR, (uint64_t)rows, (uint64_t)cols, data) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    printf("Saved %d x %d result to %s\n", rows, cols, path);
+}
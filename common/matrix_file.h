@@ -0,0 +1,119 @@
+#ifndef MATRIX_FILE_H
+#define MATRIX_FILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "mapped_file.h"
+
+// Binary matrix files (.mat): a 64-byte header followed by the elements.
+//
+//   offset  size  field
+//   0       8     magic "CLMATRIX"
+//   8       4     version (1)
+//   12      4     dtype (matrix_dtype)
+//   16      4     layout (matrix_layout)
+//   20      4     alignment of the payload in bytes, a power of two >= 64
+//   24      8     rows
+//   32      8     cols
+//   40      8     data_offset, a multiple of alignment
+//   48      8     data_size, rows * cols * element size
+//   56      8     reserved, zero
+//
+// Fields and elements are in the byte order of the host that wrote the file
+// (little-endian on x86 and ARM), since the payload is used in place. A file
+// from a host of the other byte order is recognized by its version field and
+// rejected. The payload is dense: row-major files store rows of cols elements
+// one after the other, column-major files columns of rows elements.
+//
+// Loading maps the file, so nothing is read or copied until the data is
+// touched, and the data is used in place; the payload alignment keeps it
+// suitable for aligned SIMD loads. The writer streams the payload through a
+// FILE, so files of any size can be written with a buffer of one row.
+//
+// Functions returning int return 0 on success, or print the reason and
+// return -1.
+
+#define MATRIX_FILE_MAGIC "CLMATRIX"
+#define MATRIX_FILE_VERSION 1
+#define MATRIX_FILE_ALIGN 64
+
+typedef enum {
+    MATRIX_F32 = 1,
+    MATRIX_F64 = 2,
+    MATRIX_F16 = 3,
+    MATRIX_BF16 = 4,
+    MATRIX_I8 = 5,
+    MATRIX_I32 = 6
+} matrix_dtype;
+
+typedef enum { MATRIX_ROW_MAJOR = 0, MATRIX_COL_MAJOR = 1 } matrix_layout;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t dtype;
+    uint32_t layout;
+    uint32_t alignment;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint8_t reserved[8];
+} matrix_file_header;
+
+typedef struct {
+    matrix_file_header header;
+    mapped_file file;
+    void *data;             // the payload, inside the mapping
+} matrix_file;
+
+typedef struct {
+    FILE *out;
+    matrix_file_header header;
+    uint64_t vectors;       // rows (row-major) or columns (column-major) written
+    uint64_t length;        // elements per row or column
+    const char *path;
+} matrix_file_writer;
+
+// Element size in bytes, 0 for an unknown dtype
+size_t matrix_dtype_size(matrix_dtype dtype);
+const char *matrix_dtype_name(matrix_dtype dtype);
+int matrix_dtype_parse(const char *name, matrix_dtype *dtype);
+
+// Maps a .mat file read-only after validating its header
+int matrix_file_load(matrix_file *matrix, const char *path);
+
+// Creates a .mat file of rows x cols zero elements and maps it read-write,
+// for results written in place
+int matrix_file_create(matrix_file *matrix, const char *path, uint64_t rows, uint64_t cols,
+                       matrix_dtype dtype, matrix_layout layout);
+
+void matrix_file_close(matrix_file *matrix);
+
+// Streaming writer. length is the number of elements in a row (row-major) or
+// a column (column-major); the number of rows or columns is whatever was
+// written when the writer is closed.
+int matrix_file_writer_open(matrix_file_writer *writer, const char *path, matrix_dtype dtype,
+                            matrix_layout layout, uint64_t length);
+
+// Appends count rows (or columns) of length elements each, stored contiguously
+int matrix_file_write(matrix_file_writer *writer, const void *data, uint64_t count);
+
+// Records the final shape in the header and closes the file
+int matrix_file_writer_close(matrix_file_writer *writer);
+
+// Writes a dense rows x cols matrix in one go
+int matrix_file_save(const char *path, matrix_dtype dtype, matrix_layout layout, uint64_t rows, uint64_t cols,
+                     const void *data);
+
+// For the matrix programs: when environment variable name (MATRIX_A, ...)
+// is set, maps that file, which must hold float32 in row-major order, and
+// returns its data with the shape in *rows and *cols. Returns NULL when the
+// variable is not set; exits if the file cannot be used.
+float *matrix_file_from_env(const char *name, matrix_file *matrix, int *rows, int *cols);
+
+// For the matrix programs: saves a dense row-major float32 result to the file
+// named by environment variable name, if it is set
+void matrix_file_save_env(const char *name, int rows, int cols, const float *data);
+
+#endif
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "trace.h"
+
+#define TRACE_MAX_DEPTH 64
+
+typedef struct {
+    char *name;
+    const char *category;
+    char phase;          // 'X' complete slice, 'M' track name
+    int pid, tid;
+    double ts, dur;      // microseconds
+    char *args;
+} trace_record;
+
+static int trace_state = -1;  // -1 unknown, 0 off, 1 recording, 2 written
+static const char *trace_path = NULL;
+static trace_record *trace_records = NULL;
+static int trace_count = 0, trace_capacity = 0;
+static double trace_origin = -1.0;
+static double trace_stack[TRACE_MAX_DEPTH];
+static const char *trace_stack_names[TRACE_MAX_DEPTH];
+static int trace_depth = 0;
+static void (*trace_hook)(void) = NULL;
+
+static double trace_clock_us(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1.0e6 / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1.0e6 + now.tv_nsec * 1.0e-3;
+#endif
+}
+
+static void trace_at_exit(void) {
+    trace_write();
+}
+
+int trace_enabled(void) {
+    if (trace_state < 0) {
+        trace_path = getenv("CL_TRACE");
+        trace_state = trace_path && *trace_path ? 1 : 0;
+        if (trace_state) {
+            trace_now_us();
+            trace_name_track(TRACE_PID_HOST, 0, "host");
+            atexit(trace_at_exit);
+        }
+    }
+    return trace_state == 1;
+}
+
+double trace_now_us(void) {
+    double now = trace_clock_us();
+    if (trace_origin < 0.0) {
+        trace_origin = now;
+    }
+    return now - trace_origin;
+}
+
+static char *trace_strdup(const char *text) {
+    if (!text) {
+        return NULL;
+    }
+    size_t size = strlen(text) + 1;
+    char *copy = (char *)malloc(size);
+    memcpy(copy, text, size);
+    return copy;
+}
+
+static void trace_add(char phase, const char *name, const char *category, int pid, int tid, double ts,
+                      double dur, const char *args) {
+    if (trace_count == trace_capacity) {
+        int capacity = trace_capacity ? 2 * trace_capacity : 1024;
+        trace_record *records = (trace_record *)realloc(trace_records, (size_t)capacity * sizeof(trace_record));
+        if (!records) {
+            return;
+        }
+        trace_records = records;
+        trace_capacity = capacity;
+    }
+    trace_record *record = &trace_records[trace_count++];
+    record->name = trace_strdup(name);
+    record->category = category;
+    record->phase = phase;
+    record->pid = pid;
+    record->tid = tid;
+    record->ts = ts;
+    record->dur = dur;
+    record->args = trace_strdup(args);
+}
+
+void trace_begin(const char *name) {
+    if (!trace_enabled() || trace_depth == TRACE_MAX_DEPTH) {
+        return;
+    }
+    trace_stack_names[trace_depth] = name;
+    trace_stack[trace_depth++] = trace_now_us();
+}
+
+void trace_end(void) {
+    if (!trace_enabled() || trace_depth == 0) {
+        return;
+    }
+    trace_depth--;
+    double start = trace_stack[trace_depth];
+    trace_add('X', trace_stack_names[trace_depth], "host", TRACE_PID_HOST, 0, start, trace_now_us() - start, NULL);
+}
+
+void trace_complete(const char *name, const char *category, int pid, int tid, double ts_us, double dur_us,
+                    const char *args) {
+    if (trace_enabled()) {
+        trace_add('X', name, category, pid, tid, ts_us, dur_us, args);
+    }
+}
+
+void trace_name_track(int pid, int tid, const char *name) {
+    if (trace_enabled()) {
+        trace_add('M', name, "", pid, tid, 0.0, 0.0, NULL);
+    }
+}
+
+void trace_on_write(void (*fn)(void)) {
+    trace_hook = fn;
+}
+
+static void trace_write_string(FILE *out, const char *text) {
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(out, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+int trace_write(void) {
+    if (!trace_enabled()) {
+        return 0;
+    }
+    // Scopes still open (an exit() from inside a stage) end now
+    while (trace_depth > 0) {
+        trace_end();
+    }
+    if (trace_hook) {
+        trace_hook();
+    }
+    trace_state = 2;
+
+    FILE *out = fopen(trace_path, "w");
+    if (!out) {
+        perror(trace_path);
+        return -1;
+    }
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (int i = 0; i < trace_count; i++) {
+        const trace_record *record = &trace_records[i];
+        if (record->phase == 'M') {
+            fprintf(out, "  {\"ph\": \"M\", \"name\": \"%s\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": ",
+                    record->tid ? "thread_name" : "process_name", record->pid, record->tid);
+            trace_write_string(out, record->name);
+            fprintf(out, "}}");
+        } else {
+            fprintf(out, "  {\"ph\": \"X\", \"name\": ");
+            trace_write_string(out, record->name);
+            fprintf(out, ", \"cat\": \"%s\", \"pid\": %d, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+                    record->category, record->pid, record->tid, record->ts, record->dur);
+            if (record->args) {
+                fprintf(out, ", \"args\": {%s}", record->args);
+            }
+            fprintf(out, "}");
+        }
+        fprintf(out, i + 1 < trace_count ? ",\n" : "\n");
+        free(record->name);
+        free(record->args);
+    }
+    fprintf(out, "]}\n");
+    int failed = fclose(out) != 0;
+    free(trace_records);
+    trace_records = NULL;
+    trace_count = trace_capacity = 0;
+    if (failed) {
+        perror(trace_path);
+        return -1;
+    }
+    fprintf(stderr, "Trace written to %s\n", trace_path);
+    return 0;
+}
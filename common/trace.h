@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Timeline recorder exporting the Chrome trace event format, which
+// chrome://tracing and ui.perfetto.dev open directly.
+//
+// Host code marks stages with trace_begin()/trace_end(); the OpenCL side
+// (cl_trace.h) adds one slice per device command. Everything is kept in
+// memory and written once, at exit or on trace_write(), so recording costs
+// little more than reading the clock. Host scopes are meant for the main
+// thread; they nest, and show as one track.
+//
+// Environment:
+//   CL_TRACE=file.json   record and write the trace to file.json; when unset
+//                        every call returns at once
+
+#define TRACE_PID_HOST 1
+#define TRACE_PID_DEVICE 2
+
+int trace_enabled(void);
+
+// Microseconds on the trace clock (monotonic, 0 at the first call)
+double trace_now_us(void);
+
+// A host scope; name must stay valid until the matching trace_end()
+void trace_begin(const char *name);
+void trace_end(void);
+
+// One complete slice; args is a JSON object body ("\"k\": 1") or NULL
+void trace_complete(const char *name, const char *category, int pid, int tid, double ts_us, double dur_us,
+                    const char *args);
+
+// Display name of a track
+void trace_name_track(int pid, int tid, const char *name);
+
+// Called once before the trace is written, to add slices that are only
+// known late (device timestamps of finished commands)
+void trace_on_write(void (*fn)(void));
+
+// Writes the file named by CL_TRACE; later calls do nothing. Returns 0, or
+// -1 if the file cannot be written.
+int trace_write(void);
+
+#endif